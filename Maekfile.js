@@ -116,8 +116,12 @@ const pathtracer_objects = [
 	maek.CPP("src/pathtracer/pathtracer.cpp"),
 	maek.CPP("src/pathtracer/tri_mesh.cpp"),
 	maek.CPP("src/pathtracer/bvh.cpp"),
+	maek.CPP("src/pathtracer/bvh_cache.cpp"),
+	maek.CPP("src/pathtracer/light_tree.cpp"),
 	maek.CPP("src/pathtracer/samplers.cpp"),
 	maek.CPP("src/pathtracer/aperture_shape.cpp"),
+	maek.CPP("src/pathtracer/checkpoint.cpp"),
+	maek.CPP("src/pathtracer/ray_log.cpp"),
 ];
 const util_objects = [
 	maek.CPP("src/util/hdr_image.cpp"),
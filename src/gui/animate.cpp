@@ -683,7 +683,7 @@ void Animate::update(Scene& scene, Animator& animator) {
 		} else {
 			Scene::StepOpts opts;
 			opts.use_bvh = manager.get_simulate().use_bvh;
-			//opts.thread_pool = /* TODO */;
+			opts.thread_pool = &manager.get_simulate().get_thread_pool();
 			if (current_frame == 0) opts.reset = true;
 			scene.step(animator, float(current_frame), float(current_frame + 1), 1.0f / animator.frame_rate, opts);
 			updated = true;
@@ -60,7 +60,7 @@ void Render::ui_sidebar(Manager& manager, Undo& undo, Scene& scene, View_3D& use
 	}
 }
 
-std::pair<float, float> Render::completion_time() {
+PT::Pathtracer::Completion_Time Render::completion_time() {
 	return ui_render.tracer().completion_time();
 }
 
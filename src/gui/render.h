@@ -20,7 +20,7 @@ class Render {
 public:
 	Render() = default;
 
-	std::pair<float, float> completion_time();
+	PT::Pathtracer::Completion_Time completion_time();
 	
     void ui_sidebar(Manager& manager, Undo& undo, Scene& scene, View_3D& user_cam);
     void render(View_3D& user_cam);
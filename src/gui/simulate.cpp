@@ -27,6 +27,10 @@ void Simulate::step(Scene& scene, float dt) {
     }
 }
 
+Thread_Pool& Simulate::get_thread_pool() {
+	return thread_pool;
+}
+
 void Simulate::pause() {
 	sim_timer.pause();
 }
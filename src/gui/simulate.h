@@ -32,6 +32,7 @@ public:
 	void ui_sidebar(Manager& manager, Scene& scene, Undo& undo, Widgets& widgets);
 
 	bool use_bvh = true; //public because Gui::Animate reads it when advancing time
+	Thread_Pool& get_thread_pool(); //Gui::Animate also builds collision meshes here
 
 private:
 	Scene::Collision collision;
@@ -1359,6 +1359,8 @@ void Widget_Render::begin_window(Scene& scene, Undo& undo, Manager& manager, Vie
 
 	if (method == Method::path_trace) {
 		Checkbox("Use BVH", &use_bvh);
+		if (use_bvh) Checkbox("4-Wide BVH", &wide_bvh);
+		SliderFloat("Adaptive Error", &adaptive_error, 0.0f, 0.1f, "%.3f");
 	}
 }
 
@@ -1419,6 +1421,7 @@ void Widget_Render::ui_animate(Scene& scene, Manager& manager, Undo& undo, View_
 
 			if(!render_cam.expired()) {
 				if (method == Method::path_trace) {
+					pathtracer.set_adaptive_error(adaptive_error);
 					pathtracer.render(scene, render_cam.lock(), std::move(report_callback), &quit);
 				} else if(method == Method::software_raster) {
 					rasterizer.reset(new Rasterizer(scene, *render_cam.lock(), std::move(report_callback)));
@@ -1478,6 +1481,8 @@ bool Widget_Render::ui_render(Scene& scene, Manager& manager, Undo& undo, View_3
 				has_rendered = true;
 				rebuild_ray_log = true;
 				pathtracer.use_bvh(use_bvh);
+				pathtracer.use_wide_bvh(wide_bvh);
+				pathtracer.set_adaptive_error(adaptive_error);
 				pathtracer.render(scene, render_cam.lock(), [this, report_callback](PT::Pathtracer::Render_Report &&report){
 					report_callback(std::move(report));
 					rebuild_ray_log = true;
@@ -1575,8 +1580,18 @@ void Widget_Render::display_output() {
 			Image(to_id(display.get_id()), {w, h}, {0.0f, 1.0f}, {1.0f, 0.0f});
 
 			if (!pathtracer.in_progress() && has_rendered) {
-				auto [build, render] = pathtracer.completion_time();
-				Text("Scene built in %.2fs, rendered in %.2fs.", build, render);
+				auto time = pathtracer.completion_time();
+				Text("Scene built in %.2fs, rendered in %.2fs.", time.build, time.render);
+				Text("(meshes + BVHs %.2fs, instance BVH %.2fs%s)", time.meshes, time.scene_bvh,
+				     time.scene_bvh_reused ? " reused" : "");
+				Text("(reused/rebuilt: %u/%u meshes, %u/%u textures, %u/%u materials)", time.meshes_reused,
+				     time.meshes_rebuilt, time.textures_reused, time.textures_rebuilt, time.materials_reused,
+				     time.materials_rebuilt);
+				auto samples = pathtracer.sample_counts();
+				if (samples.traced < samples.budget) {
+					Text("(adaptive sampling traced %.1f%% of samples)",
+					     100.0 * double(samples.traced) / double(samples.budget));
+				}
 			}
 		} else if (method == Method::software_raster) {
 			Image(to_id(display.get_id()), {w, h}, {0.0f, 1.0f}, {1.0f, 0.0f});
@@ -1683,6 +1698,8 @@ std::string Widget_Render::step_animation(Scene& scene, Animator& animator, Mana
 
 				render_progress = 0.0f;
 				pathtracer.use_bvh(use_bvh);
+				pathtracer.use_wide_bvh(wide_bvh);
+				pathtracer.set_adaptive_error(adaptive_error);
 				pathtracer.render(scene, render_cam.lock(), std::move(report_callback), &quit);
 				next_frame++;
 			}
@@ -242,6 +242,8 @@ private:
 
 	float exposure = 1.0f;
 	bool use_bvh = true;
+	bool wide_bvh = false;
+	float adaptive_error = 0.0f; //(0 == take every film sample)
 	bool has_rendered = false, rebuild_ray_log = false;
 	bool render_window = false, render_window_focus = false;
 	bool quit = false;
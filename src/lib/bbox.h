@@ -86,7 +86,21 @@ struct BBox {
 		// [times.x,times.y], update times with the new intersection times.
 		// This means at least one of tmin and tmax must be within the range
 
-		return false;
+		// Slab test. Flat boxes work as-is (the slab is just zero-width); a ray
+		// parallel to an axis gets infinite slab times, or NaN when it starts
+		// exactly on the slab's plane -- the comparisons below ignore NaN.
+		float tmin = times.x, tmax = times.y;
+		for (uint32_t a = 0; a < 3; a++) {
+			float inv = 1.0f / ray.dir[a];
+			float t0 = (min[a] - ray.point[a]) * inv;
+			float t1 = (max[a] - ray.point[a]) * inv;
+			if (inv < 0.0f) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+			if (tmin > tmax) return false;
+		}
+		times = Vec2(tmin, tmax);
+		return true;
 	}
 
 	/// Get the eight corner points of the bounding box
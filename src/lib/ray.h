@@ -29,12 +29,14 @@ struct Ray {
 	}
 
 	/// Move ray into the space defined by this tranform matrix
-	void transform(const Mat4& trans) {
+	/// (returns the factor distances along the ray were scaled by)
+	float transform(const Mat4& trans) {
 		point = trans * point;
 		dir = trans.rotate(dir);
 		float d = dir.norm();
 		dist_bounds *= d;
 		dir /= d;
+		return d;
 	}
 
 	/// The origin or starting point of this ray
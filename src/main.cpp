@@ -6,6 +6,7 @@
 #include "util/rand.h"
 #include "lib/log.h"
 
+#include "pathtracer/bvh_cache.h"
 #include "pathtracer/pathtracer.h"
 #include "rasterizer/rasterizer.h"
 #include "rasterizer/sample_pattern.h"
@@ -13,7 +14,125 @@
 
 #include "test.h"
 
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+//write image (with exposure) to a png file; returns false on failure:
+static bool write_png(HDR_Image const &image, float exposure, std::string const &filename) {
+	std::vector<uint8_t> data;
+	image.tonemap_to(data, exposure);
+
+	stbi_flip_vertically_on_write(true);
+	return stbi_write_png(filename.c_str(), image.w, image.h, 4, data.data(), image.w * 4) != 0;
+}
+
+//write render statistics (and the memory each mesh takes) as a json report; returns false on failure:
+static bool write_stats(PT::Pathtracer::Stats const &stats, std::vector< std::pair< std::string, PT::Tri_Mesh::Memory > > const &meshes,
+                        std::string const &filename) {
+	std::ofstream out(filename);
+	if (!out) return false;
+
+	PT::Render_Stats const &counts = stats.counts;
+	auto per = [](double a, double b) { return b > 0.0 ? a / b : 0.0; };
+	out << "{\n";
+	out << "\t\"recorded\": " << (PT::RECORD_STATS ? "true" : "false") << ",\n";
+	out << "\t\"render_seconds\": " << stats.render << ",\n";
+	out << "\t\"rays\": {\"camera\": " << counts.camera_rays << ", \"shadow\": " << counts.shadow_rays
+	    << ", \"bounce\": " << counts.bounce_rays << ", \"total\": " << counts.rays() << "},\n";
+	out << "\t\"rays_per_second\": " << per(double(counts.rays()), stats.render) << ",\n";
+	out << "\t\"bvh\": {\"nodes_visited\": " << counts.nodes_visited << ", \"primitives_tested\": " << counts.primitives_tested
+	    << ", \"nodes_per_ray\": " << per(double(counts.nodes_visited), double(counts.rays()))
+	    << ", \"primitives_per_ray\": " << per(double(counts.primitives_tested), double(counts.rays())) << "},\n";
+	out << "\t\"tiles\": {\"count\": " << stats.tiles << ", \"seconds\": " << stats.tile_seconds
+	    << ", \"mean_seconds\": " << per(stats.tile_seconds, stats.tiles) << ", \"slowest_seconds\": " << stats.slowest_tile << "},\n";
+	out << "\t\"meshes\": [";
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		auto const &[name, memory] = meshes[i];
+		std::string escaped;
+		for (char c : name) {
+			if (c == '"' || c == '\\') escaped += '\\';
+			escaped += c;
+		}
+		out << (i ? ",\n\t\t" : "\n\t\t") << "{\"name\": \"" << escaped << "\", \"triangles\": " << memory.n_triangles
+		    << ", \"vertices\": " << memory.n_vertices << ", \"vertex_bytes\": " << memory.vertices
+		    << ", \"triangle_bytes\": " << memory.triangles << ", \"bvh_bytes\": " << memory.bvh << "}";
+	}
+	out << (meshes.empty() ? "]\n" : "\n\t]\n");
+	out << "}\n";
+	return bool(out);
+}
+
+//write per-pixel render cost as a png, from black (cheapest) through red and yellow to white (costliest); returns false on failure:
+static bool write_cost_heatmap(PT::Pathtracer::Stats const &stats, uint32_t w, uint32_t h, std::string const &filename) {
+	std::vector< uint64_t > cost = stats.pixel_cost;
+	cost.resize(size_t(w) * h, 0);
+	uint64_t most = 1;
+	for (uint64_t c : cost) most = std::max(most, c);
+
+	std::vector< uint8_t > data(size_t(w) * h * 4);
+	for (size_t i = 0; i < cost.size(); ++i) {
+		float t = float(double(cost[i]) / double(most));
+		for (uint32_t c = 0; c < 3; ++c) {
+			data[4 * i + c] = static_cast< uint8_t >(std::round(255.0f * std::clamp(3.0f * t - c, 0.0f, 1.0f)));
+		}
+		data[4 * i + 3] = 255;
+	}
+
+	stbi_flip_vertically_on_write(true);
+	return stbi_write_png(filename.c_str(), w, h, 4, data.data(), w * 4) != 0;
+}
+
+//merge partial renders (from --distribute workers) into a png file; returns false on failure:
+static bool merge_partials(std::vector< std::string > const &files, float exposure, std::string const &output) {
+	HDR_Image image;
+	uint32_t tiles = 0, missing = 0;
+	try {
+		std::vector< PT::Checkpoint > partials;
+		for (auto const &file : files) {
+			partials.emplace_back(PT::Checkpoint::load(file));
+		}
+		image = PT::Pathtracer::merge(partials);
+		if (!partials.empty()) {
+			tiles = uint32_t(partials[0].tiles_done.size());
+			for (uint32_t t = 0; t < tiles; ++t) {
+				bool found = false;
+				for (auto const &partial : partials) found = found || partial.tiles_done[t];
+				missing += !found;
+			}
+		}
+	} catch (std::exception const &e) {
+		warn("ERROR: Failed to merge partial renders: %s", e.what());
+		return false;
+	}
+	if (missing) warn("WARNING: %u of %u tiles are missing from the partial renders.", missing, tiles);
+
+	if (!write_png(image, exposure, output)) {
+		warn("ERROR: Failed to write output to '%s'", output.c_str());
+		return false;
+	}
+	std::cout << "Wrote result to '" << output << "'." << std::endl;
+	return true;
+}
+
+//quote an argument for the shell popen() runs commands with:
+static std::string shell_quote(std::string const &arg) {
+#ifdef _WIN32
+	return "\"" + arg + "\"";
+#else
+	std::string ret = "'";
+	for (char c : arg) {
+		if (c == '\'') ret += "'\\''";
+		else ret += c;
+	}
+	return ret + "'";
+#endif
+}
 
 int main(int argc, char** argv) {
 
@@ -24,6 +143,7 @@ int main(int argc, char** argv) {
 
 	//settings used in this file for headless operation:
 	std::string tests_prefix = "";
+	std::string benchmarks_prefix = "";
 
 	bool pathtrace = false;
 	bool rasterize = false;
@@ -37,6 +157,22 @@ int main(int argc, char** argv) {
 
 	float exp = 1.0f;
 	bool no_bvh = false;
+	bool compact_meshes = false; //pathtracer keeps quantized mesh vertex attributes (see PT::Tri_Mesh::Vertex_Format)
+	uint32_t bvh_width = 2; //2 == binary traversal, 4 == collapsed 4-wide (SIMD) traversal
+	std::string bvh_cache_dir = ""; //keep built mesh BVHs in this directory (if not "")
+	uint64_t bvh_cache_mb = PT::BVH_Cache::Default_Max_Bytes >> 20; //evict least recently used BVHs past this size
+	float progress_images = 0.0f; //partial images per second from the pathtracer (if headless)
+	float adaptive_error = 0.0f; //relative error at which the pathtracer stops sampling a pixel (0 == off)
+	std::string sequence = "sobol"; //where the pathtracer draws its samples (see RNG::Sequence)
+	std::string integrator = "recursive"; //how the pathtracer traces tiles (see PT::Pathtracer::Integrator)
+	std::string checkpoint_file = ""; //where the pathtracer saves its progress (if not "")
+	float checkpoint_interval = 300.0f; //seconds between pathtracer checkpoints
+	bool resume = false; //resume the render in checkpoint_file
+	uint32_t distribute = 0; //split the path traced frame between this many worker processes (0 == don't)
+	std::string worker_partial = ""; //(as a worker) trace the tiles listed on stdin, and save their sums here
+	std::vector< std::string > merge_files; //partial renders to merge into the output image
+	std::string stats_file = ""; //write pathtracer statistics (rays, BVH traversal, tile times) here as json (if not "")
+	std::string cost_heatmap_file = ""; //write the pathtracer's per-pixel cost here as a png (if not "")
 
 	uint32_t film_width = -1U; //override film width (if not -1U)
 	uint32_t film_height = -1U; //override film height (if not -1U)
@@ -52,6 +188,9 @@ int main(int argc, char** argv) {
 	auto tests_option = args.add_option("--run-tests", tests_prefix, "Run all tests starting with prefix", true);
 	tests_option->expected(0, 1);
 
+	auto benchmarks_option = args.add_option("--run-benchmarks", benchmarks_prefix, "Run all benchmarks (tests named 'bench.*') starting with prefix", true);
+	benchmarks_option->expected(0, 1);
+
 	args.add_option("-s,--scene", set.scene_file, "Scene file to load");
 	args.add_option("--write", write_file, "Re-save file and exit");
 	args.add_flag("--trace", pathtrace, "Path trace scene without opening the GUI");
@@ -62,8 +201,24 @@ int main(int argc, char** argv) {
 	args.add_option("--min-frame", min_frame, "First animation frame");
 	args.add_option("--max-frame", max_frame, "Last animation frame (-1 is last keyframe)");
 	args.add_flag("--no_bvh", no_bvh, "Don't use BVH (if headless)");
+	args.add_flag("--compact-meshes", compact_meshes, "Store mesh normals and uvs quantized (8 bytes per distinct vertex instead of 32 per corner) to save memory (for pathtracer)");
+	args.add_option("--bvh-width", bvh_width, "Pathtracer BVH traversal width: 2 (binary nodes; the default) or 4 (also builds collapsed 4-wide nodes)")->check(CLI::IsMember({2u, 4u}));
+	args.add_option("--bvh-cache", bvh_cache_dir, "Keep built mesh BVHs in this directory, and reuse them for meshes that haven't changed");
+	args.add_option("--bvh-cache-size", bvh_cache_mb, "Megabytes the --bvh-cache directory may hold before the least recently used BVHs are evicted");
 	args.add_option("--exposure", exp, "Output exposure (if headless)");
-	args.add_option("--seed", RNG::fixed_seed, "Use fixed seed for RNG when rendering; (0 disables).");
+	args.add_option("--progress-images", progress_images, "Partial images per second to produce while path tracing; 0 only produces the final image (if headless)");
+	args.add_option("--adaptive-error", adaptive_error, "Stop sampling pixels once their relative error is below this; 0 always takes all film samples (for pathtracer)");
+	args.add_option("--sampler", sequence, "Pathtracer sample sequence: 'sobol' (Owen-scrambled Sobol; the default), 'independent' (hashed), or 'stream' (Mersenne Twister, as before the counter-based sequences; tiles are never split)")->check(CLI::IsMember({"stream", "sobol", "independent"}));
+	args.add_option("--integrator", integrator, "Pathtracer integrator: 'recursive' (depth-first, per sample) or 'batched-camera' (camera rays intersected in batches and shaded grouped by material; bounces are still depth-first)")->check(CLI::IsMember({"recursive", "batched-camera"}));
+	args.add_option("--checkpoint", checkpoint_file, "Periodically save path tracing progress to this file, so the render can be resumed if interrupted (for pathtracer)");
+	args.add_option("--checkpoint-interval", checkpoint_interval, "Seconds between checkpoints (for pathtracer)");
+	args.add_flag("--resume", resume, "Resume the render saved in the --checkpoint file, tracing only what it is missing (for pathtracer)");
+	args.add_option("--distribute", distribute, "Path trace with this many worker processes (each tracing some of the tiles), then merge their partial renders");
+	args.add_option("--worker-partial", worker_partial, "Path trace only the tiles listed on stdin (up to 'end'), and save their partial render to this file (used by --distribute)");
+	args.add_option("--merge", merge_files, "Merge these partial renders into the output image");
+	args.add_option("--stats", stats_file, "Write path tracing statistics (rays per second, BVH nodes and primitives per ray, time per tile) to this json file (needs PT::RECORD_STATS)");
+	args.add_option("--cost-heatmap", cost_heatmap_file, "Write a heatmap of path tracing cost (BVH nodes and primitives tested) per pixel to this png file (needs PT::RECORD_STATS)");
+	auto seed_option = args.add_option("--seed", RNG::fixed_seed, "Use fixed seed for RNG when rendering; (0 disables).");
 	args.add_option("--film-width",          film_width, "Override camera film width (pixels)");
 	args.add_option("--film-height",         film_height, "Override camera film height (pixels)");
 	args.add_option("--film-samples",        film_samples, "Override film samples-per-pixel (for pathtracer)");
@@ -73,6 +228,13 @@ int main(int argc, char** argv) {
 
 	CLI11_PARSE(args, argc, argv);
 
+	//(the cache is used wherever meshes get BVHs: path tracing, and simulation collisions, in the GUI or headless)
+	std::unique_ptr< PT::BVH_Cache > bvh_cache;
+	if (bvh_cache_dir != "") {
+		bvh_cache = std::make_unique< PT::BVH_Cache >(bvh_cache_dir, bvh_cache_mb << 20);
+		PT::BVH_Cache::shared = bvh_cache.get();
+	}
+
 	// if tests are to be run, run them and return error if (some) tests fail:
 	if (tests_option->count() > 0) {
 		if (Test::run_tests(tests_prefix)) {
@@ -82,6 +244,16 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	// if benchmarks are to be run, run them (they are just tests that only run when asked):
+	if (benchmarks_option->count() > 0) {
+		Test::run_benchmarks = true;
+		if (Test::run_tests("bench." + benchmarks_prefix)) {
+			return 0;
+		} else {
+			return 1;
+		}
+	}
+
 	if (animate && !(pathtrace || rasterize)) {
 		warn("ERROR: must specify --trace or --rasterize when doing --animate.");
 		return 1;
@@ -92,6 +264,34 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
+	if (checkpoint_file != "" && (!pathtrace || animate)) {
+		warn("ERROR: --checkpoint only works with --trace, for a single frame.");
+		return 1;
+	}
+
+	if (resume && checkpoint_file == "") {
+		warn("ERROR: must specify the --checkpoint file to --resume from.");
+		return 1;
+	}
+
+	if ((distribute > 0 || worker_partial != "") && (!pathtrace || animate || adaptive_error > 0.0f || checkpoint_file != "")) {
+		warn("ERROR: --distribute only works with --trace, for a single frame, without --adaptive-error or --checkpoint.");
+		return 1;
+	}
+
+	if ((stats_file != "" || cost_heatmap_file != "") && (!pathtrace || distribute > 0 || worker_partial != "")) {
+		warn("ERROR: --stats and --cost-heatmap only work with --trace, without --distribute.");
+		return 1;
+	}
+	if ((stats_file != "" || cost_heatmap_file != "") && !PT::RECORD_STATS) {
+		warn("WARNING: render statistics are compiled out (set PT::RECORD_STATS in pathtracer/stats.h), so --stats and --cost-heatmap will be empty.");
+	}
+
+	//if merging partial renders was requested, do that and return:
+	if (!merge_files.empty()) {
+		return merge_partials(merge_files, exp, output_file) ? 0 : 1;
+	}
+
 
 	//if headless render requested, do that and return:
 	if (pathtrace || rasterize || write_file != "") {
@@ -187,6 +387,44 @@ int main(int argc, char** argv) {
 			RNG::fixed_seed = (std::random_device())();
 		}
 
+		//----------------------------
+		//renderer setup
+
+		//one pathtracer (and its thread pool) renders every frame, so scene data that doesn't change
+		// between frames is only converted once (see Pathtracer::build_scene):
+		std::unique_ptr< PT::Pathtracer > pathtracer;
+		//the scene is stepped on the pathtracer's pool (or a pool of its own, when rasterizing):
+		std::unique_ptr< Thread_Pool > step_pool_storage;
+		Thread_Pool *step_pool = nullptr;
+		if (pathtrace) {
+			pathtracer = std::make_unique< PT::Pathtracer >();
+			pathtracer->use_bvh(!no_bvh);
+			pathtracer->use_wide_bvh(bvh_width == 4);
+			pathtracer->set_mesh_format(compact_meshes ? PT::Tri_Mesh::Vertex_Format::Compact : PT::Tri_Mesh::Vertex_Format::Full);
+			pathtracer->set_report_rate(progress_images);
+			pathtracer->set_adaptive_error(adaptive_error);
+			if (sequence == "stream") pathtracer->set_sequence(RNG::Sequence::Stream);
+			else if (sequence == "independent") pathtracer->set_sequence(RNG::Sequence::Independent);
+			else pathtracer->set_sequence(RNG::Sequence::Sobol);
+			if (integrator == "batched-camera") pathtracer->set_integrator(PT::Pathtracer::Integrator::Batched_Camera);
+			else pathtracer->set_integrator(PT::Pathtracer::Integrator::Recursive);
+			pathtracer->set_checkpoint(checkpoint_file, checkpoint_interval);
+			if (resume) pathtracer->resume_from(checkpoint_file);
+			if (worker_partial != "") {
+				//the tiles to trace, as handed out by the --distribute coordinator:
+				std::vector< uint32_t > tiles;
+				std::string token;
+				while (std::cin >> token && token != "end") {
+					tiles.emplace_back(uint32_t(std::stoul(token)));
+				}
+				pathtracer->set_tiles(tiles);
+			}
+			step_pool = &pathtracer->get_thread_pool();
+		} else if (animate) {
+			step_pool_storage = std::make_unique< Thread_Pool >(std::thread::hardware_concurrency());
+			step_pool = step_pool_storage.get();
+		}
+
 		//----------------------------
 		//animation setup
 
@@ -207,7 +445,7 @@ int main(int argc, char** argv) {
 					Scene::StepOpts opts;
 					opts.reset = (frame == 0);
 					opts.use_bvh = !no_bvh;
-					opts.thread_pool = nullptr; //TODO
+					opts.thread_pool = step_pool;
 					scene.step(animator, float(frame), float(frame + 1), 1.0f / animator.frame_rate, opts);
 				}
 			} else {
@@ -234,8 +472,14 @@ int main(int argc, char** argv) {
 		if (pathtrace) {
 			info("\tsamples: %d", camera->film.samples);
 			info("\tmax depth: %d", camera->film.max_ray_depth);
+			info("\tsampler: %s", sequence.c_str());
+			info("\tintegrator: %s", integrator.c_str());
+			if (adaptive_error > 0.0f) info("\tadaptive sampling to relative error: %f", adaptive_error);
+			if (checkpoint_file != "") info("\t%s checkpoint '%s' (every %.0fs)", resume ? "resuming from" : "saving", checkpoint_file.c_str(), checkpoint_interval);
 			info("\trender threads: %u", std::thread::hardware_concurrency());
 			if (no_bvh) info("\tusing object list instead of BVH");
+			else if (bvh_width == 4) info("\tusing 4-wide BVH traversal");
+			if (compact_meshes) info("\tusing compact mesh vertices");
 			info("\tpathtracing...");
 		} else { assert(rasterize);
 			std::string name;
@@ -247,6 +491,81 @@ int main(int argc, char** argv) {
 			info("\tsample pattern: '%s' (%d)", name.c_str(), camera->film.sample_pattern);
 			info("\trasterizing...");
 		}
+		//coordinator: run this program (with the same arguments) as distribute workers, hand each an interleaved
+		// share of the tiles over its stdin, and merge the partial renders they save:
+		if (distribute > 0 && worker_partial == "") {
+			uint32_t tiles = pathtracer->tile_count(*camera);
+			std::string command = shell_quote(argv[0]);
+			for (int32_t i = 1; i < argc; ++i) command += " " + shell_quote(argv[i]);
+			//(every worker has to make the same tiles)
+			if (seed_option->count() == 0) command += " --seed " + std::to_string(RNG::fixed_seed);
+
+			info("\tdistributing %u tiles over %u workers...", tiles, distribute);
+			std::vector< std::string > partials;
+			std::vector< FILE * > workers;
+			bool failed = false;
+			for (uint32_t w = 0; w < distribute; ++w) {
+				partials.emplace_back(output_file + ".part" + std::to_string(w) + ".ptck");
+				FILE *worker = popen((command + " --worker-partial " + shell_quote(partials.back())).c_str(), "w");
+				if (!worker) {
+					warn("ERROR: Failed to start worker %u.", w);
+					failed = true;
+					break;
+				}
+				//(tiles next to each other in render()'s order are near each other on the film, so interleaving balances the work)
+				for (uint32_t t = w; t < tiles; t += distribute) std::fprintf(worker, "%u\n", t);
+				std::fprintf(worker, "end\n");
+				std::fflush(worker);
+				workers.emplace_back(worker);
+			}
+			for (uint32_t w = 0; w < uint32_t(workers.size()); ++w) {
+				if (pclose(workers[w]) != 0) {
+					warn("ERROR: Worker %u failed.", w);
+					failed = true;
+				}
+			}
+			bool merged = !failed && merge_partials(partials, exp, output_file);
+			for (auto const &partial : partials) {
+				std::error_code ec;
+				std::filesystem::remove(partial, ec);
+			}
+			return merged ? 0 : 1;
+		}
+
+		//frames are pipelined: while frame N renders (from the renderer's copy of the scene), the scene is
+		// stepped to frame N+1 (and, when path tracing, built into a second copy that frame N+1 will render
+		// from) and frame N-1 is tonemapped and written out:
+		std::thread writer;
+		std::string write_failed; //(file the writer failed to write, if any)
+		auto finish_write = [&]() {
+			if (writer.joinable()) writer.join();
+			if (write_failed.empty()) return true;
+			warn("ERROR: Failed to write output to '%s'", write_failed.c_str());
+			return false;
+		};
+		bool quit = false; //(the pathtracer keeps a pointer to this between frames)
+
+		//when animating, files are numbered by frame:
+		auto frame_filename = [&](std::string const &file, int32_t frame, std::string const &extension) {
+			std::filesystem::path filename(file);
+			if (animate) {
+				std::stringstream str;
+				str << std::setfill('0') << std::setw(4) << frame;
+
+				std::error_code ec;
+				if (std::filesystem::is_directory(filename, ec) ) {
+					//numbered files within the directory:
+					filename = filename / (str.str() + extension);
+				} else {
+					//number goes after the stem:
+					std::filesystem::path ext = filename.extension();
+					filename.replace_extension("");
+					filename += str.str();
+					filename += ext;
+				}
+			}
+			return filename;
+		};
 		for (int32_t frame = min_frame; frame <= max_frame; ++frame) {
 			//do the render:
 			info(" frame %d", frame);
@@ -282,23 +601,104 @@ int main(int argc, char** argv) {
 				}
 			};
 
+			std::unique_ptr< Rasterizer > rasterizer;
 			if (pathtrace) {
-				bool quit = false;
-				PT::Pathtracer pathtracer;
+				try {
+					pathtracer->render(scene, camera_instance.lock(), std::move(report_callback), &quit);
+				} catch (std::exception const &e) {
+					warn("ERROR: %s", e.what());
+					finish_write();
+					return 1;
+				}
+			} else { assert(rasterize);
+				rasterizer = std::make_unique< Rasterizer >(scene, *camera_instance.lock(), std::move(report_callback));
+			}
 
-				pathtracer.use_bvh(!no_bvh);
-				pathtracer.render(scene, camera_instance.lock(), std::move(report_callback), &quit);
+			//advance (if animating) while the frame renders, and build the next frame for the pathtracer:
+			if (animate && frame != max_frame) {
+				info("Advancing %d -> %d", frame, frame + 1);
+				Scene::StepOpts opts;
+				opts.use_bvh = !no_bvh;
+				opts.thread_pool = step_pool;
+				scene.step(animator, float(frame), float(frame + 1), 1.0f / animator.frame_rate, opts);
+				if (pathtrace) {
+					try {
+						pathtracer->prepare(scene);
+					} catch (std::exception const &e) {
+						warn("ERROR: %s", e.what());
+						finish_write();
+						return 1;
+					}
+				}
+			}
 
-				while (pathtracer.in_progress()) {
-					print_progress(percent_done);
+			if (pathtrace) {
+				while (pathtracer->in_progress()) {
+					if (worker_partial == "") print_progress(pathtracer->progress());
 					std::this_thread::sleep_for(std::chrono::milliseconds(250));
 				}
 				std::cout << std::endl;
 
-			} else { assert(rasterize);
+				auto samples = pathtracer->sample_counts();
+				if (samples.traced < samples.budget && samples.traced > 0) {
+					//(assumes the samples that weren't traced would have cost as much as the ones that were)
+					float render = pathtracer->completion_time().render;
+					float saved = render * float(samples.budget - samples.traced) / float(samples.traced);
+					info("\ttraced %llu of %llu samples (%.1f%%), saving ~%.2fs", (unsigned long long)samples.traced,
+					     (unsigned long long)samples.budget, 100.0 * double(samples.traced) / double(samples.budget), saved);
+				} else {
+					info("\ttraced %llu samples", (unsigned long long)samples.traced);
+				}
+
+				{
+					size_t vertices = 0, triangles = 0, bvh = 0;
+					for (auto const &[name, memory] : pathtracer->mesh_memory(scene)) {
+						vertices += memory.vertices;
+						triangles += memory.triangles;
+						bvh += memory.bvh;
+					}
+					info("\tmeshes hold %.1fMB: %.1fMB vertices, %.1fMB triangles, %.1fMB BVH nodes",
+					     1e-6 * double(vertices + triangles + bvh), 1e-6 * double(vertices), 1e-6 * double(triangles), 1e-6 * double(bvh));
+				}
+				if (bvh_cache) {
+					PT::BVH_Cache::Counts counts = bvh_cache->counts();
+					info("\tBVH cache: %u loaded, %u built and stored, %u invalid, %u evicted (so far)", counts.loaded, counts.stored,
+					     counts.rejected, counts.evicted);
+				}
+
+				if constexpr (PT::RECORD_STATS) {
+					PT::Pathtracer::Stats stats = pathtracer->stats();
+					uint64_t rays = stats.counts.rays();
+					info("\t%.2fM rays/s; %.1f BVH nodes and %.1f primitives per ray; %.3fs per tile (slowest %.3fs)",
+					     stats.render > 0.0f ? 1e-6 * double(rays) / stats.render : 0.0,
+					     rays ? double(stats.counts.nodes_visited) / double(rays) : 0.0,
+					     rays ? double(stats.counts.primitives_tested) / double(rays) : 0.0,
+					     stats.tiles ? stats.tile_seconds / stats.tiles : 0.0f, stats.slowest_tile);
+				}
+				if (stats_file != "" || cost_heatmap_file != "") {
+					PT::Pathtracer::Stats stats = pathtracer->stats();
+					if (stats_file != "") {
+						std::string filename = frame_filename(stats_file, frame, ".json").generic_string();
+						if (!write_stats(stats, pathtracer->mesh_memory(scene), filename)) {
+							warn("ERROR: Failed to write statistics to '%s'", filename.c_str());
+							finish_write();
+							return 1;
+						}
+						std::cout << "Wrote statistics to '" << filename << "'." << std::endl;
+					}
+					if (cost_heatmap_file != "") {
+						std::string filename = frame_filename(cost_heatmap_file, frame, ".png").generic_string();
+						if (!write_cost_heatmap(stats, camera->film.width, camera->film.height, filename)) {
+							warn("ERROR: Failed to write cost heatmap to '%s'", filename.c_str());
+							finish_write();
+							return 1;
+						}
+						std::cout << "Wrote cost heatmap to '" << filename << "'." << std::endl;
+					}
+				}
 
-				Rasterizer rasterizer(scene, *camera_instance.lock(), std::move(report_callback));
-				while (rasterizer.in_progress()) {
+			} else {
+				while (rasterizer->in_progress()) {
 					print_progress(percent_done);
 					std::this_thread::sleep_for(std::chrono::milliseconds(250));
 				}
@@ -306,54 +706,33 @@ int main(int argc, char** argv) {
 			}
 			info("\tdone.");
 
-			//write frame:
-			if (output_file == "") {
-				std::cout << "No output was requested, not writing any file." << std::endl;
-			} else {
-
-				std::filesystem::path filename(output_file);
-
-				if (animate) {
-					std::stringstream str;
-					str << std::setfill('0') << std::setw(4) << frame;
-
-					std::error_code ec;
-					if (std::filesystem::is_directory(filename, ec) ) {
-						//numbered files within the directory:
-						filename = filename / (str.str() + ".png");
-					} else {
-						//number goes after the stem:
-						std::filesystem::path ext = filename.extension();
-						filename.replace_extension("");
-						filename += str.str();
-						filename += ext;
-					}
-				}
-
-				uint32_t data_w, data_h;
-				std::vector<uint8_t> data;
-				display_hdr.tonemap_to(data, exp);
-				data_w = display_hdr.w;
-				data_h = display_hdr.h;
-
-				stbi_flip_vertically_on_write(true);
-				if (!stbi_write_png(filename.generic_string().c_str(), data_w, data_h, 4, data.data(), data_w * 4)) {
-					warn("ERROR: Failed to write output to '%s'", filename.generic_string().c_str());
+			//workers save their tiles' sums rather than an image:
+			if (worker_partial != "") {
+				try {
+					pathtracer->partial().save(worker_partial);
+				} catch (std::exception const &e) {
+					warn("ERROR: Failed to save partial render: %s", e.what());
 					return 1;
 				}
-				std::cout << "Wrote result to '" << filename.generic_string() << "'." << std::endl;
+				continue;
 			}
 
-			//advance (if animating):
-			if (animate && frame != max_frame) {
-				info("Advancing %d -> %d", frame, frame + 1);
-				Scene::StepOpts opts;
-				opts.use_bvh = !no_bvh;
-				opts.thread_pool = nullptr; //TODO
-				scene.step(animator, float(frame), float(frame + 1), 1.0f / animator.frame_rate, opts);
+			//write frame (after the previous one is written):
+			if (!finish_write()) return 1;
+			if (output_file == "") {
+				std::cout << "No output was requested, not writing any file." << std::endl;
+			} else {
+				std::filesystem::path filename = frame_filename(output_file, frame, ".png");
+				writer = std::thread([&write_failed, exp, filename, image = std::move(display_hdr)]() {
+					if (!write_png(image, exp, filename.generic_string())) {
+						write_failed = filename.generic_string();
+						return;
+					}
+					std::cout << "Wrote result to '" << filename.generic_string() << "'." << std::endl;
+				});
 			}
-
 		}
+		if (!finish_write()) return 1;
 
 		return 0;
 	}
@@ -38,8 +38,25 @@ public:
 		return std::visit([](const auto& o) { return o.bbox(); }, underlying);
 	}
 
-	Trace hit(Ray ray) const {
-		return std::visit([&](const auto& o) { return o.hit(ray); }, underlying);
+	Trace hit(const Ray& ray) const {
+		Hit hit;
+		if (!intersect(ray, hit)) return Trace{};
+		return finalize(ray, hit);
+	}
+
+	//closest hit within ray.dist_bounds, as a minimal record (see Hit); leaves hit alone and returns false if there is none:
+	bool intersect(const Ray& ray, Hit& hit) const {
+		return std::visit([&](const auto& o) { return o.intersect(ray, hit); }, underlying);
+	}
+
+	//surface attributes of a hit recorded by intersect() (every hit in an aggregate is on some instance):
+	static Trace finalize(const Ray& ray, const Hit& hit) {
+		return Instance::finalize(ray, hit);
+	}
+
+	//is there any hit within ray.dist_bounds? (use for shadow rays -- stops at the first hit found)
+	bool occluded(Ray ray) const {
+		return std::visit([&](const auto& o) { return o.occluded(ray); }, underlying);
 	}
 
 	uint32_t visualize(GL::Lines& lines, GL::Lines& active, uint32_t level, Mat4 vtrans) const {
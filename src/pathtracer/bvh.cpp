@@ -2,10 +2,20 @@
 #include "bvh.h"
 #include "aggregate.h"
 #include "instance.h"
+#include "stats.h"
 #include "tri_mesh.h"
 
+#include "../util/thread_pool.h"
+
+#include <functional>
+#include <limits>
 #include <stack>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PT_BVH_SSE
+#endif
+
 namespace PT {
 
 struct BVHBuildData {
@@ -21,38 +31,582 @@ struct SAHBucketData {
 	size_t num_prims; ///< number of primitives in the bucket
 };
 
+//run f(begin, end) over chunks of [0, n), on the thread pool if supplied and n is large enough:
+template<typename F>
+static void for_chunks(Thread_Pool* pool, size_t n, size_t chunk, F&& f) {
+	if (!pool || n <= chunk) {
+		f(size_t(0), n);
+		return;
+	}
+	Thread_Pool::Group group;
+	std::vector<std::function<void()>> tasks;
+	for (size_t begin = 0; begin < n; begin += chunk) {
+		size_t end = std::min(begin + chunk, n);
+		tasks.emplace_back([&f, begin, end]() { f(begin, end); });
+	}
+	pool->enqueue(group, std::move(tasks));
+	pool->wait(group);
+}
+
 template<typename Primitive>
 void BVH<Primitive>::build(std::vector<Primitive>&& prims, size_t max_leaf_size) {
+	BVH_Build_Opts opts;
+	opts.max_leaf_size = max_leaf_size;
+	build(std::move(prims), opts);
+}
+
+template<typename Primitive>
+void BVH<Primitive>::build(std::vector<Primitive>&& prims, BVH_Build_Opts const &opts) {
 	//A3T3 - build a bvh
 
 	// Keep these
-    nodes.clear();
-    primitives = std::move(prims);
+	nodes.clear();
+	wide_nodes.clear();
+	primitives = std::move(prims);
+	root_idx = 0;
+	if (opts.order) opts.order->clear();
+
+	if (primitives.empty()) return;
+
+	// Top-down binned SAH build:
+	//  primitive bounds and centroids are computed once up front, then each node
+	//  bins its primitives' centroids into buckets along all three axes and splits
+	//  at the bucket boundary with the lowest surface area heuristic cost.
+	// Nodes with at least opts.parallel_threshold primitives bound/bin in parallel
+	// chunks and build their left subtree as a separate task.
+
+	const size_t max_leaf_size = std::max(opts.max_leaf_size, size_t(1));
+	const uint32_t buckets = std::max(opts.buckets, 2u);
+	const size_t threshold = std::max(opts.parallel_threshold, size_t(1));
+	Thread_Pool* pool = opts.thread_pool;
+
+	const size_t n = primitives.size();
+	std::vector<BBox> boxes(n);
+	std::vector<Vec3> centroids(n);
+	std::vector<size_t> order(n); //primitives are sorted by sorting this, then permuted once at the end
+	for_chunks(pool, n, threshold, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			boxes[i] = primitives[i].bbox();
+			centroids[i] = boxes[i].center();
+			order[i] = i;
+		}
+	});
+
+	// Node slots are assigned so that the tree comes out the same no matter how the
+	// subtree tasks are scheduled: a node for k primitives at slot b owns slots
+	// [b, b + 2k - 1); its left child (with m primitives) goes at b + 1 and its right
+	// child at b + 2m. Slots left unused by leaves holding several primitives are
+	// removed afterward.
+	nodes.resize(2 * n - 1);
+	std::vector<uint8_t> slot_used(nodes.size(), 0); //(each slot is written by the one task that builds it)
+
+	//Below this depth, nodes split at the median centroid along their widest axis instead of by SAH, which
+	// bounds the depth (and so the recursion) at about Max_SAH_Depth + log2(n) even for degenerate input:
+	constexpr uint32_t Max_SAH_Depth = 64;
+
+	struct Bounds {
+		BBox box;      ///< bbox of all primitives
+		BBox centroid; ///< bbox of all primitive centroids
+	};
+	auto bound = [&](size_t start, size_t end) {
+		//(each chunk writes its own slot, so merging is deterministic)
+		size_t chunks = (end - start + threshold - 1) / threshold;
+		std::vector<Bounds> partial(pool ? chunks : 1);
+		for_chunks(pool, end - start, threshold, [&](size_t begin, size_t finish) {
+			Bounds& b = partial[pool ? begin / threshold : 0];
+			for (size_t i = start + begin; i < start + finish; ++i) {
+				b.box.enclose(boxes[order[i]]);
+				b.centroid.enclose(centroids[order[i]]);
+			}
+		});
+		Bounds ret;
+		for (auto const& b : partial) {
+			ret.box.enclose(b.box);
+			ret.centroid.enclose(b.centroid);
+		}
+		return ret;
+	};
+
+	auto bucket_of = [&](Vec3 c, BBox const& centroid_bounds, uint32_t axis) {
+		float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+		float t = (c[axis] - centroid_bounds.min[axis]) / extent;
+		return std::min(uint32_t(t * buckets), buckets - 1);
+	};
+
+	//bins [start, end) along every axis with nonzero centroid extent:
+	auto bin = [&](size_t start, size_t end, BBox const& centroid_bounds) {
+		size_t chunks = (end - start + threshold - 1) / threshold;
+		std::vector<std::vector<SAHBucketData>> partial(pool ? chunks : 1,
+			std::vector<SAHBucketData>(3 * buckets, SAHBucketData{BBox{}, 0}));
+		for_chunks(pool, end - start, threshold, [&](size_t begin, size_t finish) {
+			auto& data = partial[pool ? begin / threshold : 0];
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				if (!(centroid_bounds.max[axis] > centroid_bounds.min[axis])) continue;
+				for (size_t i = start + begin; i < start + finish; ++i) {
+					SAHBucketData& bucket = data[axis * buckets + bucket_of(centroids[order[i]], centroid_bounds, axis)];
+					bucket.bb.enclose(boxes[order[i]]);
+					bucket.num_prims += 1;
+				}
+			}
+		});
+		for (size_t c = 1; c < partial.size(); ++c) {
+			for (uint32_t i = 0; i < 3 * buckets; ++i) {
+				partial[0][i].bb.enclose(partial[c][i].bb);
+				partial[0][i].num_prims += partial[c][i].num_prims;
+			}
+		}
+		return std::move(partial[0]);
+	};
+
+	std::function<void(size_t, size_t, size_t, uint32_t)> build_node = [&](size_t start, size_t end, size_t slot, uint32_t depth) {
+		const size_t count = end - start;
+		Bounds bounds = bound(start, end);
+
+		Node& node = nodes[slot];
+		node.bbox = bounds.box;
+		node.start = start;
+		node.size = count;
+		node.l = node.r = slot;
+		slot_used[slot] = 1;
+
+		if (count <= max_leaf_size) return;
+
+		if (depth >= Max_SAH_Depth) {
+			uint32_t axis = 0;
+			Vec3 extent = bounds.centroid.max - bounds.centroid.min;
+			if (extent.y > extent[axis]) axis = 1;
+			if (extent.z > extent[axis]) axis = 2;
+			size_t mid = start + count / 2;
+			//(ties broken by index, so the split doesn't depend on the order primitives arrived in)
+			std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end, [&](size_t a, size_t b) {
+				if (centroids[a][axis] != centroids[b][axis]) return centroids[a][axis] < centroids[b][axis];
+				return a < b;
+			});
+			node.l = slot + 1;
+			node.r = slot + 2 * (mid - start);
+			build_node(start, mid, node.l, depth + 1);
+			build_node(mid, end, node.r, depth + 1);
+			return;
+		}
+
+		//find the lowest-cost bucket boundary:
+		// (cost of splitting after bucket b is SA(left) * N(left) + SA(right) * N(right))
+		std::vector<SAHBucketData> data = bin(start, end, bounds.centroid);
+		float best_cost = std::numeric_limits<float>::infinity();
+		uint32_t best_axis = 0, best_bucket = 0;
+		std::vector<float> right_cost(buckets);
+		for (uint32_t axis = 0; axis < 3; ++axis) {
+			if (!(bounds.centroid.max[axis] > bounds.centroid.min[axis])) continue;
+			SAHBucketData const* axis_data = &data[axis * buckets];
+
+			BBox right;
+			size_t right_prims = 0;
+			for (uint32_t b = buckets - 1; b > 0; --b) {
+				right.enclose(axis_data[b].bb);
+				right_prims += axis_data[b].num_prims;
+				right_cost[b] = right.surface_area() * right_prims;
+			}
+			BBox left;
+			size_t left_prims = 0;
+			for (uint32_t b = 0; b + 1 < buckets; ++b) {
+				left.enclose(axis_data[b].bb);
+				left_prims += axis_data[b].num_prims;
+				if (left_prims == 0 || left_prims == count) continue;
+				float cost = left.surface_area() * left_prims + right_cost[b + 1];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_bucket = b;
+				}
+			}
+		}
 
-    // Construct a BVH from the given vector of primitives and maximum leaf
-    // size configuration.
+		size_t mid;
+		if (best_cost < std::numeric_limits<float>::infinity()) {
+			auto split = std::partition(order.begin() + start, order.begin() + end, [&](size_t i) {
+				return bucket_of(centroids[i], bounds.centroid, best_axis) <= best_bucket;
+			});
+			mid = size_t(split - order.begin());
+		} else {
+			//all centroids coincide, so any split is as good as another:
+			mid = start + count / 2;
+		}
+		assert(mid > start && mid < end);
 
-	//TODO
+		node.l = slot + 1;
+		node.r = slot + 2 * (mid - start);
+
+		if (pool && count >= threshold) {
+			Thread_Pool::Group group;
+			pool->enqueue(group, [&, start, mid, l = node.l, depth]() { build_node(start, mid, l, depth + 1); });
+			build_node(mid, end, node.r, depth + 1);
+			pool->wait(group);
+		} else {
+			build_node(start, mid, node.l, depth + 1);
+			build_node(mid, end, node.r, depth + 1);
+		}
+	};
+	build_node(0, n, root_idx, 0);
+
+	//compact away unused node slots (used slots are already in depth-first order):
+	std::vector<size_t> remap(nodes.size());
+	size_t used = 0;
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		if (!slot_used[i]) continue;
+		remap[i] = used;
+		nodes[used] = nodes[i];
+		used += 1;
+	}
+	nodes.resize(used);
+	nodes.shrink_to_fit();
+	for (Node& node : nodes) {
+		node.l = remap[node.l];
+		node.r = remap[node.r];
+	}
 
+	//put primitives in leaf order:
+	std::vector<Primitive> sorted;
+	sorted.reserve(n);
+	for (size_t i : order) {
+		sorted.emplace_back(std::move(primitives[i]));
+	}
+	primitives = std::move(sorted);
+	if (opts.order) opts.order->assign(order.begin(), order.end());
+
+	if (opts.wide) build_wide();
+}
+
+template<typename Primitive> void BVH<Primitive>::build_wide() {
+	wide_nodes.clear();
+	if (nodes.empty()) return;
+	//(offsets are 32-bit; nodes.size() bounds both the wide node and primitive counts)
+	if (nodes.size() >= BVH_Wide_Node::Empty) {
+		warn("BVH too large for 32-bit wide nodes; using binary traversal.");
+		return;
+	}
+
+	//each wide node takes the (up to) four descendants of a binary node found by repeatedly
+	// opening the interior descendant with the largest surface area:
+	std::function<uint32_t(size_t)> collapse = [&](size_t idx) -> uint32_t {
+		uint32_t w = uint32_t(wide_nodes.size());
+		wide_nodes.emplace_back();
+
+		size_t kids[BVH_Wide_Node::Width];
+		uint32_t n = 0;
+		if (nodes[idx].is_leaf()) {
+			kids[n++] = idx;
+		} else {
+			kids[n++] = nodes[idx].l;
+			kids[n++] = nodes[idx].r;
+			while (n < BVH_Wide_Node::Width) {
+				uint32_t open = n;
+				float open_area = -1.0f;
+				for (uint32_t i = 0; i < n; ++i) {
+					if (nodes[kids[i]].is_leaf()) continue;
+					float area = nodes[kids[i]].bbox.surface_area();
+					if (area > open_area) {
+						open = i;
+						open_area = area;
+					}
+				}
+				if (open == n) break;
+				size_t opened = kids[open];
+				kids[open] = nodes[opened].l;
+				kids[n++] = nodes[opened].r;
+			}
+		}
+
+		for (uint32_t i = 0; i < BVH_Wide_Node::Width; ++i) {
+			BBox box = i < n ? nodes[kids[i]].bbox : BBox{};
+			for (uint32_t a = 0; a < 3; ++a) {
+				wide_nodes[w].bounds[a][i] = box.min[a];
+				wide_nodes[w].bounds[3 + a][i] = box.max[a];
+			}
+			uint32_t offset = BVH_Wide_Node::Empty, count = 0;
+			if (i < n && nodes[kids[i]].is_leaf()) {
+				offset = uint32_t(nodes[kids[i]].start);
+				count = uint32_t(nodes[kids[i]].size);
+			} else if (i < n) {
+				//(recursion may reallocate wide_nodes, so no references across this call)
+				offset = collapse(kids[i]);
+			}
+			wide_nodes[w].offset[i] = offset;
+			wide_nodes[w].count[i] = count;
+		}
+		return w;
+	};
+	collapse(root_idx);
+	wide_nodes.shrink_to_fit();
 }
 
+//traversal stack entry: a node (or, for wide traversal, possibly a leaf) and the distance at which the ray enters it
+struct BVH_Stack_Entry {
+	uint32_t offset;
+	uint32_t count; //(non-zero for leaves)
+	float t;
+};
+
+//Traversal stacks live in one per-thread vector so that hit() doesn't allocate per ray.
+// Traversals nest (an instance BVH's primitives have BVHs of their own), so each one
+// works above the height the stack had when it started and restores it when done.
+class BVH_Stack {
+public:
+	BVH_Stack() : entries(stack()), base(entries.size()) {
+	}
+	~BVH_Stack() {
+		entries.resize(base);
+	}
+	bool empty() const {
+		return entries.size() == base;
+	}
+	void push(BVH_Stack_Entry const& entry) {
+		entries.push_back(entry);
+	}
+	BVH_Stack_Entry pop() {
+		BVH_Stack_Entry ret = entries.back();
+		entries.pop_back();
+		return ret;
+	}
+
+private:
+	static std::vector<BVH_Stack_Entry>& stack() {
+		static thread_local std::vector<BVH_Stack_Entry> entries;
+		return entries;
+	}
+	std::vector<BVH_Stack_Entry>& entries;
+	size_t base;
+};
+
 template<typename Primitive> Trace BVH<Primitive>::hit(const Ray& ray) const {
 	//A3T3 - traverse your BVH
 
-    // Implement ray - BVH intersection test. A ray intersects
-    // with a BVH aggregate if and only if it intersects a primitive in
-    // the BVH that is not an aggregate.
+	// Implement ray - BVH intersection test. A ray intersects
+	// with a BVH aggregate if and only if it intersects a primitive in
+	// the BVH that is not an aggregate.
 
-    // The starter code simply iterates through all the primitives.
-    // Again, remember you can use hit() on any Primitive value.
+	Hit hit;
+	if (!intersect(ray, hit)) return Trace{};
+	return finalize(ray, hit);
+}
 
-	//TODO: replace this code with a more efficient traversal:
-    Trace ret;
-    for(const Primitive& prim : primitives) {
-        Trace hit = prim.hit(ray);
-        ret = Trace::min(ret, hit);
-    }
-    return ret;
+template<typename Primitive> bool BVH<Primitive>::intersect(const Ray& ray, Hit& hit) const {
+	if (!wide_nodes.empty()) return intersect_wide(ray, hit);
+	return intersect_binary(ray, hit);
+}
+
+template<typename Primitive> Trace BVH<Primitive>::finalize(const Ray& ray, const Hit& hit) const {
+	//triangles are found through their index; instances record themselves in the hit:
+	if constexpr (std::is_same_v<Primitive, Triangle>) return primitives[hit.prim].finalize(ray, hit);
+	else return Primitive::finalize(ray, hit);
+}
+
+//leaves only record where each closer hit is (and shorten the ray to it):
+template<typename Primitive> static inline bool intersect_leaf(std::vector<Primitive> const& primitives, size_t start, size_t end, Ray& ray, Hit& hit, Traversal_Count& count) {
+	count.tested(end - start);
+	bool found = false;
+	for (size_t i = start; i < end; ++i) {
+		if (primitives[i].intersect(ray, hit)) {
+			if constexpr (std::is_same_v<Primitive, Triangle>) hit.prim = uint32_t(i);
+			ray.dist_bounds.y = hit.t;
+			found = true;
+		}
+	}
+	return found;
+}
+
+template<typename Primitive> bool BVH<Primitive>::intersect_binary(const Ray& ray_, Hit& hit) const {
+	if (nodes.empty()) return false;
+
+	//closest hit so far bounds the ray from here on:
+	Ray ray = ray_;
+	Vec2 times = ray.dist_bounds;
+	if (!nodes[root_idx].bbox.hit(ray, times)) return false;
+
+	bool found = false;
+
+	Traversal_Count count;
+	BVH_Stack stack;
+	stack.push({uint32_t(root_idx), 0, times.x});
+	while (!stack.empty()) {
+		BVH_Stack_Entry entry = stack.pop();
+		if (entry.t > ray.dist_bounds.y) continue;
+
+		const Node& node = nodes[entry.offset];
+		count.node();
+		if (node.is_leaf()) {
+			found |= intersect_leaf(primitives, node.start, node.start + node.size, ray, hit, count);
+			continue;
+		}
+
+		//visit the nearer child first (so push it last):
+		Vec2 l_times = ray.dist_bounds, r_times = ray.dist_bounds;
+		bool l_hit = nodes[node.l].bbox.hit(ray, l_times);
+		bool r_hit = nodes[node.r].bbox.hit(ray, r_times);
+		BVH_Stack_Entry l{uint32_t(node.l), 0, l_times.x}, r{uint32_t(node.r), 0, r_times.x};
+		if (l_hit && r_hit) {
+			if (l.t <= r.t) {
+				stack.push(r);
+				stack.push(l);
+			} else {
+				stack.push(l);
+				stack.push(r);
+			}
+		} else if (l_hit) {
+			stack.push(l);
+		} else if (r_hit) {
+			stack.push(r);
+		}
+	}
+	return found;
+}
+
+//ray data shared by all of the wide slab tests along one traversal:
+struct BVH_Wide_Ray {
+	BVH_Wide_Ray(const Ray& ray) {
+		for (uint32_t a = 0; a < 3; ++a) {
+			point[a] = ray.point[a];
+			inv_dir[a] = 1.0f / ray.dir[a];
+			//negative directions enter through the max side, so swap the min/max rows:
+			near[a] = inv_dir[a] < 0.0f ? 3 + a : a;
+			far[a] = inv_dir[a] < 0.0f ? a : 3 + a;
+		}
+	}
+	float point[3], inv_dir[3];
+	uint32_t near[3], far[3];
+};
+
+//test ray against all four children of node over [tmin, tmax]
+// returns a bitmask of the children hit and writes each child's entry distance to t:
+// (as in BBox::hit, NaN slab times -- rays starting in a parallel slab's plane -- are ignored)
+static inline uint32_t wide_slabs(const BVH_Wide_Node& node, const BVH_Wide_Ray& ray, float tmin, float tmax, float t[BVH_Wide_Node::Width]) {
+#ifdef PT_BVH_SSE
+	__m128 lo = _mm_set1_ps(tmin), hi = _mm_set1_ps(tmax);
+	for (uint32_t a = 0; a < 3; ++a) {
+		__m128 p = _mm_set1_ps(ray.point[a]);
+		__m128 inv = _mm_set1_ps(ray.inv_dir[a]);
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.near[a]]), p), inv);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.far[a]]), p), inv);
+		//(_mm_max_ps / _mm_min_ps return their second operand if either is NaN)
+		lo = _mm_max_ps(t0, lo);
+		hi = _mm_min_ps(t1, hi);
+	}
+	_mm_storeu_ps(t, lo);
+	return uint32_t(_mm_movemask_ps(_mm_cmple_ps(lo, hi)));
+#else
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < BVH_Wide_Node::Width; ++i) {
+		float lo = tmin, hi = tmax;
+		for (uint32_t a = 0; a < 3; ++a) {
+			float t0 = (node.bounds[ray.near[a]][i] - ray.point[a]) * ray.inv_dir[a];
+			float t1 = (node.bounds[ray.far[a]][i] - ray.point[a]) * ray.inv_dir[a];
+			lo = t0 > lo ? t0 : lo;
+			hi = t1 < hi ? t1 : hi;
+		}
+		t[i] = lo;
+		if (lo <= hi) mask |= (1u << i);
+	}
+	return mask;
+#endif
+}
+
+template<typename Primitive> bool BVH<Primitive>::intersect_wide(const Ray& ray_, Hit& hit) const {
+	bool found = false;
+
+	//closest hit so far bounds the ray from here on:
+	Ray ray = ray_;
+	BVH_Wide_Ray wide_ray(ray);
+
+	Traversal_Count count;
+	BVH_Stack stack;
+	stack.push({0, 0, ray.dist_bounds.x});
+	while (!stack.empty()) {
+		BVH_Stack_Entry entry = stack.pop();
+		if (entry.t > ray.dist_bounds.y) continue;
+
+		if (entry.count) {
+			found |= intersect_leaf(primitives, entry.offset, entry.offset + entry.count, ray, hit, count);
+			continue;
+		}
+
+		const BVH_Wide_Node& node = wide_nodes[entry.offset];
+		count.node();
+		float t[BVH_Wide_Node::Width];
+		uint32_t mask = wide_slabs(node, wide_ray, ray.dist_bounds.x, ray.dist_bounds.y, t);
+		if (!mask) continue;
+
+		//sort hit children far-to-near, then push them in that order so the nearest is visited first:
+		BVH_Stack_Entry hits[BVH_Wide_Node::Width];
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < BVH_Wide_Node::Width; ++i) {
+			if (!(mask & (1u << i))) continue;
+			BVH_Stack_Entry hit{node.offset[i], node.count[i], t[i]};
+			uint32_t j = n++;
+			for (; j > 0 && hits[j - 1].t < hit.t; --j) hits[j] = hits[j - 1];
+			hits[j] = hit;
+		}
+		for (uint32_t i = 0; i < n; ++i) stack.push(hits[i]);
+	}
+	return found;
+}
+
+template<typename Primitive> bool BVH<Primitive>::occluded(const Ray& ray) const {
+	if (!wide_nodes.empty()) return occluded_wide(ray);
+	return occluded_binary(ray);
+}
+
+//(any hit will do, so these skip the nearest-first ordering that hit() uses)
+
+template<typename Primitive> bool BVH<Primitive>::occluded_binary(const Ray& ray) const {
+	if (nodes.empty()) return false;
+
+	Vec2 times = ray.dist_bounds;
+	if (!nodes[root_idx].bbox.hit(ray, times)) return false;
+
+	Traversal_Count count;
+	BVH_Stack stack;
+	stack.push({uint32_t(root_idx), 0, times.x});
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.pop().offset];
+		count.node();
+		if (node.is_leaf()) {
+			for (size_t i = node.start; i < node.start + node.size; ++i) {
+				count.tested(1);
+				if (primitives[i].occluded(ray)) return true;
+			}
+			continue;
+		}
+		Vec2 l_times = ray.dist_bounds, r_times = ray.dist_bounds;
+		if (nodes[node.r].bbox.hit(ray, r_times)) stack.push({uint32_t(node.r), 0, r_times.x});
+		if (nodes[node.l].bbox.hit(ray, l_times)) stack.push({uint32_t(node.l), 0, l_times.x});
+	}
+	return false;
+}
+
+template<typename Primitive> bool BVH<Primitive>::occluded_wide(const Ray& ray) const {
+	BVH_Wide_Ray wide_ray(ray);
+
+	Traversal_Count count;
+	BVH_Stack stack;
+	stack.push({0, 0, ray.dist_bounds.x});
+	while (!stack.empty()) {
+		BVH_Stack_Entry entry = stack.pop();
+		if (entry.count) {
+			for (uint32_t i = entry.offset; i < entry.offset + entry.count; ++i) {
+				count.tested(1);
+				if (primitives[i].occluded(ray)) return true;
+			}
+			continue;
+		}
+
+		const BVH_Wide_Node& node = wide_nodes[entry.offset];
+		count.node();
+		float t[BVH_Wide_Node::Width];
+		uint32_t mask = wide_slabs(node, wide_ray, ray.dist_bounds.x, ray.dist_bounds.y, t);
+		for (uint32_t i = 0; i < BVH_Wide_Node::Width; ++i) {
+			if (mask & (1u << i)) stack.push({node.offset[i], node.count[i], t[i]});
+		}
+	}
+	return false;
 }
 
 template<typename Primitive>
@@ -60,8 +614,14 @@ BVH<Primitive>::BVH(std::vector<Primitive>&& prims, size_t max_leaf_size) {
 	build(std::move(prims), max_leaf_size);
 }
 
+template<typename Primitive>
+BVH<Primitive>::BVH(std::vector<Primitive>&& prims, BVH_Build_Opts const &opts) {
+	build(std::move(prims), opts);
+}
+
 template<typename Primitive> std::vector<Primitive> BVH<Primitive>::destructure() {
 	nodes.clear();
+	wide_nodes.clear();
 	return std::move(primitives);
 }
 
@@ -70,6 +630,7 @@ template<typename P>
 typename std::enable_if<std::is_copy_assignable_v<P>, BVH<P>>::type BVH<Primitive>::copy() const {
 	BVH<Primitive> ret;
 	ret.nodes = nodes;
+	ret.wide_nodes = wide_nodes;
 	ret.primitives = primitives;
 	ret.root_idx = root_idx;
 	return ret;
@@ -91,6 +652,7 @@ float BVH<Primitive>::pdf(Ray ray, const Mat4& T, const Mat4& iT) const {
 
 template<typename Primitive> void BVH<Primitive>::clear() {
 	nodes.clear();
+	wide_nodes.clear();
 	primitives.clear();
 }
 
@@ -7,15 +7,45 @@
 #include "trace.h"
 
 struct RNG;
+class Thread_Pool;
 
 namespace PT {
 
+struct BVH_Build_Opts {
+	size_t max_leaf_size = 1;
+	uint32_t buckets = 16; //SAH buckets per axis
+	Thread_Pool *thread_pool = nullptr; //if supplied, bound nodes and build subtrees in parallel
+	size_t parallel_threshold = 4096; //(nodes with fewer primitives are built on one thread)
+	//also collapse the tree into 4-wide nodes, which hit() then traverses instead of the binary nodes:
+	// (the binary nodes are kept too, for visualize() and the BVH cache, so this costs memory as well as build time)
+	bool wide = false;
+	//if supplied, filled with the (input) index of each primitive, in the leaf order the BVH keeps them in:
+	std::vector<uint32_t> *order = nullptr;
+};
+
+//Collapsed 4-wide BVH node.
+// Child bounds are stored SoA, so a ray is tested against all four children in one (SSE) pass.
+struct alignas(32) BVH_Wide_Node {
+	static constexpr uint32_t Width = 4;
+	static constexpr uint32_t Empty = ~0u;
+
+	//bounds[0..2] are the children's min x/y/z, bounds[3..5] their max x/y/z:
+	// (empty slots have inverted bounds, so they are never hit)
+	float bounds[6][Width];
+	//interior child: offset is an index into wide_nodes and count is 0
+	//leaf child: offset is the first primitive and count the number of primitives
+	//empty slot: offset is Empty and count is 0
+	uint32_t offset[Width];
+	uint32_t count[Width];
+};
+static_assert(sizeof(BVH_Wide_Node) == 128, "BVH_Wide_Node should fill exactly two cache lines.");
+
 template<typename Primitive> class BVH {
 public:
 	class Node {
 	public:
 		BBox bbox;
-		size_t start, size, l, r;
+		size_t start = 0, size = 0, l = 0, r = 0;
 
 		// A node is a leaf if l == r, since all interior nodes must have distinct children
 		bool is_leaf() const;
@@ -24,7 +54,9 @@ public:
 
 	BVH() = default;
 	BVH(std::vector<Primitive>&& primitives, size_t max_leaf_size = 1);
+	BVH(std::vector<Primitive>&& primitives, BVH_Build_Opts const &opts);
 	void build(std::vector<Primitive>&& primitives, size_t max_leaf_size = 1);
+	void build(std::vector<Primitive>&& primitives, BVH_Build_Opts const &opts);
 
 	BVH(BVH&& src) = default;
 	BVH& operator=(BVH&& src) = default;
@@ -34,6 +66,12 @@ public:
 
 	BBox bbox() const;
 	Trace hit(const Ray& ray) const;
+	//closest hit within ray.dist_bounds, as a minimal record (see Hit); leaves hit alone and returns false if there is none:
+	bool intersect(const Ray& ray, Hit& hit) const;
+	//surface attributes of a hit recorded by intersect():
+	Trace finalize(const Ray& ray, const Hit& hit) const;
+	//does ray hit any primitive within ray.dist_bounds? (returns at the first hit found)
+	bool occluded(const Ray& ray) const;
 
 	template<typename P = Primitive>
 	typename std::enable_if<std::is_copy_assignable_v<P>, BVH<P>>::type copy() const;
@@ -51,9 +89,16 @@ public:
 	std::vector<Primitive> primitives;
 	std::vector<Node> nodes;
 	size_t root_idx = 0;
+	//collapsed copy of nodes (empty unless built with BVH_Build_Opts::wide); wide_nodes[0] is the root:
+	std::vector<BVH_Wide_Node> wide_nodes;
 
 private:
 	size_t new_node(BBox box = {}, size_t start = 0, size_t size = 0, size_t l = 0, size_t r = 0);
+	void build_wide();
+	bool intersect_binary(const Ray& ray, Hit& hit) const;
+	bool intersect_wide(const Ray& ray, Hit& hit) const;
+	bool occluded_binary(const Ray& ray) const;
+	bool occluded_wide(const Ray& ray) const;
 };
 
 } // namespace PT
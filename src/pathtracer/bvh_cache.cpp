@@ -0,0 +1,284 @@
+
+#include "bvh_cache.h"
+
+#include "../lib/log.h"
+#include "../util/hash.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace PT {
+
+BVH_Cache* BVH_Cache::shared = nullptr;
+
+// cache entries are a sequence of chunks that look like:
+// FFFFBBBBBBBBDDD...DDD
+//  FFFF: four-byte chunk label
+//  BBBBBBBB: eight-byte count of bytes (little-endian unsigned integer)
+//  DD...DDD: BBBBBBBB-byte array of data
+// (the checkpoint / s3ds layout, but with 64-bit counts, since the nodes of a large mesh can pass 4GB)
+
+namespace {
+
+constexpr char Header_fourcc[4] = {'b','v','h','c'};
+constexpr uint32_t Version = 1;
+struct Header {
+	uint32_t version;
+	uint32_t node_bytes, wide_node_bytes; //(sizeof the node types, so entries from other builds are rejected)
+	uint32_t padding;
+	uint64_t key;
+	uint64_t triangles;
+	uint64_t root_idx;
+	uint64_t checksum; //of the data of the chunks that follow
+};
+static_assert(sizeof(Header) == 6*8, "Header is packed.");
+
+constexpr char Order_fourcc[4] = {'o','r','d','0'};
+constexpr char Nodes_fourcc[4] = {'n','o','d','0'};
+constexpr char Wide_fourcc[4] = {'w','i','d','0'};
+
+constexpr char const *Extension = ".bvh";
+
+using Node = BVH<Triangle>::Node;
+
+template<typename T>
+void write(std::ostream& out, const char (&fourcc)[4], T const* data, size_t count) {
+	out.write(fourcc, 4);
+	uint64_t bytes = uint64_t(count) * sizeof(T);
+	out.write(reinterpret_cast<const char*>(&bytes), 8);
+	out.write(reinterpret_cast<const char*>(data), std::streamsize(bytes));
+}
+
+//walks the chunks of an entry; each read reads a chunk's data straight into its vector (or returns false if it isn't there):
+struct Chunk_Reader {
+	std::istream& in;
+	uint64_t remaining; //bytes of the entry not yet read
+
+	template<typename T> bool read(const char (&fourcc)[4], std::vector<T>* data, Hash64* hash = nullptr) {
+		char label[4];
+		uint64_t bytes;
+		if (remaining < 12 || !in.read(label, 4) || std::memcmp(label, fourcc, 4) != 0) return false;
+		if (!in.read(reinterpret_cast<char*>(&bytes), 8)) return false;
+		remaining -= 12;
+		if (bytes > remaining || bytes % sizeof(T) != 0) return false;
+		data->resize(size_t(bytes / sizeof(T)));
+		if (!in.read(reinterpret_cast<char*>(data->data()), std::streamsize(bytes))) return false;
+		remaining -= bytes;
+		if (hash) hash->add_array(*data);
+		return true;
+	}
+};
+
+//is the entry's tree one that traversal can walk over triangles primitives, without leaving its arrays or looping?
+// (children always come after their parents, in both node arrays)
+bool valid_tree(size_t triangles, size_t root_idx, std::vector<uint32_t> const& order, std::vector<Node> const& nodes,
+                std::vector<BVH_Wide_Node> const& wide_nodes) {
+	if (order.size() != triangles) return false;
+	std::vector<bool> seen(triangles, false);
+	for (uint32_t i : order) {
+		if (i >= triangles || seen[i]) return false;
+		seen[i] = true;
+	}
+
+	if (nodes.empty()) return triangles == 0 && wide_nodes.empty();
+	if (root_idx >= nodes.size()) return false;
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		Node const& node = nodes[i];
+		if (node.start > triangles || node.size > triangles - node.start) return false;
+		if (!node.is_leaf() && (node.l <= i || node.r <= i || node.l >= nodes.size() || node.r >= nodes.size())) return false;
+	}
+
+	for (size_t i = 0; i < wide_nodes.size(); ++i) {
+		for (uint32_t c = 0; c < BVH_Wide_Node::Width; ++c) {
+			uint32_t offset = wide_nodes[i].offset[c], count = wide_nodes[i].count[c];
+			if (count > 0) {
+				if (offset > triangles || count > triangles - offset) return false;
+			} else if (offset != BVH_Wide_Node::Empty && (offset <= i || offset >= wide_nodes.size())) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+BVH_Cache::BVH_Cache(std::filesystem::path directory, uint64_t max_bytes_) : dir(std::move(directory)), max_bytes(max_bytes_) {
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	if (ec) warn("Failed to create BVH cache directory '%s': %s", dir.string().c_str(), ec.message().c_str());
+}
+
+uint64_t BVH_Cache::key(Indexed_Mesh const& mesh, Tri_Mesh::Vertex_Format format, BVH_Build_Opts const& opts) {
+	Hash64 hash;
+	hash.add(Version);
+	hash.add_array(mesh.vertices());
+	hash.add_array(mesh.indices());
+	//(the build options that change the tree; the thread pool and parallel threshold don't)
+	hash.add(uint32_t(format));
+	hash.add(uint64_t(opts.max_leaf_size));
+	hash.add(opts.buckets);
+	hash.add(uint32_t(opts.wide));
+	return hash.value();
+}
+
+std::filesystem::path BVH_Cache::path(uint64_t key) const {
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return dir / (std::string(name) + Extension);
+}
+
+bool BVH_Cache::load(uint64_t key, std::vector<Triangle>& triangles, BVH<Triangle>& bvh) {
+	std::filesystem::path file = path(key);
+
+	std::vector<uint32_t> order;
+	std::vector<Node> nodes;
+	std::vector<BVH_Wide_Node> wide_nodes;
+	bool valid = false;
+	uint64_t root_idx = 0;
+	{
+		std::ifstream in(file, std::ios::binary);
+		if (!in) return false; //(no entry)
+		std::error_code ec;
+		uint64_t bytes = std::filesystem::file_size(file, ec);
+		if (ec) return false;
+
+		Chunk_Reader reader{in, bytes};
+		std::vector<Header> header;
+		Hash64 hash;
+		valid = reader.read(Header_fourcc, &header) && header.size() == 1 && header[0].version == Version
+		     && header[0].node_bytes == sizeof(Node) && header[0].wide_node_bytes == sizeof(BVH_Wide_Node)
+		     && header[0].key == key && header[0].triangles == triangles.size()
+		     && reader.read(Order_fourcc, &order, &hash) && reader.read(Nodes_fourcc, &nodes, &hash)
+		     && reader.read(Wide_fourcc, &wide_nodes, &hash) && reader.remaining == 0
+		     && hash.value() == header[0].checksum
+		     && valid_tree(triangles.size(), size_t(header[0].root_idx), order, nodes, wide_nodes);
+		if (valid) root_idx = header[0].root_idx;
+	}
+	std::error_code ec;
+	if (!valid) {
+		warn("Discarding invalid BVH cache entry '%s'.", file.string().c_str());
+		std::filesystem::remove(file, ec);
+		rejected += 1;
+		return false;
+	}
+
+	std::vector<Triangle> sorted;
+	sorted.reserve(order.size());
+	for (uint32_t i : order) sorted.emplace_back(std::move(triangles[i]));
+	bvh.primitives = std::move(sorted);
+	bvh.nodes = std::move(nodes);
+	bvh.root_idx = size_t(root_idx);
+	bvh.wide_nodes = std::move(wide_nodes);
+	triangles.clear();
+
+	//(the modification time is when an entry was last used, for eviction)
+	std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), ec);
+	loaded += 1;
+	return true;
+}
+
+void BVH_Cache::store(uint64_t key, BVH<Triangle> const& bvh, std::vector<uint32_t> const& order) {
+	assert(order.size() == bvh.primitives.size());
+
+	uint64_t bytes = 4 * 12 + sizeof(Header) + order.size() * sizeof(uint32_t) + bvh.nodes.size() * sizeof(Node)
+	               + bvh.wide_nodes.size() * sizeof(BVH_Wide_Node);
+	if (bytes > max_bytes) return; //(it would only be evicted)
+
+	Hash64 hash;
+	hash.add_array(order);
+	hash.add_array(bvh.nodes);
+	hash.add_array(bvh.wide_nodes);
+
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	header.version = Version;
+	header.node_bytes = sizeof(Node);
+	header.wide_node_bytes = sizeof(BVH_Wide_Node);
+	header.key = key;
+	header.triangles = bvh.primitives.size();
+	header.root_idx = bvh.root_idx;
+	header.checksum = hash.value();
+
+	//written to a temporary file, then renamed, so readers never see a partial entry:
+	// (the temporary's name is per-thread, since two meshes with the same key may be stored at once)
+	std::filesystem::path file = path(key);
+	std::filesystem::path temporary = file;
+	temporary += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+	std::error_code ec;
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		if (out) {
+			write(out, Header_fourcc, &header, 1);
+			write(out, Order_fourcc, order.data(), order.size());
+			write(out, Nodes_fourcc, bvh.nodes.data(), bvh.nodes.size());
+			write(out, Wide_fourcc, bvh.wide_nodes.data(), bvh.wide_nodes.size());
+		}
+		if (!out) {
+			warn("Failed to write BVH cache entry '%s'.", temporary.string().c_str());
+			out.close();
+			std::filesystem::remove(temporary, ec);
+			return;
+		}
+	}
+	std::filesystem::rename(temporary, file, ec);
+	if (ec) {
+		warn("Failed to write BVH cache entry '%s': %s", file.string().c_str(), ec.message().c_str());
+		std::filesystem::remove(temporary, ec);
+		return;
+	}
+	stored += 1;
+
+	evict();
+}
+
+void BVH_Cache::evict() {
+	std::lock_guard<std::mutex> lock(evict_mut);
+
+	struct Entry {
+		std::filesystem::file_time_type used;
+		uint64_t bytes;
+		std::filesystem::path path;
+	};
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+	std::error_code ec;
+	for (auto const& item : std::filesystem::directory_iterator(dir, ec)) {
+		if (!item.is_regular_file(ec) || item.path().extension() != Extension) continue;
+		Entry entry{item.last_write_time(ec), item.file_size(ec), item.path()};
+		if (ec) continue;
+		total += entry.bytes;
+		entries.emplace_back(std::move(entry));
+	}
+	if (total <= max_bytes) return;
+
+	//least recently used first:
+	std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) { return a.used < b.used; });
+	for (auto const& entry : entries) {
+		if (total <= max_bytes) break;
+		if (std::filesystem::remove(entry.path, ec)) {
+			total -= entry.bytes;
+			evicted += 1;
+		}
+	}
+}
+
+BVH_Cache::Counts BVH_Cache::counts() const {
+	Counts ret;
+	ret.loaded = loaded;
+	ret.stored = stored;
+	ret.rejected = rejected;
+	ret.evicted = evicted;
+	return ret;
+}
+
+std::filesystem::path const& BVH_Cache::directory() const {
+	return dir;
+}
+
+} // namespace PT
@@ -0,0 +1,59 @@
+
+#pragma once
+
+#include "tri_mesh.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace PT {
+
+//A BVH_Cache keeps built triangle BVHs (their nodes, and the order they put their triangles in) on disk, so a
+// mesh that hasn't changed doesn't need its BVH rebuilt every time a scene is opened or rendered.
+//Entries are keyed by a hash of the mesh's data and the options its BVH is built with, one file per entry;
+// each chunk is read straight into the vector it fills, checked before they are used (an entry that fails is deleted and
+// rebuilt), and the least recently used are evicted once the directory holds more than max_bytes.
+class BVH_Cache {
+public:
+	explicit BVH_Cache(std::filesystem::path directory, uint64_t max_bytes = Default_Max_Bytes);
+
+	static constexpr uint64_t Default_Max_Bytes = 2ull << 30;
+
+	//key of the BVH Tri_Mesh builds over mesh (in format) with opts:
+	static uint64_t key(Indexed_Mesh const& mesh, Tri_Mesh::Vertex_Format format, BVH_Build_Opts const& opts);
+
+	//if there is a valid entry for key (for exactly these triangles, in the order Tri_Mesh makes them), moves
+	// the triangles into bvh in the entry's order, sets its nodes, and returns true; otherwise leaves both alone:
+	bool load(uint64_t key, std::vector<Triangle>& triangles, BVH<Triangle>& bvh);
+	//save bvh (built with BVH_Build_Opts::order set to 'order') as key's entry, then evict entries over max_bytes:
+	// (failing to write is not an error; the BVH just isn't cached)
+	void store(uint64_t key, BVH<Triangle> const& bvh, std::vector<uint32_t> const& order);
+
+	struct Counts {
+		uint32_t loaded = 0; //entries used
+		uint32_t stored = 0; //entries written (after a miss)
+		uint32_t rejected = 0; //entries that failed their checks on load (and were deleted)
+		uint32_t evicted = 0;
+	};
+	Counts counts() const;
+
+	std::filesystem::path const& directory() const;
+
+	//the cache every Tri_Mesh built with a BVH uses (so Pathtracer::build_scene and Scene::build_collision both
+	// do); nullptr == no caching (the default; see --bvh-cache):
+	static BVH_Cache* shared;
+
+private:
+	std::filesystem::path path(uint64_t key) const;
+	void evict();
+
+	std::filesystem::path dir;
+	uint64_t max_bytes;
+	std::mutex evict_mut; //(one eviction pass at a time)
+	std::atomic<uint32_t> loaded = 0, stored = 0, rejected = 0, evicted = 0;
+};
+
+} // namespace PT
@@ -0,0 +1,150 @@
+
+#include "checkpoint.h"
+
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace PT {
+
+// checkpoints are a sequence of chunks that look like:
+// FFFFBBBBDDD...DDD
+//  FFFF: four-byte chunk label
+//  BBBB: four-byte count of bytes (little-endian unsigned integer)
+//  DD...DDD: BBBB-byte array of data
+// (the same layout the s3ds scene format uses)
+
+namespace {
+
+constexpr char Header_fourcc[4] = {'p','t','c','k'};
+constexpr uint32_t Version = 2;
+struct Header {
+	uint32_t version;
+	uint32_t width, height, samples, max_ray_depth;
+	uint32_t seed;
+	uint32_t tile_size;
+	uint8_t sequence, integrator;
+	uint8_t padding[2];
+};
+static_assert(sizeof(Header) == 8*4, "Header is packed.");
+
+constexpr char Tiles_fourcc[4] = {'t','l','s','0'};
+constexpr char Accumulator_fourcc[4] = {'a','c','c','0'};
+constexpr char Samples_fourcc[4] = {'s','m','p','0'};
+constexpr char Moments_fourcc[4] = {'m','o','m','0'};
+
+template<typename T>
+void write(std::ostream& out, const char (&fourcc)[4], std::vector<T> const& data) {
+	if (size_t(uint32_t(data.size() * sizeof(T))) != data.size() * sizeof(T)) {
+		throw std::runtime_error("Too much data for '" + std::string(fourcc,4) + "' chunk.");
+	}
+
+	out.write(fourcc, 4);
+
+	uint32_t bytes = static_cast<uint32_t>(data.size() * sizeof(T));
+	out.write(reinterpret_cast<const char*>(&bytes), 4);
+
+	out.write(reinterpret_cast<const char*>(data.data()), bytes);
+}
+
+template<typename T> void read(std::istream& in, const char (&fourcc)[4], std::vector<T>* data_) {
+	assert(data_);
+	auto& data = *data_;
+	data.clear();
+
+	struct {
+		char fourcc[4];
+		uint32_t bytes;
+	} header;
+	if (!in.read(reinterpret_cast< char * >(&header), sizeof(header))) throw std::runtime_error("Out of bytes reading header of '" + std::string(fourcc,4) + "' chunk.");
+	if (std::memcmp(header.fourcc, fourcc, 4) != 0) throw std::runtime_error("Expected '" + std::string(fourcc,4) + "' chunk, but read '" + std::string(header.fourcc,4) + "' chunk.");
+
+	if (header.bytes % sizeof(T) != 0) throw std::runtime_error( "Bytes in '" + std::string(fourcc,4) + "' chunk (" + std::to_string(header.bytes) + ") is not a multiple of type size (" + std::to_string(sizeof(T)) + ").");
+
+	data.resize(header.bytes / sizeof(T));
+
+	if (!in.read(reinterpret_cast<char*>(data.data()), sizeof(T) * data.size())) throw std::runtime_error("Out of bytes reading data of '" + std::string(fourcc,4) + "' chunk.");
+}
+
+} // namespace
+
+bool Checkpoint::same_render(Checkpoint const &other) const {
+	return width == other.width && height == other.height && samples == other.samples
+	    && max_ray_depth == other.max_ray_depth && seed == other.seed && tile_size == other.tile_size
+	    && sequence == other.sequence && integrator == other.integrator && tiles_done.size() == other.tiles_done.size();
+}
+
+void Checkpoint::reset(uint32_t w, uint32_t h, uint32_t tiles) {
+	width = w;
+	height = h;
+	tiles_done.assign(tiles, 0);
+	accumulator.assign(size_t(w) * h, {0, 0, 0});
+	accumulator_samples.assign(size_t(w) * h, 0);
+	accumulator_moments.assign(size_t(w) * h, 0);
+}
+
+void Checkpoint::save(std::string const &path) const {
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		if (!out) throw std::runtime_error("Failed to open '" + temporary + "' for writing.");
+
+		Header header;
+		std::memset(&header, 0, sizeof(header));
+		header.version = Version;
+		header.width = width;
+		header.height = height;
+		header.samples = samples;
+		header.max_ray_depth = max_ray_depth;
+		header.seed = seed;
+		header.tile_size = tile_size;
+		header.sequence = sequence;
+		header.integrator = integrator;
+		write(out, Header_fourcc, std::vector< Header >{header});
+
+		write(out, Tiles_fourcc, tiles_done);
+		write(out, Accumulator_fourcc, accumulator);
+		write(out, Samples_fourcc, accumulator_samples);
+		write(out, Moments_fourcc, accumulator_moments);
+
+		if (!out) throw std::runtime_error("Failed to write '" + temporary + "'.");
+	}
+	std::error_code ec;
+	std::filesystem::rename(temporary, path, ec);
+	if (ec) throw std::runtime_error("Failed to replace '" + path + "': " + ec.message());
+}
+
+Checkpoint Checkpoint::load(std::string const &path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) throw std::runtime_error("Failed to open '" + path + "' for reading.");
+
+	std::vector< Header > header;
+	read(in, Header_fourcc, &header);
+	if (header.size() != 1) throw std::runtime_error("Expected one checkpoint header, got " + std::to_string(header.size()) + ".");
+	if (header[0].version != Version) throw std::runtime_error("Unsupported checkpoint version " + std::to_string(header[0].version) + ".");
+
+	Checkpoint ret;
+	ret.width = header[0].width;
+	ret.height = header[0].height;
+	ret.samples = header[0].samples;
+	ret.max_ray_depth = header[0].max_ray_depth;
+	ret.seed = header[0].seed;
+	ret.tile_size = header[0].tile_size;
+	ret.sequence = header[0].sequence;
+	ret.integrator = header[0].integrator;
+
+	read(in, Tiles_fourcc, &ret.tiles_done);
+	read(in, Accumulator_fourcc, &ret.accumulator);
+	read(in, Samples_fourcc, &ret.accumulator_samples);
+	read(in, Moments_fourcc, &ret.accumulator_moments);
+
+	size_t pixels = size_t(ret.width) * ret.height;
+	if (ret.accumulator.size() != pixels || ret.accumulator_samples.size() != pixels || ret.accumulator_moments.size() != pixels) {
+		throw std::runtime_error("Checkpoint sums don't match its " + std::to_string(ret.width) + "x" + std::to_string(ret.height) + " film.");
+	}
+	return ret;
+}
+
+} // namespace PT
@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PT {
+
+//A Checkpoint is the progress of a path-traced render, as saved to (and resumed from) disk:
+// the settings that decide which tiles the render traces and what they add (so a resumed render can check
+// it is the same render), which of those tiles are done, and what they added to the accumulator.
+//Since the accumulator is fixed point, the sums don't depend on the order tiles were added in, and a render
+// resumed from a checkpoint gives the same image as one that was never interrupted.
+struct Checkpoint {
+	uint32_t width = 0, height = 0, samples = 0, max_ray_depth = 0;
+	uint32_t seed = 0; //seed of the stream the tiles' seeds (and the sample sequences) come from
+	uint32_t tile_size = 0; //pixels on a side of the tiles (which depends on the threads it was rendered with)
+	uint8_t sequence = 0, integrator = 0; //(RNG::Sequence, Pathtracer::Integrator)
+
+	std::vector< uint8_t > tiles_done; //per tile, in the order render() makes them: 1 if its samples are in the sums
+	std::vector< std::array< int64_t, 3 > > accumulator; //per pixel: sum of samples (40.24 fixed point)
+	std::vector< uint32_t > accumulator_samples; //per pixel: count of samples
+	std::vector< int64_t > accumulator_moments; //per pixel: sum of squared sample luminances (48.16 fixed point)
+
+	//was other made with the same settings (and seed), so that their tiles are the same?
+	bool same_render(Checkpoint const &other) const;
+
+	//(zeroed) sums for a w x h film:
+	void reset(uint32_t w, uint32_t h, uint32_t tiles);
+
+	//write to a file; goes through a temporary file, so a save that is interrupted leaves the last checkpoint intact:
+	// throws on error
+	void save(std::string const &path) const;
+	//read from a file; throws on error:
+	static Checkpoint load(std::string const &path);
+};
+
+} // namespace PT
@@ -12,35 +12,123 @@
 
 namespace PT {
 
+//An affine transform, stored as the top three rows of its Mat4 (the bottom row of which is always 0 0 0 1):
+// 48 bytes instead of 64, and applying it to a point needs no divide.
+struct Affine {
+	Affine() = default;
+	explicit Affine(const Mat4& M) {
+		for (uint32_t i = 0; i < 4; ++i) cols[i] = M.cols[i].xyz();
+	}
+
+	Mat4 to_mat4() const {
+		return Mat4{Vec4(cols[0], 0.0f), Vec4(cols[1], 0.0f), Vec4(cols[2], 0.0f), Vec4(cols[3], 1.0f)};
+	}
+
+	Vec3 operator*(Vec3 p) const {
+		return p.x * cols[0] + p.y * cols[1] + p.z * cols[2] + cols[3];
+	}
+	Vec3 rotate(Vec3 v) const {
+		return v.x * cols[0] + v.y * cols[1] + v.z * cols[2];
+	}
+	//applies the transpose of the linear part; for the inverse of T, this is T's normal matrix:
+	Vec3 rotate_transposed(Vec3 v) const {
+		return Vec3{dot(cols[0], v), dot(cols[1], v), dot(cols[2], v)};
+	}
+
+	Affine inverse() const {
+		//rows of the inverse of the linear part are the cross products of its columns, over its determinant:
+		Vec3 r0 = cross(cols[1], cols[2]), r1 = cross(cols[2], cols[0]), r2 = cross(cols[0], cols[1]);
+		float inv_det = 1.0f / dot(cols[0], r0);
+		r0 *= inv_det;
+		r1 *= inv_det;
+		r2 *= inv_det;
+		Affine ret;
+		ret.cols[0] = Vec3{r0.x, r1.x, r2.x};
+		ret.cols[1] = Vec3{r0.y, r1.y, r2.y};
+		ret.cols[2] = Vec3{r0.z, r1.z, r2.z};
+		ret.cols[3] = -ret.rotate(cols[3]);
+		return ret;
+	}
+
+	Vec3 cols[4];
+};
+
 class Instance {
 public:
-	Instance(Shape const * shape, Material* material, const Mat4& T)
-		: T(T), iT(T.inverse()), material(material), geometry(shape) {
-		has_transform = T != Mat4::I;
+	Instance(Shape const * shape, Shading_Material const * material, const Mat4& T)
+		: T(T), material(material), geometry(shape) {
+		classify();
 	}
-	Instance(Tri_Mesh const * mesh, Material* material, const Mat4& T)
-		: T(T), iT(T.inverse()), material(material), geometry(mesh) {
-		has_transform = T != Mat4::I;
+	Instance(Tri_Mesh const * mesh, Shading_Material const * material, const Mat4& T)
+		: T(T), material(material), geometry(mesh) {
+		classify();
+	}
+
+	//what the transform does, so the common cases (particles are all translated and uniformly scaled) can skip
+	// the general matrix math:
+	enum class Transform_Kind : uint8_t {
+		Identity,
+		Translate_Scale, //p * s + t, with s > 0 (T.cols[0].x is s, T.cols[3] is t; iT.cols[0].x is 1 / s)
+		General,
+	};
+	Transform_Kind transform_kind() const {
+		return kind;
 	}
 
 	BBox bbox() const {
 		auto box = std::visit([](const auto& g) { return g->bbox(); }, geometry);
-		if (has_transform) box.transform(T);
+		if (kind == Transform_Kind::Translate_Scale) {
+			if (!box.empty()) box = BBox(box.min * T.cols[0].x + T.cols[3], box.max * T.cols[0].x + T.cols[3]);
+		} else if (kind == Transform_Kind::General) {
+			box.transform(T.to_mat4());
+		}
 		return box;
 	}
 
-	Trace hit(Ray ray) const {
-		if (has_transform) ray.transform(iT);
-		auto trace = std::visit([&](const auto& g) { return g->hit(ray); }, geometry);
-		if (trace.hit) {
-			trace.material = material;
-			if (has_transform) trace.transform(T, iT.T());
+	Trace hit(const Ray& ray) const {
+		Hit hit;
+		if (!intersect(ray, hit)) return Trace{};
+		return finalize(ray, hit);
+	}
+
+	//closest hit within ray.dist_bounds, as a minimal record (see Hit); leaves hit alone and returns false if there is none:
+	// (hit.t stays a distance along ray; the transform to world space is left to finalize)
+	bool intersect(Ray ray, Hit& hit) const {
+		float scale = to_local(ray);
+		if (!std::visit([&](const auto& g) { return g->intersect(ray, hit); }, geometry)) return false;
+		hit.t /= scale;
+		hit.instance = this;
+		return true;
+	}
+
+	//surface attributes of a hit recorded by intersect() (on the instance the hit names):
+	static Trace finalize(Ray ray, Hit hit) {
+		const Instance& instance = *hit.instance;
+		hit.t *= instance.to_local(ray);
+		Trace trace = std::visit([&](const auto& g) { return g->finalize(ray, hit); }, instance.geometry);
+		trace.material = instance.material;
+		if (instance.kind == Transform_Kind::Translate_Scale) {
+			//(a uniform scale leaves normals alone)
+			float s = instance.T.cols[0].x;
+			trace.position = trace.position * s + instance.T.cols[3];
+			trace.origin = trace.origin * s + instance.T.cols[3];
+			trace.distance *= s;
+		} else if (instance.kind == Transform_Kind::General) {
+			trace.position = instance.T * trace.position;
+			trace.origin = instance.T * trace.origin;
+			trace.normal = instance.iT.rotate_transposed(trace.normal).unit();
+			trace.distance = (trace.position - trace.origin).norm();
 		}
 		return trace;
 	}
 
+	bool occluded(Ray ray) const {
+		to_local(ray);
+		return std::visit([&](const auto& g) { return g->occluded(ray); }, geometry);
+	}
+
 	uint32_t visualize(GL::Lines& lines, GL::Lines& active, uint32_t level, Mat4 vtrans) const {
-		if (has_transform) vtrans = vtrans * T;
+		if (kind != Transform_Kind::Identity) vtrans = vtrans * T.to_mat4();
 		return std::visit(overloaded{[&](const Tri_Mesh* mesh) {
 										 return mesh->visualize(lines, active, level, vtrans);
 									 },
@@ -49,25 +137,62 @@ public:
 	}
 
 	Vec3 sample(RNG &rng, Vec3 from) const {
-		if (has_transform) from = iT * from;
+		if (kind != Transform_Kind::Identity) from = iT * from;
 		auto dir = std::visit([&](const auto& g) { return g->sample(rng, from); }, geometry);
-		if (has_transform) dir = T.rotate(dir).unit();
+		if (kind == Transform_Kind::General) dir = T.rotate(dir).unit();
 		return dir;
 	}
 
 	float pdf(Ray ray, Mat4 pdf_T = Mat4::I, Mat4 pdf_iT = Mat4::I) const {
-		if (has_transform) {
-			pdf_T = pdf_T * T;
-			pdf_iT = iT * pdf_iT;
+		if (kind != Transform_Kind::Identity) {
+			pdf_T = pdf_T * T.to_mat4();
+			pdf_iT = iT.to_mat4() * pdf_iT;
 		}
 		return std::visit([&](const auto& g) { return g->pdf(ray, pdf_T, pdf_iT); }, geometry);
 	}
 
 private:
-	Mat4 T, iT;
-	bool has_transform = false;
+	//moves ray into the instance's local space (as Ray::transform(iT) does), returning how much that scaled distances:
+	// (rays are unit length, so a uniform scale only scales their origin and bounds)
+	float to_local(Ray& ray) const {
+		if (kind == Transform_Kind::Identity) return 1.0f;
+		if (kind == Transform_Kind::Translate_Scale) {
+			float inv_s = iT.cols[0].x;
+			ray.point = ray.point * inv_s + iT.cols[3];
+			ray.dist_bounds *= inv_s;
+			return inv_s;
+		}
+		ray.point = iT * ray.point;
+		ray.dir = iT.rotate(ray.dir);
+		float d = ray.dir.norm();
+		ray.dist_bounds *= d;
+		ray.dir /= d;
+		return d;
+	}
+
+	void classify() {
+		iT = T.inverse();
+		Vec3 x = T.cols[0], y = T.cols[1], z = T.cols[2];
+		if (x == Vec3{1.0f, 0.0f, 0.0f} && y == Vec3{0.0f, 1.0f, 0.0f} && z == Vec3{0.0f, 0.0f, 1.0f}
+		    && T.cols[3] == Vec3{}) {
+			kind = Transform_Kind::Identity;
+		} else if (x.x > 0.0f && x == Vec3{x.x, 0.0f, 0.0f} && y == Vec3{0.0f, x.x, 0.0f} && z == Vec3{0.0f, 0.0f, x.x}) {
+			kind = Transform_Kind::Translate_Scale;
+			//(exactly, rather than through the general inverse)
+			float inv_s = 1.0f / x.x;
+			iT.cols[0] = Vec3{inv_s, 0.0f, 0.0f};
+			iT.cols[1] = Vec3{0.0f, inv_s, 0.0f};
+			iT.cols[2] = Vec3{0.0f, 0.0f, inv_s};
+			iT.cols[3] = -T.cols[3] * inv_s;
+		} else {
+			kind = Transform_Kind::General;
+		}
+	}
+
+	Affine T, iT;
+	Transform_Kind kind = Transform_Kind::Identity;
 
-	const Material* material = nullptr;
+	const Shading_Material* material = nullptr;
 	std::variant<const Shape*, const Tri_Mesh*> geometry;
 };
 
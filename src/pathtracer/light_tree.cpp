@@ -0,0 +1,304 @@
+
+#include "light_tree.h"
+#include "samplers.h"
+#include "shading_material.h"
+
+#include "../util/rand.h"
+
+#include <numeric>
+
+namespace PT {
+
+void Light_Bounds::enclose(const Light_Bounds& other) {
+	if (other.box.empty()) return;
+	if (box.empty()) {
+		*this = other;
+		return;
+	}
+	box.enclose(other.box);
+	power += other.power;
+
+	//union of the two normal cones (a is the wider one):
+	Vec3 a = axis, b = other.axis;
+	float theta_a = theta, theta_b = other.theta;
+	if (theta_b > theta_a) {
+		std::swap(a, b);
+		std::swap(theta_a, theta_b);
+	}
+	float theta_d = std::acos(std::clamp(dot(a, b), -1.0f, 1.0f));
+	if (std::min(theta_d + theta_b, PI_F) <= theta_a) {
+		axis = a;
+		theta = theta_a;
+		return;
+	}
+	float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+	Vec3 perp = b - dot(a, b) * a;
+	float perp_len = perp.norm();
+	if (theta_o >= PI_F || perp_len < 1e-6f) {
+		axis = a;
+		theta = PI_F;
+		return;
+	}
+	//rotate a toward b until the new cone just contains both:
+	float theta_r = theta_o - theta_a;
+	axis = (std::cos(theta_r) * a + std::sin(theta_r) * (perp / perp_len)).unit();
+	theta = theta_o;
+}
+
+float Light_Bounds::importance(Vec3 from) const {
+	if (power <= 0.0f) return 0.0f;
+
+	Vec3 to = from - box.center();
+	float dist2 = to.norm_squared();
+	float radius2 = 0.25f * (box.max - box.min).norm_squared();
+	//inside the bounding sphere, nothing bounds the angles:
+	if (dist2 <= radius2) return power / std::max(radius2, EPS_F);
+
+	float dist = std::sqrt(dist2);
+	//angle from the cone's axis to 'from' (folded, since emitters are two-sided),
+	// less the cone's spread and the angle the bounding sphere subtends:
+	float theta_d = std::acos(std::min(std::abs(dot(axis, to)) / dist, 1.0f));
+	float theta_u = std::asin(std::sqrt(radius2) / dist);
+	float theta_p = std::max(theta_d - theta - theta_u, 0.0f);
+	return power * std::cos(theta_p) / dist2;
+}
+
+template<typename Emitter> Light_Tree<Emitter>::Light_Tree(std::vector<Emitter>&& emitters_) {
+	build(std::move(emitters_));
+}
+
+template<typename Emitter> void Light_Tree<Emitter>::build(std::vector<Emitter>&& emitters_) {
+	nodes.clear();
+	emitters = std::move(emitters_);
+	if (emitters.empty()) return;
+
+	std::vector<Light_Bounds> bounds;
+	bounds.reserve(emitters.size());
+	float total = 0.0f;
+	for (auto const& emitter : emitters) {
+		bounds.emplace_back(emitter.bounds());
+		total += bounds.back().power;
+	}
+	//a power estimate of zero (say, from a dark spot of an emission texture) shouldn't make an emitter impossible to sample:
+	float min_power = 1e-3f * total / emitters.size();
+	for (auto& b : bounds) b.power = std::max(b.power, min_power);
+
+	std::vector<uint32_t> order(emitters.size());
+	std::iota(order.begin(), order.end(), 0u);
+	nodes.reserve(2 * emitters.size() - 1);
+	build_node(order, bounds, 0, order.size());
+}
+
+template<typename Emitter>
+uint32_t Light_Tree<Emitter>::build_node(std::vector<uint32_t>& order, std::vector<Light_Bounds> const& bounds, size_t begin, size_t end) {
+	uint32_t index = uint32_t(nodes.size());
+	nodes.emplace_back();
+
+	if (end - begin == 1) {
+		nodes[index].bounds = bounds[order[begin]];
+		nodes[index].emitter = order[begin];
+		return index;
+	}
+
+	//split at the median centroid along the axis the centroids spread furthest in:
+	// (so the tree is balanced, and walking it is O(log N) however the emitters are arranged)
+	BBox centroids;
+	for (size_t i = begin; i < end; ++i) centroids.enclose(bounds[order[i]].box.center());
+	Vec3 extent = centroids.max - centroids.min;
+	uint32_t axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	size_t mid = (begin + end) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+		return bounds[a].box.center()[axis] < bounds[b].box.center()[axis];
+	});
+
+	build_node(order, bounds, begin, mid);
+	uint32_t right = build_node(order, bounds, mid, end);
+
+	Light_Bounds node_bounds = nodes[index + 1].bounds;
+	node_bounds.enclose(nodes[right].bounds);
+	nodes[index].bounds = node_bounds;
+	nodes[index].right = right;
+	return index;
+}
+
+template<typename Emitter> float Light_Tree<Emitter>::left_probability(const Node& node, Vec3 from) const {
+	float l = (&node + 1)->bounds.importance(from);
+	float r = nodes[node.right].bounds.importance(from);
+	if (l + r <= 0.0f) return 0.5f;
+	return l / (l + r);
+}
+
+template<typename Emitter> Vec3 Light_Tree<Emitter>::sample(RNG &rng, Vec3 from) const {
+	if (nodes.empty()) return {};
+	const Node* node = &nodes[0];
+	while (node->right) {
+		node = rng.coin_flip(left_probability(*node, from)) ? node + 1 : &nodes[node->right];
+	}
+	return emitters[node->emitter].sample(rng, from);
+}
+
+template<typename Emitter> float Light_Tree<Emitter>::pdf(Ray ray, const Mat4& T) const {
+	if (nodes.empty()) return 0.0f;
+
+	//only emitters along the ray contribute, so only walk the subtrees the ray passes through,
+	// carrying the probability of sample() choosing each node:
+	// (the tree is balanced, so its depth -- and this stack -- stay small)
+	std::pair<uint32_t, float> stack[64];
+	uint32_t top = 0;
+	stack[top++] = {0u, 1.0f};
+
+	float ret = 0.0f;
+	while (top) {
+		auto [index, prob] = stack[--top];
+		const Node& node = nodes[index];
+		Vec2 times = ray.dist_bounds;
+		if (!node.bounds.box.hit(ray, times)) continue;
+
+		if (!node.right) {
+			ret += prob * emitters[node.emitter].pdf(ray, T);
+			continue;
+		}
+		float p_l = left_probability(node, ray.point);
+		if (p_l > 0.0f) stack[top++] = {index + 1, prob * p_l};
+		if (p_l < 1.0f) stack[top++] = {node.right, prob * (1.0f - p_l)};
+	}
+	return ret;
+}
+
+template<typename Emitter> Light_Bounds Light_Tree<Emitter>::bounds() const {
+	if (nodes.empty()) return {};
+	return nodes[0].bounds;
+}
+
+template<typename Emitter> size_t Light_Tree<Emitter>::n_emitters() const {
+	return emitters.size();
+}
+
+template<typename Emitter> bool Light_Tree<Emitter>::empty() const {
+	return emitters.empty();
+}
+
+template<typename Emitter> void Light_Tree<Emitter>::clear() {
+	nodes.clear();
+	emitters.clear();
+}
+
+Emissive_Triangle::Emissive_Triangle(Vec3 v0, Vec3 v1, Vec3 v2, float emission)
+	: p0(v0), e1(v1 - v0), e2(v2 - v0), emission(emission) {
+}
+
+Light_Bounds Emissive_Triangle::bounds() const {
+	Light_Bounds ret;
+	ret.box.enclose(p0);
+	ret.box.enclose(p0 + e1);
+	ret.box.enclose(p0 + e2);
+	Vec3 n = cross(e1, e2);
+	float n_len = n.norm();
+	if (n_len > 0.0f) ret.axis = n / n_len;
+	ret.theta = 0.0f;
+	ret.power = emission * 0.5f * n_len;
+	return ret;
+}
+
+Vec3 Emissive_Triangle::sample(RNG &rng, Vec3 from) const {
+	Samplers::Triangle sampler(p0, p0 + e1, p0 + e2);
+	return (sampler.sample(rng) - from).unit();
+}
+
+float Emissive_Triangle::pdf(Ray ray, const Mat4& T) const {
+	// Moller-Trumbore, as in Triangle::intersect:
+	Vec3 p = cross(ray.dir, e2);
+	float det = dot(e1, p);
+	if (det == 0.0f) return 0.0f;
+	float inv_det = 1.0f / det;
+	Vec3 s = ray.point - p0;
+	float u = dot(s, p) * inv_det;
+	if (u < 0.0f || u > 1.0f) return 0.0f;
+	Vec3 q = cross(s, e1);
+	float v = dot(ray.dir, q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f) return 0.0f;
+	float t = dot(e2, q) * inv_det;
+	if (t < ray.dist_bounds.x || t > ray.dist_bounds.y) return 0.0f;
+
+	//area density -> solid angle density, measured in world space:
+	Vec3 to = T * ray.at(t) - T * ray.point;
+	Vec3 n = cross(T.rotate(e1), T.rotate(e2));
+	float n_len = n.norm();
+	float dist2 = to.norm_squared();
+	float cos_theta = std::abs(dot(n, to)) / (n_len * std::sqrt(dist2));
+	if (n_len == 0.0f || !(cos_theta > 0.0f)) return 0.0f;
+	return dist2 / (0.5f * n_len * cos_theta);
+}
+
+std::vector<Emissive_Triangle> Emissive_Triangle::from_mesh(const Tri_Mesh& mesh, const Shading_Material& material) {
+	std::vector<Emissive_Triangle> ret;
+	ret.reserve(mesh.n_triangles());
+	for (auto const& tri : mesh.triangles()) {
+		Tri_Mesh_Vert a = mesh.vertex(tri, 0), b = mesh.vertex(tri, 1), c = mesh.vertex(tri, 2);
+		//(the tree only needs a rough idea of each triangle's power, so look up emission at the corners and center)
+		float emission = material.emission(a.uv).luma() + material.emission(b.uv).luma() +
+		                 material.emission(c.uv).luma() + material.emission((a.uv + b.uv + c.uv) / 3.0f).luma();
+		ret.emplace_back(a.position, b.position, c.position, 0.25f * emission);
+	}
+	return ret;
+}
+
+//do angles survive T? (i.e., is T rotation, uniform scale, and translation only)
+static bool is_similarity(const Mat4& T) {
+	Vec3 x = T[0].xyz(), y = T[1].xyz(), z = T[2].xyz();
+	float s = x.norm_squared();
+	float tolerance = 1e-4f * s;
+	return std::abs(y.norm_squared() - s) <= tolerance && std::abs(z.norm_squared() - s) <= tolerance &&
+	       std::abs(dot(x, y)) <= tolerance && std::abs(dot(y, z)) <= tolerance && std::abs(dot(z, x)) <= tolerance;
+}
+
+Area_Light::Area_Light(Shape const* shape_, Shading_Material const* material, const Mat4& T)
+	: T(T), iT(T.inverse()) {
+	has_transform = T != Mat4::I;
+	shape.emplace(shape_, material, T);
+
+	float area = std::visit([](const Shapes::Sphere& sphere) { return 4.0f * PI_F * sphere.radius * sphere.radius; },
+	                        shape_->shape);
+	float scale = std::cbrt(std::abs(T.det()));
+	world_bounds.box = shape->bbox();
+	world_bounds.theta = PI_F; //(faces every way)
+	world_bounds.power = material->emission(Vec2{0.5f, 0.5f}).luma() * area * scale * scale;
+}
+
+Area_Light::Area_Light(Light_Tree<Emissive_Triangle> const* triangles, const Mat4& T)
+	: T(T), iT(T.inverse()), triangles(triangles) {
+	has_transform = T != Mat4::I;
+
+	Light_Bounds local = triangles->bounds();
+	float scale = std::cbrt(std::abs(T.det()));
+	world_bounds.box = local.box;
+	if (has_transform) world_bounds.box.transform(T);
+	//normals transform by the inverse transpose, and only keep their angles under similarity transforms:
+	world_bounds.axis = iT.T().rotate(local.axis).unit();
+	world_bounds.theta = is_similarity(T) ? local.theta : PI_F;
+	world_bounds.power = local.power * scale * scale;
+}
+
+Light_Bounds Area_Light::bounds() const {
+	return world_bounds;
+}
+
+Vec3 Area_Light::sample(RNG &rng, Vec3 from) const {
+	if (shape) return shape->sample(rng, from);
+	if (has_transform) from = iT * from;
+	Vec3 dir = triangles->sample(rng, from);
+	if (has_transform) dir = T.rotate(dir).unit();
+	return dir;
+}
+
+float Area_Light::pdf(Ray ray, const Mat4& pdf_T) const {
+	//(shapes also take the inverse; area lights are in world space, so pdf_T is the identity in practice)
+	if (shape) return shape->pdf(ray, pdf_T, pdf_T == Mat4::I ? Mat4::I : pdf_T.inverse());
+	if (has_transform) ray.transform(iT);
+	return triangles->pdf(ray, pdf_T * T);
+}
+
+template class Light_Tree<Emissive_Triangle>;
+template class Light_Tree<Area_Light>;
+
+} // namespace PT
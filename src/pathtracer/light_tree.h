@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../lib/mathlib.h"
+
+#include <optional>
+
+#include "instance.h"
+#include "tri_mesh.h"
+
+struct RNG;
+
+namespace PT {
+
+//Bounds on a group of emitters: where they are (box), which way they face (a cone of normals
+// around axis with half-angle theta; emitters are two-sided), and how much power they emit.
+struct Light_Bounds {
+	BBox box;
+	Vec3 axis = Vec3{0.0f, 1.0f, 0.0f};
+	float theta = 0.0f;
+	float power = 0.0f;
+
+	void enclose(const Light_Bounds& other);
+
+	//estimate of the light these emitters send toward point 'from':
+	// (conservative in angle, so an emitter that could light 'from' never gets importance zero)
+	float importance(Vec3 from) const;
+};
+
+//Light BVH ("light tree"), after Conty Estevez and Kulla, "Importance Sampling of Many Lights
+// with Adaptive Tree Splitting" (2018). Sampling walks from the root to one emitter, picking
+// each child in proportion to its importance; pdf() retraces the same choices for the emitters
+// along a ray, so both cost O(log N) rather than O(N).
+//Emitter needs: Light_Bounds bounds(), Vec3 sample(RNG&, Vec3 from), float pdf(Ray, T).
+template<typename Emitter> class Light_Tree {
+public:
+	Light_Tree() = default;
+	Light_Tree(std::vector<Emitter>&& emitters);
+	void build(std::vector<Emitter>&& emitters);
+
+	Light_Tree(Light_Tree&& src) = default;
+	Light_Tree& operator=(Light_Tree&& src) = default;
+	Light_Tree(const Light_Tree& src) = delete;
+	Light_Tree& operator=(const Light_Tree& src) = delete;
+
+	//sample a vector pointing to an emitter from point 'from' (all in the tree's space):
+	Vec3 sample(RNG &rng, Vec3 from) const;
+	//density of sample() producing ray.dir from ray.point, as a solid angle measured after transforming by T:
+	// (ray is in the tree's space, so T's inverse isn't needed)
+	float pdf(Ray ray, const Mat4& T = Mat4::I) const;
+
+	Light_Bounds bounds() const;
+	size_t n_emitters() const;
+	bool empty() const;
+	void clear();
+
+private:
+	struct Node {
+		Light_Bounds bounds;
+		//interior nodes: left child is the next node, right child is at 'right'
+		//leaves: right is 0 and 'emitter' is the emitter's index
+		uint32_t right = 0;
+		uint32_t emitter = 0;
+	};
+
+	uint32_t build_node(std::vector<uint32_t>& order, std::vector<Light_Bounds> const& bounds, size_t begin, size_t end);
+	//probability of descending into node's left child when sampling from point 'from':
+	float left_probability(const Node& node, Vec3 from) const;
+
+	std::vector<Node> nodes;
+	std::vector<Emitter> emitters;
+};
+
+//One emissive triangle of a mesh, in mesh space:
+class Emissive_Triangle {
+public:
+	Emissive_Triangle(Vec3 v0, Vec3 v1, Vec3 v2, float emission);
+
+	Light_Bounds bounds() const;
+	Vec3 sample(RNG &rng, Vec3 from) const;
+	float pdf(Ray ray, const Mat4& T) const;
+
+	//emitters for every triangle of mesh, with power estimated from the material's emission:
+	static std::vector<Emissive_Triangle> from_mesh(const Tri_Mesh& mesh, const Shading_Material& material);
+
+private:
+	Vec3 p0, e1, e2;
+	float emission; //(luminance)
+};
+
+//One emissive instance in world space: a shape, or a mesh (sampled through its triangles' light tree).
+class Area_Light {
+public:
+	Area_Light(Shape const* shape, Shading_Material const* material, const Mat4& T);
+	//(emission is already baked into the triangles' power)
+	Area_Light(Light_Tree<Emissive_Triangle> const* triangles, const Mat4& T);
+
+	Light_Bounds bounds() const;
+	Vec3 sample(RNG &rng, Vec3 from) const;
+	float pdf(Ray ray, const Mat4& T) const;
+
+private:
+	Mat4 T, iT;
+	bool has_transform = false;
+	Light_Bounds world_bounds;
+
+	//set for shapes:
+	std::optional<Instance> shape;
+	//set for meshes:
+	Light_Tree<Emissive_Triangle> const* triangles = nullptr;
+};
+
+} // namespace PT
@@ -3,10 +3,13 @@
 
 #include "../lib/mathlib.h"
 #include "../util/rand.h"
+#include "stats.h"
 #include "trace.h"
 
 namespace PT {
 
+class Triangle;
+
 template<typename Primitive> class List {
 public:
 	List() {
@@ -23,12 +26,40 @@ public:
 	}
 
 	Trace hit(const Ray& ray) const {
-		Trace ret;
+		Hit hit;
+		if (!intersect(ray, hit)) return Trace{};
+		return finalize(ray, hit);
+	}
+
+	//closest hit within ray.dist_bounds, as a minimal record (see Hit); leaves hit alone and returns false if there is none:
+	bool intersect(Ray ray, Hit& hit) const {
+		Traversal_Count count;
+		count.tested(prims.size());
+		bool found = false;
+		for (size_t i = 0; i < prims.size(); ++i) {
+			if (prims[i].intersect(ray, hit)) {
+				if constexpr (std::is_same_v<Primitive, Triangle>) hit.prim = uint32_t(i);
+				ray.dist_bounds.y = hit.t;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	//surface attributes of a hit recorded by intersect():
+	Trace finalize(const Ray& ray, const Hit& hit) const {
+		//triangles are found through their index; instances record themselves in the hit:
+		if constexpr (std::is_same_v<Primitive, Triangle>) return prims[hit.prim].finalize(ray, hit);
+		else return Primitive::finalize(ray, hit);
+	}
+
+	bool occluded(const Ray& ray) const {
+		Traversal_Count count;
 		for (const auto& p : prims) {
-			Trace test = p.hit(ray);
-			ret = Trace::min(ret, test);
+			count.tested(1);
+			if (p.occluded(ray)) return true;
 		}
-		return ret;
+		return false;
 	}
 
 	void append(Primitive&& prim) {
@@ -65,6 +96,10 @@ public:
 		return prims.size();
 	}
 
+	const std::vector<Primitive>& primitives() const {
+		return prims;
+	}
+
 private:
 	std::vector<Primitive> prims;
 };
@@ -2,8 +2,12 @@
 #include "pathtracer.h"
 #include "../geometry/util.h"
 #include "../test.h"
+#include "../util/hash.h"
 
 #include <SDL.h>
+#include <algorithm>
+#include <set>
+#include <stdexcept>
 #include <thread>
 
 namespace PT {
@@ -14,6 +18,74 @@ constexpr bool LOG_CAMERA_RAYS = false;
 constexpr bool LOG_AREA_LIGHT_RAYS = false;
 static thread_local RNG log_rng(0x15462662); //separate RNG for logging a fraction of rays to avoid changing result when logging enabled
 
+//every set of ray log buffers gets an id no other set (of any pathtracer) has had:
+static uint64_t new_ray_log_id() {
+	static std::atomic< uint64_t > next_id = 1;
+	return next_id.fetch_add(1);
+}
+
+//build_scene() notices changed resources by fingerprint:
+namespace {
+
+//geometry as Tri_Mesh sees it (the same walk as Indexed_Mesh::from_halfedge_mesh with SplitEdges):
+uint64_t mesh_fingerprint(Halfedge_Mesh const& mesh) {
+	Hash64 hash;
+	for (Halfedge_Mesh::FaceCRef f = mesh.faces.begin(); f != mesh.faces.end(); f++) {
+		if (f->boundary) continue;
+		hash.add(f->id);
+		Halfedge_Mesh::HalfedgeCRef h = f->halfedge;
+		do {
+			Vec3 pos = h->vertex->position;
+			hash.add_array(&pos, 1);
+			hash.add_array(&h->corner_normal, 1);
+			hash.add_array(&h->corner_uv, 1);
+			h = h->next;
+		} while (h != f->halfedge);
+	}
+	return hash.value();
+}
+
+uint64_t mesh_fingerprint(Indexed_Mesh const& mesh) {
+	Hash64 hash;
+	hash.add_array(mesh.vertices());
+	hash.add_array(mesh.indices());
+	return hash.value();
+}
+
+//fingerprint of a (small) resource's introspected fields; textures it refers to are identified by address:
+// (build_scene() separately checks whether those textures changed)
+template< typename T >
+uint64_t resource_fingerprint(T const& resource) {
+	Hash64 hash;
+	introspect< Intent::Read >([&](const char*, auto const& value) {
+		using V = std::decay_t< decltype(value) >;
+		if constexpr (std::is_same_v< V, float >) {
+			hash.add(value);
+		} else if constexpr (std::is_same_v< V, Spectrum >) {
+			hash.add_array(&value, 1);
+		} else if constexpr (std::is_same_v< V, std::string >) {
+			hash.add(uint64_t(value.size()));
+			for (char c : value) hash.add(uint32_t(uint8_t(c)));
+		} else if constexpr (std::is_same_v< V, std::weak_ptr< Texture > >) {
+			hash.add(uint64_t(reinterpret_cast< uintptr_t >(value.lock().get())));
+		} else {
+			static_assert(!sizeof(V), "resource_fingerprint doesn't know how to hash this field type");
+		}
+	}, resource);
+	return hash.value();
+}
+
+//(Texture's operator!= doesn't consider the sampler or the kind of texture)
+bool same_texture(Texture const& a, Texture const& b) {
+	if (a.texture.index() != b.texture.index()) return false;
+	if (auto image = std::get_if< Textures::Image >(&a.texture)) {
+		if (image->sampler != std::get< Textures::Image >(b.texture).sampler) return false;
+	}
+	return !(a != b);
+}
+
+} // namespace
+
 Spectrum Pathtracer::sample_direct_lighting_task4(RNG &rng, const Shading_Info& hit) {
 	//A3T4: Pathtracer - direct light sampling (basic sampling)
 
@@ -81,19 +153,29 @@ Spectrum Pathtracer::sample_indirect_lighting(RNG &rng, const Shading_Info& hit)
 
 std::pair<Spectrum, Spectrum> Pathtracer::trace(RNG &rng, const Ray& ray) {
 
-	Trace result = scene.hit(ray);
+	//(camera rays start at the film's max depth, and every bounce lowers it; depth 0 rays only look for emission)
+	if constexpr (RECORD_STATS) {
+		if (ray.depth == camera.film.max_ray_depth) count_ray(Ray_Kind::Camera);
+		else count_ray(ray.depth == 0 ? Ray_Kind::Shadow : Ray_Kind::Bounce);
+	}
+
+	return shade(rng, ray, compiled->scene->hit(ray));
+}
+
+std::pair<Spectrum, Spectrum> Pathtracer::shade(RNG &rng, const Ray& ray, Trace result) {
+
 	if (!result.hit) {
-		if (env_lights.size()) {
+		if (!compiled->env_emitters.empty()) {
 			Spectrum radiance;
-			for (const auto& light : env_lights) {
-				radiance += light.second->evaluate(ray.dir);
+			for (auto const& emitter : compiled->env_emitters) {
+				radiance += emitter.light->evaluate(ray.dir);
 			}
 			return {radiance, {}};
 		}
 		return {};
 	}
 
-	const Material* bsdf = result.material;
+	const Shading_Material* bsdf = result.material;
 	if (!bsdf) return {};
 
 	if (!bsdf->is_sided() && dot(result.normal, ray.dir) > 0.0f) {
@@ -128,7 +210,7 @@ std::pair<Spectrum, Spectrum> Pathtracer::trace(RNG &rng, const Ray& ray) {
 	return {emissive, direct + sample_indirect_lighting(rng, info)};
 }
 
-Pathtracer::Pathtracer() : thread_pool(std::thread::hardware_concurrency()) {
+Pathtracer::Pathtracer() : thread_pool(std::thread::hardware_concurrency()), ray_log_id(new_ray_log_id()) {
 }
 
 Pathtracer::~Pathtracer() {
@@ -137,6 +219,32 @@ Pathtracer::~Pathtracer() {
 }
 
 void Pathtracer::build_scene(Scene& scene_) {
+	prepared.reset();
+	compile(scene_, *compiled);
+}
+
+void Pathtracer::prepare(Scene& scene_) {
+	//start from the current build, sharing its copies (and scene BVH), so unchanged ones are reused as usual and
+	// changed ones are replaced rather than updated under the tiles still tracing them:
+	prepared = std::make_unique<Compiled_Scene>();
+	prepared->scene = compiled->scene;
+	prepared->mesh_lights = compiled->mesh_lights;
+	prepared->mesh_cache = compiled->mesh_cache;
+	prepared->shape_cache = compiled->shape_cache;
+	prepared->texture_cache = compiled->texture_cache;
+	prepared->material_cache = compiled->material_cache;
+	prepared->env_light_cache = compiled->env_light_cache;
+	prepared->default_texture = compiled->default_texture;
+	prepared->default_material = compiled->default_material;
+	prepared->scene_objects = compiled->scene_objects;
+	prepared->scene_built = compiled->scene_built;
+	prepared->scene_built_with_bvh = compiled->scene_built_with_bvh;
+	prepared->scene_built_wide = compiled->scene_built_wide;
+	prepared_from = &scene_;
+	compile(scene_, *prepared);
+}
+
+void Pathtracer::compile(Scene& scene_, Compiled_Scene& into) {
 
 	// It would be nice to let the interface be usable here (as with
 	// the path-tracing part), but this would cause too much hassle with
@@ -149,64 +257,169 @@ void Pathtracer::build_scene(Scene& scene_) {
 	// We could also do instancing instead of duplicating the bvh
 	// for big meshes, but that's something to add in the future
 
+	// Resources are copied into path tracing formats incrementally: copies of resources that haven't
+	// changed since the last build (see Cached) are reused, as is the scene BVH if no instance moved.
+
+	Timer build_timer;
+	auto& scene = into.scene;
+	auto& emissive_objects = into.emissive_objects;
+	auto& point_lights = into.point_lights;
+	auto& delta_lights = into.delta_lights;
+	auto& env_emitters = into.env_emitters;
+	auto& mesh_lights = into.mesh_lights;
+	auto& mesh_cache = into.mesh_cache;
+	auto& shape_cache = into.shape_cache;
+	auto& texture_cache = into.texture_cache;
+	auto& material_cache = into.material_cache;
+	auto& env_light_cache = into.env_light_cache;
+	auto& default_texture = into.default_texture;
+	auto& default_material = into.default_material;
+	auto& build_stats = into.build_stats;
+	build_stats = Completion_Time{};
+	emissive_objects.clear();
 	delta_lights.clear();
-	env_lights.clear();
-	textures.clear();
-	materials.clear();
-	meshes.clear();
-	shapes.clear();
-
-	std::unordered_map<std::shared_ptr<Halfedge_Mesh>, std::string> mesh_names;
-	std::unordered_map<std::shared_ptr<Skinned_Mesh>, std::string> skinned_mesh_names;
-	std::unordered_map<std::shared_ptr<Shape>, std::string> shape_names;
-	std::unordered_map<std::shared_ptr<Texture>, std::string> texture_names;
-	std::unordered_map<std::shared_ptr<Material>, std::string> material_names;
+	env_emitters.clear();
+
+	//a copy can be updated in place unless another Compiled_Scene (which tiles may be tracing) shares it:
+	// (only this build's own mesh tasks touch these counts meanwhile, each on its own entry)
+	auto unshared = [](auto const& copy) { return copy && copy.use_count() == 1; };
+
+	auto begin_build = [](auto& cache) {
+		for (auto& [key, entry] : cache) {
+			entry.changed = false;
+			entry.used = false;
+		}
+	};
+	//entry for a resource, reset if the address now belongs to a different resource than the cached one:
+	auto entry_for = [](auto& cache, auto const& resource) -> auto& {
+		auto& entry = cache[resource.get()];
+		if (entry.source.lock() != resource) entry = {};
+		entry.source = resource;
+		entry.used = true;
+		return entry;
+	};
+	auto end_build = [](auto& cache) {
+		for (auto it = cache.begin(); it != cache.end();) {
+			if (it->second.used) ++it;
+			else it = cache.erase(it);
+		}
+	};
+	begin_build(mesh_cache);
+	begin_build(shape_cache);
+	begin_build(texture_cache);
+	begin_build(material_cache);
+	begin_build(env_light_cache);
+
 	std::unordered_map<std::shared_ptr<Delta_Light>, std::string> delta_light_names;
-	std::unordered_map<std::shared_ptr<Environment_Light>, std::string> env_light_names;
-	std::string default_texture_name, default_material_name;
 
 	{ // copy scene data into path tracing formats
-		std::vector<std::future<std::pair<std::string, Tri_Mesh>>> mesh_futs;
+		Timer meshes_timer;
+
+		//meshes are fingerprinted (and, if changed, converted) in parallel; each task has its own cache entry:
+		// (entries are all made before any task runs, and unordered_map doesn't move its elements)
+		std::vector<std::function<void()>> mesh_tasks;
+		Thread_Pool::Group mesh_group;
+		auto update_mesh = [this,&unshared](Cached<void, Tri_Mesh>& entry, uint64_t fingerprint, auto&& make_indexed) {
+			//(a mesh built without a BVH, or in another format or BVH width, needs rebuilding if one is wanted now)
+			fingerprint ^= uint64_t(scene_use_bvh) | (uint64_t(mesh_format) << 1) | (uint64_t(scene_wide_bvh) << 9);
+			if (entry.copy && entry.fingerprint == fingerprint) return;
+			Tri_Mesh mesh(make_indexed(), scene_use_bvh, &thread_pool, mesh_format, scene_wide_bvh);
+			if (unshared(entry.copy)) *entry.copy = std::move(mesh);
+			else entry.copy = std::make_shared<Tri_Mesh>(std::move(mesh));
+			entry.fingerprint = fingerprint;
+			entry.changed = true;
+		};
+
+		//the mesh phase lasts until the last mesh task finishes (not until the wait below, which is after the
+		// other conversions, which run on this thread meanwhile):
+		std::atomic< float > meshes_done = 0.0f;
+		auto mesh_done = [&meshes_timer, &meshes_done]() {
+			float done = meshes_timer.s();
+			float latest = meshes_done.load();
+			while (latest < done && !meshes_done.compare_exchange_weak(latest, done)) {}
+		};
 
 		for (const auto& [name, mesh] : scene_.meshes) {
-			mesh_names[mesh] = name;
-			mesh_futs.emplace_back(thread_pool.enqueue([name=name,mesh=mesh,this]() {
-				return std::pair{name, Tri_Mesh(Indexed_Mesh::from_halfedge_mesh( *mesh, Indexed_Mesh::SplitEdges), scene_use_bvh)};
-			}));
+			auto& entry = entry_for(mesh_cache, mesh);
+			mesh_tasks.emplace_back([&entry,mesh=mesh,&update_mesh,&mesh_done,this]() {
+				update_mesh(entry, mesh_fingerprint(*mesh), [&]() {
+					return Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges);
+				});
+				mesh_done();
+			});
 		}
 
 		for (const auto& [name, mesh] : scene_.skinned_meshes) {
-			skinned_mesh_names[mesh] = name;
-			mesh_futs.emplace_back(thread_pool.enqueue([name=name,mesh=mesh,this]() {
-				return std::pair{name, Tri_Mesh(mesh->posed_mesh(), scene_use_bvh)};
-			}));
+			auto& entry = entry_for(mesh_cache, mesh);
+			mesh_tasks.emplace_back([&entry,mesh=mesh,&update_mesh,&mesh_done,this]() {
+				//(the pose can change without the mesh changing, so this fingerprints the posed mesh)
+				Indexed_Mesh posed = mesh->posed_mesh();
+				update_mesh(entry, mesh_fingerprint(posed), [&]() { return std::move(posed); });
+				mesh_done();
+			});
 		}
 
+		thread_pool.enqueue(mesh_group, std::move(mesh_tasks));
+
 		for (const auto& [name, shape] : scene_.shapes) {
-			shape_names[shape] = name;
-			shapes.emplace(name, std::make_shared<Shape>(*shape));
+			auto& entry = entry_for(shape_cache, shape);
+			uint64_t fingerprint = resource_fingerprint(*shape);
+			if (entry.copy && entry.fingerprint == fingerprint) continue;
+			if (unshared(entry.copy)) *entry.copy = *shape;
+			else entry.copy = std::make_shared<Shape>(*shape);
+			entry.fingerprint = fingerprint;
+			entry.changed = true;
 		}
 
-		std::unordered_map<std::shared_ptr<Texture>, std::shared_ptr<Texture>> texture_to_copy;
+		//textures are compared against their copies rather than fingerprinted: (cheap, as unchanged copies share pixels)
 		for (const auto& [name, texture] : scene_.textures) {
-			texture_names[texture] = name;
-			auto copy = std::make_shared<Texture>(texture->copy());
-			texture_to_copy[texture] = copy;
-			textures.emplace(name, std::move(copy));
+			auto& entry = entry_for(texture_cache, texture);
+			if (entry.copy && same_texture(*entry.copy, *texture)) {
+				build_stats.textures_reused += 1;
+				continue;
+			}
+			if (unshared(entry.copy)) *entry.copy = texture->copy();
+			else entry.copy = std::make_shared<Texture>(texture->copy());
+			entry.changed = true;
+			build_stats.textures_rebuilt += 1;
+		}
+		if (!default_texture) {
+			default_texture = std::make_shared<Texture>(Textures::Constant{Spectrum{0.0f}, 1.0f});
 		}
-		default_texture_name = scene_.make_unique("default_texture");
-		textures.emplace(default_texture_name, std::make_shared<Texture>(Textures::Constant{Spectrum{0.0f}, 1.0f}));
 
-		for (const auto& [name, material] : scene_.materials) {
-			material_names[material] = name;
-			auto copy = std::make_shared<Material>(*material);
-			copy->for_each([&](std::weak_ptr<Texture>& tex) {
-				if (!tex.expired()) tex = texture_to_copy[tex.lock()];
+		//copies refer to copies of textures (which keep their addresses when updated):
+		auto texture_copy = [&](std::weak_ptr<Texture>& tex) {
+			if (!tex.expired()) tex = texture_cache.at(tex.lock().get()).copy;
+		};
+		//...but a copy also needs updating if a texture it uses changed:
+		auto textures_changed = [&](auto& resource) {
+			bool changed = false;
+			resource.for_each([&](std::weak_ptr<Texture>& tex) {
+				if (!tex.expired()) changed = changed || texture_cache.at(tex.lock().get()).changed;
 			});
-			materials.emplace(name, std::move(copy));
+			return changed;
+		};
+
+		for (const auto& [name, material] : scene_.materials) {
+			auto& entry = entry_for(material_cache, material);
+			uint64_t fingerprint = resource_fingerprint(*material);
+			if (entry.copy && entry.fingerprint == fingerprint && !textures_changed(*material)) {
+				build_stats.materials_reused += 1;
+				continue;
+			}
+			if (!unshared(entry.copy)) entry.copy = std::make_shared<Material_Copy>();
+			entry.copy->material = *material;
+			entry.copy->material.for_each(texture_copy);
+			entry.copy->shading = Shading_Material::from(entry.copy->material);
+			entry.fingerprint = fingerprint;
+			entry.changed = true;
+			build_stats.materials_rebuilt += 1;
+		}
+		if (!default_material) {
+			default_material = std::make_shared<Material_Copy>();
+			default_material->material = Material{Materials::Lambertian{default_texture}};
+			default_material->shading = Shading_Material::from(default_material->material);
 		}
-		default_material_name = scene_.make_unique("default_material");
-		materials.emplace(default_material_name, std::make_shared<Material>(Materials::Lambertian{ textures.at(default_texture_name) }));
 
 		for (const auto& [name, delta_light] : scene_.delta_lights) {
 			delta_light_names[delta_light] = name;
@@ -214,49 +427,105 @@ void Pathtracer::build_scene(Scene& scene_) {
 		}
 
 		for (const auto& [name, env_light] : scene_.env_lights) {
-			env_light_names[env_light] = name;
+			auto& entry = entry_for(env_light_cache, env_light);
+			uint64_t fingerprint = resource_fingerprint(*env_light);
+			if (entry.copy && entry.fingerprint == fingerprint && !textures_changed(*env_light)) continue;
 			auto light = std::make_shared<Environment_Light>(*env_light);
-			light->for_each([&](std::weak_ptr<Texture>& tex) {
-				if (!tex.expired()) tex = texture_to_copy[tex.lock()];
-			});
+			light->for_each(texture_copy);
 			if (light->is<Environment_Lights::Sphere>()) {
 				auto& sphere_map = std::get<Environment_Lights::Sphere>(light->light);
 				if (auto radiance = sphere_map.radiance.lock()) {
 					if (radiance->is<Textures::Image>()) {
 						sphere_map.importance = Samplers::Sphere::Image{
-							std::get<Textures::Image>(radiance->texture).image
+							std::get<Textures::Image>(radiance->texture).image, &thread_pool
 						};
 					}
 				}
 			}
-			env_lights.emplace(name, std::move(light));
+			//(env lights are only referred to through env_emitters, so they can be replaced outright)
+			entry.copy = std::move(light);
+			entry.fingerprint = fingerprint;
+			entry.changed = true;
 		}
 
-		for (auto& f : mesh_futs) {
-			auto [name, mesh] = f.get();
-			meshes.emplace(name, std::make_shared<Tri_Mesh>(std::move(mesh)));
+		//flatten environment lights for the miss and light-sampling paths, weighted by the light they emit:
+		for (auto const& [key, entry] : env_light_cache) {
+			if (!entry.used) continue;
+			env_emitters.push_back({entry.copy.get(), env_light_power(*entry.copy)});
 		}
+		float total_env_power = 0.0f;
+		for (auto const& emitter : env_emitters) total_env_power += emitter.weight;
+		for (auto& emitter : env_emitters) {
+			//(as with area lights, don't make any light impossible to sample on the strength of an estimate)
+			emitter.weight = total_env_power > 0.0f
+			               ? std::max(emitter.weight / total_env_power, 1e-3f / env_emitters.size())
+			               : 1.0f / env_emitters.size();
+		}
+		float total_weight = 0.0f;
+		for (auto const& emitter : env_emitters) total_weight += emitter.weight;
+		for (auto& emitter : env_emitters) emitter.weight /= total_weight;
+
+		thread_pool.wait(mesh_group);
+		for (auto const& [key, entry] : mesh_cache) {
+			if (!entry.used) continue;
+			if (entry.changed) build_stats.meshes_rebuilt += 1;
+			else build_stats.meshes_reused += 1;
+		}
+		build_stats.meshes = meshes_done.load();
 	}
 
 	{ // create scene instances
-		std::vector<Instance> objects, area_lights;
+		std::vector<Instance> objects;
+		std::vector<Object_Key> object_keys;
+		std::vector<Area_Light> area_lights;
 		std::vector<Light_Instance> lights;
 
+		//emissive meshes are sampled through a light tree over their triangles, built once per (mesh, material):
+		// (and kept across builds unless the mesh or material changed, or the pair is no longer in the scene)
+		std::set<std::pair<const Tri_Mesh*, const Shading_Material*>> used_mesh_lights;
+		std::set<const void*> changed_copies;
+		for (auto const& [key, entry] : mesh_cache) {
+			if (entry.changed) changed_copies.insert(entry.copy.get());
+		}
+		for (auto const& [key, entry] : material_cache) {
+			if (entry.changed) changed_copies.insert(&entry.copy->shading);
+		}
+		for (auto it = mesh_lights.begin(); it != mesh_lights.end();) {
+			if (changed_copies.count(it->first.first) || changed_copies.count(it->first.second)) {
+				it = mesh_lights.erase(it);
+			} else {
+				++it;
+			}
+		}
+		auto add_mesh_light = [&](const Tri_Mesh* mesh, const Shading_Material* material, const Mat4& T) {
+			used_mesh_lights.emplace(mesh, material);
+			auto& triangles = mesh_lights[{mesh, material}];
+			if (!triangles) triangles = std::make_shared<Light_Tree<Emissive_Triangle>>(Emissive_Triangle::from_mesh(*mesh, *material));
+			if (!triangles->empty()) area_lights.emplace_back(triangles.get(), T);
+		};
+
+		auto material_for = [&](std::weak_ptr<Material> const& material) {
+			if (material.expired()) return &default_material->shading;
+			return &material_cache.at(material.lock().get()).copy->shading;
+		};
+		auto add_object = [&](auto const* geometry, const Shading_Material* material, const Mat4& T) {
+			objects.emplace_back(geometry, material, T);
+			object_keys.push_back(Object_Key{geometry, material, T});
+		};
+
 		for (const auto& [name, mesh_inst] : scene_.instances.meshes) {
 
 			if (!mesh_inst->settings.visible) continue;
 			if (mesh_inst->mesh.expired()) continue;
 
-			auto& mesh = meshes.at(mesh_names.at(mesh_inst->mesh.lock()));
-			auto& material = materials.at(mesh_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(mesh_inst->material.lock()));
+			auto mesh = mesh_cache.at(mesh_inst->mesh.lock().get()).copy.get();
+			auto material = material_for(mesh_inst->material);
 			Mat4 T = mesh_inst->transform.lock()->local_to_world();
 
-			objects.emplace_back(mesh.get(), material.get(), T);
+			add_object(mesh, material, T);
 
 			if (material->is_emissive()) {
-				area_lights.emplace_back(mesh.get(), material.get(), T);
+				add_mesh_light(mesh, material, T);
 			}
 		}
 
@@ -265,16 +534,14 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (!mesh_inst->settings.visible) continue;
 			if (mesh_inst->mesh.expired()) continue;
 
-			auto& mesh = meshes.at(skinned_mesh_names.at(mesh_inst->mesh.lock()));
-			auto& material = materials.at(mesh_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(mesh_inst->material.lock()));
+			auto mesh = mesh_cache.at(mesh_inst->mesh.lock().get()).copy.get();
+			auto material = material_for(mesh_inst->material);
 			Mat4 T = mesh_inst->transform.lock()->local_to_world();
 
-			objects.emplace_back(mesh.get(), material.get(), T);
+			add_object(mesh, material, T);
 
 			if (material->is_emissive()) {
-				area_lights.emplace_back(mesh.get(), material.get(), T);
+				add_mesh_light(mesh, material, T);
 			}
 		}
 
@@ -283,16 +550,14 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (!shape_inst->settings.visible) continue;
 			if (shape_inst->shape.expired()) continue;
 
-			auto& shape = shapes.at(shape_names.at(shape_inst->shape.lock()));
-			auto& material = materials.at(shape_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(shape_inst->material.lock()));
+			auto shape = shape_cache.at(shape_inst->shape.lock().get()).copy.get();
+			auto material = material_for(shape_inst->material);
 			Mat4 T = shape_inst->transform.lock()->local_to_world();
 
-			objects.emplace_back(shape.get(), material.get(), T);
+			add_object(shape, material, T);
 
 			if (material->is_emissive()) {
-				area_lights.emplace_back(shape.get(), material.get(), T);
+				area_lights.emplace_back(shape, material, T);
 			}
 		}
 
@@ -302,10 +567,8 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (part_inst->mesh.expired()) continue;
 			if (part_inst->particles.expired()) continue;
 
-			auto& mesh = meshes.at(mesh_names.at(part_inst->mesh.lock()));
-			auto& material = materials.at(part_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(part_inst->material.lock()));
+			auto mesh = mesh_cache.at(part_inst->mesh.lock().get()).copy.get();
+			auto material = material_for(part_inst->material);
 			//Mat4 T = part_inst->transform.lock()->local_to_world();
 
 			auto particles = part_inst->particles.lock();
@@ -313,9 +576,9 @@ void Pathtracer::build_scene(Scene& scene_) {
 				//NOTE: particle positions stored in world space (thus no 'T *' here):
 				Mat4 pT = Mat4::translate(p.position) * Mat4::scale(Vec3{particles->radius});
 
-				objects.emplace_back(mesh.get(), material.get(), pT);
+				add_object(mesh, material, pT);
 				if (material->is_emissive()) {
-					area_lights.emplace_back(mesh.get(), material.get(), pT);
+					add_mesh_light(mesh, material, pT);
 				}
 			}
 		}
@@ -331,16 +594,44 @@ void Pathtracer::build_scene(Scene& scene_) {
 			lights.emplace_back(light.get(), T);
 		}
 
-		
-		emissive_objects = List(std::move(area_lights));
+		for (auto it = mesh_lights.begin(); it != mesh_lights.end();) {
+			if (used_mesh_lights.count(it->first)) ++it;
+			else it = mesh_lights.erase(it);
+		}
+		emissive_objects.build(std::move(area_lights));
 		point_lights = std::move(lights);
 
-		if (scene_use_bvh) {
-			scene = Aggregate(BVH<Instance>(std::move(objects)));
+		//the scene BVH only depends on instance geometry and transforms, and copies keep their addresses,
+		// so it can be reused unless an instance (or the geometry it refers to) changed:
+		bool geometry_changed = false;
+		for (auto const& [key, entry] : mesh_cache) geometry_changed = geometry_changed || entry.changed;
+		for (auto const& [key, entry] : shape_cache) geometry_changed = geometry_changed || entry.changed;
+
+		Timer scene_bvh_timer;
+		if (into.scene_built && into.scene_built_with_bvh == scene_use_bvh && into.scene_built_wide == scene_wide_bvh && !geometry_changed
+		    && object_keys == into.scene_objects) {
+			build_stats.scene_bvh_reused = true;
+		} else if (scene_use_bvh) {
+			BVH_Build_Opts opts;
+			opts.thread_pool = &thread_pool;
+			opts.wide = scene_wide_bvh;
+			scene = std::make_shared<Aggregate>(BVH<Instance>(std::move(objects), opts));
 		} else {
-			scene = Aggregate(List<Instance>(std::move(objects)));
+			scene = std::make_shared<Aggregate>(List<Instance>(std::move(objects)));
 		}
+		into.scene_objects = std::move(object_keys);
+		into.scene_built = true;
+		into.scene_built_with_bvh = scene_use_bvh;
+		into.scene_built_wide = scene_wide_bvh;
+		build_stats.scene_bvh = scene_bvh_timer.s();
 	}
+
+	end_build(mesh_cache);
+	end_build(shape_cache);
+	end_build(texture_cache);
+	end_build(material_cache);
+	end_build(env_light_cache);
+	build_stats.build = build_timer.s();
 }
 
 void Pathtracer::set_camera(std::shared_ptr<::Instance::Camera> camera_) {
@@ -356,56 +647,320 @@ void Pathtracer::use_bvh(bool bvh) {
 	scene_use_bvh = bvh;
 }
 
+void Pathtracer::use_wide_bvh(bool wide) {
+	scene_wide_bvh = wide;
+}
+
+void Pathtracer::set_mesh_format(Tri_Mesh::Vertex_Format format) {
+	mesh_format = format;
+}
+
+std::vector< std::pair< std::string, Tri_Mesh::Memory > > Pathtracer::mesh_memory(Scene const &scene) const {
+	std::vector< std::pair< std::string, Tri_Mesh::Memory > > ret;
+	auto add = [&](std::string const &name, const void* key) {
+		auto entry = compiled->mesh_cache.find(key);
+		if (entry != compiled->mesh_cache.end() && entry->second.copy) ret.emplace_back(name, entry->second.copy->memory());
+	};
+	for (auto const& [name, mesh] : scene.meshes) add(name, mesh.get());
+	for (auto const& [name, mesh] : scene.skinned_meshes) add(name, mesh.get());
+	return ret;
+}
+
 void Pathtracer::log_ray(const Ray& ray, float t, Spectrum color) {
-	std::lock_guard<std::mutex> lock(ray_log_mut);
-	ray_log.push_back(Ray_Log{ray, t, color});
+	thread_ray_log().add(Ray_Log{ray, t, color});
+}
+
+Ray_Log_Buffer& Pathtracer::thread_ray_log() {
+	//(the buffer this thread logged to last, and the id of the set it belongs to)
+	static thread_local std::pair< uint64_t, Ray_Log_Buffer* > cached{0, nullptr};
+	if (cached.first == ray_log_id) return *cached.second;
+
+	std::lock_guard< std::mutex > lock(ray_log_mut);
+	std::thread::id thread = std::this_thread::get_id();
+	Ray_Log_Buffer* buffer = nullptr;
+	for (auto const& [id, log] : ray_logs) {
+		if (id == thread) buffer = log.get();
+	}
+	if (!buffer) {
+		ray_logs.emplace_back(thread, std::make_unique< Ray_Log_Buffer >(ray_log_capacity, ray_log_policy, ray_logs.size()));
+		buffer = ray_logs.back().second.get();
+	}
+	cached = {ray_log_id, buffer};
+	return *buffer;
+}
+
+void Pathtracer::clear_ray_log() {
+	std::lock_guard< std::mutex > lock(ray_log_mut);
+	if (next_ray_log_capacity != ray_log_capacity || next_ray_log_policy != ray_log_policy) {
+		ray_log_capacity = next_ray_log_capacity;
+		ray_log_policy = next_ray_log_policy;
+		ray_logs.clear();
+		ray_log_id = new_ray_log_id();
+	} else {
+		for (auto& [id, log] : ray_logs) log->clear();
+	}
 }
 
-void Pathtracer::accumulate(Tile const &tile, const HDR_Image& data) {
+void Pathtracer::set_ray_log(uint32_t capacity, Ray_Log_Policy policy) {
+	std::lock_guard< std::mutex > lock(ray_log_mut);
+	next_ray_log_capacity = capacity;
+	next_ray_log_policy = policy;
+}
 
-	std::lock_guard<std::mutex> lock(accumulator_mut);
+//the accumulator's fixed point formats (checkpoints keep sums in the same formats, so must convert the same way):
+namespace {
+//spectrum components as 40.24 fixed point:
+int64_t fixed_sample(float value) {
+	return int64_t(value * (1ll<<24ll));
+}
+//squared luminances as 48.16 fixed point (clamped so that fireflies can't overflow it):
+int64_t fixed_moment(float moment) {
+	return int64_t(std::min(double(moment), 1e12) * (1ll<<16ll));
+}
+//pixel value from the sum of its samples:
+Spectrum mean_sample(std::array< int64_t, 3 > const &sum, uint32_t samples) {
+	if (samples == 0) return Spectrum(0.0f, 0.0f, 0.0f);
+	//(doing the conversion in double precision is probably overkill)
+	return Spectrum(
+		float(sum[0] / double(1ll<<24ll) / double(samples)),
+		float(sum[1] / double(1ll<<24ll) / double(samples)),
+		float(sum[2] / double(1ll<<24ll) / double(samples))
+	);
+}
+} // namespace
 
+void Pathtracer::accumulate(Tile const &tile, const HDR_Image& data, std::vector< float > const &moments) {
+	assert(data.w == tile.x_end - tile.x_begin && data.h == tile.y_end - tile.y_begin);
+	assert(moments.size() == data.data().size());
+
+	uint64_t traced = 0;
 	for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
 		for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
 			uint32_t idx = py * accumulator_w + px;
-			uint32_t &samples = accumulator_samples[idx];
-			std::array< int64_t, 3 > &spectrum = accumulator[idx];
+			//(do_trace skipped converged pixels, so they get no samples)
+			if (!pixel_converged.empty() && pixel_converged[idx]) continue;
+
+			std::atomic< uint32_t > &samples = accumulator_samples[idx];
+			std::array< std::atomic< int64_t >, 3 > &spectrum = accumulator[idx];
 
 			//convert to 40.24 fixed point and add:
-			const Spectrum& n = data.at(px, py);
-			spectrum[0] += int64_t(n.r * (1ll<<24ll));
-			spectrum[1] += int64_t(n.g * (1ll<<24ll));
-			spectrum[2] += int64_t(n.b * (1ll<<24ll));
+			const Spectrum& n = data.at(px - tile.x_begin, py - tile.y_begin);
+			spectrum[0].fetch_add(fixed_sample(n.r), std::memory_order_relaxed);
+			spectrum[1].fetch_add(fixed_sample(n.g), std::memory_order_relaxed);
+			spectrum[2].fetch_add(fixed_sample(n.b), std::memory_order_relaxed);
+
+			//second moment as 48.16 fixed point:
+			float m = moments[(py - tile.y_begin) * data.w + (px - tile.x_begin)];
+			accumulator_moments[idx].fetch_add(fixed_moment(m), std::memory_order_relaxed);
 
 			//add appropriate weight:
-			samples += (tile.s_end - tile.s_begin);
+			samples.fetch_add(tile.s_end - tile.s_begin, std::memory_order_relaxed);
+			traced += tile.s_end - tile.s_begin;
+		}
+	}
+	traced_samples.fetch_add(traced, std::memory_order_relaxed);
+
+	//(the checkpoint thread runs from before the first tile is queued until after the last one finishes)
+	if (checkpoint_thread.joinable()) {
+		std::lock_guard< std::mutex > lock(checkpoint_mut);
+		checkpoint_tiles.emplace_back(Checkpoint_Tile{tile, data.copy(), moments});
+	}
+
+	//flag the progress image blocks this tile overlaps as out of date:
+	for (uint32_t by = tile.y_begin / Dirty_Block_Size; by * Dirty_Block_Size < tile.y_end; ++by) {
+		for (uint32_t bx = tile.x_begin / Dirty_Block_Size; bx * Dirty_Block_Size < tile.x_end; ++bx) {
+			dirty_blocks[by * dirty_blocks_w + bx].store(true, std::memory_order_release);
 		}
 	}
 }
 
-HDR_Image Pathtracer::accumulator_to_image() const {
-	HDR_Image image(accumulator_w, accumulator_h, Spectrum(0.0f, 0.0f, 0.0f));
-	for (uint32_t i = 0; i < uint32_t(accumulator.size()); ++i) {
-		//(doing the conversion in double precision is probably overkill)
-		if (accumulator_samples[i] > 0) {
-			image.at(i) = Spectrum(
-				float(accumulator[i][0] / double(1ll<<24ll) / double(accumulator_samples[i])),
-				float(accumulator[i][1] / double(1ll<<24ll) / double(accumulator_samples[i])),
-				float(accumulator[i][2] / double(1ll<<24ll) / double(accumulator_samples[i]))
-			);
+void Pathtracer::reset_accumulator(uint32_t w, uint32_t h) {
+	accumulator_w = w;
+	accumulator_h = h;
+	//(value-initialization zeros the atomics)
+	accumulator = decltype(accumulator)(size_t(w) * h);
+	accumulator_samples = decltype(accumulator_samples)(size_t(w) * h);
+	accumulator_moments = decltype(accumulator_moments)(size_t(w) * h);
+
+	dirty_blocks_w = (w + Dirty_Block_Size - 1) / Dirty_Block_Size;
+	uint32_t dirty_blocks_h = (h + Dirty_Block_Size - 1) / Dirty_Block_Size;
+	dirty_blocks = decltype(dirty_blocks)(size_t(dirty_blocks_w) * dirty_blocks_h);
+	progress_image = HDR_Image(w, h, Spectrum(0.0f, 0.0f, 0.0f));
+}
+
+void Pathtracer::save_checkpoints() {
+	//pieces of tiles that aren't all here yet (by tile index), with the pixel-samples they cover so far:
+	// (a checkpoint only has whole tiles, since a resumed render re-traces whole tiles)
+	std::unordered_map< uint32_t, std::pair< uint32_t, std::vector< Checkpoint_Tile > > > pieces;
+
+	std::unique_lock< std::mutex > lock(checkpoint_mut);
+	while (true) {
+		checkpoint_wake.wait_for(lock, std::chrono::duration< float >(checkpoint_interval), [this]() {
+			return checkpoint_stop;
+		});
+		if (checkpoint_stop) return;
+		if (checkpoint_tiles.empty()) continue;
+		std::vector< Checkpoint_Tile > arrived = std::move(checkpoint_tiles);
+		checkpoint_tiles.clear();
+		lock.unlock();
+
+		std::vector< Checkpoint_Tile > tiles;
+		for (auto &piece : arrived) {
+			Tile const &tile = piece.tile;
+			uint32_t size = (tile.x_end - tile.x_begin) * (tile.y_end - tile.y_begin) * (tile.s_end - tile.s_begin);
+			if (size == tile.whole_size) {
+				tiles.emplace_back(std::move(piece));
+				continue;
+			}
+			auto &[covered, gathered] = pieces[tile.index];
+			covered += size;
+			uint32_t index = tile.index, whole_size = tile.whole_size;
+			gathered.emplace_back(std::move(piece));
+			if (covered == whole_size) {
+				for (auto &p : gathered) tiles.emplace_back(std::move(p));
+				pieces.erase(index);
+			}
+		}
+
+		//add whole tiles to the checkpoint's sums, just as accumulate() adds them to the accumulator:
+		for (auto const &[tile, data, moments] : tiles) {
+			for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
+				for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
+					uint32_t idx = py * accumulator_w + px;
+					uint32_t i = (py - tile.y_begin) * data.w + (px - tile.x_begin);
+					const Spectrum& n = data.at(i);
+					checkpoint.accumulator[idx][0] += fixed_sample(n.r);
+					checkpoint.accumulator[idx][1] += fixed_sample(n.g);
+					checkpoint.accumulator[idx][2] += fixed_sample(n.b);
+					checkpoint.accumulator_moments[idx] += fixed_moment(moments[i]);
+					checkpoint.accumulator_samples[idx] += tile.s_end - tile.s_begin;
+				}
+			}
+			checkpoint.tiles_done[tile.index] = 1;
+		}
+		try {
+			checkpoint.save(checkpoint_path);
+		} catch (std::exception const &e) {
+			warn("Failed to save checkpoint: %s", e.what());
 		}
+
+		lock.lock();
 	}
-	return image;
+}
+
+void Pathtracer::stop_checkpoints() {
+	{
+		std::lock_guard< std::mutex > lock(checkpoint_mut);
+		checkpoint_stop = true;
+	}
+	checkpoint_wake.notify_all();
+	if (checkpoint_thread.joinable()) checkpoint_thread.join();
+	checkpoint_tiles.clear();
+}
+
+Spectrum Pathtracer::accumulator_pixel(uint32_t idx) const {
+	return mean_sample({
+		accumulator[idx][0].load(std::memory_order_relaxed),
+		accumulator[idx][1].load(std::memory_order_relaxed),
+		accumulator[idx][2].load(std::memory_order_relaxed)
+	}, accumulator_samples[idx].load(std::memory_order_relaxed));
+}
+
+float Pathtracer::accumulator_relative_error(uint32_t idx) const {
+	uint32_t samples = accumulator_samples[idx].load(std::memory_order_relaxed);
+	if (samples < 2) return std::numeric_limits< float >::infinity();
+	double mean = accumulator_pixel(idx).luma();
+	double second = accumulator_moments[idx].load(std::memory_order_relaxed) / double(1ll<<16ll) / double(samples);
+	//(unbiased) variance of the samples, then of their mean:
+	double variance = std::max(second - mean * mean, 0.0) * samples / double(samples - 1);
+	double error = std::sqrt(variance / samples);
+	//(floor on the mean so that black pixels can converge)
+	constexpr double Min_Mean = 1e-3;
+	return float(error / std::max(mean, Min_Mean));
+}
+
+void Pathtracer::resolve_dirty_blocks() {
+	for (uint32_t b = 0; b < uint32_t(dirty_blocks.size()); ++b) {
+		if (!dirty_blocks[b].exchange(false, std::memory_order_acquire)) continue;
+		//(reports share the progress image, so it may need its own pixels again)
+		progress_image.make_unique();
+		uint32_t x_begin = (b % dirty_blocks_w) * Dirty_Block_Size;
+		uint32_t y_begin = (b / dirty_blocks_w) * Dirty_Block_Size;
+		uint32_t x_end = std::min(x_begin + Dirty_Block_Size, accumulator_w);
+		uint32_t y_end = std::min(y_begin + Dirty_Block_Size, accumulator_h);
+		for (uint32_t py = y_begin; py < y_end; ++py) {
+			for (uint32_t px = x_begin; px < x_end; ++px) {
+				progress_image.at(px, py) = accumulator_pixel(py * accumulator_w + px);
+			}
+		}
+	}
+}
+
+void Pathtracer::report_progress(uint32_t traced) {
+	if (report_rate <= 0.0f) return;
+
+	//if another thread is reporting, skip this report rather than waiting for it:
+	std::unique_lock<std::mutex> lock(report_mut, std::try_to_lock);
+	if (!lock.owns_lock()) return;
+
+	//the final report will take care of things:
+	if (finished_tiles.load() == total_tiles) return;
+	if (report_timer.s() < 1.0f / report_rate) return;
+
+	resolve_dirty_blocks();
+	report_fn({traced / float(total_tiles), progress_image.copy()});
+	report_timer.reset();
+}
+
+void Pathtracer::report_final() {
+	std::lock_guard<std::mutex> lock(report_mut);
+	render_timer.pause();
+	resolve_dirty_blocks();
+	report_fn({1.0f, progress_image.copy()});
+}
+
+void Pathtracer::finish_tiles(uint32_t count) {
+	uint32_t traced = finished_tiles.fetch_add(count) + count;
+	if (traced == total_tiles) {
+		//(there is no need to save a checkpoint of a finished render)
+		{
+			std::lock_guard< std::mutex > lock(checkpoint_mut);
+			checkpoint_stop = true;
+		}
+		checkpoint_wake.notify_all();
+		report_final();
+	} else {
+		report_progress(traced);
+	}
+	//(only counted for in_progress() once reported, so callers see the final image before the render ends)
+	traced_tiles.fetch_add(count);
 }
 
 void Pathtracer::do_trace(RNG &rng, Tile const &tile) {
 	//A3T1 - Step 0: understand this function!
 
-	HDR_Image sample(camera.film.width, camera.film.height, Spectrum(0.0f, 0.0f, 0.0f));
+	//samples are summed in a tile-sized buffer, whose (0,0) is pixel (x_begin,y_begin):
+	// (allocating the full film here would cost w*h per tile)
+	HDR_Image sample(tile.x_end - tile.x_begin, tile.y_end - tile.y_begin, Spectrum(0.0f, 0.0f, 0.0f));
+	//(squared luminances are summed alongside, for the accumulator's variance estimates)
+	std::vector< float > moments(sample.data().size(), 0.0f);
+	//(and, with RECORD_STATS, the traversal steps each pixel's samples took)
+	std::vector< uint64_t > cost;
+	if constexpr (RECORD_STATS) cost.assign(sample.data().size(), 0);
 	for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
 		for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
+			//adaptive sampling has already finished with this pixel:
+			if (!pixel_converged.empty() && pixel_converged[py * accumulator_w + px]) continue;
+
+			uint64_t steps = traversal_steps();
+
 			for (uint32_t s = tile.s_begin; s < tile.s_end; ++s) {
 
+				//draws for this sample depend only on (pixel, sample), not on the tile:
+				if (sequence != RNG::Sequence::Stream) {
+					rng.start_sample(sequence, sequence_seed, py * accumulator_w + px, sample_offset + s);
+				}
+
 				//generate a camera ray for this pixel:
 				auto [ray, pdf] = camera.sample_ray(rng, px, py);
 				ray.transform(camera_to_world);
@@ -423,26 +978,299 @@ void Pathtracer::do_trace(RNG &rng, Tile const &tile) {
 				Spectrum p = (emissive + light) / pdf;
 
 				if (p.valid()) {
-					sample.at(px, py) += p;
+					sample.at(px - tile.x_begin, py - tile.y_begin) += p;
+					float luma = p.luma();
+					moments[(py - tile.y_begin) * sample.w + (px - tile.x_begin)] += luma * luma;
 				}
 
-				if (cancel_flag && *cancel_flag) return;
+				if (render_group.cancelled() || (cancel_flag && *cancel_flag)) return;
+			}
+
+			if constexpr (RECORD_STATS) {
+				cost[(py - tile.y_begin) * sample.w + (px - tile.x_begin)] += traversal_steps() - steps;
+			}
+		}
+	}
+	rng.end_sample();
+	accumulate(tile, sample, moments);
+	if constexpr (RECORD_STATS) add_pixel_cost(tile, cost);
+}
+
+void Pathtracer::do_trace_batched(RNG &rng, Tile const &tile) {
+	//Computes the same samples as do_trace(), but a wave of samples at a time: camera rays for the whole
+	// wave are generated and intersected in one pass, then the hits are shaded (by shade(), which is what
+	// trace() does with a hit) grouped by material, so consecutive shading calls run over the same material.
+	//Only the camera rays are batched: shade() continues each path depth-first, through the A3 lighting
+	// functions, which trace their bounce and shadow rays themselves.
+	// With a counter-based sequence, every sample draws the same numbers as it would in do_trace(), so the
+	// image is the same, bit for bit; with Stream, draws are made in a different order.
+
+	//at most this many samples are in flight at once: (per-sample state is tens of bytes)
+	constexpr uint32_t Wave_Size = 4096;
+
+	HDR_Image sample(tile.x_end - tile.x_begin, tile.y_end - tile.y_begin, Spectrum(0.0f, 0.0f, 0.0f));
+	std::vector< float > moments(sample.data().size(), 0.0f);
+	std::vector< uint64_t > cost;
+	if constexpr (RECORD_STATS) cost.assign(sample.data().size(), 0);
+
+	//pixels (tile-local index) that still need samples:
+	std::vector< uint32_t > pixels;
+	for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
+		for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
+			if (!pixel_converged.empty() && pixel_converged[py * accumulator_w + px]) continue;
+			pixels.emplace_back((py - tile.y_begin) * sample.w + (px - tile.x_begin));
+		}
+	}
+	const uint32_t samples_per_pixel = tile.s_end - tile.s_begin;
+	const uint64_t total_paths = uint64_t(pixels.size()) * samples_per_pixel;
+
+	//per-sample state (structure-of-arrays, indexed by sample within the wave):
+	std::vector< uint32_t > path_pixel;
+	std::vector< float > path_pdf;
+	std::vector< RNG::Sample_State > path_sample;
+	std::vector< Ray > rays;
+	std::vector< Trace > hits;
+	std::vector< Spectrum > radiance;
+	std::vector< uint32_t > group, order;
+	std::unordered_map< const Shading_Material *, uint32_t > material_group; //(1 + order of first hit in the wave)
+
+	for (uint64_t wave_begin = 0; wave_begin < total_paths; wave_begin += Wave_Size) {
+		uint32_t wave = uint32_t(std::min< uint64_t >(Wave_Size, total_paths - wave_begin));
+		path_pixel.resize(wave);
+		path_pdf.resize(wave);
+		path_sample.resize(wave);
+		rays.resize(wave);
+		hits.resize(wave);
+		radiance.resize(wave);
+
+		//camera rays, in the order do_trace() would trace them:
+		for (uint32_t p = 0; p < wave; ++p) {
+			uint64_t path = wave_begin + p;
+			uint32_t local = pixels[path / samples_per_pixel];
+			uint32_t px = tile.x_begin + local % sample.w;
+			uint32_t py = tile.y_begin + local / sample.w;
+			uint32_t s = tile.s_begin + uint32_t(path % samples_per_pixel);
+
+			if (sequence != RNG::Sequence::Stream) {
+				rng.start_sample(sequence, sequence_seed, py * accumulator_w + px, sample_offset + s);
+			}
+			auto [ray, pdf] = camera.sample_ray(rng, px, py);
+			ray.transform(camera_to_world);
+
+			path_pixel[p] = local;
+			path_pdf[p] = pdf;
+			path_sample[p] = rng.save_sample();
+			rays[p] = ray;
+		}
+
+		//intersect the whole wave:
+		for (uint32_t p = 0; p < wave; ++p) {
+			uint64_t steps = traversal_steps();
+			count_ray(Ray_Kind::Camera);
+			hits[p] = compiled->scene->hit(rays[p]);
+			if constexpr (RECORD_STATS) cost[path_pixel[p]] += traversal_steps() - steps;
+		}
+
+		//shade grouped by material, misses first, materials in the order the wave first hits them:
+		// (rather than by address, so Stream draws are made in the same order every run)
+		material_group.clear();
+		group.resize(wave);
+		for (uint32_t p = 0; p < wave; ++p) {
+			const Shading_Material *material = hits[p].hit ? hits[p].material : nullptr;
+			if (!material) {
+				group[p] = 0;
+				continue;
+			}
+			auto [at, added] = material_group.emplace(material, uint32_t(material_group.size()) + 1);
+			group[p] = at->second;
+		}
+		order.resize(wave);
+		for (uint32_t p = 0; p < wave; ++p) order[p] = p;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return group[a] < group[b]; });
+
+		for (uint32_t p : order) {
+			uint64_t steps = traversal_steps();
+			rng.resume_sample(path_sample[p]);
+			auto [emissive, light] = shade(rng, rays[p], hits[p]);
+			radiance[p] = (emissive + light) / path_pdf[p];
+			if constexpr (RECORD_STATS) cost[path_pixel[p]] += traversal_steps() - steps;
+
+			if (render_group.cancelled() || (cancel_flag && *cancel_flag)) return;
+		}
+
+		//sum in sample order, as do_trace() does:
+		for (uint32_t p = 0; p < wave; ++p) {
+			Spectrum const& r = radiance[p];
+			if (r.valid()) {
+				sample.at(path_pixel[p]) += r;
+				float luma = r.luma();
+				moments[path_pixel[p]] += luma * luma;
 			}
 		}
 	}
-	accumulate(tile, sample);
+	rng.end_sample();
+	accumulate(tile, sample, moments);
+	if constexpr (RECORD_STATS) add_pixel_cost(tile, cost);
 }
 
 bool Pathtracer::in_progress() const {
 	return traced_tiles.load() < total_tiles;
 }
 
-std::pair<float, float> Pathtracer::completion_time() const {
-	return {build_timer.s(), render_timer.s()};
+float Pathtracer::progress() const {
+	if (total_tiles == 0) return 1.0f;
+	return traced_tiles.load() / float(total_tiles);
+}
+
+void Pathtracer::set_report_rate(float rate) {
+	report_rate = rate;
+}
+
+void Pathtracer::set_integrator(Integrator integrator_) {
+	integrator = integrator_;
+}
+
+Thread_Pool& Pathtracer::get_thread_pool() {
+	return thread_pool;
+}
+
+void Pathtracer::set_checkpoint(std::string const &path, float interval) {
+	checkpoint_path = path;
+	checkpoint_interval = std::max(interval, 0.01f);
+}
+
+void Pathtracer::resume_from(std::string const &path) {
+	resume_path = path;
+}
+
+void Pathtracer::set_tiles(std::vector< uint32_t > const &tiles) {
+	selected_tiles.clear();
+	for (uint32_t t : tiles) {
+		if (t >= selected_tiles.size()) selected_tiles.resize(t + 1, 0);
+		selected_tiles[t] = 1;
+	}
+}
+
+uint32_t Pathtracer::tile_count(::Camera const &camera_) const {
+	auto count = [](uint32_t size, uint32_t tile) {
+		return (size + tile - 1) / tile;
+	};
+	uint32_t size = tile_size(camera_.film.width, camera_.film.height);
+	return count(camera_.film.width, size) * count(camera_.film.height, size)
+	     * count(camera_.film.samples, tile_samples());
+}
+
+uint32_t Pathtracer::tile_size(uint32_t width, uint32_t height) const {
+	//as large as can still make enough regions for the threads (in multiples of 8 pixels):
+	uint32_t regions = std::max(Min_Regions, Regions_Per_Thread * uint32_t(thread_pool.size()));
+	uint32_t size = uint32_t(std::sqrt(double(width) * double(height) / regions)) / 8 * 8;
+	return std::clamp(size, Min_Tile_Size, Max_Tile_Size);
+}
+
+Checkpoint Pathtracer::empty_checkpoint() const {
+	Checkpoint ret;
+	ret.reset(accumulator_w, accumulator_h, uint32_t(summed_tiles.size()));
+	ret.samples = camera.film.samples;
+	ret.max_ray_depth = camera.film.max_ray_depth;
+	ret.seed = sequence_seed;
+	ret.tile_size = render_tile_size;
+	ret.sequence = uint8_t(sequence);
+	ret.integrator = uint8_t(integrator);
+	return ret;
+}
+
+Checkpoint Pathtracer::partial() const {
+	Checkpoint ret = empty_checkpoint();
+	ret.tiles_done = summed_tiles;
+	for (uint32_t idx = 0; idx < uint32_t(accumulator.size()); ++idx) {
+		for (uint32_t c = 0; c < 3; ++c) ret.accumulator[idx][c] = accumulator[idx][c].load(std::memory_order_relaxed);
+		ret.accumulator_samples[idx] = accumulator_samples[idx].load(std::memory_order_relaxed);
+		ret.accumulator_moments[idx] = accumulator_moments[idx].load(std::memory_order_relaxed);
+	}
+	return ret;
+}
+
+HDR_Image Pathtracer::merge(std::vector< Checkpoint > const &partials) {
+	if (partials.empty()) return HDR_Image();
+	Checkpoint const &first = partials[0];
+
+	//sum the partials' sums, just as the accumulator would have:
+	std::vector< std::array< int64_t, 3 > > sums(first.accumulator.size(), {0, 0, 0});
+	std::vector< uint32_t > samples(first.accumulator.size(), 0);
+	std::vector< uint8_t > tiles(first.tiles_done.size(), 0);
+	for (auto const &partial : partials) {
+		if (!partial.same_render(first)) throw std::runtime_error("Partial renders were made with different settings.");
+		for (uint32_t t = 0; t < uint32_t(tiles.size()); ++t) {
+			if (!partial.tiles_done[t]) continue;
+			if (tiles[t]) throw std::runtime_error("Partial renders both have tile " + std::to_string(t) + ".");
+			tiles[t] = 1;
+		}
+		for (uint32_t idx = 0; idx < uint32_t(sums.size()); ++idx) {
+			for (uint32_t c = 0; c < 3; ++c) sums[idx][c] += partial.accumulator[idx][c];
+			samples[idx] += partial.accumulator_samples[idx];
+		}
+	}
+
+	HDR_Image ret(first.width, first.height);
+	for (uint32_t idx = 0; idx < uint32_t(sums.size()); ++idx) {
+		ret.at(idx) = mean_sample(sums[idx], samples[idx]);
+	}
+	return ret;
+}
+
+void Pathtracer::set_sequence(RNG::Sequence sequence_) {
+	sequence = sequence_;
+}
+
+void Pathtracer::set_adaptive_error(float relative_error) {
+	adaptive_error = std::max(relative_error, 0.0f);
+}
+
+Pathtracer::Sample_Counts Pathtracer::sample_counts() const {
+	Sample_Counts ret;
+	ret.traced = traced_samples.load();
+	ret.budget = budget_samples;
+	return ret;
+}
+
+Pathtracer::Stats Pathtracer::stats() const {
+	Stats ret;
+	{
+		std::lock_guard< std::mutex > lock(stats_mut);
+		ret = tile_stats;
+	}
+	ret.render = render_timer.s();
+	ret.pixel_cost.reserve(pixel_cost.size());
+	for (auto const &cost : pixel_cost) ret.pixel_cost.emplace_back(cost.load(std::memory_order_relaxed));
+	return ret;
+}
+
+void Pathtracer::record_tile(Render_Stats const &counts, float seconds) {
+	std::lock_guard< std::mutex > lock(stats_mut);
+	tile_stats.counts += counts;
+	tile_stats.tiles += 1;
+	tile_stats.tile_seconds += seconds;
+	tile_stats.slowest_tile = std::max(tile_stats.slowest_tile, seconds);
+}
+
+void Pathtracer::add_pixel_cost(Tile const &tile, std::vector< uint64_t > const &cost) {
+	uint32_t w = tile.x_end - tile.x_begin;
+	for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
+		for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
+			uint64_t c = cost[(py - tile.y_begin) * w + (px - tile.x_begin)];
+			if (c) pixel_cost[py * accumulator_w + px].fetch_add(c, std::memory_order_relaxed);
+		}
+	}
+}
+
+Pathtracer::Completion_Time Pathtracer::completion_time() const {
+	Completion_Time ret = compiled->build_stats;
+	ret.render = render_timer.s();
+	return ret;
 }
 
 uint32_t Pathtracer::visualize_bvh(GL::Lines& lines, GL::Lines& active, uint32_t depth) {
-	return scene.visualize(lines, active, depth, Mat4::I);
+	return compiled->scene->visualize(lines, active, depth, Mat4::I);
 }
 
 void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camera_,
@@ -462,44 +1290,124 @@ void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camer
 		add_samples = false;
 	}
 
+	//a resumed render starts from a checkpoint's sums, and only traces the tiles it doesn't have:
+	Checkpoint resumed;
+	bool resuming = !resume_path.empty();
+	if (resuming) {
+		std::string path = std::move(resume_path);
+		resume_path.clear();
+		resumed = Checkpoint::load(path);
+		if (resumed.width != camera.film.width || resumed.height != camera.film.height || resumed.samples != camera.film.samples
+		 || resumed.max_ray_depth != camera.film.max_ray_depth || resumed.sequence != uint8_t(sequence)
+		 || resumed.integrator != uint8_t(integrator)) {
+			throw std::runtime_error("Checkpoint '" + path + "' was made with different film or sampling settings.");
+		}
+		if (resumed.tile_size < Min_Tile_Size || resumed.tile_size > Max_Tile_Size) {
+			throw std::runtime_error("Checkpoint '" + path + "' has tiles of " + std::to_string(resumed.tile_size) + " pixels.");
+		}
+		if (adaptive_error > 0.0f) throw std::runtime_error("Can't resume an adaptively sampled render.");
+		add_samples = false;
+	}
+
 	if (!add_samples) {
-		build_timer.reset();
-		build_scene(scene_);
-		build_timer.pause();
-		accumulator_w = camera.film.width;
-		accumulator_h = camera.film.height;
-		std::array< int64_t, 3 > zero;
-		zero.fill(0);
-		accumulator.assign(accumulator_w * accumulator_h, zero);
-		accumulator_samples.assign(accumulator_w * accumulator_h, 0);
-		ray_log.clear();
+		if (prepared && prepared_from == &scene_) {
+			//prepare() already built this (while the last render traced the build it replaces):
+			compiled = std::move(prepared);
+		} else {
+			build_scene(scene_);
+		}
+		reset_accumulator(camera.film.width, camera.film.height);
+		clear_ray_log();
+	}
+	if (resuming) {
+		for (uint32_t idx = 0; idx < uint32_t(accumulator.size()); ++idx) {
+			for (uint32_t c = 0; c < 3; ++c) accumulator[idx][c].store(resumed.accumulator[idx][c], std::memory_order_relaxed);
+			accumulator_samples[idx].store(resumed.accumulator_samples[idx], std::memory_order_relaxed);
+			accumulator_moments[idx].store(resumed.accumulator_moments[idx], std::memory_order_relaxed);
+		}
+		for (auto &dirty : dirty_blocks) dirty.store(true, std::memory_order_relaxed);
 	}
 	render_timer.reset();
+	report_timer.reset();
+	traced_samples = 0;
+	{
+		std::lock_guard< std::mutex > lock(stats_mut);
+		tile_stats = Stats{};
+	}
+	if constexpr (RECORD_STATS) pixel_cost = decltype(pixel_cost)(size_t(camera.film.width) * camera.film.height);
+	budget_samples = uint64_t(camera.film.width) * camera.film.height * camera.film.samples;
 
 	//divide image into tiles for rendering:
-	// (feedback will be posted back to the UI after every tile completes)
+	// (feedback is posted back to the UI as tiles complete, at most report_rate times per second)
 	std::vector< Tile > tiles;
 
-	//tune these to your liking:
-	// lower values == quicker feedback but also generally more overhead
-	constexpr uint32_t tile_width = 100;
-	constexpr uint32_t tile_height = 100;
-	constexpr uint32_t tile_samples = 50;
+	const uint32_t tile_samples = this->tile_samples();
 
 	//get a pseudo-random stream to seed the tiles with:
 	RNG seeds_rng;
 	if (RNG::fixed_seed != 0) seeds_rng.seed(RNG::fixed_seed);
-
-	for (uint32_t y_begin = 0; y_begin < camera.film.height; y_begin += tile_height) {
-		uint32_t y_end = std::min(y_begin + tile_height, camera.film.height);
-		for (uint32_t x_begin = 0; x_begin < camera.film.width; x_begin += tile_width) {
-			uint32_t x_end = std::min(x_begin + tile_width, camera.film.width);
+	if (resuming) seeds_rng.seed(resumed.seed);
+	//(counter-based sequences are keyed by the same seed, but don't depend on the tiles)
+	sequence_seed = seeds_rng.get_seed();
+	if (!add_samples) rendered_samples = 0;
+	sample_offset = rendered_samples;
+	rendered_samples += camera.film.samples;
+
+	const uint32_t size = resuming ? resumed.tile_size : tile_size(camera.film.width, camera.film.height);
+	render_tile_size = size;
+	uint32_t region = 0;
+	for (uint32_t y_begin = 0; y_begin < camera.film.height; y_begin += size) {
+		uint32_t y_end = std::min(y_begin + size, camera.film.height);
+		for (uint32_t x_begin = 0; x_begin < camera.film.width; x_begin += size) {
+			uint32_t x_end = std::min(x_begin + size, camera.film.width);
 			for (uint32_t s_begin = 0; s_begin < camera.film.samples; s_begin += tile_samples) {
 				uint32_t s_end = std::min(s_begin + tile_samples, camera.film.samples);
 				uint32_t seed = seeds_rng.mt();
-				tiles.emplace_back(Tile{seed, x_begin, x_end, y_begin, y_end, s_begin, s_end});
+				uint32_t whole_size = (x_end - x_begin) * (y_end - y_begin) * (s_end - s_begin);
+				tiles.emplace_back(Tile{seed, x_begin, x_end, y_begin, y_end, s_begin, s_end, uint32_t(tiles.size()), region, whole_size});
 			}
+			++region;
+		}
+	}
+	{
+		std::lock_guard< std::mutex > lock(schedule_mut);
+		regions.assign(region, Region{});
+		measured_seconds = 0.0;
+		measured_work = 0;
+	}
+	split_tiles = (sequence != RNG::Sequence::Stream);
+
+	if (resuming && resumed.tiles_done.size() != tiles.size()) {
+		throw std::runtime_error("Checkpoint has " + std::to_string(resumed.tiles_done.size()) + " tiles, but the render has " +
+		                         std::to_string(tiles.size()) + ".");
+	}
+
+	//trace the selected tiles (from set_tiles), or all of them, less those a resumed checkpoint already has:
+	std::vector< uint8_t > selected = std::move(selected_tiles);
+	selected_tiles.clear();
+	if (selected.empty()) selected.assign(tiles.size(), 1);
+	else if (adaptive_error > 0.0f) throw std::runtime_error("Can't trace selected tiles of an adaptively sampled render.");
+	selected.resize(tiles.size(), 0);
+	if (resuming) summed_tiles = std::move(resumed.tiles_done);
+	else summed_tiles.assign(tiles.size(), 0);
+	std::vector< uint8_t > traced(tiles.size(), 0);
+	for (uint32_t i = 0; i < uint32_t(tiles.size()); ++i) {
+		traced[i] = selected[i] && !summed_tiles[i];
+		summed_tiles[i] |= traced[i];
+	}
+
+	//checkpoints start from the resumed sums (or from nothing):
+	// (not made for adaptive sampling, or when adding to an earlier render's samples)
+	if (!checkpoint_path.empty() && adaptive_error == 0.0f && !add_samples) {
+		checkpoint = empty_checkpoint();
+		if (resuming) {
+			for (uint32_t i = 0; i < uint32_t(tiles.size()); ++i) checkpoint.tiles_done[i] = summed_tiles[i] && !traced[i];
+			checkpoint.accumulator = std::move(resumed.accumulator);
+			checkpoint.accumulator_samples = std::move(resumed.accumulator_samples);
+			checkpoint.accumulator_moments = std::move(resumed.accumulator_moments);
 		}
+		checkpoint_stop = false;
+		checkpoint_thread = std::thread(&Pathtracer::save_checkpoints, this);
 	}
 
 	//a bit of flare -- do the tiles in a fancy order:
@@ -522,49 +1430,283 @@ void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camer
 
 	//actually launch the render jobs:
 	total_tiles = uint32_t(tiles.size());
-	for (auto const &tile : tiles) {
-		//queue up a render job per-tile:
-		thread_pool.enqueue([tile, this]() {
+	if (adaptive_error > 0.0f) {
+		//split tiles into passes by their sample ranges (keeping the inside-out order within each pass):
+		passes.assign((camera.film.samples + tile_samples - 1) / tile_samples, {});
+		for (auto const &tile : tiles) {
+			passes[tile.s_begin / tile_samples].emplace_back(tile);
+		}
+		next_pass = 0;
+		pixel_converged.assign(size_t(accumulator_w) * accumulator_h, 0);
+		start_next_pass();
+	} else {
+		passes.clear();
+		pixel_converged.clear();
+		//tiles that aren't traced count as traced (before queueing the others, so they can't finish the render early):
+		auto skip = std::remove_if(tiles.begin(), tiles.end(), [&](Tile const &tile) {
+			return !traced[tile.index];
+		});
+		uint32_t skipped = uint32_t(tiles.end() - skip);
+		tiles.erase(skip, tiles.end());
+		if (skipped) finish_tiles(skipped);
+		if (!tiles.empty()) schedule(tiles);
+	}
+}
+
+void Pathtracer::schedule(std::vector< Tile > const &tiles) {
+	{
+		std::lock_guard< std::mutex > lock(schedule_mut);
+		for (auto &region : regions) {
+			region.waiting.clear();
+			region.waiting_work = 0;
+		}
+		waiting_tiles = uint32_t(tiles.size());
+		uint32_t rank = 0;
+		for (auto const &tile : tiles) {
+			Region &region = regions[tile.region];
+			if (region.waiting.empty()) region.rank = rank++;
+			uint64_t work = tile_work(tile);
+			region.waiting.emplace_back(Waiting_Tile{tile, work});
+			region.waiting_work += work;
+		}
+		for (auto &region : regions) std::reverse(region.waiting.begin(), region.waiting.end());
+	}
+	enqueue_tile_tasks(uint32_t(tiles.size()));
+}
+
+bool Pathtracer::next_tile(Tile &tile) {
+	//cut tile in two, leaving one half in tile and the other in piece: (across its longer side, or, once that
+	// is Min_Piece_Size or less, across its samples) returns false if tile is too small to split
+	auto split = [](Tile &tile, Tile &piece) {
+		piece = tile;
+		uint32_t w = tile.x_end - tile.x_begin, h = tile.y_end - tile.y_begin, s = tile.s_end - tile.s_begin;
+		if (std::max(w, h) > Min_Piece_Size) {
+			if (w >= h) tile.x_end = piece.x_begin = tile.x_begin + w / 2;
+			else tile.y_end = piece.y_begin = tile.y_begin + h / 2;
+		} else if (s > 1) {
+			tile.s_end = piece.s_begin = tile.s_begin + s / 2;
+		} else {
+			return false;
+		}
+		return true;
+	};
+
+	uint32_t added = 0;
+	{
+		std::lock_guard< std::mutex > lock(schedule_mut);
+		//(regions nothing has been measured in yet are estimated at the average cost so far)
+		double average = measured_work ? measured_seconds / double(measured_work) : 1.0;
+		auto rate = [&](Region const &region) {
+			return region.work ? region.seconds / double(region.work) : average;
+		};
+
+		//find the waiting tile estimated to cost the most, and the estimated cost of all of them:
+		Region *best = nullptr;
+		double best_cost = 0.0, remaining = 0.0;
+		for (auto &region : regions) {
+			if (region.waiting.empty()) continue;
+			double r = rate(region);
+			remaining += r * double(region.waiting_work);
+			double cost = r * double(region.waiting.back().work);
+			if (!best || cost > best_cost || (cost == best_cost && region.rank < best->rank)) {
+				best = &region;
+				best_cost = cost;
+			}
+		}
+		if (!best) return false;
+
+		Waiting_Tile next = best->waiting.back();
+		best->waiting.pop_back();
+		best->waiting_work -= next.work;
+		waiting_tiles -= 1;
+
+		//while too few tiles are waiting to keep the other threads busy, split off pieces (which wait to be
+		// traced next) until what's left is no more than its share of the work left:
+		uint32_t threads = thread_pool.size();
+		if (split_tiles && threads > 1) {
+			double share = remaining / double(Pieces_Per_Thread * threads);
+			double r = rate(*best);
+			Tile piece;
+			while (waiting_tiles < Pieces_Per_Thread * (threads - 1) && r * double(next.work) > share
+			       && next.work >= 2 * Min_Piece_Work && split(next.tile, piece)) {
+				next.work = tile_work(next.tile);
+				uint64_t work = tile_work(piece);
+				best->waiting.emplace_back(Waiting_Tile{piece, work});
+				best->waiting_work += work;
+				waiting_tiles += 1;
+				++added;
+			}
+		}
+		tile = next.tile;
+
+		//(counted before this tile can finish, so the render can't seem done while pieces are waiting)
+		total_tiles += added;
+		if (!passes.empty()) pass_tiles_left += added;
+	}
+	if (added) enqueue_tile_tasks(added);
+	return true;
+}
+
+void Pathtracer::measured(Tile const &tile, float seconds) {
+	uint64_t work = tile_work(tile);
+	std::lock_guard< std::mutex > lock(schedule_mut);
+	Region &region = regions[tile.region];
+	region.seconds += seconds;
+	region.work += work;
+	measured_seconds += seconds;
+	measured_work += work;
+}
+
+uint64_t Pathtracer::tile_work(Tile const &tile) const {
+	uint64_t pixels = uint64_t(tile.x_end - tile.x_begin) * (tile.y_end - tile.y_begin);
+	if (!pixel_converged.empty()) {
+		pixels = 0;
+		for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
+			for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
+				pixels += !pixel_converged[py * accumulator_w + px];
+			}
+		}
+	}
+	return pixels * (tile.s_end - tile.s_begin);
+}
+
+void Pathtracer::enqueue_tile_tasks(uint32_t count) {
+	std::vector<std::function<void()>> tasks;
+	tasks.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		//queue up a render job per-tile (each traces whichever tile the scheduler says is next):
+		tasks.emplace_back([this]() {
+			Tile tile;
+			if (!next_tile(tile)) return;
+
+			//(a worker runs one task at a time, so what its counts gain while tracing is this tile's)
+			Render_Stats before;
+			if constexpr (RECORD_STATS) before = Render_Stats::thread();
+			Timer timer;
+
 			RNG rng(tile.seed);
-			do_trace(rng, tile);
+			if (integrator == Integrator::Batched_Camera) do_trace_batched(rng, tile);
+			else do_trace(rng, tile);
+			if (render_group.cancelled()) return;
 
-			uint32_t traced = traced_tiles.fetch_add(1) + 1;
-			if (traced == total_tiles) {
-				std::lock_guard<std::mutex> lock(accumulator_mut);
-				render_timer.pause();
-				report_fn({1.0f, accumulator_to_image()});
-			} else {
-				std::lock_guard<std::mutex> lock(accumulator_mut);
-				report_fn({traced / float(total_tiles), accumulator_to_image()});
+			float seconds = timer.s();
+			measured(tile, seconds);
+			if constexpr (RECORD_STATS) record_tile(Render_Stats::thread() - before, seconds);
+
+			//the last tile of an adaptive pass starts the next one:
+			if (!passes.empty() && pass_tiles_left.fetch_sub(1) == 1) {
+				start_next_pass();
+			}
+			finish_tiles(1);
+		});
+	}
+	thread_pool.enqueue(render_group, std::move(tasks));
+}
+
+void Pathtracer::start_next_pass() {
+	//never stop a pixel before its variance estimate means something:
+	constexpr uint32_t Min_Samples = 8;
+
+	while (next_pass < passes.size()) {
+		std::vector< Tile > const &pass = passes[next_pass++];
+
+		//no tiles are running, so the accumulator is up to date:
+		for (uint32_t idx = 0; idx < uint32_t(pixel_converged.size()); ++idx) {
+			if (pixel_converged[idx]) continue;
+			if (accumulator_samples[idx].load(std::memory_order_relaxed) < Min_Samples) continue;
+			if (accumulator_relative_error(idx) <= adaptive_error) pixel_converged[idx] = 1;
+		}
+
+		//keep tiles with pixels left to trace, starting with those that have the most:
+		std::vector< std::pair< uint32_t, Tile > > remaining;
+		for (auto const &tile : pass) {
+			uint32_t pixels = 0;
+			for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
+				for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
+					pixels += !pixel_converged[py * accumulator_w + px];
+				}
 			}
+			if (pixels) remaining.emplace_back(pixels, tile);
+		}
+		std::stable_sort(remaining.begin(), remaining.end(), [](auto const &a, auto const &b) {
+			return a.first > b.first;
 		});
+
+		//skipped tiles count as traced (before queueing the others, so they can't finish the render early):
+		uint32_t skipped = uint32_t(pass.size() - remaining.size());
+		if (remaining.empty()) {
+			finish_tiles(skipped);
+			continue;
+		}
+		if (skipped) finish_tiles(skipped);
+
+		std::vector< Tile > tiles;
+		tiles.reserve(remaining.size());
+		for (auto const &[pixels, tile] : remaining) tiles.emplace_back(tile);
+		pass_tiles_left = uint32_t(tiles.size());
+		schedule(tiles);
+		return;
 	}
 }
 
 void Pathtracer::cancel() {
 	if (cancel_flag) *cancel_flag = true;
-	thread_pool.clear();
+	//drops queued tiles and waits for running ones (without restarting the worker threads):
+	thread_pool.cancel(render_group);
+	stop_checkpoints();
+	{
+		std::lock_guard< std::mutex > lock(schedule_mut);
+		regions.clear();
+	}
 	traced_tiles = 0;
+	finished_tiles = 0;
 	total_tiles = 0;
 	if (cancel_flag) *cancel_flag = false;
 	render_timer.pause();
 }
 
 const std::vector<Pathtracer::Ray_Log> Pathtracer::copy_ray_log() {
+	//(the lock only keeps buffers from being added or replaced; their threads keep logging while this copies)
 	std::lock_guard<std::mutex> lock(ray_log_mut);
-	return ray_log;
+	std::vector<Ray_Log> ret;
+	for (auto const& [id, log] : ray_logs) log->copy_to(ret);
+	return ret;
+}
+
+float Pathtracer::env_light_power(const Environment_Light& light) {
+	//image maps already integrated their luminance to build their importance sampler:
+	if (light.is<Environment_Lights::Sphere>()) {
+		auto const& sphere = std::get<Environment_Lights::Sphere>(light.light);
+		if (!sphere.importance.rows.empty()) return sphere.importance.total;
+	}
+	//otherwise, estimate it from a spherical Fibonacci set of directions:
+	constexpr uint32_t Directions = 256;
+	const float golden = PI_F * (3.0f - std::sqrt(5.0f));
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < Directions; ++i) {
+		float y = 1.0f - 2.0f * (i + 0.5f) / Directions;
+		float r = std::sqrt(std::max(1.0f - y * y, 0.0f));
+		float phi = golden * i;
+		sum += std::max(light.evaluate(Vec3{r * std::cos(phi), y, r * std::sin(phi)}).luma(), 0.0f);
+	}
+	return sum * 4.0f * PI_F / Directions;
 }
 
 Vec3 Pathtracer::sample_area_lights(RNG &rng, Vec3 from) {
 
-	size_t n_emissive = emissive_objects.n_primitives();
-	size_t n_env = env_lights.size();
+	auto& emissive_objects = compiled->emissive_objects;
+	auto& env_emitters = compiled->env_emitters;
+	size_t n_emissive = emissive_objects.n_emitters();
+	size_t n_env = env_emitters.size();
 
 	auto sample_env_lights = [&]() {
-		int32_t n = rng.integer(0, static_cast<int32_t>(n_env));
-		auto it = env_lights.begin();
-		std::advance(it, n);
-		return it->second->sample(rng);
+		//(few enough env lights that a linear walk over their weights is cheapest)
+		float pick = rng.unit();
+		for (size_t i = 0; i + 1 < n_env; ++i) {
+			if (pick < env_emitters[i].weight) return env_emitters[i].light->sample(rng);
+			pick -= env_emitters[i].weight;
+		}
+		return env_emitters.back().light->sample(rng);
 	};
 
 	if (n_emissive > 0 && n_env > 0) {
@@ -582,15 +1724,17 @@ Vec3 Pathtracer::sample_area_lights(RNG &rng, Vec3 from) {
 
 float Pathtracer::area_lights_pdf(Vec3 from, Vec3 dir) {
 
-	size_t n_emissive = emissive_objects.n_primitives();
-	size_t n_env = env_lights.size();
+	auto& emissive_objects = compiled->emissive_objects;
+	auto& env_emitters = compiled->env_emitters;
+	size_t n_emissive = emissive_objects.n_emitters();
+	size_t n_env = env_emitters.size();
 
 	auto env_lights_pdf = [&]() {
 		float pdf = 0.0f;
-		for (auto& light : env_lights) {
-			pdf += light.second->pdf(dir);
+		for (auto const& emitter : env_emitters) {
+			pdf += emitter.weight * emitter.light->pdf(dir);
 		}
-		return n_env ? pdf / n_env : 0.0f;
+		return pdf;
 	};
 
 	uint32_t n_strategies = (n_emissive > 0) + (n_env > 0);
@@ -604,7 +1748,7 @@ Spectrum Pathtracer::sum_delta_lights(const Shading_Info& hit) {
 	if (hit.bsdf.is_specular()) return {};
 
 	Spectrum radiance;
-	for (auto& light : point_lights) {
+	for (auto& light : compiled->point_lights) {
 		Delta_Lights::Incoming incoming = light.incoming(hit.pos);
 		Vec3 in_dir = hit.world_to_object.rotate(incoming.direction);
 
@@ -613,8 +1757,8 @@ Spectrum Pathtracer::sum_delta_lights(const Shading_Info& hit) {
 
 		Ray shadow_ray(hit.pos, incoming.direction, Vec2{EPS_F, incoming.distance - EPS_F});
 
-		Trace shadow = scene.hit(shadow_ray);
-		if (!shadow.hit) {
+		count_ray(Ray_Kind::Shadow);
+		if (!compiled->scene->occluded(shadow_ray)) {
 			radiance += attenuation * incoming.radiance;
 		}
 	}
@@ -1,49 +1,149 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
+#include <map>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 
 #include "../lib/mathlib.h"
 #include "../scene/scene.h"
 
 #include "../util/hdr_image.h"
+#include "../util/rand.h"
 #include "../util/thread_pool.h"
 #include "../util/timer.h"
 
 #include "aggregate.h"
+#include "checkpoint.h"
+#include "light_tree.h"
+#include "ray_log.h"
+#include "shading_material.h"
+#include "stats.h"
 
 namespace PT {
 
 class Pathtracer {
 public:
 	struct Shading_Info {
-		const Material& bsdf;
+		const Shading_Material& bsdf;
 		Mat4 world_to_object, object_to_world;
 		Vec3 pos, out_dir, normal;
 		Vec2 uv;
 		uint32_t depth = 0;
 	};
-	struct Ray_Log {
-		Ray ray;
-		float t = 1.0f;
-		Spectrum color = Spectrum{1.0f};
-	};
+	using Ray_Log = PT::Ray_Log;
 
 	Pathtracer();
 	~Pathtracer();
 
 	void use_bvh(bool use_bvh);
+	//also collapse BVHs into 4-wide nodes, and traverse those (see BVH_Build_Opts::wide):
+	void use_wide_bvh(bool wide);
+	//how meshes keep their vertex attributes (Compact: quantized, and decoded only at closest hits; see Tri_Mesh):
+	void set_mesh_format(Tri_Mesh::Vertex_Format format);
 	uint32_t visualize_bvh(GL::Lines& lines, GL::Lines& active, uint32_t level);
-	const std::vector<Ray_Log> copy_ray_log(); //copy ray log (with proper locking)
+	const std::vector<Ray_Log> copy_ray_log(); //copy ray log (merging every thread's buffer)
+
+	//ray log: each thread logs up to 'capacity' rays into a buffer of its own (without locks), and once that is
+	// full, 'policy' decides which it keeps (so logging any number of rays takes bounded memory):
+	// (takes effect when the next render() clears the log)
+	void set_ray_log(uint32_t capacity, Ray_Log_Policy policy);
 
 	using Render_Report = std::pair<float, HDR_Image>;
 	void render(Scene& scene, std::shared_ptr<::Instance::Camera> camera,
 	            std::function<void(Render_Report &&)>&& f, bool* quit, bool add_samples = false);
+	//build 'scene' for the next render() while the current one is still tracing, e.g. the next frame of an
+	// animation; the next render() of 'scene' then starts from this build instead of building it again:
+	// (call from the thread that calls render(), and don't change 'scene' in between)
+	void prepare(Scene& scene);
 	
 	bool in_progress() const;
-	std::pair<float, float> completion_time() const;
+	float progress() const; //fraction of tiles traced
+
+	//timings of the last build_scene() and render() (seconds):
+	struct Completion_Time {
+		float build = 0.0f; //whole scene build, including:
+		float meshes = 0.0f; // - converting meshes and building their BVHs (in parallel)
+		float scene_bvh = 0.0f; // - building the BVH over all instances
+		float render = 0.0f;
+
+		//what the last build_scene() reused from earlier builds vs. (re)built:
+		uint32_t meshes_reused = 0, meshes_rebuilt = 0;
+		uint32_t textures_reused = 0, textures_rebuilt = 0;
+		uint32_t materials_reused = 0, materials_rebuilt = 0;
+		bool scene_bvh_reused = false;
+	};
+	Completion_Time completion_time() const;
+	//memory held by the path tracing copy of each of scene's meshes (by name), as of the last build_scene():
+	std::vector< std::pair< std::string, Tri_Mesh::Memory > > mesh_memory(Scene const &scene) const;
+
+	//limit intermediate (partial) render reports to 'rate' per second; 0 == only send the final image:
+	void set_report_rate(float rate);
+
+	//adaptive sampling: stop tracing a pixel once the standard error of its mean luminance is below
+	// 'relative_error' times that mean (film.samples is still the most any pixel gets); 0 == disabled:
+	void set_adaptive_error(float relative_error);
+
+	//where camera, BSDF, and light samples draw their random numbers (see RNG::Sequence):
+	// (Sobol by default; Stream draws the Mersenne Twister numbers seeds gave before the counter-based sequences)
+	void set_sequence(RNG::Sequence sequence);
+
+	//how tiles are traced:
+	enum class Integrator : uint8_t {
+		Recursive, //one sample at a time, depth-first through trace() (see do_trace)
+		Batched_Camera, //a wave of samples at a time: camera rays intersected in one batch, then each path shaded (and
+		                // continued depth-first, as trace() does) grouped by material (see do_trace_batched)
+	};
+	void set_integrator(Integrator integrator);
+
+	//checkpoints: while rendering, save progress to 'path' every 'interval' seconds; "" == off
+	// (checkpoints are kept up to date, and written, by a thread of their own, so tiles never wait on the disk;
+	//  they aren't made when sampling adaptively, since which tiles run depends on how earlier passes went)
+	void set_checkpoint(std::string const &path, float interval);
+	//make the next render() resume from the checkpoint at 'path', tracing only the tiles it doesn't have:
+	// (render() throws if the checkpoint was made with different film or sampling settings)
+	void resume_from(std::string const &path);
+
+	//distributed rendering: several pathtracers (usually in separate processes) each trace some of a frame's tiles,
+	// and the sums they add up to are merged into the frame; since the sums are fixed point, the merged frame is
+	// the same as one pathtracer tracing every tile (given the same seed).
+	//only trace these tiles in the next render() (indices in [0, tile_count()), in the order render() makes tiles):
+	void set_tiles(std::vector< uint32_t > const &tiles);
+	//how many tiles render() divides camera's film into: (more with more threads, so distributed workers
+	// must have as many threads as each other)
+	uint32_t tile_count(::Camera const &camera) const;
+	//the sums the last render() added up to, as a checkpoint of the tiles it traced (or resumed):
+	Checkpoint partial() const;
+	//the image of the sums of partial renders of (disjoint sets of tiles of) the same frame:
+	// (throws if they weren't made with the same settings, or share tiles; tiles no partial has are left black)
+	static HDR_Image merge(std::vector< Checkpoint > const &partials);
+
+	//the pool tiles are traced on; other work (e.g., stepping the scene while a frame renders) may share it:
+	Thread_Pool& get_thread_pool();
+
+	//samples traced by the last render() vs. the film.samples-per-pixel budget:
+	// (the two only differ with adaptive sampling)
+	struct Sample_Counts {
+		uint64_t traced = 0;
+		uint64_t budget = 0;
+	};
+	Sample_Counts sample_counts() const;
+
+	//statistics of the last render(), summed over the tiles it traced: (all zero if RECORD_STATS is off)
+	struct Stats {
+		Render_Stats counts; //rays, BVH nodes visited, and primitives tested (see stats.h)
+		uint32_t tiles = 0; //tiles traced
+		float tile_seconds = 0.0f; //time spent tracing tiles, summed over threads
+		float slowest_tile = 0.0f;
+		float render = 0.0f; //wall-clock time of the render (as in completion_time())
+		//per pixel (in film order, bottom row first): traversal steps spent on its samples
+		std::vector< uint64_t > pixel_cost;
+	};
+	Stats stats() const;
 
 	Spectrum sample_direct_lighting_task4(RNG &rng, const Shading_Info& hit);
 	Spectrum sample_direct_lighting_task6(RNG &rng, const Shading_Info& hit);
@@ -56,40 +156,182 @@ private:
 	void cancel();
 
 	//a 'Tile' is a region of the image (in both pixel and sample space) to trace:
+	// (the scheduler may split a tile into pieces, which are Tiles with the same seed, index, and region)
 	struct Tile {
 		uint32_t seed = 0; //RNG seed to use
 		uint32_t x_begin = 0, x_end = 0;
 		uint32_t y_begin = 0, y_end = 0;
 		uint32_t s_begin = 0, s_end = 0;
+		uint32_t index = 0; //in the order render() makes tiles (for checkpoints)
+		uint32_t region = 0; //area of the film its sample batches share (in the order render() makes them)
+		uint32_t whole_size = 0; //pixel-samples in the tile as render() made it (more than in any of its pieces)
 	};
 
+	//tune these to your liking:
+	// lower values == quicker feedback but also generally more overhead
+	// (tiles are square, and shrink so the film has at least Min_Regions areas of tiles, and more on many cores)
+	static constexpr uint32_t Max_Tile_Size = 100;
+	static constexpr uint32_t Min_Tile_Size = 16;
+	static constexpr uint32_t Min_Regions = 64;
+	static constexpr uint32_t Regions_Per_Thread = 8;
+	uint32_t tile_size(uint32_t width, uint32_t height) const;
+	//(the tile size of the current render: a resumed render keeps its checkpoint's)
+	uint32_t render_tile_size = 0;
+	// (adaptive sampling checks for converged pixels after every tile_samples(), so it uses fewer)
+	uint32_t tile_samples() const {
+		return adaptive_error > 0.0f ? 16 : 50;
+	}
+
 	//trace [x_begin,x_end)x[y_begin,y_end) region of the image, shooting rays for samples [s_begin,s_end):
 	void do_trace(RNG &rng, Tile const &tile);
+	//...the same, batching a wave of samples' camera rays: (same image as do_trace with a counter-based sequence)
+	void do_trace_batched(RNG &rng, Tile const &tile);
 	//accumulate samples from do_trace into the accumulator:
-	void accumulate(Tile const &tile, const HDR_Image& data);
+	// (data is tile-sized: data.at(0,0) holds the samples for pixel (x_begin,y_begin);
+	//  moments holds the sums of squared sample luminances, in the same layout)
+	void accumulate(Tile const &tile, const HDR_Image& data, std::vector< float > const &moments);
 
 	bool* cancel_flag = nullptr;
 	std::function<void(Render_Report &&)> report_fn;
 
 	Thread_Pool thread_pool;
+	Thread_Pool::Group render_group; //tile tasks from the current render()
 	bool scene_use_bvh = true;
-	Timer render_timer, build_timer;
+	bool scene_wide_bvh = false;
+	Tri_Mesh::Vertex_Format mesh_format = Tri_Mesh::Vertex_Format::Full;
+	Timer render_timer;
 
-	std::mutex accumulator_mut;
 	uint32_t accumulator_w = 0, accumulator_h = 0;
 	//accumulator will store spectrums as 40.24 fixed point to avoid order-of-addition nondeterminism:
-	std::vector< std::array< int64_t, 3 > > accumulator;
+	// (since addition order doesn't matter, tiles add with relaxed atomics instead of taking a lock)
+	std::vector< std::array< std::atomic< int64_t >, 3 > > accumulator;
 	//accumulator will store sample counts as well:
-	std::vector< uint32_t > accumulator_samples;
-	//compute image (divide spectrums by sample counts):
-	HDR_Image accumulator_to_image() const;
+	std::vector< std::atomic< uint32_t > > accumulator_samples;
+	//...and the sum of squared sample luminances (as 48.16 fixed point), for variance estimates:
+	std::vector< std::atomic< int64_t > > accumulator_moments;
+	//(re-)allocate accumulator and progress image for a w x h film:
+	void reset_accumulator(uint32_t w, uint32_t h);
+	//compute pixel of image (divide spectrum by sample count):
+	Spectrum accumulator_pixel(uint32_t idx) const;
+	//standard error of pixel's mean luminance, relative to that mean:
+	float accumulator_relative_error(uint32_t idx) const;
+
+	//progress images are only updated in blocks that accumulate() has touched since the last report:
+	static constexpr uint32_t Dirty_Block_Size = 32;
+	uint32_t dirty_blocks_w = 0;
+	std::vector< std::atomic< bool > > dirty_blocks;
+	HDR_Image progress_image;
+	//bring progress_image up to date with the accumulator:
+	void resolve_dirty_blocks();
+
+	//intermediate reports are rate-limited; the final report is always sent:
+	std::mutex report_mut;
+	float report_rate = 10.0f;
+	Timer report_timer;
+	void report_progress(uint32_t traced);
+	void report_final();
 
-	uint32_t total_tiles = 0;
+	std::atomic<uint32_t> total_tiles = 0; //(tile pieces count as tiles; splitting a tile adds to this)
 	std::atomic<uint32_t> traced_tiles = 0;
+	std::atomic<uint32_t> finished_tiles = 0; //(counted before their reports are sent; traced_tiles after)
+	//count tiles as done, and report progress (or the final image, if these were the last tiles):
+	void finish_tiles(uint32_t count);
+
+	//adaptive sampling traces the film in passes (one per tile_samples range of samples),
+	// deciding which pixels have converged between passes:
+	// (tiles and their seeds are all made up-front, so the image only depends on the seed)
+	float adaptive_error = 0.0f;
+	std::vector< std::vector< Tile > > passes;
+	uint32_t next_pass = 0;
+	std::atomic< uint32_t > pass_tiles_left = 0;
+	//per-pixel: 1 if converged (only written between passes, so tiles can read it freely):
+	std::vector< uint8_t > pixel_converged;
+	//mark converged pixels, then queue the tiles of the next pass that still have pixels to trace:
+	void start_next_pass();
+
+	//scheduling: tiles wait in their regions, and each tile task traces the waiting tile estimated to cost the
+	// most (from what its region has cost so far); when too few tiles are waiting to go around the threads, a tile
+	// estimated to cost more than its share of the work left is first split into pieces, so that the end of a
+	// render (or a render of only a few tiles) still keeps every core busy:
+	// (pieces draw exactly the samples their tile would have with the default, counter-based, sequences, so
+	//  splitting never changes the image; RNG::Sequence::Stream's draws follow on from each other, so its tiles are
+	//  never split, and only the several regions per thread keep the cores busy)
+	struct Waiting_Tile {
+		Tile tile;
+		uint64_t work = 0; //pixel-samples left to trace (skipping converged pixels)
+	};
+	struct Region {
+		std::vector< Waiting_Tile > waiting; //(next one at the back)
+		uint64_t waiting_work = 0;
+		double seconds = 0.0; //time its traced tiles took...
+		uint64_t work = 0; //...to trace this many pixel-samples
+		uint32_t rank = 0; //(earlier-queued regions go first among those with equal estimates)
+	};
+	//how finely to split tiles: into pieces of at most 1 / (Pieces_Per_Thread * threads) of the work left
+	static constexpr uint32_t Pieces_Per_Thread = 2;
+	static constexpr uint32_t Min_Piece_Size = 8; //(pixels on a side; then pieces are split by samples)
+	static constexpr uint64_t Min_Piece_Work = 1024; //(pixel-samples)
+	std::mutex schedule_mut;
+	std::vector< Region > regions;
+	uint32_t waiting_tiles = 0;
+	double measured_seconds = 0.0;
+	uint64_t measured_work = 0;
+	bool split_tiles = true;
+	//queue tiles, in order (all tiles of the previous schedule() must be finished):
+	void schedule(std::vector< Tile > const &tiles);
+	//take the next tile (or piece) to trace, queueing tasks for any pieces split off of it:
+	bool next_tile(Tile &tile);
+	//add a traced tile's time to the estimates:
+	void measured(Tile const &tile, float seconds);
+	uint64_t tile_work(Tile const &tile) const;
+	void enqueue_tile_tasks(uint32_t count);
+
+	std::atomic< uint64_t > traced_samples = 0;
+	uint64_t budget_samples = 0;
+
+	//statistics of the current render: tiles add their counts and times under stats_mut, and their pixels'
+	// costs with relaxed atomics (both once per tile, so tracing itself only touches thread-local counts):
+	mutable std::mutex stats_mut;
+	Stats tile_stats; //(stats() fills in its pixel_cost from the atomics below)
+	std::vector< std::atomic< uint64_t > > pixel_cost;
+	void record_tile(Render_Stats const &counts, float seconds);
+	//(cost is tile-sized, in the layout of do_trace's sample buffer)
+	void add_pixel_cost(Tile const &tile, std::vector< uint64_t > const &cost);
+
+	std::vector< uint8_t > selected_tiles; //(from set_tiles(), for the next render; empty == all)
+	std::vector< uint8_t > summed_tiles; //per tile of the current render: 1 if it is traced (or resumed) into the sums
+	//a checkpoint of the current render with no tiles in it:
+	Checkpoint empty_checkpoint() const;
+
+	std::string checkpoint_path, resume_path;
+	float checkpoint_interval = 60.0f;
+	//accumulate() hands each tile's samples to the checkpoint thread, which adds them to its own copy of the sums
+	// (so its copy only ever holds whole tiles) and saves that copy every checkpoint_interval:
+	struct Checkpoint_Tile {
+		Tile tile;
+		HDR_Image data;
+		std::vector< float > moments;
+	};
+	std::mutex checkpoint_mut;
+	std::condition_variable checkpoint_wake;
+	std::vector< Checkpoint_Tile > checkpoint_tiles;
+	bool checkpoint_stop = false;
+	Checkpoint checkpoint;
+	std::thread checkpoint_thread;
+	void save_checkpoints();
+	void stop_checkpoints();
+
+	Integrator integrator = Integrator::Recursive;
+	RNG::Sequence sequence = RNG::Sequence::Sobol;
+	uint32_t sequence_seed = 0;
+	//sample indices within the sequence start after those of earlier renders (when adding samples):
+	uint32_t sample_offset = 0, rendered_samples = 0;
 
 	//trace a single ray into the scene,
 	//return (emitted, reflected) light incoming along ray
 	std::pair<Spectrum, Spectrum> trace(RNG &rng, const Ray& ray);
+	//...the same, given the ray's closest hit: (trace() is scene.hit() then shade())
+	std::pair<Spectrum, Spectrum> shade(RNG &rng, const Ray& ray, Trace result);
 
 	//compute the contribution of all of the delta lights in the scene:
 	// NOTE: no sampling required because delta lights are in exactly one spot!
@@ -98,24 +340,84 @@ private:
 	//compute a direction to one of the area lights:
 	Vec3 sample_area_lights(RNG &rng, Vec3 from);
 	float area_lights_pdf(Vec3 from, Vec3 dir);
+	//integral of an environment light's luminance over the sphere (or an estimate of it):
+	static float env_light_power(const Environment_Light& light);
 
+	//buffers of threads that have logged rays (added under ray_log_mut, then written by their thread alone):
 	std::mutex ray_log_mut;
-	std::vector<Ray_Log> ray_log;
+	std::vector<std::pair<std::thread::id, std::unique_ptr<Ray_Log_Buffer>>> ray_logs;
+	uint32_t ray_log_capacity = 16384, next_ray_log_capacity = 16384;
+	Ray_Log_Policy ray_log_policy = Ray_Log_Policy::Reservoir, next_ray_log_policy = Ray_Log_Policy::Reservoir;
+	//(threads cache their buffer along with this id, which is new whenever the buffers are replaced)
+	uint64_t ray_log_id = 0;
+	Ray_Log_Buffer& thread_ray_log();
+	void clear_ray_log(); //(only while no tiles are running)
 	void log_ray(const Ray& ray, float t, Spectrum color = Spectrum{1.0f});
 
-	Aggregate scene;
-	List<Instance> emissive_objects;
-	std::vector<Light_Instance> point_lights;
-
 	Camera camera;
 	Mat4 camera_to_world;
 
-	std::unordered_map<std::string, std::shared_ptr<Delta_Light>> delta_lights;
-	std::unordered_map<std::string, std::shared_ptr<Environment_Light>> env_lights;
-	std::unordered_map<std::string, std::shared_ptr<Material>> materials;
-	std::unordered_map<std::string, std::shared_ptr<Texture>> textures;
-	std::unordered_map<std::string, std::shared_ptr<Tri_Mesh>> meshes;
-	std::unordered_map<std::string, std::shared_ptr<Shape>> shapes;
+	//Path tracing copies of scene resources are kept across builds, keyed by the resource they were made from.
+	// When a resource changes, its copy is updated in place, so pointers to copies (held by instances, materials,
+	// light trees, and the scene BVH) stay valid -- unless the copy is shared with another Compiled_Scene (see
+	// prepare()), in which case it is replaced instead; copies of resources that leave the scene are dropped.
+	template< typename T, typename Copy = T >
+	struct Cached {
+		std::weak_ptr< T > source;
+		std::shared_ptr< Copy > copy;
+		uint64_t fingerprint = 0; //of the source, when copied
+		bool changed = false; //copy was (re)made by the latest build
+		bool used = false; //source was in the scene at the latest build
+	};
+	//(instances refer to a material copy's shading record, which points into the copy)
+	struct Material_Copy {
+		Material material;
+		Shading_Material shading;
+	};
+	//env_lights as a flat array, each with its (normalized) share of environment light samples:
+	struct Env_Emitter {
+		const Environment_Light* light = nullptr;
+		float weight = 0.0f;
+	};
+	//the instances the scene BVH was built over (with scene_use_bvh as of then), so an unchanged one can be reused:
+	struct Object_Key {
+		const void* geometry = nullptr;
+		const Shading_Material* material = nullptr;
+		Mat4 T;
+		bool operator==(Object_Key const &other) const {
+			return geometry == other.geometry && material == other.material && T == other.T;
+		}
+	};
+
+	//everything a build makes from a Scene, which is all that tiles read of it:
+	struct Compiled_Scene {
+		std::shared_ptr<Aggregate> scene = std::make_shared<Aggregate>(); //(shared by builds that reuse it)
+		Light_Tree<Area_Light> emissive_objects;
+		std::vector<Light_Instance> point_lights;
+		std::unordered_map<std::string, std::shared_ptr<Delta_Light>> delta_lights;
+		std::vector<Env_Emitter> env_emitters;
+		//light trees over the triangles of each emissive (mesh, material) pair, shared by all their instances:
+		std::map<std::pair<const Tri_Mesh*, const Shading_Material*>, std::shared_ptr<Light_Tree<Emissive_Triangle>>> mesh_lights;
+
+		std::unordered_map<const void*, Cached<void, Tri_Mesh>> mesh_cache; //(halfedge and skinned meshes)
+		std::unordered_map<const Shape*, Cached<Shape>> shape_cache;
+		std::unordered_map<const Texture*, Cached<Texture>> texture_cache;
+		std::unordered_map<const Material*, Cached<Material, Material_Copy>> material_cache;
+		std::unordered_map<const Environment_Light*, Cached<Environment_Light>> env_light_cache;
+		std::shared_ptr<Texture> default_texture;
+		std::shared_ptr<Material_Copy> default_material;
+
+		std::vector<Object_Key> scene_objects;
+		bool scene_built = false, scene_built_with_bvh = false, scene_built_wide = false;
+		Completion_Time build_stats; //(times and counts of the build that made this)
+	};
+	//tiles trace 'compiled'; prepare() builds the next frame's into 'prepared', starting from a copy of 'compiled'
+	// (whose copies it shares until they change), which render() swaps in once the current frame is done:
+	std::unique_ptr<Compiled_Scene> compiled = std::make_unique<Compiled_Scene>();
+	std::unique_ptr<Compiled_Scene> prepared;
+	const Scene* prepared_from = nullptr;
+	//build scene_ into 'into':
+	void compile(Scene& scene_, Compiled_Scene& into);
 };
 
 } // namespace PT
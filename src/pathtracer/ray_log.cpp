@@ -0,0 +1,81 @@
+
+#include "ray_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace PT {
+
+static_assert(std::is_trivially_copyable_v< Ray_Log >, "ray log entries are copied word by word");
+
+namespace {
+
+//a well-mixed 64-bit value for x (splitmix64's finalizer):
+uint64_t mix(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+} // namespace
+
+Ray_Log_Buffer::Ray_Log_Buffer(uint32_t capacity, Ray_Log_Policy policy, uint64_t seed_)
+	: slots(std::make_unique< Slot[] >(capacity)), slot_count(capacity), keep(policy), seed(seed_) {
+}
+
+void Ray_Log_Buffer::add(Ray_Log const &entry) {
+	uint64_t n = count.load(std::memory_order_relaxed);
+	if (slot_count == 0) return;
+
+	//once full, the n-th ray replaces the oldest (Latest), or replaces a random slot with probability capacity / (n+1) (Reservoir):
+	uint64_t index = n;
+	if (n >= slot_count) {
+		if (keep == Ray_Log_Policy::Latest) {
+			index = n % slot_count;
+		} else {
+			index = mix(seed ^ n) % (n + 1);
+			if (index >= slot_count) {
+				count.store(n + 1, std::memory_order_release);
+				return;
+			}
+		}
+	}
+
+	uint32_t words[Words] = {};
+	std::memcpy(words, &entry, sizeof(Ray_Log));
+
+	//(a seqlock: readers that see an odd sequence, or a different sequence after copying, skip the slot)
+	Slot &slot = slots[index];
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (uint32_t w = 0; w < Words; ++w) slot.words[w].store(words[w], std::memory_order_relaxed);
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+
+	count.store(n + 1, std::memory_order_release);
+}
+
+void Ray_Log_Buffer::copy_to(std::vector< Ray_Log > &out) const {
+	uint64_t filled = std::min< uint64_t >(count.load(std::memory_order_acquire), slot_count);
+	for (uint64_t i = 0; i < filled; ++i) {
+		Slot const &slot = slots[i];
+		uint32_t before = slot.sequence.load(std::memory_order_acquire);
+		if (before & 1) continue;
+		uint32_t words[Words];
+		for (uint32_t w = 0; w < Words; ++w) words[w] = slot.words[w].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+
+		Ray_Log entry;
+		std::memcpy(&entry, words, sizeof(Ray_Log));
+		out.emplace_back(entry);
+	}
+}
+
+void Ray_Log_Buffer::clear() {
+	count.store(0, std::memory_order_release);
+}
+
+} // namespace PT
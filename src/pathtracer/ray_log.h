@@ -0,0 +1,64 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../lib/mathlib.h"
+
+namespace PT {
+
+struct Ray_Log {
+	Ray ray;
+	float t = 1.0f;
+	Spectrum color = Spectrum{1.0f};
+};
+
+//what a full Ray_Log_Buffer does with more rays:
+enum class Ray_Log_Policy : uint8_t {
+	Reservoir, //keep a uniform random sample of every ray logged (reservoir sampling)
+	Latest, //keep the most recent rays (a ring buffer)
+};
+
+//A fixed-capacity log of rays, written by one thread without locks, and read by any thread:
+// each slot is written under a sequence number of its own (odd while being written), so readers copy slots
+// while the writer fills others, and skip any slot they catch mid-write.
+class Ray_Log_Buffer {
+public:
+	Ray_Log_Buffer(uint32_t capacity, Ray_Log_Policy policy, uint64_t seed);
+
+	//log a ray (only ever called by the thread that owns the buffer):
+	void add(Ray_Log const &entry);
+	//append the rays the buffer holds to 'out' (from any thread):
+	void copy_to(std::vector< Ray_Log > &out) const;
+	//forget every ray (only while nothing is adding):
+	void clear();
+
+	uint32_t capacity() const {
+		return slot_count;
+	}
+	Ray_Log_Policy policy() const {
+		return keep;
+	}
+	//rays logged since the last clear (including those the buffer no longer holds):
+	uint64_t logged() const {
+		return count.load(std::memory_order_acquire);
+	}
+
+private:
+	static constexpr uint32_t Words = (sizeof(Ray_Log) + 3) / 4;
+	struct Slot {
+		std::atomic< uint32_t > sequence = 0;
+		std::array< std::atomic< uint32_t >, Words > words = {};
+	};
+	std::unique_ptr< Slot[] > slots;
+	uint32_t slot_count = 0;
+	Ray_Log_Policy keep = Ray_Log_Policy::Reservoir;
+	uint64_t seed = 0;
+	std::atomic< uint64_t > count = 0;
+};
+
+} // namespace PT
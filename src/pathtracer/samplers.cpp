@@ -1,6 +1,7 @@
 
 #include "samplers.h"
 #include "../util/rand.h"
+#include "../util/thread_pool.h"
 
 constexpr bool IMPORTANCE_SAMPLING = true;
 
@@ -116,39 +117,129 @@ float Sphere::Uniform::pdf(Vec3 dir) const {
 	return 1.0f / (4.0f * PI_F);
 }
 
-Sphere::Image::Image(const HDR_Image& image) {
-    //A3T7 - image sampler init
-
-    // Set up importance sampling data structures for a spherical environment map image.
-    // You may make use of the _pdf, _cdf, and total members, or create your own.
+//fill table with a Walker/Vose alias table for the n (non-negative) weights; all-zero weights give a uniform table:
+static void build_alias(float const* weights, uint32_t n, Sphere::Image::Alias* table) {
+	double sum = 0.0;
+	for (uint32_t i = 0; i < n; ++i) sum += weights[i];
+	if (!(sum > 0.0)) {
+		for (uint32_t i = 0; i < n; ++i) table[i] = {1.0f, i};
+		return;
+	}
 
-    const auto [_w, _h] = image.dimension();
-    w = _w;
-    h = _h;
+	//(scratch space is reused across the rows a thread builds)
+	thread_local std::vector<double> scaled;
+	thread_local std::vector<uint32_t> small, large;
+	scaled.resize(n);
+	small.clear();
+	large.clear();
+	for (uint32_t i = 0; i < n; ++i) {
+		scaled[i] = weights[i] * (n / sum);
+		(scaled[i] < 1.0 ? small : large).push_back(i);
+	}
+	//pair each under-full slot with an over-full one that tops it up:
+	while (!small.empty() && !large.empty()) {
+		uint32_t s = small.back(), l = large.back();
+		small.pop_back();
+		table[s] = {float(scaled[s]), l};
+		scaled[l] -= 1.0 - scaled[s];
+		if (scaled[l] < 1.0) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	//whatever is left is full, up to rounding:
+	for (uint32_t i : large) table[i] = {1.0f, i};
+	for (uint32_t i : small) table[i] = {1.0f, i};
+}
+
+Sphere::Image::Image(const HDR_Image& image, Thread_Pool* thread_pool) {
+	const auto [_w, _h] = image.dimension();
+	w = _w;
+	h = _h;
+	if (w == 0 || h == 0) return;
+
+	_pdf.resize(size_t(w) * h);
+	texels.resize(size_t(w) * h);
+	rows.resize(h);
+	std::vector<float> row_weights(h);
+
+	//a texel's importance is its luminance times the solid angle it covers, which shrinks toward the poles:
+	// (rows are independent, so build them in parallel when given a pool)
+	auto build_rows = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t y = begin; y < end; ++y) {
+			float sin_theta = std::sin(PI_F * (y + 0.5f) / h);
+			float* weights = &_pdf[size_t(y) * w];
+			double sum = 0.0;
+			for (uint32_t x = 0; x < w; ++x) {
+				float luma = image.at(x, y).luma();
+				weights[x] = std::isfinite(luma) ? std::max(luma, 0.0f) * sin_theta : 0.0f;
+				sum += weights[x];
+			}
+			row_weights[y] = float(sum);
+			build_alias(weights, w, &texels[size_t(y) * w]);
+		}
+	};
+	if (thread_pool && h > 1) {
+		Thread_Pool::Group group;
+		uint32_t chunk = std::max(1u, h / 64u);
+		for (uint32_t y = 0; y < h; y += chunk) {
+			thread_pool->enqueue(group, [=]() { build_rows(y, std::min(y + chunk, h)); });
+		}
+		thread_pool->wait(group);
+	} else {
+		build_rows(0, h);
+	}
+	build_alias(row_weights.data(), h, rows.data());
+
+	//normalize weights into texel probabilities (matching what the tables pick):
+	double sum = 0.0;
+	for (float weight : row_weights) sum += weight;
+	if (sum > 0.0) {
+		float inv_sum = float(1.0 / sum);
+		for (float& p : _pdf) p *= inv_sum;
+	} else {
+		std::fill(_pdf.begin(), _pdf.end(), 1.0f / (float(w) * h));
+	}
+	//each texel covers (2pi / w) * (pi / h) * sin(theta) steradians:
+	total = float(sum) * 2.0f * PI_F * PI_F / (float(w) * h);
 }
 
 Vec3 Sphere::Image::sample(RNG &rng) const {
-	if(!IMPORTANCE_SAMPLING) {
-		// Step 1: Uniform sampling
-		// Declare a uniform sampler and return its sample
-    	return Vec3{};
+	if(!IMPORTANCE_SAMPLING || rows.empty()) {
+		Uniform uniform;
+		return uniform.sample(rng);
 	} else {
-		// Step 2: Importance sampling
-		// Use your importance sampling data structure to generate a sample direction.
-		// Tip: std::upper_bound
-    	return Vec3{};
+		auto pick = [&](Alias const* table, uint32_t n) {
+			uint32_t i = std::min(uint32_t(rng.unit() * n), n - 1);
+			return rng.unit() < table[i].keep ? i : table[i].alias;
+		};
+		uint32_t y = pick(rows.data(), h);
+		uint32_t x = pick(&texels[size_t(y) * w], w);
+
+		//uniformly within the texel (in u,v -- pdf() accounts for the change to solid angle):
+		float phi = 2.0f * PI_F * (x + rng.unit()) / w;
+		float theta = PI_F * (y + rng.unit()) / h;
+		float sin_theta = std::sin(theta);
+		return Vec3{sin_theta * std::cos(phi), -std::cos(theta), sin_theta * std::sin(phi)};
 	}
 }
 
 float Sphere::Image::pdf(Vec3 dir) const {
-    if(!IMPORTANCE_SAMPLING) {
-		// Step 1: Uniform sampling
-		// Declare a uniform sampler and return its pdf
-    	return 0.f;
+	if(!IMPORTANCE_SAMPLING || _pdf.empty()) {
+		Uniform uniform;
+		return uniform.pdf(dir);
 	} else {
-		// A3T7 - image sampler importance sampling pdf
-		// What is the PDF of this distribution at a particular direction?
-    	return 0.f;
+		//same lat/lon mapping as Shapes::Sphere::uv:
+		float u = std::atan2(dir.z, dir.x) / (2.0f * PI_F);
+		if (u < 0.0f) u += 1.0f;
+		float v = std::acos(std::clamp(-dir.y, -1.0f, 1.0f)) / PI_F;
+		uint32_t x = std::min(uint32_t(u * w), w - 1);
+		uint32_t y = std::min(uint32_t(v * h), h - 1);
+
+		float sin_theta = std::sqrt(std::max(1.0f - dir.y * dir.y, 0.0f));
+		if (sin_theta <= 0.0f) return 0.0f;
+		//probability over the texel's area in (u,v), then to solid angle (dw = 2pi^2 sin(theta) du dv):
+		return _pdf[size_t(y) * w + x] * float(w) * float(h) / (2.0f * PI_F * PI_F * sin_theta);
 	}
 }
 
@@ -4,6 +4,7 @@
 #include "../util/hdr_image.h"
 
 struct RNG;
+class Thread_Pool;
 
 namespace Samplers {
 //Samplers in Scotty3D allow picking random points in various geometric distributions.
@@ -92,16 +93,26 @@ struct Uniform {
 };
 
 //Sphere::Image importance-samples the surface, with importance given by a lat/lon image with the north pole at (0,1,0):
+// (texels are picked in O(1) with Walker/Vose alias tables -- one over rows, then one per row over its texels --
+//  and each texel's probability is stored so pdf() is a lookup)
 struct Image {
 	Image() = default;
-	Image(const HDR_Image& image);
+	Image(const HDR_Image& image, Thread_Pool* thread_pool = nullptr);
 
 	Vec3 sample(RNG &rng) const;
 	float pdf(Vec3 dir) const;
 
+	//alias table slot: stay in this slot with probability 'keep', otherwise go to slot 'alias':
+	struct Alias {
+		float keep = 1.0f;
+		uint32_t alias = 0;
+	};
+
 	uint32_t w = 0, h = 0;
-	std::vector<float> _pdf, _cdf;
-	Rect jitter;
+	std::vector<float> _pdf;      //probability of each texel (row-major, like HDR_Image)
+	std::vector<Alias> rows;      //h slots, choosing a row
+	std::vector<Alias> texels;    //w slots per row, choosing a texel within the row
+	float total = 0.0f;           //integral of luminance over the sphere
 };
 
 } // namespace Sphere
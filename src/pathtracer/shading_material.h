@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include "../scene/material.h"
+
+#include <type_traits>
+
+namespace PT {
+
+//Shading_Material is the pathtracer's flattened record of a Material, made by build_scene():
+// the kind of material and its hit-independent properties are looked up once, rather than through a
+// variant visit on every call, and emission reads its texture through a plain pointer rather than
+// locking a weak_ptr (whose shared reference count all rendering threads would otherwise contend on).
+//It has the same shading interface as Material and must not outlive the Material (and textures) it was made from.
+struct Shading_Material {
+	enum class Kind : uint8_t {
+		Lambertian,
+		Mirror,
+		Refract,
+		Glass,
+		Emissive,
+	};
+	Kind kind = Kind::Lambertian;
+	bool emissive = false, specular = false, sided = false;
+	void const* bsdf = nullptr; //the Materials:: alternative of the source material
+	Texture const* emission_texture = nullptr; //(for Materials::Emissive)
+
+	static Shading_Material from(Material const& material) {
+		Shading_Material ret;
+		std::visit([&](auto const& m) {
+			using M = std::decay_t<decltype(m)>;
+			if constexpr (std::is_same_v<M, Materials::Lambertian>) ret.kind = Kind::Lambertian;
+			else if constexpr (std::is_same_v<M, Materials::Mirror>) ret.kind = Kind::Mirror;
+			else if constexpr (std::is_same_v<M, Materials::Refract>) ret.kind = Kind::Refract;
+			else if constexpr (std::is_same_v<M, Materials::Glass>) ret.kind = Kind::Glass;
+			else if constexpr (std::is_same_v<M, Materials::Emissive>) {
+				ret.kind = Kind::Emissive;
+				ret.emission_texture = m.emissive.lock().get();
+			} else static_assert(!sizeof(M), "Shading_Material doesn't know this kind of material");
+			ret.bsdf = &m;
+			ret.emissive = m.is_emissive();
+			ret.specular = m.is_specular();
+			ret.sided = m.is_sided();
+		}, material.material);
+		return ret;
+	}
+
+	//call f with the source material's BSDF:
+	template<typename F> decltype(auto) visit(F&& f) const {
+		switch (kind) {
+		case Kind::Lambertian: return f(*static_cast<Materials::Lambertian const*>(bsdf));
+		case Kind::Mirror: return f(*static_cast<Materials::Mirror const*>(bsdf));
+		case Kind::Refract: return f(*static_cast<Materials::Refract const*>(bsdf));
+		case Kind::Glass: return f(*static_cast<Materials::Glass const*>(bsdf));
+		case Kind::Emissive: break;
+		}
+		return f(*static_cast<Materials::Emissive const*>(bsdf));
+	}
+
+	Spectrum evaluate(Vec3 out, Vec3 in, Vec2 uv) const {
+		return visit([&](auto const& m) { return m.evaluate(out, in, uv); });
+	}
+	Materials::Scatter scatter(RNG& rng, Vec3 out, Vec2 uv) const {
+		return visit([&](auto const& m) { return m.scatter(rng, out, uv); });
+	}
+	float pdf(Vec3 out, Vec3 in) const {
+		return visit([&](auto const& m) { return m.pdf(out, in); });
+	}
+	Spectrum emission(Vec2 uv) const {
+		if (!emission_texture) return {};
+		return emission_texture->evaluate(uv);
+	}
+
+	bool is_emissive() const {
+		return emissive;
+	}
+	bool is_specular() const {
+		return specular;
+	}
+	bool is_sided() const {
+		return sided;
+	}
+};
+
+} // namespace PT
@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include <cstdint>
+
+namespace PT {
+
+//set to true to count render statistics (for --stats and --cost-heatmap); off by default, since counting
+// costs every ray and traversal a few thread-local adds, and every pixel sample a cost update:
+constexpr bool RECORD_STATS = false;
+
+//Render statistics are counted by each thread into a Render_Stats of its own, so counting is a plain
+// increment (no atomics, no locks); the pathtracer adds up what each tile added to its thread's counts.
+struct Render_Stats {
+	uint64_t camera_rays = 0;
+	uint64_t shadow_rays = 0; //rays toward lights (delta light shadow rays, and emission-only light rays)
+	uint64_t bounce_rays = 0;
+	uint64_t nodes_visited = 0; //BVH nodes (of the scene and of the meshes in it)
+	uint64_t primitives_tested = 0;
+
+	uint64_t rays() const {
+		return camera_rays + shadow_rays + bounce_rays;
+	}
+	//BVH nodes visited plus primitives tested (what the cost heatmap measures):
+	uint64_t traversal_steps() const {
+		return nodes_visited + primitives_tested;
+	}
+
+	Render_Stats& operator+=(Render_Stats const& o) {
+		camera_rays += o.camera_rays;
+		shadow_rays += o.shadow_rays;
+		bounce_rays += o.bounce_rays;
+		nodes_visited += o.nodes_visited;
+		primitives_tested += o.primitives_tested;
+		return *this;
+	}
+	Render_Stats operator-(Render_Stats const& o) const {
+		Render_Stats ret;
+		ret.camera_rays = camera_rays - o.camera_rays;
+		ret.shadow_rays = shadow_rays - o.shadow_rays;
+		ret.bounce_rays = bounce_rays - o.bounce_rays;
+		ret.nodes_visited = nodes_visited - o.nodes_visited;
+		ret.primitives_tested = primitives_tested - o.primitives_tested;
+		return ret;
+	}
+
+	//this thread's counts (only ever growing):
+	static Render_Stats& thread() {
+		static thread_local Render_Stats stats;
+		return stats;
+	}
+};
+
+enum class Ray_Kind : uint8_t { Camera, Shadow, Bounce };
+
+inline void count_ray(Ray_Kind kind) {
+	if constexpr (RECORD_STATS) {
+		Render_Stats& stats = Render_Stats::thread();
+		if (kind == Ray_Kind::Camera) ++stats.camera_rays;
+		else if (kind == Ray_Kind::Shadow) ++stats.shadow_rays;
+		else ++stats.bounce_rays;
+	}
+}
+
+//this thread's traversal steps so far (differences of which are the cost of what was traced in between):
+inline uint64_t traversal_steps() {
+	if constexpr (RECORD_STATS) return Render_Stats::thread().traversal_steps();
+	return 0;
+}
+
+//counts one traversal's node visits and primitive tests in locals, and adds them to the thread's counts
+// when the traversal is done (so traversal loops don't touch thread-local storage):
+class Traversal_Count {
+public:
+	Traversal_Count() = default;
+	Traversal_Count(Traversal_Count const&) = delete;
+	~Traversal_Count() {
+		if constexpr (RECORD_STATS) {
+			Render_Stats& stats = Render_Stats::thread();
+			stats.nodes_visited += nodes;
+			stats.primitives_tested += primitives;
+		}
+	}
+	void node() {
+		if constexpr (RECORD_STATS) ++nodes;
+	}
+	void tested(uint64_t count) {
+		if constexpr (RECORD_STATS) primitives += count;
+	}
+
+private:
+	uint64_t nodes = 0, primitives = 0;
+};
+
+} // namespace PT
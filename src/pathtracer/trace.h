@@ -3,10 +3,20 @@
 
 #include "../lib/mathlib.h"
 
-class Material;
-
 namespace PT {
 
+class Instance;
+struct Shading_Material;
+
+//Minimal record of the closest hit found so far, carried through traversal by intersect().
+// Surface attributes are only computed -- by finalize() -- once the closest hit is known.
+struct Hit {
+	float t = std::numeric_limits<float>::infinity(); //distance along the ray passed to intersect()
+	Vec2 bary; //barycentrics of the triangle's v1 and v2
+	uint32_t prim = ~0u; //triangle index within its mesh
+	const Instance* instance = nullptr; //instance hit (if any)
+};
+
 struct Trace {
 
 	Trace() = default;
@@ -23,7 +33,7 @@ struct Trace {
 	Vec3 position, normal, origin;
 	Vec2 uv;
 
-	const Material* material = nullptr;
+	const Shading_Material* material = nullptr;
 
 	static Trace min(const Trace& l, const Trace& r) {
 		if (l.hit && r.hit) {
@@ -1,59 +1,123 @@
 
 #include "../test.h"
 
+#include "bvh_cache.h"
 #include "samplers.h"
 #include "tri_mesh.h"
 
+#include <unordered_map>
+
 namespace PT {
 
 BBox Triangle::bbox() const {
 	//A3T2 / A3T3
 
-	// TODO (PathTracer): Task 2 or 3
-    // Compute the bounding box of the triangle.
+	// Compute the bounding box of the triangle.
 
-    // Beware of flat/zero-volume boxes! You may need to
-    // account for that here, or later on in BBox::hit.
+	// Flat/zero-volume boxes are fine here; BBox::hit handles them.
 
-    BBox box;
-    return box;
+	BBox box;
+	box.enclose(position(0));
+	box.enclose(position(1));
+	box.enclose(position(2));
+	return box;
+}
+
+bool Triangle::intersect(const Ray& ray, float& t, float& u, float& v) const {
+	// Moller-Trumbore: solve ray.point + t * ray.dir == (1-u-v) * v_0 + u * v_1 + v * v_2
+	Vec3 p = cross(ray.dir, e2);
+	float det = dot(e1, p);
+	if (det == 0.0f) return false; //ray is parallel to the triangle's plane
+	float inv_det = 1.0f / det;
+
+	Vec3 s = ray.point - p0;
+	u = dot(s, p) * inv_det;
+	if (u < 0.0f || u > 1.0f) return false;
+
+	Vec3 q = cross(s, e1);
+	v = dot(ray.dir, q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f) return false;
+
+	t = dot(e2, q) * inv_det;
+	return t >= ray.dist_bounds.x && t <= ray.dist_bounds.y;
 }
 
 Trace Triangle::hit(const Ray& ray) const {
 	//A3T2
-	
+
+	Hit hit;
+	if (!intersect(ray, hit)) {
+		Trace ret;
+		ret.origin = ray.point;
+		return ret;
+	}
+	return finalize(ray, hit);
+}
+
+bool Triangle::intersect(const Ray& ray, Hit& hit) const {
+	float t, u, v;
+	if (!intersect(ray, t, u, v)) return false;
+	hit.t = t;
+	hit.bary = Vec2{u, v};
+	return true;
+}
+
+Trace Triangle::finalize(const Ray& ray, const Hit& hit) const {
+	if (!vertex_list) {
+		//(a compact mesh's triangle; see Tri_Mesh::finalize)
+		Trace ret;
+		ret.origin = ray.point;
+		ret.hit = true;
+		ret.distance = hit.t;
+		ret.position = ray.at(hit.t);
+		ret.normal = cross(e1, e2).unit();
+		return ret;
+	}
+
 	// Each vertex contains a postion and surface normal
-    Tri_Mesh_Vert v_0 = vertex_list[v0];
-    Tri_Mesh_Vert v_1 = vertex_list[v1];
-    Tri_Mesh_Vert v_2 = vertex_list[v2];
-    (void)v_0;
-    (void)v_1;
-    (void)v_2;
-
-    // TODO (PathTracer): Task 2
-    // Intersect the ray with the triangle defined by the three vertices.
-
-    Trace ret;
-    ret.origin = ray.point;
-    ret.hit = false;       // was there an intersection?
-    ret.distance = 0.0f;   // at what distance did the intersection occur?
-    ret.position = Vec3{}; // where was the intersection?
-    ret.normal = Vec3{};   // what was the surface normal at the intersection?
-                           // (this should be interpolated between the three vertex normals)
-	ret.uv = Vec2{};	   // What was the uv associated with the point of intersection?
-						   // (this should be interpolated between the three vertex uvs)
-    return ret;
+	Tri_Mesh_Vert const &v_0 = vertex_list[v0];
+	Tri_Mesh_Vert const &v_1 = vertex_list[v1];
+	Tri_Mesh_Vert const &v_2 = vertex_list[v2];
+
+	float u = hit.bary.x, v = hit.bary.y, w = 1.0f - u - v;
+	Trace ret;
+	ret.origin = ray.point;
+	ret.hit = true;
+	ret.distance = hit.t;
+	ret.position = ray.at(hit.t);
+	ret.normal = (w * v_0.normal + u * v_1.normal + v * v_2.normal).unit();
+	ret.uv = w * v_0.uv + u * v_1.uv + v * v_2.uv;
+	return ret;
+}
+
+bool Triangle::occluded(const Ray& ray) const {
+	float t, u, v;
+	return intersect(ray, t, u, v);
 }
 
 Triangle::Triangle(Tri_Mesh_Vert* verts, uint32_t v0, uint32_t v1, uint32_t v2)
-	: v0(v0), v1(v1), v2(v2), vertex_list(verts) {
+	: p0(verts[v0].position), e1(verts[v1].position - p0), e2(verts[v2].position - p0),
+	  v0(v0), v1(v1), v2(v2), vertex_list(verts) {
+}
+
+Triangle::Triangle(Vec3 p0, Vec3 p1, Vec3 p2, uint32_t v0, uint32_t v1, uint32_t v2)
+	: p0(p0), e1(p1 - p0), e2(p2 - p0), v0(v0), v1(v1), v2(v2), vertex_list(nullptr) {
+}
+
+const Tri_Mesh_Vert& Triangle::vertex(uint32_t i) const {
+	assert(i < 3);
+	assert(vertex_list);
+	return vertex_list[i == 0 ? v0 : (i == 1 ? v1 : v2)];
+}
+
+Vec3 Triangle::position(uint32_t i) const {
+	assert(i < 3);
+	if (vertex_list) return vertex(i).position;
+	return i == 0 ? p0 : (i == 1 ? p0 + e1 : p0 + e2);
 }
 
 Vec3 Triangle::sample(RNG &rng, Vec3 from) const {
-	Tri_Mesh_Vert v_0 = vertex_list[v0];
-	Tri_Mesh_Vert v_1 = vertex_list[v1];
-	Tri_Mesh_Vert v_2 = vertex_list[v2];
-	Samplers::Triangle sampler(v_0.position, v_1.position, v_2.position);
+	Samplers::Triangle sampler(position(0), position(1), position(2));
 	Vec3 pos = sampler.sample(rng);
 	return (pos - from).unit();
 }
@@ -66,9 +130,9 @@ float Triangle::pdf(Ray wray, const Mat4& T, const Mat4& iT) const {
 	Trace trace = hit(tray);
 	if (trace.hit) {
 		trace.transform(T, iT.T());
-		Vec3 v_0 = T * vertex_list[v0].position;
-		Vec3 v_1 = T * vertex_list[v1].position;
-		Vec3 v_2 = T * vertex_list[v2].position;
+		Vec3 v_0 = T * position(0);
+		Vec3 v_1 = T * position(1);
+		Vec3 v_2 = T * position(2);
 		Samplers::Triangle sampler(v_0, v_1, v_2);
 		float a = sampler.pdf(trace.position);
 		float g = (trace.position - wray.point).norm_squared() / std::abs(dot(trace.normal, wray.dir));
@@ -78,6 +142,12 @@ float Triangle::pdf(Ray wray, const Mat4& T, const Mat4& iT) const {
 }
 
 bool Triangle::operator==(const Triangle& rhs) const {
+	if (!vertex_list || !rhs.vertex_list) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (Test::differs(position(i), rhs.position(i))) return false;
+		}
+		return true;
+	}
 	if (Test::differs(vertex_list[v0].position, rhs.vertex_list[rhs.v0].position) ||
 	    Test::differs(vertex_list[v0].normal, rhs.vertex_list[rhs.v0].normal) ||
 	    Test::differs(vertex_list[v0].uv, rhs.vertex_list[rhs.v0].uv) ||
@@ -92,20 +162,94 @@ bool Triangle::operator==(const Triangle& rhs) const {
 	return true;
 }
 
-Tri_Mesh::Tri_Mesh(const Indexed_Mesh& mesh, bool use_bvh_) : use_bvh(use_bvh_) {
-	for (const auto& v : mesh.vertices()) {
-		verts.push_back({v.pos, v.norm, v.uv});
+uint32_t Tri_Mesh_Compact_Vert::encode_normal(Vec3 n) {
+	//project onto the octahedron |x| + |y| + |z| == 1, and fold its lower half over the upper:
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (!(l1 > 0.0f)) return 0u;
+	float x = n.x / l1, y = n.y / l1;
+	if (n.z < 0.0f) {
+		float ox = x;
+		x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - std::abs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
 	}
+	auto snorm16 = [](float f) {
+		return uint32_t(uint16_t(int16_t(std::round(std::clamp(f, -1.0f, 1.0f) * 32767.0f))));
+	};
+	return snorm16(x) | (snorm16(y) << 16);
+}
+
+Vec3 Tri_Mesh_Compact_Vert::decode_normal(uint32_t bits) {
+	float x = float(int16_t(uint16_t(bits & 0xffff))) / 32767.0f;
+	float y = float(int16_t(uint16_t(bits >> 16))) / 32767.0f;
+	float z = 1.0f - std::abs(x) - std::abs(y);
+	if (z < 0.0f) {
+		float ox = x;
+		x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - std::abs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return Vec3{x, y, z}.unit();
+}
 
+Tri_Mesh::Tri_Mesh(const Indexed_Mesh& mesh, bool use_bvh_, Thread_Pool *thread_pool, Vertex_Format format_, bool wide_bvh)
+	: use_bvh(use_bvh_), format(format_) {
 	const auto& idxs = mesh.indices();
 
 	std::vector<Triangle> tris;
-	for (size_t i = 0; i < idxs.size(); i += 3) {
-		tris.push_back(Triangle(verts.data(), idxs[i], idxs[i + 1], idxs[i + 2]));
+	if (format == Vertex_Format::Full) {
+		for (const auto& v : mesh.vertices()) {
+			verts.push_back({v.pos, v.norm, v.uv});
+		}
+		for (size_t i = 0; i < idxs.size(); i += 3) {
+			tris.push_back(Triangle(verts.data(), idxs[i], idxs[i + 1], idxs[i + 2]));
+		}
+	} else {
+		//uvs are quantized to 16 bits over the mesh's uv bounds:
+		Vec2 uv_max{-std::numeric_limits<float>::infinity()};
+		uv_min = Vec2{std::numeric_limits<float>::infinity()};
+		for (const auto& v : mesh.vertices()) {
+			uv_min = hmin(uv_min, v.uv);
+			uv_max = hmax(uv_max, v.uv);
+		}
+		if (mesh.vertices().empty()) uv_min = uv_max = Vec2{};
+		uv_scale = (uv_max - uv_min) / 65535.0f;
+		auto quantize = [](float f, float min, float scale) {
+			return scale > 0.0f ? uint16_t(std::clamp(std::round((f - min) / scale), 0.0f, 65535.0f)) : uint16_t(0);
+		};
+
+		//vertices whose encoded attributes match (e.g., the corners SplitEdges made of one smooth vertex) share one:
+		std::vector<uint32_t> remap;
+		remap.reserve(mesh.vertices().size());
+		std::unordered_map<uint64_t, uint32_t> shared;
+		for (const auto& v : mesh.vertices()) {
+			Tri_Mesh_Compact_Vert c{Tri_Mesh_Compact_Vert::encode_normal(v.norm), quantize(v.uv.x, uv_min.x, uv_scale.x),
+			                        quantize(v.uv.y, uv_min.y, uv_scale.y)};
+			uint64_t key = uint64_t(c.normal) | (uint64_t(c.u) << 32) | (uint64_t(c.v) << 48);
+			auto [it, added] = shared.emplace(key, uint32_t(compact_verts.size()));
+			if (added) compact_verts.push_back(c);
+			remap.push_back(it->second);
+		}
+		compact_verts.shrink_to_fit();
+
+		const auto& vs = mesh.vertices();
+		for (size_t i = 0; i < idxs.size(); i += 3) {
+			tris.push_back(Triangle(vs[idxs[i]].pos, vs[idxs[i + 1]].pos, vs[idxs[i + 2]].pos,
+			                        remap[idxs[i]], remap[idxs[i + 1]], remap[idxs[i + 2]]));
+		}
 	}
 
 	if (use_bvh) {
-		triangle_bvh.build(std::move(tris), 4);
+		BVH_Build_Opts opts;
+		opts.max_leaf_size = 4;
+		opts.thread_pool = thread_pool;
+		opts.wide = wide_bvh;
+		BVH_Cache* cache = BVH_Cache::shared;
+		uint64_t key = cache ? BVH_Cache::key(mesh, format, opts) : 0;
+		if (!cache || !cache->load(key, tris, triangle_bvh)) {
+			std::vector<uint32_t> order;
+			if (cache) opts.order = &order;
+			triangle_bvh.build(std::move(tris), opts);
+			if (cache) cache->store(key, triangle_bvh, order);
+		}
 	} else {
 		triangle_list = List<Triangle>(std::move(tris));
 	}
@@ -113,7 +257,11 @@ Tri_Mesh::Tri_Mesh(const Indexed_Mesh& mesh, bool use_bvh_) : use_bvh(use_bvh_)
 
 Tri_Mesh Tri_Mesh::copy() const {
 	Tri_Mesh ret;
+	ret.format = format;
 	ret.verts = verts;
+	ret.compact_verts = compact_verts;
+	ret.uv_min = uv_min;
+	ret.uv_scale = uv_scale;
 	ret.triangle_bvh = triangle_bvh.copy();
 	ret.triangle_list = triangle_list.copy();
 	ret.use_bvh = use_bvh;
@@ -126,14 +274,84 @@ BBox Tri_Mesh::bbox() const {
 }
 
 Trace Tri_Mesh::hit(const Ray& ray) const {
+	if (format == Vertex_Format::Compact) {
+		//(attributes are decoded by this mesh's finalize, not the triangles')
+		Hit hit;
+		if (!intersect(ray, hit)) {
+			Trace ret;
+			ret.origin = ray.point;
+			return ret;
+		}
+		return finalize(ray, hit);
+	}
 	if (use_bvh) return triangle_bvh.hit(ray);
 	return triangle_list.hit(ray);
 }
 
+bool Tri_Mesh::intersect(const Ray& ray, Hit& hit) const {
+	if (use_bvh) return triangle_bvh.intersect(ray, hit);
+	return triangle_list.intersect(ray, hit);
+}
+
+Trace Tri_Mesh::finalize(const Ray& ray, const Hit& hit) const {
+	if (format == Vertex_Format::Compact) {
+		const Triangle& tri = triangles()[hit.prim];
+		Tri_Mesh_Compact_Vert const &v_0 = compact_verts[tri.v0];
+		Tri_Mesh_Compact_Vert const &v_1 = compact_verts[tri.v1];
+		Tri_Mesh_Compact_Vert const &v_2 = compact_verts[tri.v2];
+
+		float u = hit.bary.x, v = hit.bary.y, w = 1.0f - u - v;
+		Trace ret;
+		ret.origin = ray.point;
+		ret.hit = true;
+		ret.distance = hit.t;
+		ret.position = ray.at(hit.t);
+		ret.normal = (w * Tri_Mesh_Compact_Vert::decode_normal(v_0.normal) + u * Tri_Mesh_Compact_Vert::decode_normal(v_1.normal) +
+		              v * Tri_Mesh_Compact_Vert::decode_normal(v_2.normal)).unit();
+		//(interpolating the quantized coordinates first, then scaling once)
+		ret.uv = uv_min + uv_scale * Vec2{w * v_0.u + u * v_1.u + v * v_2.u, w * v_0.v + u * v_1.v + v * v_2.v};
+		return ret;
+	}
+	if (use_bvh) return triangle_bvh.finalize(ray, hit);
+	return triangle_list.finalize(ray, hit);
+}
+
+bool Tri_Mesh::occluded(const Ray& ray) const {
+	if (use_bvh) return triangle_bvh.occluded(ray);
+	return triangle_list.occluded(ray);
+}
+
 size_t Tri_Mesh::n_triangles() const {
 	return use_bvh ? triangle_bvh.n_primitives() : triangle_list.n_primitives();
 }
 
+const std::vector<Triangle>& Tri_Mesh::triangles() const {
+	return use_bvh ? triangle_bvh.primitives : triangle_list.primitives();
+}
+
+Tri_Mesh_Vert Tri_Mesh::vertex(const Triangle& tri, uint32_t i) const {
+	assert(i < 3);
+	if (format == Vertex_Format::Full) return tri.vertex(i);
+	Tri_Mesh_Compact_Vert const &c = compact_verts[i == 0 ? tri.v0 : (i == 1 ? tri.v1 : tri.v2)];
+	return Tri_Mesh_Vert{tri.position(i), Tri_Mesh_Compact_Vert::decode_normal(c.normal),
+	                     uv_min + uv_scale * Vec2{float(c.u), float(c.v)}};
+}
+
+Tri_Mesh::Vertex_Format Tri_Mesh::vertex_format() const {
+	return format;
+}
+
+Tri_Mesh::Memory Tri_Mesh::memory() const {
+	Memory ret;
+	ret.vertices = verts.capacity() * sizeof(Tri_Mesh_Vert) + compact_verts.capacity() * sizeof(Tri_Mesh_Compact_Vert);
+	ret.n_vertices = verts.size() + compact_verts.size();
+	ret.n_triangles = n_triangles();
+	ret.triangles = triangles().capacity() * sizeof(Triangle);
+	ret.bvh = triangle_bvh.nodes.capacity() * sizeof(BVH<Triangle>::Node) +
+	          triangle_bvh.wide_nodes.capacity() * sizeof(BVH_Wide_Node);
+	return ret;
+}
+
 uint32_t Tri_Mesh::visualize(GL::Lines& lines, GL::Lines& active, uint32_t level,
                              const Mat4& trans) const {
 	if (use_bvh) return triangle_bvh.visualize(lines, active, level, trans);
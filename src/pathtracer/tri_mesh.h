@@ -16,10 +16,27 @@ struct Tri_Mesh_Vert {
 	Vec2 uv;
 };
 
+//shading attributes of a compact mesh's vertex (its position is only kept in its triangles' p0, e1, e2):
+struct Tri_Mesh_Compact_Vert {
+	uint32_t normal; //octahedral encoding, 16 bits per coordinate (see encode_normal)
+	uint16_t u, v; //quantized over the mesh's uv bounds
+
+	static uint32_t encode_normal(Vec3 n);
+	static Vec3 decode_normal(uint32_t bits);
+};
+static_assert(sizeof(Tri_Mesh_Compact_Vert) == 8);
+
 class Triangle {
 public:
 	BBox bbox() const;
 	Trace hit(const Ray& ray) const;
+	//closest-hit traversal: if ray hits within ray.dist_bounds, records t and barycentrics in hit
+	// (the containing BVH / List records hit.prim):
+	bool intersect(const Ray& ray, Hit& hit) const;
+	//surface attributes of a hit recorded by intersect():
+	Trace finalize(const Ray& ray, const Hit& hit) const;
+	//does ray hit the triangle anywhere within ray.dist_bounds? (cheaper than hit(): no surface attributes)
+	bool occluded(const Ray& ray) const;
 
 	uint32_t visualize(GL::Lines&, GL::Lines&, uint32_t, const Mat4&) const {
 		return 0u;
@@ -30,12 +47,28 @@ public:
 	float pdf(Ray ray, const Mat4& T, const Mat4& iT) const;
 
 	Triangle(Tri_Mesh_Vert* verts, uint32_t v0, uint32_t v1, uint32_t v2);
+	//a triangle of a compact mesh: only positions are kept here, so finalize() gives the geometric normal and
+	// no uv (Tri_Mesh::finalize decodes the mesh's vertex attributes instead); v0, v1, v2 index those attributes:
+	Triangle(Vec3 p0, Vec3 p1, Vec3 p2, uint32_t v0, uint32_t v1, uint32_t v2);
+
+	//corner i (0, 1, or 2) of the triangle: (not for triangles of compact meshes; see Tri_Mesh::vertex)
+	const Tri_Mesh_Vert& vertex(uint32_t i) const;
+	//position of corner i:
+	Vec3 position(uint32_t i) const;
 
 	bool operator==(const Triangle& rhs) const;
 
 private:
+	//ray-triangle intersection within ray.dist_bounds; sets distance t and barycentrics u (of v1), v (of v2):
+	bool intersect(const Ray& ray, float& t, float& u, float& v) const;
+
+	//intersection data, precomputed so hit tests never gather vertices:
+	// (BVH<Triangle> keeps its triangles in leaf order, so each leaf's tests read one contiguous run)
+	Vec3 p0, e1, e2;
+
+	//shading data, only read for the closest hit (see finalize):
 	uint32_t v0, v1, v2;
-	Tri_Mesh_Vert* vertex_list;
+	Tri_Mesh_Vert* vertex_list; //(nullptr for triangles of compact meshes)
 	friend class Tri_Mesh;
 };
 
@@ -43,9 +76,17 @@ static_assert(std::is_copy_assignable_v<Triangle>);
 
 class Tri_Mesh {
 public:
+	//how vertex attributes are stored:
+	enum class Vertex_Format : uint8_t {
+		Full, //a Tri_Mesh_Vert per Indexed_Mesh vertex (32 bytes)
+		Compact, //a Tri_Mesh_Compact_Vert (8 bytes) per distinct encoded normal and uv, decoded only for closest hits
+	};
+
 	Tri_Mesh() = default;
 	// You can only build Tri_Mesh from an Indexed_Mesh:
-	Tri_Mesh(const Indexed_Mesh& mesh, bool use_bvh);
+	// (if thread_pool is supplied, the BVH is built in parallel on it; wide_bvh sets BVH_Build_Opts::wide)
+	Tri_Mesh(const Indexed_Mesh& mesh, bool use_bvh, Thread_Pool *thread_pool = nullptr,
+	         Vertex_Format format = Vertex_Format::Full, bool wide_bvh = false);
 
 	Tri_Mesh(Tri_Mesh&& src) = default;
 	Tri_Mesh& operator=(Tri_Mesh&& src) = default;
@@ -56,11 +97,30 @@ public:
 
 	BBox bbox() const;
 	Trace hit(const Ray& ray) const;
+	bool intersect(const Ray& ray, Hit& hit) const;
+	Trace finalize(const Ray& ray, const Hit& hit) const;
+	bool occluded(const Ray& ray) const;
 
 	uint32_t visualize(GL::Lines& lines, GL::Lines& active, uint32_t level,
 	                   const Mat4& trans) const;
 
 	size_t n_triangles() const;
+	//(in BVH leaf order if the mesh uses a BVH)
+	const std::vector<Triangle>& triangles() const;
+	//corner i (0, 1, or 2) of one of triangles(), decoded if the mesh is compact:
+	Tri_Mesh_Vert vertex(const Triangle& tri, uint32_t i) const;
+
+	Vertex_Format vertex_format() const;
+
+	//bytes held by the mesh:
+	struct Memory {
+		size_t vertices = 0, triangles = 0, bvh = 0; //vertex attributes, triangle array, BVH nodes
+		size_t n_vertices = 0, n_triangles = 0;
+		size_t total() const {
+			return vertices + triangles + bvh;
+		}
+	};
+	Memory memory() const;
 
 	//sample a vector pointing to the mesh from point 'from':
 	Vec3 sample(RNG &rng, Vec3 from) const;
@@ -68,7 +128,11 @@ public:
 
 private:
 	bool use_bvh = true;
+	Vertex_Format format = Vertex_Format::Full;
 	std::vector<Tri_Mesh_Vert> verts;
+	//(if format is Compact:)
+	std::vector<Tri_Mesh_Compact_Vert> compact_verts;
+	Vec2 uv_min, uv_scale; //uv == uv_min + uv_scale * (u, v)
 	BVH<Triangle> triangle_bvh;
 	List<Triangle> triangle_list;
 };
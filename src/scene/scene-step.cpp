@@ -47,22 +47,27 @@ Scene::Collision Scene::build_collision(bool use_bvh, Thread_Pool *thread_pool)
 
 	//first, convert all meshes -> PT::Tri_Mesh
 	if (thread_pool) {
-		std::vector<std::future<std::pair<Halfedge_Mesh const *, PT::Tri_Mesh>>> mesh_futs;
+		//each task fills in its own slot:
+		std::vector<std::pair<Halfedge_Mesh const *, PT::Tri_Mesh>> mesh_results(meshes.size() + skinned_meshes.size());
+		std::vector<std::function<void()>> mesh_tasks;
+		Thread_Pool::Group mesh_group;
 
 		for (const auto& [name, mesh] : meshes) {
-			mesh_futs.emplace_back(thread_pool->enqueue([name=name,mesh=mesh,use_bvh]() {
-				return std::pair{const_cast< const Halfedge_Mesh * >(mesh.get()), PT::Tri_Mesh(Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges), use_bvh)};
-			}));
+			mesh_tasks.emplace_back([&result=mesh_results[mesh_tasks.size()],mesh=mesh,use_bvh,thread_pool]() {
+				result = std::pair{const_cast< const Halfedge_Mesh * >(mesh.get()), PT::Tri_Mesh(Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges), use_bvh, thread_pool)};
+			});
 		}
 
 		for (const auto& [name, mesh] : skinned_meshes) {
-			mesh_futs.emplace_back(thread_pool->enqueue([name=name,mesh=mesh,use_bvh]() {
-				return std::pair{const_cast< const Halfedge_Mesh * >(&mesh->mesh), PT::Tri_Mesh(mesh->posed_mesh(), use_bvh)};
-			}));
+			mesh_tasks.emplace_back([&result=mesh_results[mesh_tasks.size()],mesh=mesh,use_bvh,thread_pool]() {
+				result = std::pair{const_cast< const Halfedge_Mesh * >(&mesh->mesh), PT::Tri_Mesh(mesh->posed_mesh(), use_bvh, thread_pool)};
+			});
 		}
 
-		for (auto& f : mesh_futs) {
-			auto [ptr, mesh] = f.get();
+		thread_pool->enqueue(mesh_group, std::move(mesh_tasks));
+		thread_pool->wait(mesh_group);
+
+		for (auto& [ptr, mesh] : mesh_results) {
 			collision.meshes.emplace(ptr, std::move(mesh));
 		}
 	} else {
@@ -114,7 +119,9 @@ Scene::Collision Scene::build_collision(bool use_bvh, Thread_Pool *thread_pool)
 	}
 
 	if (use_bvh) {
-		collision.world = PT::Aggregate(PT::BVH<PT::Instance>(std::move(objects)));
+		PT::BVH_Build_Opts opts;
+		opts.thread_pool = thread_pool;
+		collision.world = PT::Aggregate(PT::BVH<PT::Instance>(std::move(objects), opts));
 	} else {
 		collision.world = PT::Aggregate(PT::List<PT::Instance>(std::move(objects)));
 	}
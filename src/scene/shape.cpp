@@ -18,26 +18,63 @@ BBox Sphere::bbox() const {
 	return box;
 }
 
+bool Sphere::intersect(Ray const &ray, float& t) const {
+	// |ray.point + t * ray.dir|^2 == radius^2, with ray.dir unit length:
+	//  t^2 + 2 b t + c == 0, with b = dot(point, dir), c = |point|^2 - radius^2
+	float b = dot(ray.point, ray.dir);
+	float c = ray.point.norm_squared() - radius * radius;
+	float disc = b * b - c;
+	if (disc < 0.0f) return false;
+	float root = std::sqrt(disc);
+
+	// check the nearer intersection first, then the farther one:
+	t = -b - root;
+	if (t >= ray.dist_bounds.x && t <= ray.dist_bounds.y) return true;
+	t = -b + root;
+	return t >= ray.dist_bounds.x && t <= ray.dist_bounds.y;
+}
+
 PT::Trace Sphere::hit(Ray ray) const {
 	//A3T2 - sphere hit
 
-    // TODO (PathTracer): Task 2
-    // Intersect this ray with a sphere of radius Sphere::radius centered at the origin.
-
-    // If the ray intersects the sphere twice, ret should
-    // represent the first intersection, but remember to respect
-    // ray.dist_bounds! For example, if there are two intersections,
-    // but only the _later_ one is within ray.dist_bounds, you should
-    // return that one!
-
-    PT::Trace ret;
-    ret.origin = ray.point;
-    ret.hit = false;       // was there an intersection?
-    ret.distance = 0.0f;   // at what distance did the intersection occur?
-    ret.position = Vec3{}; // where was the intersection?
-    ret.normal = Vec3{};   // what was the surface normal at the intersection?
-	ret.uv = Vec2{}; 	   // what was the uv coordinates at the intersection? (you may find Sphere::uv to be useful)
-    return ret;
+	// Intersect this ray with a sphere of radius Sphere::radius centered at the origin.
+
+	// If the ray intersects the sphere twice, ret should
+	// represent the first intersection, but remember to respect
+	// ray.dist_bounds! For example, if there are two intersections,
+	// but only the _later_ one is within ray.dist_bounds, you should
+	// return that one!
+
+	PT::Hit hit;
+	if (!intersect(ray, hit)) {
+		PT::Trace ret;
+		ret.origin = ray.point;
+		return ret;
+	}
+	return finalize(ray, hit);
+}
+
+bool Sphere::intersect(Ray const &ray, PT::Hit& hit) const {
+	float t;
+	if (!intersect(ray, t)) return false;
+	hit.t = t;
+	return true;
+}
+
+PT::Trace Sphere::finalize(Ray const &ray, PT::Hit const &hit) const {
+	PT::Trace ret;
+	ret.origin = ray.point;
+	ret.hit = true;
+	ret.distance = hit.t;
+	ret.position = ray.at(hit.t);
+	ret.normal = ret.position.unit();
+	ret.uv = uv(ret.normal);
+	return ret;
+}
+
+bool Sphere::occluded(Ray ray) const {
+	float t;
+	return intersect(ray, t);
 }
 
 Vec3 Sphere::sample(RNG &rng, Vec3 from) const {
@@ -22,6 +22,11 @@ public:
 
 	BBox bbox() const;
 	PT::Trace hit(Ray ray) const;
+	//closest-hit traversal: if ray hits within ray.dist_bounds, records t in hit:
+	bool intersect(Ray const &ray, PT::Hit& hit) const;
+	//surface attributes of a hit recorded by intersect():
+	PT::Trace finalize(Ray const &ray, PT::Hit const &hit) const;
+	bool occluded(Ray ray) const;
 	Vec3 sample(RNG &rng, Vec3 from) const;
 	float pdf(Ray ray, Mat4 pdf_T = Mat4::I, Mat4 pdf_iT = Mat4::I) const;
 
@@ -36,6 +41,10 @@ public:
 		f("radius", t.radius);
 	}
 	static inline const char *TYPE = "Sphere"; //used by introspect_variant<>
+
+private:
+	//nearest intersection distance within ray.dist_bounds:
+	bool intersect(Ray const &ray, float& t) const;
 };
 
 } // namespace Shapes
@@ -55,6 +64,18 @@ public:
 		return std::visit([&](auto& s) { return s.hit(ray); }, shape);
 	}
 
+	bool intersect(Ray const &ray, PT::Hit& hit) const {
+		return std::visit([&](auto& s) { return s.intersect(ray, hit); }, shape);
+	}
+
+	PT::Trace finalize(Ray const &ray, PT::Hit const &hit) const {
+		return std::visit([&](auto& s) { return s.finalize(ray, hit); }, shape);
+	}
+
+	bool occluded(Ray ray) const {
+		return std::visit([&](auto& s) { return s.occluded(ray); }, shape);
+	}
+
 	Vec3 sample(RNG &rng, Vec3 from) const {
 		return std::visit([&](auto& s) { return s.sample(rng, from); }, shape);
 	}
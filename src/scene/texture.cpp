@@ -114,6 +114,18 @@ Image::Image(Sampler sampler_, HDR_Image const &image_) {
 	update_mipmap();
 }
 
+Image Image::copy() const {
+	Image ret;
+	ret.sampler = sampler;
+	ret.image = image.copy();
+	ret.levels.reserve(levels.size());
+	for (auto const &level : levels) {
+		ret.levels.emplace_back(level.copy());
+	}
+	ret.levels_of = levels_of.copy();
+	return ret;
+}
+
 Spectrum Image::evaluate(Vec2 uv, float lod) const {
 	if (image.w == 0 && image.h == 0) return Spectrum();
 	if (sampler == Sampler::nearest) {
@@ -127,9 +139,14 @@ Spectrum Image::evaluate(Vec2 uv, float lod) const {
 
 void Image::update_mipmap() {
 	if (sampler == Sampler::trilinear) {
-		generate_mipmap(image, &levels);
+		//(writers unshare the image's pixels with make_unique(), so levels are only regenerated when it changed)
+		if (levels.empty() || !levels_of.shares_pixels(image)) {
+			generate_mipmap(image, &levels);
+			levels_of = image.copy();
+		}
 	} else {
 		levels.clear();
+		levels_of = HDR_Image();
 	}
 }
 
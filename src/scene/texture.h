@@ -22,9 +22,8 @@ public:
 	Image() = default;
 	Image(Sampler sampler_, HDR_Image const &image_);
 	
-	Image copy() const {
-		return Image{sampler, image};
-	}
+	//copies share pixels and mipmap levels with this image (see HDR_Image), so copying is cheap:
+	Image copy() const;
 
 	//Read value from the image.
 	//  uv of [0,1]x[0,1] corresponds to the [0,w]x[0,h] of the contained image.
@@ -39,6 +38,7 @@ public:
 	//updates 'levels' for current sampler and image:
 	void update_mipmap();
 	std::vector<HDR_Image> levels; //mipmap levels (if needed)
+	HDR_Image levels_of; //shares pixels with the image 'levels' were generated from
 
 	GL::Tex2D to_gl() const;
 
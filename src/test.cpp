@@ -13,6 +13,7 @@
 #include <unordered_set>
 
 bool Test::run_generators = false;
+bool Test::run_benchmarks = false;
 
 namespace {
 std::map<std::string, std::function<void()>>& get_tests() {
@@ -103,4 +103,5 @@ public:
 	static double print_empirical_threshold(const std::vector<double>& ref,
 	                                        const std::function<std::vector<double>()>& histogram);
 	static bool run_generators; //for test cases that need to run something against reference to generate data
+	static bool run_benchmarks; //benchmarks ('bench.*' cases) throw Test::ignored unless this is set (--run-benchmarks)
 };
@@ -0,0 +1,58 @@
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+//Hash64 accumulates a 64-bit fingerprint of a sequence of values, for noticing when data has changed.
+// (this is not a cryptographic hash: collisions are unlikely, not impossible)
+class Hash64 {
+public:
+	void add(uint64_t v) {
+		h = (h ^ v) * 0x100000001b3ull;
+		h ^= h >> 29;
+	}
+	void add(uint32_t v) {
+		add(uint64_t(v));
+	}
+	void add(float f) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		add(bits);
+	}
+
+	//add the bytes of an array of plain data (without padding, so that every byte is meaningful):
+	template< typename T >
+	void add_array(T const *data, size_t count) {
+		static_assert(std::is_trivially_copyable_v< T >, "hashing raw bytes of plain data");
+		static_assert(sizeof(T) % sizeof(uint32_t) == 0, "hashing whole words");
+		add(uint64_t(count));
+		size_t words = count * sizeof(T) / sizeof(uint32_t);
+		unsigned char const *bytes = reinterpret_cast< unsigned char const * >(data);
+		for (size_t i = 0; i < words; ++i) {
+			uint32_t word;
+			std::memcpy(&word, bytes + i * sizeof(uint32_t), sizeof(word));
+			add(word);
+		}
+	}
+	template< typename T >
+	void add_array(std::vector< T > const &data) {
+		add_array(data.data(), data.size());
+	}
+
+	//fingerprint so far (with a final mix, so that nearby states don't give nearby values):
+	uint64_t value() const {
+		uint64_t x = h;
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+private:
+	uint64_t h = 0xcbf29ce484222325ull;
+};
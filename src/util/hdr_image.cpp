@@ -5,24 +5,45 @@
 #include <sf_libs/stb_image.h>
 #include <sf_libs/tinyexr.h>
 
+#include <atomic>
 #include <cstring>
 
-HDR_Image::HDR_Image(uint32_t w, uint32_t h, Spectrum color) : w(w), h(h) {
-	pixels.resize(w * h, color);
+HDR_Image::HDR_Image(uint32_t w, uint32_t h, Spectrum color)
+	: w(w), h(h), pixels(std::make_shared< std::vector<Spectrum> >(w * h, color)) {
 }
 
-HDR_Image::HDR_Image(uint32_t w, uint32_t h, const std::vector<Spectrum>& pixels)
-	: w(w), h(h), pixels(pixels) {
-	assert(pixels.size() == w * h);
+HDR_Image::HDR_Image(uint32_t w, uint32_t h, std::vector<Spectrum> pixels_)
+	: w(w), h(h), pixels(std::make_shared< std::vector<Spectrum> >(std::move(pixels_))) {
+	assert(pixels->size() == w * h);
 }
 
 HDR_Image HDR_Image::copy() const {
-	HDR_Image ret(w, h, pixels);
+	HDR_Image ret;
+	ret.w = w;
+	ret.h = h;
+	ret.pixels = pixels;
 	return ret;
 }
 
+void HDR_Image::make_unique() {
+	if (!pixels) {
+		pixels = std::make_shared< std::vector<Spectrum> >();
+	} else if (pixels.use_count() > 1) {
+		pixels = std::make_shared< std::vector<Spectrum> >(*pixels);
+	} else {
+		//other copies may have just been released; see their reads before writing:
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+}
+
 const std::vector<Spectrum>& HDR_Image::data() const {
-	return pixels;
+	static const std::vector<Spectrum> empty;
+	return pixels ? *pixels : empty;
+}
+
+std::vector<Spectrum>& HDR_Image::writable_data() {
+	make_unique();
+	return *pixels;
 }
 
 std::pair<uint32_t, uint32_t> HDR_Image::dimension() const {
@@ -50,7 +71,7 @@ HDR_Image HDR_Image::load(const std::string& file) {
 		}
 
 		image = HDR_Image(n_w, n_h);
-		std::vector< Spectrum > &pixels = image.pixels;
+		std::vector< Spectrum > &pixels = *image.pixels;
 
 		//EXR is top-left origin, so flip vertically during load to put origin in bottom left:
 		for (uint32_t j = 0; j < image.h; j++) {
@@ -75,7 +96,7 @@ HDR_Image HDR_Image::load(const std::string& file) {
 		if (channels < 3) throw std::runtime_error("Image loaded from " + file + " has fewer than 3 color channels.");
 
 		image = HDR_Image(n_w, n_h);
-		std::vector< Spectrum > &pixels = image.pixels;
+		std::vector< Spectrum > &pixels = *image.pixels;
 
 		for (uint32_t i = 0; i < image.w * image.h * channels; i += channels) {
 			float r = data[i] / 255.0f;
@@ -127,7 +148,7 @@ HDR_Image HDR_Image::decode(uint8_t const *buffer, size_t length) {
 		static_assert(offsetof(Spectrum, g) == 4, "Spectrum g is second.");
 		static_assert(offsetof(Spectrum, b) == 8, "Spectrum b is third.");
 		std::memcpy(pixels.data(), buffer, sizeof(Spectrum) * pixels.size());
-		return HDR_Image(header.width, header.height, pixels);
+		return HDR_Image(header.width, header.height, std::move(pixels));
 	} else {
 		throw std::runtime_error("Unrecognized format for image storage.");
 	}
@@ -147,6 +168,7 @@ std::vector< uint8_t > HDR_Image::encode() const {
 	std::memcpy(buffer, reinterpret_cast< const char * >(&h), 4); buffer += 4;
 
 	//data:
+	std::vector< Spectrum > const &pixels = this->data();
 	std::memcpy(buffer, reinterpret_cast< const char * >(pixels.data()), 12 * pixels.size());
 	buffer += 12 * pixels.size();
 	assert(buffer == data.data() + data.size());
@@ -186,7 +208,7 @@ HDR_Image HDR_Image::missing_image() {
 			data >>= 4;
 		}
 	}
-	return HDR_Image(16, 16, pixels);
+	return HDR_Image(16, 16, std::move(pixels));
 }
 
 //TODO: should support HDR (i.e. floating point) textures in GL::Tex2D to avoid tonemapping
@@ -206,7 +228,7 @@ void HDR_Image::tonemap_to(std::vector<uint8_t>& data, float e) const {
 		for (uint32_t i = 0; i < w; i++) {
 
 			uint32_t pidx = j * w + i;
-			const Spectrum& sample = pixels[pidx];
+			const Spectrum& sample = (*pixels)[pidx];
 
 			float r = 1.0f - std::exp(-sample.r * e);
 			float g = 1.0f - std::exp(-sample.g * e);
@@ -228,6 +250,7 @@ bool operator!=(const HDR_Image& a, const HDR_Image& b) {
 	auto [aw, ah] = a.dimension();
 	auto [bw, bh] = b.dimension();
 	if (aw != bw || ah != bh) return true;
+	if (a.shares_pixels(b)) return false;
 	for (uint32_t i = 0; i < aw * ah; i++) {
 		if (a.at(i) != b.at(i)) return true;
 	}
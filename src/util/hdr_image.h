@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include "../lib/spectrum.h"
@@ -12,6 +13,10 @@
  *
  * The origin is located in the bottom left.
  *
+ * Pixel storage is shared between copies (copy-on-write): copy() is cheap,
+ *  and an image gets its own pixels when make_unique() (or writable_data()) is called,
+ *  which code that writes pixels does once before writing through at().
+ *
  */
 class HDR_Image {
 public:
@@ -21,7 +26,7 @@ public:
 	HDR_Image(uint32_t w, uint32_t h, Spectrum color = Spectrum(0.0f, 0.0f, 0.0f));
 	//image from pixel array (row-major, bottom-left origin):
 	//required: pixels.size() == w*h
-	HDR_Image(uint32_t w, uint32_t h, const std::vector<Spectrum>& pixels);
+	HDR_Image(uint32_t w, uint32_t h, std::vector<Spectrum> pixels);
 
 	~HDR_Image() = default;
 
@@ -30,25 +35,39 @@ public:
 	HDR_Image& operator=(const HDR_Image& src) = delete;
 	HDR_Image(HDR_Image&& src) = default;
 	HDR_Image& operator=(HDR_Image&& src) = default;
-	HDR_Image copy() const;
+	HDR_Image copy() const; //(shares pixels with this image until either is written)
 
 	//direct data access (row-major, bottom-left origin):
 	const std::vector<Spectrum>& data() const;
+	//...for writing (after make_unique()):
+	std::vector<Spectrum>& writable_data();
+
+	//give this image its own pixels, if it shares them with copies; call before writing pixels:
+	// (don't make copies of an image while another thread writes it)
+	void make_unique();
+
+	//does this image share pixel storage with 'other'? (if so, they have the same contents)
+	bool shares_pixels(HDR_Image const &other) const {
+		return pixels && pixels == other.pixels;
+	}
 
 	//range-checked access helpers:
+	// (non-const access writes the pixels in place, so the image must not share them: see make_unique())
 	Spectrum& at(uint32_t x, uint32_t y) {
 		assert(x < w && y < h);
-		return pixels[y * w + x];
+		assert(pixels.use_count() == 1);
+		return (*pixels)[y * w + x];
 	}
 	Spectrum const &at(uint32_t x, uint32_t y) const {
 		assert(x < w && y < h);
-		return pixels[y * w + x];
+		return (*pixels)[y * w + x];
 	}
 	Spectrum& at(uint32_t i) {
-		return pixels.at(i);
+		assert(pixels.use_count() == 1);
+		return pixels->at(i);
 	}
 	Spectrum const &at(uint32_t i) const {
-		return pixels.at(i);
+		return data().at(i);
 	}
 
 	//void clear(Spectrum color);
@@ -73,7 +92,7 @@ public:
 
 	std::string loaded_from = "";
 private:
-	std::vector<Spectrum> pixels;
+	std::shared_ptr< std::vector<Spectrum> > pixels;
 };
 
 bool operator!=(const HDR_Image& a, const HDR_Image& b);
@@ -6,6 +6,71 @@
 #include <random>
 #include <thread>
 
+namespace {
+
+//PCG output permutation (O'Neill 2014) applied to a counter, as in Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020):
+uint32_t pcg_hash(uint32_t x) {
+	uint32_t state = x * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint32_t hash_combine(uint32_t seed, uint32_t v) {
+	return pcg_hash(seed ^ (v + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)));
+}
+
+uint32_t reverse_bits(uint32_t x) {
+	x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+	x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+	x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+	x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+	return (x >> 16u) | (x << 16u);
+}
+
+//Laine-Karras permutation: a hash in which each bit only depends on the bits below it:
+uint32_t laine_karras(uint32_t x, uint32_t seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+//hash-based Owen scrambling (Burley, "Practical Hash-based Owen Scrambling", 2020):
+// (an Owen scramble lets each bit depend on the bits above it, so run Laine-Karras on the reversed bits)
+uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+	return reverse_bits(laine_karras(reverse_bits(x), seed));
+}
+
+//second dimension of the Sobol sequence (the first is just reverse_bits):
+// (multiplying by its generator matrix is linear over GF(2), so it is done a byte at a time with tables)
+struct Sobol_1_Tables {
+	Sobol_1_Tables() {
+		uint32_t columns[32];
+		uint32_t v = 1u << 31u;
+		for (uint32_t bit = 0; bit < 32; ++bit, v ^= v >> 1u) columns[bit] = v;
+		for (uint32_t byte = 0; byte < 4; ++byte) {
+			for (uint32_t value = 0; value < 256; ++value) {
+				uint32_t r = 0;
+				for (uint32_t bit = 0; bit < 8; ++bit) {
+					if (value & (1u << bit)) r ^= columns[8 * byte + bit];
+				}
+				tables[byte][value] = r;
+			}
+		}
+	}
+	uint32_t tables[4][256];
+};
+const Sobol_1_Tables sobol_1_tables;
+
+uint32_t sobol_1(uint32_t i) {
+	return sobol_1_tables.tables[0][i & 0xffu] ^ sobol_1_tables.tables[1][(i >> 8u) & 0xffu]
+	     ^ sobol_1_tables.tables[2][(i >> 16u) & 0xffu] ^ sobol_1_tables.tables[3][i >> 24u];
+}
+
+} // namespace
+
 RNG::RNG() {
 	random_seed();
 }
@@ -17,13 +82,19 @@ RNG::RNG(uint32_t seed) {
 float RNG::unit() {
 	//not using std::uniform_real_distribution because it has different behavior on different standard libraries
 	static_assert(decltype(mt)::min() == 0 && decltype(mt)::max() == 0xffffffff, "Mersenne Twister has the expected range.");
-	return std::scalbn(float(mt()), -32);
+	if (sequence == Sequence::Stream) return std::scalbn(float(mt()), -32);
+	//(only the top 24 bits, so that the result can't round up to 1.0f)
+	return std::scalbn(float(bits() >> 8), -24);
 }
 
 int32_t RNG::integer(int32_t min, int32_t max) {
 	//not using std::uniform_int_distribution because it has different behavior on different standard libraries
 	static_assert(decltype(mt)::min() == 0 && decltype(mt)::max() == 0xffffffff, "Mersenne Twister has the expected range.");
 	uint64_t size = int64_t(max) - int64_t(min);
+	if (sequence != Sequence::Stream) {
+		//sequences have a fixed number of draws per dimension, so scale rather than rejection sample:
+		return int32_t(int64_t((uint64_t(bits()) * size) >> 32) + int64_t(min));
+	}
 	//true, but for readability will not do it: static_assert(int64_t(std::numeric_limits< int32_t >::max()) - int64_t(std::numeric_limits< int32_t >::min()) == std::numeric_limits< uint32_t >::max(), "range size fits into uint32_t");
 	//maximum value such that (max_val + 1) is a multiple of size:
 	uint32_t max_val = static_cast<uint32_t>(0x100000000ull / size * size - 1ull);
@@ -58,3 +129,55 @@ void RNG::random_seed() {
 uint32_t RNG::get_seed() {
 	return _seed;
 }
+
+const char* RNG::sequence_name(Sequence sequence) {
+	switch (sequence) {
+	case Sequence::Stream: return "stream";
+	case Sequence::Independent: return "independent";
+	case Sequence::Sobol: return "sobol";
+	}
+	return "???";
+}
+
+void RNG::start_sample(Sequence sequence_, uint32_t seed, uint32_t pixel, uint32_t sample) {
+	sequence = sequence_;
+	sample_pixel = hash_combine(seed, pixel);
+	sample_index = sample;
+	sample_key = hash_combine(sample_pixel, sample);
+	dimension = 0;
+}
+
+void RNG::end_sample() {
+	sequence = Sequence::Stream;
+}
+
+RNG::Sample_State RNG::save_sample() const {
+	return Sample_State{sequence, sample_pixel, sample_index, sample_key, dimension, pair_second};
+}
+
+void RNG::resume_sample(Sample_State const &state) {
+	sequence = state.sequence;
+	sample_pixel = state.pixel;
+	sample_index = state.index;
+	sample_key = state.key;
+	dimension = state.dimension;
+	pair_second = state.pair_second;
+}
+
+uint32_t RNG::bits() {
+	uint32_t d = dimension++;
+	if (sequence == Sequence::Independent) {
+		return hash_combine(sample_key, d);
+	}
+	assert(sequence == Sequence::Sobol);
+
+	//Sobol only has two well-stratified dimensions, so dimensions are drawn in pairs
+	// from a (0,2)-sequence whose sample order is shuffled independently for each pair:
+	// (Burley 2020, section 4 -- "padding" the sequence)
+	if (d & 1u) return pair_second;
+	uint32_t pair = hash_combine(sample_pixel, d);
+	uint32_t index = owen_scramble(sample_index, pair);
+	pair_second = owen_scramble(sobol_1(index), hash_combine(pair, 2u));
+	//(owen_scramble(reverse_bits(index)), with the reversals cancelled)
+	return reverse_bits(laine_karras(index, hash_combine(pair, 1u)));
+}
@@ -28,7 +28,41 @@ struct RNG {
 
 	static inline uint32_t fixed_seed = 0; //0 = 'pick a new seed every render', otherwise use as seed
 
+	//Where unit(), integer(), and coin_flip() get their numbers:
+	// (the counter-based sequences make draw d of sample s of a pixel a function of (seed, pixel, s, d) alone,
+	//  so results don't depend on how samples are split up or ordered)
+	enum class Sequence : uint8_t {
+		Stream,      //next value from the Mersenne Twister stream (mt)
+		Independent, //PCG hash of (seed, pixel, sample, draw)
+		Sobol,       //Owen-scrambled Sobol (0,2)-sequence, shuffled per (seed, pixel, draw pair)
+	};
+	static const char* sequence_name(Sequence sequence);
+
+	//draw the dimensions of sample 'sample' of pixel 'pixel' from a counter-based sequence, starting at dimension 0:
+	void start_sample(Sequence sequence, uint32_t seed, uint32_t pixel, uint32_t sample);
+	//go back to drawing from mt:
+	void end_sample();
+
+	//where the current sample is in its sequence, so several samples can be drawn from in turn:
+	// (resuming a Stream sample just draws from mt)
+	struct Sample_State {
+		Sequence sequence = Sequence::Stream;
+		uint32_t pixel = 0, index = 0, key = 0, dimension = 0, pair_second = 0;
+	};
+	Sample_State save_sample() const;
+	void resume_sample(Sample_State const &state);
+
 	std::mt19937 mt;
 private:
 	uint32_t _seed = 0;
+
+	//next 32 random bits from whichever sequence is in use:
+	uint32_t bits();
+
+	Sequence sequence = Sequence::Stream;
+	uint32_t sample_pixel = 0; //(hash of seed and pixel)
+	uint32_t sample_index = 0;
+	uint32_t sample_key = 0; //(hash of seed, pixel, and sample)
+	uint32_t dimension = 0;
+	uint32_t pair_second = 0; //(Sobol draws come in pairs; this is the second of the current pair)
 };
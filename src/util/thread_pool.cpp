@@ -1,71 +1,215 @@
 
 #include "thread_pool.h"
-#include "../util/rand.h"
+
+#include <algorithm>
+#include <chrono>
+
+//lets enqueue() / wait() know if they are being called from one of the pool's own workers:
+static thread_local Thread_Pool const* current_pool = nullptr;
+static thread_local uint32_t current_worker = 0;
+
+Thread_Pool::Group::~Group() {
+	assert(pending.load() == 0);
+}
 
 Thread_Pool::Thread_Pool(uint32_t threads) {
-	start(threads);
+	//(hardware_concurrency() is allowed to return zero)
+	threads = std::max(threads, 1u);
+	for (uint32_t i = 0; i < threads; i++) {
+		workers.emplace_back(std::make_unique< Worker >());
+	}
+	for (uint32_t i = 0; i < threads; i++) {
+		workers[i]->thread = std::thread([this, i]() { work(i); });
+	}
 }
 
 Thread_Pool::~Thread_Pool() {
 	stop();
 }
 
-void Thread_Pool::start(uint32_t threads) {
-	n_threads = threads;
-	stop_now = false;
-	stop_when_done = false;
-	for (uint32_t i = 0; i < threads; i++)
-		workers.emplace_back([this] {
-			for (;;) {
-				std::function<void()> task;
-				{
-					std::unique_lock<std::mutex> lock(this->queue_mutex);
-					this->condition.wait(lock, [this] {
-						return this->stop_now || this->stop_when_done || !this->tasks.empty();
-					});
-					if (this->stop_now || (this->stop_when_done && this->tasks.empty())) return;
-					task = std::move(this->tasks.front());
-					this->tasks.pop();
-				}
-				task();
-			}
-		});
+void Thread_Pool::enqueue(Group& group, std::function<void()>&& task) {
+	std::vector< std::function<void()> > tasks;
+	tasks.emplace_back(std::move(task));
+	enqueue(group, std::move(tasks));
 }
 
-void Thread_Pool::clear() {
-	stop();
-	start(n_threads);
+void Thread_Pool::enqueue(Group& group, std::vector< std::function<void()> >&& tasks) {
+	assert(!stop_now && !workers.empty());
+	if (tasks.empty()) return;
+
+	uint32_t count = uint32_t(tasks.size());
+	group.pending.fetch_add(count);
+	//(count as queued before the tasks are visible, so 'queued' never underflows)
+	queued.fetch_add(count);
+
+	//tasks from a worker stay on that worker (others will steal them if idle);
+	// tasks from outside are dealt round-robin to all workers:
+	bool local = (current_pool == this);
+	uint32_t first = local ? current_worker : next_worker.fetch_add(count) % size();
+	uint32_t spread = local ? 1 : size();
+
+	for (uint32_t k = 0; k < spread && k < count; ++k) {
+		Worker& worker = *workers[(first + k) % size()];
+		std::lock_guard< std::mutex > lock(worker.mut);
+		//worker gets tasks k, k + spread, k + 2 * spread, ...
+		// pushed latest-first, since the worker pops from the back:
+		uint32_t last = k + ((count - 1 - k) / spread) * spread;
+		for (uint32_t i = last; ; i -= spread) {
+			worker.tasks.push_back(Task{std::move(tasks[i]), &group});
+			if (i == k) break;
+		}
+	}
+
+	{ //(take the lock so a worker can't miss the wakeup between checking 'queued' and sleeping)
+		std::lock_guard< std::mutex > lock(sleep_mut);
+	}
+	if (count == 1) wake.notify_one();
+	else wake.notify_all();
 }
 
-void Thread_Pool::wait() {
+bool Thread_Pool::pop(uint32_t index, Task& task) {
+	auto take = [&](Worker& worker, bool back) {
+		std::lock_guard< std::mutex > lock(worker.mut);
+		if (worker.tasks.empty()) return false;
+		if (back) {
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+		} else {
+			task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
+		}
+		//(count as running before no longer counting as queued, so wait() never sees a gap)
+		running.fetch_add(1);
+		queued.fetch_sub(1);
+		return true;
+	};
 
-	{
-		std::unique_lock<std::mutex> lock(queue_mutex);
-		stop_when_done = true;
+	//own tasks first (most recently queued first):
+	if (take(*workers[index], true)) return true;
+	//then steal from others (least recently queued first):
+	for (uint32_t i = 1; i < size(); ++i) {
+		if (take(*workers[(index + i) % size()], false)) return true;
 	}
+	return false;
+}
+
+void Thread_Pool::run(Task& task) {
+	Group& group = *task.group;
+	if (!group.cancelled()) task.function();
+	//release captured state before anyone waiting on the group wakes up:
+	task.function = nullptr;
+	finish(group, 1);
 
-	condition.notify_all();
-	for (std::thread& worker : workers) {
-		worker.join();
+	if (running.fetch_sub(1) == 1 && queued.load() == 0) {
+		std::lock_guard< std::mutex > lock(sleep_mut);
+		idle.notify_all();
 	}
-	workers.clear();
+}
 
-	start(n_threads);
+void Thread_Pool::finish(Group& group, uint32_t count) {
+	//(decrement under done_mut, and wait() takes done_mut before returning, so the group can't be
+	// destroyed between its last task finishing and the notify)
+	std::lock_guard< std::mutex > lock(group.done_mut);
+	if (group.pending.fetch_sub(count) == count) {
+		group.done.notify_all();
+	}
 }
 
-void Thread_Pool::stop() {
+void Thread_Pool::work(uint32_t index) {
+	current_pool = this;
+	current_worker = index;
 
+	for (;;) {
+		Task task;
+		if (pop(index, task)) {
+			run(task);
+			continue;
+		}
+		std::unique_lock< std::mutex > lock(sleep_mut);
+		wake.wait(lock, [this] {
+			return stop_now || queued.load() > 0;
+		});
+		if (stop_now) return;
+	}
+}
+
+template< typename F >
+void Thread_Pool::drop_if(F&& pred) {
+	std::vector< Task > dropped;
+	for (auto& worker : workers) {
+		std::lock_guard< std::mutex > lock(worker->mut);
+		auto keep = std::stable_partition(worker->tasks.begin(), worker->tasks.end(), [&](Task const& task) {
+			return !pred(task);
+		});
+		std::move(keep, worker->tasks.end(), std::back_inserter(dropped));
+		worker->tasks.erase(keep, worker->tasks.end());
+	}
+	if (dropped.empty()) return;
+
+	queued.fetch_sub(uint32_t(dropped.size()));
+	for (Task& task : dropped) {
+		task.function = nullptr;
+		finish(*task.group, 1);
+	}
+
+	std::lock_guard< std::mutex > lock(sleep_mut);
+	idle.notify_all();
+}
+
+void Thread_Pool::wait(Group& group) {
+	if (current_pool == this) {
+		//a worker can't just block here (the tasks it is waiting on might be in its own deque), so help out:
+		while (group.pending.load() != 0) {
+			Task task;
+			if (pop(current_worker, task)) {
+				run(task);
+				continue;
+			}
+			//nothing to run -- group's remaining tasks are running elsewhere:
+			std::unique_lock< std::mutex > lock(group.done_mut);
+			group.done.wait_for(lock, std::chrono::milliseconds(1), [&group] {
+				return group.pending.load() == 0;
+			});
+		}
+		//(the last finish() may still hold done_mut)
+		std::lock_guard< std::mutex > lock(group.done_mut);
+	} else {
+		std::unique_lock< std::mutex > lock(group.done_mut);
+		group.done.wait(lock, [&group] {
+			return group.pending.load() == 0;
+		});
+	}
+}
+
+void Thread_Pool::cancel(Group& group) {
+	group.cancel_flag = true;
+	drop_if([&group](Task const& task) { return task.group == &group; });
+	wait(group);
+	group.cancel_flag = false;
+}
+
+void Thread_Pool::wait() {
+	assert(current_pool != this);
+	std::unique_lock< std::mutex > lock(sleep_mut);
+	idle.wait(lock, [this] {
+		return queued.load() == 0 && running.load() == 0;
+	});
+}
+
+void Thread_Pool::clear() {
+	drop_if([](Task const&) { return true; });
+	wait();
+}
+
+void Thread_Pool::stop() {
+	clear();
 	{
-		std::unique_lock<std::mutex> lock(queue_mutex);
+		std::lock_guard< std::mutex > lock(sleep_mut);
 		stop_now = true;
 	}
-
-	condition.notify_all();
-	for (std::thread& worker : workers) {
-		worker.join();
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker->thread.join();
 	}
 	workers.clear();
-
-	std::queue<std::function<void()>> empty;
-	std::swap(tasks, empty);
 }
@@ -1,50 +1,99 @@
-
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
-#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <vector>
 
 #include "../lib/log.h"
 
+//Work-stealing thread pool.
+// Each worker owns a deque of tasks: it pops from the back of its own deque,
+// and steals from the front of other workers' deques when it runs dry.
+// Tasks are always enqueued as part of a Group, which can be waited on or
+// cancelled without disturbing the worker threads or other groups.
 class Thread_Pool {
 public:
 	Thread_Pool(uint32_t threads);
 	~Thread_Pool();
 
-	void stop();
-	void wait();
-	void clear();
+	//A set of tasks that are waited on / cancelled together.
+	// (must outlive its tasks -- wait() or cancel() before destroying)
+	class Group {
+	public:
+		Group() = default;
+		~Group();
 
-	template<class F, class... Args>
-	auto enqueue(F&& f, Args&&... args)
-		-> std::future<typename std::invoke_result<F, Args...>::type> {
+		Group(const Group&) = delete;
+		Group& operator=(const Group&) = delete;
 
-		using return_type = typename std::invoke_result<F, Args...>::type;
-		assert(!stop_now && !stop_when_done);
+		//true while the group is being cancelled; long-running tasks may poll this to exit early:
+		bool cancelled() const {
+			return cancel_flag.load(std::memory_order_relaxed);
+		}
 
-		auto task = std::make_shared<std::packaged_task<return_type()>>(
-			std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+	private:
+		friend class Thread_Pool;
+		std::atomic< uint32_t > pending = 0; //tasks enqueued but not yet finished (or dropped)
+		std::atomic< bool > cancel_flag = false;
+		std::mutex done_mut;
+		std::condition_variable done;
+	};
 
-		std::future<return_type> res = task->get_future();
-		{
-			std::unique_lock<std::mutex> lock(queue_mutex);
-			tasks.emplace([task]() { (*task)(); });
-		}
-		condition.notify_one();
-		return res;
+	//queue one task (or a batch of tasks) as part of group:
+	// (when called from a worker, tasks go to that worker's deque; otherwise they are dealt out to all workers)
+	void enqueue(Group& group, std::function<void()>&& task);
+	void enqueue(Group& group, std::vector< std::function<void()> >&& tasks);
+
+	//block until every task in group has finished:
+	// (when called from a worker thread, runs queued tasks while waiting)
+	void wait(Group& group);
+
+	//drop group's pending tasks and wait for its running tasks to finish:
+	void cancel(Group& group);
+
+	//block until all queued tasks have finished:
+	void wait();
+	//drop all pending tasks and wait for running tasks to finish:
+	void clear();
+	//clear() and shut down the worker threads:
+	void stop();
+
+	uint32_t size() const {
+		return uint32_t(workers.size());
 	}
 
 private:
-	void start(uint32_t);
-	uint32_t n_threads;
-	bool stop_now = true;
-	bool stop_when_done = true;
-	std::mutex queue_mutex;
-	std::condition_variable condition;
-	std::vector<std::thread> workers;
-	std::queue<std::function<void()>> tasks;
+	struct Task {
+		std::function<void()> function;
+		Group* group = nullptr;
+	};
+
+	struct Worker {
+		std::mutex mut;
+		std::deque< Task > tasks;
+		std::thread thread;
+	};
+
+	void work(uint32_t index);
+	bool pop(uint32_t index, Task& task);
+	void run(Task& task);
+	void finish(Group& group, uint32_t count);
+	template< typename F >
+	void drop_if(F&& pred);
+
+	std::vector< std::unique_ptr< Worker > > workers;
+	std::atomic< uint32_t > next_worker = 0; //round-robin target for tasks enqueued from outside the pool
+
+	//sleeping / idle bookkeeping:
+	std::mutex sleep_mut;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::atomic< uint32_t > queued = 0; //tasks sitting in deques
+	std::atomic< uint32_t > running = 0; //tasks currently executing
+	bool stop_now = false;
 };
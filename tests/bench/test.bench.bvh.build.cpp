@@ -0,0 +1,115 @@
+#include "test.h"
+
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/bvh.h"
+#include "pathtracer/tri_mesh.h"
+#include "scene/animator.h"
+#include "scene/io.h"
+#include "scene/scene.h"
+#include "util/thread_pool.h"
+#include "util/timer.h"
+
+#include <filesystem>
+#include <thread>
+
+// BVH build:
+//  builds triangle BVHs for every mesh in media/js3d (plus one large synthetic mesh), single-threaded and on a thread pool,
+//  and checks that both builds produce the same tree.
+
+Test test_bench_bvh_build("bench.bvh.build", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	std::filesystem::path media = "media/js3d";
+	if (!std::filesystem::is_directory(media)) {
+		throw Test::ignored("Run from the repository root (needs media/js3d).");
+	}
+
+	std::vector< std::filesystem::path > files;
+	for (auto const& entry : std::filesystem::directory_iterator(media)) {
+		if (entry.path().extension() == ".js3d") files.emplace_back(entry.path());
+	}
+	std::sort(files.begin(), files.end());
+
+	uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+	Thread_Pool pool(threads);
+
+	auto triangles = [](Indexed_Mesh const& mesh, std::vector< PT::Tri_Mesh_Vert >& verts) {
+		for (auto const& v : mesh.vertices()) verts.push_back({v.pos, v.norm, v.uv});
+		std::vector< PT::Triangle > tris;
+		auto const& idxs = mesh.indices();
+		for (size_t i = 0; i < idxs.size(); i += 3) {
+			tris.emplace_back(verts.data(), idxs[i], idxs[i + 1], idxs[i + 2]);
+		}
+		return tris;
+	};
+
+	log("\n\t%-36s %10s %12s %12s %8s", "scene", "triangles", "serial ms", "parallel ms", "nodes");
+	size_t total_tris = 0;
+	float total_serial = 0.0f, total_parallel = 0.0f;
+	auto bench = [&](std::string const& name, std::vector< Indexed_Mesh > const& meshes) {
+		size_t tris = 0, nodes = 0;
+		float serial_ms = 0.0f, parallel_ms = 0.0f;
+		for (auto const& mesh : meshes) {
+			std::vector< PT::Tri_Mesh_Vert > verts;
+			std::vector< PT::Triangle > prims = triangles(mesh, verts);
+			tris += prims.size();
+
+			PT::BVH_Build_Opts opts;
+			opts.max_leaf_size = 4;
+
+			PT::BVH< PT::Triangle > serial, parallel;
+			{
+				Timer t;
+				serial.build(std::vector< PT::Triangle >(prims), opts);
+				serial_ms += t.ms();
+			}
+			opts.thread_pool = &pool;
+			{
+				Timer t;
+				parallel.build(std::move(prims), opts);
+				parallel_ms += t.ms();
+			}
+			nodes += parallel.nodes.size();
+
+			if (serial.nodes.size() != parallel.nodes.size() || !(serial.primitives == parallel.primitives)) {
+				throw Test::error("Parallel build of a mesh in '" + name + "' differs from the serial build.");
+			}
+			for (size_t i = 0; i < serial.nodes.size(); ++i) {
+				auto const& a = serial.nodes[i];
+				auto const& b = parallel.nodes[i];
+				if (a.start != b.start || a.size != b.size || a.l != b.l || a.r != b.r) {
+					throw Test::error("Parallel build of a mesh in '" + name + "' differs from the serial build.");
+				}
+			}
+		}
+
+		log("\n\t%-36s %10zu %12.2f %12.2f %8zu", name.c_str(), tris, serial_ms, parallel_ms, nodes);
+		total_tris += tris;
+		total_serial += serial_ms;
+		total_parallel += parallel_ms;
+	};
+
+	for (auto const& file : files) {
+		Scene scene;
+		Animator animator;
+		load(file.generic_string(), &scene, &animator);
+
+		std::vector< Indexed_Mesh > meshes;
+		for (auto const& [name, mesh] : scene.meshes) {
+			meshes.emplace_back(Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges));
+		}
+		for (auto const& [name, mesh] : scene.skinned_meshes) {
+			meshes.emplace_back(mesh->posed_mesh());
+		}
+		bench(file.filename().generic_string(), meshes);
+	}
+
+	//the media scenes are small, so also build one mesh big enough to be split across threads all the way down:
+	std::vector< Indexed_Mesh > sphere;
+	sphere.emplace_back(Util::closed_sphere_mesh(1.0f, 7));
+	bench("(subdivided sphere)", sphere);
+
+	log("\n\t%-36s %10zu %12.2f %12.2f", "(total)", total_tris, total_serial, total_parallel);
+	log("\n\t(%u threads)\n", threads);
+});
@@ -0,0 +1,99 @@
+#include "test.h"
+
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/bvh.h"
+#include "pathtracer/list.h"
+#include "pathtracer/tri_mesh.h"
+#include "scene/animator.h"
+#include "scene/io.h"
+#include "scene/scene.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// BVH traversal:
+//  rays/sec through the same tree with binary nodes and with collapsed 4-wide nodes,
+//  on the larger media/js3d meshes and one large synthetic mesh.
+//  Also checks both traversals (and, for a few rays, brute force) agree on every hit.
+
+Test test_bench_bvh_traversal("bench.bvh.traversal", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	std::vector< std::pair< std::string, Indexed_Mesh > > meshes;
+	for (std::string file : {"media/js3d/cow.js3d", "media/js3d/bunny.js3d", "media/js3d/A4-human.js3d"}) {
+		Scene scene;
+		Animator animator;
+		try {
+			load(file, &scene, &animator);
+		} catch (std::exception& e) {
+			throw Test::ignored("Run from the repository root (couldn't load '" + file + "').");
+		}
+		for (auto const& [name, mesh] : scene.meshes) {
+			meshes.emplace_back(file + ":" + name, Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges));
+		}
+		for (auto const& [name, mesh] : scene.skinned_meshes) {
+			meshes.emplace_back(file + ":" + name, mesh->posed_mesh());
+		}
+	}
+	meshes.emplace_back("(subdivided sphere)", Util::closed_sphere_mesh(1.0f, 7));
+
+	constexpr uint32_t Rays = 200000;
+	constexpr uint32_t Checked = 1000; //rays also checked against brute force
+
+	log("\n\t%-40s %10s %14s %14s %8s", "mesh", "triangles", "binary Mray/s", "wide Mray/s", "speedup");
+	for (auto const& [name, mesh] : meshes) {
+		std::vector< PT::Tri_Mesh_Vert > verts;
+		for (auto const& v : mesh.vertices()) verts.push_back({v.pos, v.norm, v.uv});
+		std::vector< PT::Triangle > tris;
+		auto const& idxs = mesh.indices();
+		for (size_t i = 0; i < idxs.size(); i += 3) {
+			tris.emplace_back(verts.data(), idxs[i], idxs[i + 1], idxs[i + 2]);
+		}
+		PT::List< PT::Triangle > list{std::vector< PT::Triangle >(tris)};
+
+		PT::BVH_Build_Opts opts;
+		opts.max_leaf_size = 4;
+		opts.wide = true;
+		PT::BVH< PT::Triangle > wide(std::move(tris), opts);
+		PT::BVH< PT::Triangle > binary = wide.copy();
+		binary.wide_nodes.clear();
+
+		//rays from a sphere around the mesh toward points inside its bounds:
+		BBox box = wide.bbox();
+		Vec3 center = box.center();
+		float radius = 2.0f * (box.max - box.min).norm();
+		RNG rng(1234);
+		std::vector< Ray > rays;
+		rays.reserve(Rays);
+		for (uint32_t i = 0; i < Rays; ++i) {
+			Vec3 from = center + radius * Vec3(rng.unit() - 0.5f, rng.unit() - 0.5f, rng.unit() - 0.5f).unit();
+			Vec3 to = box.min + Vec3(rng.unit(), rng.unit(), rng.unit()) * (box.max - box.min);
+			rays.emplace_back(from, to - from);
+		}
+
+		auto trace_all = [&](PT::BVH< PT::Triangle > const& bvh, std::vector< PT::Trace >& out) {
+			out.clear();
+			out.reserve(rays.size());
+			Timer t;
+			for (auto const& ray : rays) out.emplace_back(bvh.hit(ray));
+			return rays.size() / (t.s() * 1e6f);
+		};
+		std::vector< PT::Trace > binary_hits, wide_hits;
+		float binary_rate = trace_all(binary, binary_hits);
+		float wide_rate = trace_all(wide, wide_hits);
+
+		for (uint32_t i = 0; i < Rays; ++i) {
+			if (auto diff = Test::differs(binary_hits[i], wide_hits[i])) {
+				throw Test::error("Binary and wide traversal disagree on '" + name + "': " + diff.value());
+			}
+			if (i < Checked) {
+				if (auto diff = Test::differs(list.hit(rays[i]), wide_hits[i])) {
+					throw Test::error("Wide traversal disagrees with brute force on '" + name + "': " + diff.value());
+				}
+			}
+		}
+
+		log("\n\t%-40s %10zu %14.2f %14.2f %7.2fx", name.c_str(), idxs.size() / 3, binary_rate, wide_rate, wide_rate / binary_rate);
+	}
+	log("\n");
+});
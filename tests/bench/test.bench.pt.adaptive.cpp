@@ -0,0 +1,90 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+#include <thread>
+
+// Adaptive sampling:
+//  renders a camera looking out at a lat/lon environment map that is smooth in most places and
+//  speckled with very bright texels in a few bands, with every film sample and then adaptively.
+//  Reports samples traced and render time for both, checks that two adaptive renders with the same
+//  seed are bit-identical, and that the adaptive image stays close to the full one.
+
+Test test_bench_pt_adaptive("bench.pt.adaptive", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t width = 640, height = 360, samples = 256;
+	constexpr float relative_error = 0.02f;
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, width, height, samples);
+
+	HDR_Image sky(1024, 512);
+	RNG rng(97531);
+	for (uint32_t y = 0; y < sky.h; ++y) {
+		for (uint32_t x = 0; x < sky.w; ++x) {
+			float t = float(y) / sky.h;
+			bool speckled = (y / 32) % 4 == 1 && rng.coin_flip(0.05f);
+			sky.at(x, y) = speckled ? Spectrum{200.0f} : Spectrum{0.3f + 0.7f * t, 0.5f + 0.5f * t, 1.0f};
+		}
+	}
+	std::weak_ptr< Texture > sky_texture = scene.get< Texture >(scene.create("Sky", Texture{
+		Textures::Image{Textures::Image::Sampler::nearest, std::move(sky)}}));
+	scene.create("Environment", Environment_Light{Environment_Lights::Sphere::make_image(sky_texture)});
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	auto render = [&](float error) {
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		pathtracer.set_adaptive_error(error);
+		HDR_Image result;
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+			result = std::move(report.second);
+		}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return std::make_tuple(std::move(result), pathtracer.sample_counts(), pathtracer.completion_time().render);
+	};
+
+	auto [full, full_samples, full_s] = render(0.0f);
+	auto [adaptive, adaptive_samples, adaptive_s] = render(relative_error);
+	auto [again, again_samples, again_s] = render(relative_error);
+	RNG::fixed_seed = old_seed;
+
+	if (full_samples.traced != full_samples.budget) {
+		throw Test::error("Non-adaptive render traced " + std::to_string(full_samples.traced) + " of " +
+		                  std::to_string(full_samples.budget) + " samples.");
+	}
+	if (adaptive_samples.traced != again_samples.traced || adaptive.data() != again.data()) {
+		throw Test::error("Adaptive renders with the same seed differ.");
+	}
+
+	//adaptive pixels stop within relative_error (one standard error) of their mean, so allow a few of those:
+	double error = 0.0;
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			float a = adaptive.at(x, y).luma(), f = full.at(x, y).luma();
+			error += std::abs(a - f) / std::max(f, 1e-3f);
+		}
+	}
+	error /= double(width) * height;
+	if (error > 4.0 * relative_error) {
+		throw Test::error("Adaptive image is off by " + std::to_string(error) + " (relative) on average.");
+	}
+
+	auto percent = [](PT::Pathtracer::Sample_Counts const &c) { return 100.0 * double(c.traced) / double(c.budget); };
+	log("\n\t%ux%u at %u spp, relative error %.3f (mean relative difference %.4f):", width, height, samples,
+	    relative_error, error);
+	log("\n\t  every sample: %12llu samples (%5.1f%%) in %.3fs", (unsigned long long)full_samples.traced,
+	    percent(full_samples), full_s);
+	log("\n\t  adaptive:     %12llu samples (%5.1f%%) in %.3fs", (unsigned long long)adaptive_samples.traced,
+	    percent(adaptive_samples), adaptive_s);
+	log("\n");
+});
@@ -0,0 +1,108 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <thread>
+
+// Batched-camera integrator:
+//  renders a grid of diffuse and emissive spheres on a diffuse floor, under a sky and a point light, with the
+//  recursive and the batched-camera integrators, and reports the render time of each. Checks that, with a Sobol
+//  sequence, both integrators make the same image bit for bit; and that, with the Stream sequence (where
+//  the two draw numbers in different orders), each pixel's mean over several seeds agrees within noise.
+//  (the integrators share shade(), so this holds however far the A3 tasks are along)
+
+Test test_bench_pt_batched_camera("bench.pt.batched_camera", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t width = 320, height = 180, samples = 64;
+	constexpr uint32_t Seeds = 8, seed_samples = 8;
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, width, height, samples);
+	std::weak_ptr< Camera > camera = camera_instance.lock()->camera;
+	camera.lock()->film.max_ray_depth = 4;
+	Test_Scenes::spheres(scene, 3);
+	Test_Scenes::mesh_instance(scene, "Floor", Test_Scenes::sphere(scene, "Floor Sphere", 3),
+		Test_Scenes::lambertian(scene, "Floor", Test_Scenes::constant(scene, "Floor Albedo", Spectrum{0.8f})),
+		Vec3{0.0f, -104.0f, -8.0f}, 100.0f);
+	Delta_Lights::Point point;
+	point.color = Spectrum{1.0f};
+	point.intensity = 20.0f;
+	std::weak_ptr< Delta_Light > lamp = scene.get< Delta_Light >(scene.create("Lamp", Delta_Light{point}));
+	scene.create("Lamp Instance", Instance::Delta_Light{
+		scene.get< Transform >(scene.create("Lamp Transform", Transform{Vec3{0.0f, 5.0f, -4.0f}, Vec3{}, Vec3{1.0f}})), lamp});
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	auto render = [&](PT::Pathtracer::Integrator integrator, RNG::Sequence sequence) {
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		pathtracer.set_integrator(integrator);
+		pathtracer.set_sequence(sequence);
+		HDR_Image result;
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+			result = std::move(report.second);
+		}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return std::make_pair(std::move(result), pathtracer.completion_time().render);
+	};
+	using Integrator = PT::Pathtracer::Integrator;
+
+	//timing, with the default (Sobol) sequence, where every sample draws the same numbers in both integrators:
+	auto [recursive, recursive_s] = render(Integrator::Recursive, RNG::Sequence::Sobol);
+	auto [batched, batched_s] = render(Integrator::Batched_Camera, RNG::Sequence::Sobol);
+	if (recursive.data() != batched.data()) {
+		RNG::fixed_seed = old_seed;
+		throw Test::error("With a Sobol sequence, the batched-camera image differs from the recursive one.");
+	}
+
+	//with Stream, compare per-pixel means over several seeds against their standard errors:
+	camera.lock()->film.samples = seed_samples;
+	std::vector< double > sum[2], sum2[2];
+	for (uint32_t i = 0; i < 2; ++i) {
+		sum[i].assign(width * height, 0.0);
+		sum2[i].assign(width * height, 0.0);
+		for (uint32_t seed = 0; seed < Seeds; ++seed) {
+			RNG::fixed_seed = 0x5EED + seed;
+			HDR_Image image = render(i ? Integrator::Batched_Camera : Integrator::Recursive, RNG::Sequence::Stream).first;
+			for (uint32_t p = 0; p < width * height; ++p) {
+				double luma = image.at(p).luma();
+				sum[i][p] += luma;
+				sum2[i][p] += luma * luma;
+			}
+		}
+	}
+	RNG::fixed_seed = old_seed;
+
+	uint32_t outliers = 0;
+	double worst = 0.0;
+	for (uint32_t p = 0; p < width * height; ++p) {
+		double mean[2], variance[2];
+		for (uint32_t i = 0; i < 2; ++i) {
+			mean[i] = sum[i][p] / Seeds;
+			variance[i] = std::max(sum2[i][p] / Seeds - mean[i] * mean[i], 0.0) * Seeds / (Seeds - 1);
+		}
+		double standard_error = std::sqrt((variance[0] + variance[1]) / Seeds);
+		double difference = std::abs(mean[0] - mean[1]);
+		//(pixels that are the same in every render, e.g. sky, must match to rounding)
+		if (difference > 4.0 * standard_error + 1e-5 * std::max(1.0, mean[0])) ++outliers;
+		if (standard_error > 0.0) worst = std::max(worst, difference / standard_error);
+	}
+	//(a few pixels land past 4 standard errors by chance, but only a few)
+	if (outliers > width * height / 1000) {
+		throw Test::error(std::to_string(outliers) + " pixel means differ between the batched-camera and recursive integrators by"
+		                  " more than noise.");
+	}
+
+	log("\n\t%ux%u at %u spp:", width, height, samples);
+	log("\n\t  recursive: %.3fs", recursive_s);
+	log("\n\t  batched:   %.3fs (%.2fx)", batched_s, recursive_s / batched_s);
+	log("\n\t%u seeds x %u spp per integrator: %u of %u pixel means past 4 standard errors (worst %.2f)", Seeds,
+	    seed_samples, outliers, width * height, worst);
+	log("\n");
+});
@@ -0,0 +1,117 @@
+#include "test.h"
+
+#include "geometry/halfedge.h"
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/bvh_cache.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+#include <fstream>
+
+// BVH cache:
+//  converts a large mesh to a Tri_Mesh without a BVH cache, then with an empty cache (building and storing
+//  its BVH), then again (loading it). Reports the time of each, and checks that the loaded BVH hits the same
+//  as the built one. Then checks that a damaged entry is rejected (and rebuilt), and that a small cache
+//  evicts its least recently used entries.
+
+Test test_bench_pt_bvh_cache("bench.pt.bvh_cache", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	std::filesystem::path dir = std::filesystem::temp_directory_path() / "s3d-bench-bvh-cache";
+	std::filesystem::remove_all(dir);
+
+	//(split into corners, as the pathtracer converts halfedge meshes)
+	auto sphere = [](float radius, uint32_t subdivisions) {
+		return Indexed_Mesh::from_halfedge_mesh(Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(radius, subdivisions)),
+		                                        Indexed_Mesh::SplitEdges);
+	};
+	Indexed_Mesh mesh = sphere(1.0f, 7);
+
+	RNG rng(4321);
+	std::vector< Ray > rays;
+	for (uint32_t i = 0; i < 100000; ++i) {
+		Vec3 from = 3.0f * Vec3(rng.unit() - 0.5f, rng.unit() - 0.5f, rng.unit() - 0.5f).unit();
+		Vec3 to = Vec3(rng.unit(), rng.unit(), rng.unit()) - Vec3(0.5f);
+		rays.emplace_back(from, to - from);
+	}
+	//do a and b have the same triangles, in the same order, and hit rays the same?
+	auto same = [&](PT::Tri_Mesh const& a, PT::Tri_Mesh const& b) {
+		if (a.n_triangles() != b.n_triangles()) return false;
+		for (size_t t = 0; t < a.n_triangles(); ++t) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (a.triangles()[t].position(i) != b.triangles()[t].position(i)) return false;
+			}
+		}
+		for (auto const& ray : rays) {
+			PT::Trace x = a.hit(ray), y = b.hit(ray);
+			if (x.hit != y.hit || x.distance != y.distance || x.normal != y.normal) return false;
+		}
+		return true;
+	};
+
+	Timer uncached_timer;
+	PT::Tri_Mesh uncached(mesh, true);
+	float uncached_s = uncached_timer.s();
+
+	PT::BVH_Cache cache(dir);
+	PT::BVH_Cache::shared = &cache;
+
+	Timer cold_timer;
+	PT::Tri_Mesh cold(mesh, true);
+	float cold_s = cold_timer.s();
+
+	Timer warm_timer;
+	PT::Tri_Mesh warm(mesh, true);
+	float warm_s = warm_timer.s();
+
+	PT::BVH_Cache::Counts counts = cache.counts();
+	if (counts.stored != 1 || counts.loaded != 1) {
+		PT::BVH_Cache::shared = nullptr;
+		throw Test::error("Expected one BVH stored and then loaded, got " + std::to_string(counts.stored) + " stored and "
+		                  + std::to_string(counts.loaded) + " loaded.");
+	}
+	if (!same(uncached, cold) || !same(uncached, warm)) {
+		PT::BVH_Cache::shared = nullptr;
+		throw Test::error("BVH loaded from the cache differs from the one built.");
+	}
+
+	//damage the entry (past its header, so only its checksum can tell):
+	uint64_t entry_bytes = 0;
+	for (auto const& entry : std::filesystem::directory_iterator(dir)) {
+		entry_bytes = entry.file_size();
+		std::fstream file(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekg(std::streamoff(entry_bytes / 2));
+		char byte = char(file.get());
+		file.seekp(std::streamoff(entry_bytes / 2));
+		file.put(char(byte ^ 0xFF));
+	}
+	PT::Tri_Mesh damaged(mesh, true);
+	counts = cache.counts();
+	bool rejected = counts.rejected == 1 && counts.stored == 2 && same(uncached, damaged);
+
+	//a cache with room for about two of these entries keeps the two used most recently:
+	PT::BVH_Cache small(dir / "small", 5 * entry_bytes / 2);
+	PT::BVH_Cache::shared = &small;
+	for (float radius : {1.0f, 2.0f, 3.0f}) {
+		PT::Tri_Mesh other(sphere(radius, 7), true);
+	}
+	uint64_t small_bytes = 0;
+	for (auto const& entry : std::filesystem::directory_iterator(dir / "small")) small_bytes += entry.file_size();
+	PT::BVH_Cache::Counts small_counts = small.counts();
+	PT::Tri_Mesh newest(sphere(3.0f, 7), true);
+	bool evicted = small_counts.evicted == 1 && small_bytes <= 5 * entry_bytes / 2 && small.counts().loaded == 1;
+
+	PT::BVH_Cache::shared = nullptr;
+	std::filesystem::remove_all(dir);
+
+	if (!rejected) throw Test::error("A damaged BVH cache entry wasn't rejected and rebuilt.");
+	if (!evicted) throw Test::error("The BVH cache didn't evict its least recently used entry.");
+
+	log("\n\t%zu triangles (%.1f MB cache entry):", mesh.indices().size() / 3, 1e-6 * double(entry_bytes));
+	log("\n\t  no cache:         %.3fs", uncached_s);
+	log("\n\t  build and store:  %.3fs", cold_s);
+	log("\n\t  load:             %.3fs", warm_s);
+	log("\n");
+});
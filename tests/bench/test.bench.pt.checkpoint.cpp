@@ -0,0 +1,93 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <filesystem>
+#include <thread>
+
+// Checkpoints:
+//  renders a scene without checkpoints and with frequent checkpoints, and reports the render time of each.
+//  Then interrupts a checkpointed render part of the way through and resumes it with a new pathtracer;
+//  checks that the resumed render only traced the tiles the checkpoint was missing, and that its image is
+//  bit-identical to the uninterrupted one.
+
+Test test_bench_pt_checkpoint("bench.pt.checkpoint", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr float Interval = 0.05f;
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 400, 300, 4);
+	std::weak_ptr< Camera > camera = camera_instance.lock()->camera;
+	Test_Scenes::spheres(scene);
+
+	std::string path = (std::filesystem::temp_directory_path() / "s3d-bench-checkpoint.ptck").string();
+	std::filesystem::remove(path);
+
+	//start a render; 'interrupt' returns early (leaving the render running) once half its tiles are done:
+	auto render = [&](PT::Pathtracer &pathtracer, HDR_Image &result, bool interrupt) {
+		pathtracer.set_report_rate(0.0f);
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+			result = std::move(report.second);
+		}, &quit);
+		while (pathtracer.in_progress() && !(interrupt && pathtracer.progress() >= 0.5f)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (interrupt) {
+			//(give the checkpoint thread time to save what's done so far)
+			std::this_thread::sleep_for(std::chrono::duration< float >(4.0f * Interval));
+			if (!pathtracer.in_progress()) throw Test::error("Render finished before it could be interrupted.");
+		}
+		return pathtracer.completion_time().render;
+	};
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	HDR_Image plain, checkpointed, interrupted, resumed;
+	float plain_s = 0.0f, checkpointed_s = 0.0f, resumed_s = 0.0f;
+	uint64_t budget = 0, resumed_traced = 0;
+	{
+		PT::Pathtracer pathtracer;
+		plain_s = render(pathtracer, plain, false);
+	}
+	{
+		PT::Pathtracer pathtracer;
+		pathtracer.set_checkpoint(path, Interval);
+		checkpointed_s = render(pathtracer, checkpointed, false);
+	}
+	{
+		PT::Pathtracer pathtracer;
+		pathtracer.set_checkpoint(path, Interval);
+		render(pathtracer, interrupted, true);
+		//(destroying the pathtracer cancels the render)
+	}
+	PT::Checkpoint checkpoint = PT::Checkpoint::load(path);
+	uint32_t tiles = uint32_t(checkpoint.tiles_done.size()), done = 0;
+	for (uint8_t d : checkpoint.tiles_done) done += d;
+	{
+		PT::Pathtracer pathtracer;
+		pathtracer.resume_from(path);
+		resumed_s = render(pathtracer, resumed, false);
+		budget = pathtracer.sample_counts().budget;
+		resumed_traced = pathtracer.sample_counts().traced;
+	}
+	RNG::fixed_seed = old_seed;
+	std::filesystem::remove(path);
+
+	if (checkpointed.data() != plain.data()) throw Test::error("Checkpointing changed the image.");
+	if (done == 0 || done == tiles) {
+		throw Test::error("Interrupted render's checkpoint has " + std::to_string(done) + " of " + std::to_string(tiles) + " tiles.");
+	}
+	if (resumed_traced >= budget) throw Test::error("Resumed render traced every sample.");
+	if (resumed.data() != plain.data()) throw Test::error("Resumed image differs from the uninterrupted one.");
+
+	log("\n\t%ux%u at %u spp, %u tiles:", checkpoint.width, checkpoint.height, checkpoint.samples, tiles);
+	log("\n\t  no checkpoints:              %.3fs", plain_s);
+	log("\n\t  checkpoint every %.2fs:      %.3fs", Interval, checkpointed_s);
+	log("\n\t  resumed from %2u / %2u tiles:   %.3fs (%.1f%% of samples)", done, tiles, resumed_s,
+	    100.0 * double(resumed_traced) / double(budget));
+	log("\n");
+});
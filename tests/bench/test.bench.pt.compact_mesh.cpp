@@ -0,0 +1,156 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "geometry/indexed.h"
+#include "pathtracer/pathtracer.h"
+#include "pathtracer/tri_mesh.h"
+#include "scene/animator.h"
+#include "scene/io.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+#include <thread>
+
+// Compact mesh vertices:
+//  for the larger media/js3d meshes (if run from the repository root) and one large synthetic mesh, reports
+//  the memory each Tri_Mesh holds with full and with compact vertices, the largest normal and uv error of the
+//  compact vertices, and closest-hit rays/sec with each. Then renders a textured scene with each, and checks
+//  that the compact render's mean difference from the full one is within a tolerance.
+
+Test test_bench_pt_compact_mesh("bench.pt.compact_mesh", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	using Format = PT::Tri_Mesh::Vertex_Format;
+
+	std::vector< std::pair< std::string, Indexed_Mesh > > meshes;
+	for (std::string file : {"media/js3d/cow.js3d", "media/js3d/bunny.js3d", "media/js3d/A4-human.js3d"}) {
+		Scene scene;
+		Animator animator;
+		try {
+			load(file, &scene, &animator);
+		} catch (std::exception& e) {
+			continue; //(not run from the repository root)
+		}
+		for (auto const& [name, mesh] : scene.meshes) {
+			if (mesh->faces.size() < 100) continue; //(skip the ground planes)
+			meshes.emplace_back(file + ":" + name, Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges));
+		}
+	}
+	//(split into corners, as the pathtracer converts halfedge meshes)
+	meshes.emplace_back("(subdivided sphere)", Indexed_Mesh::from_halfedge_mesh(
+		Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(1.0f, 7)), Indexed_Mesh::SplitEdges));
+
+	constexpr uint32_t Rays = 200000;
+
+	log("\n\t%-36s %10s %12s %12s %9s %9s %9s %9s", "mesh", "triangles", "full MB", "compact MB", "normal", "uv", "full", "compact");
+	log("\n\t%-36s %10s %12s %12s %9s %9s %9s %9s", "", "", "", "", "err (deg)", "error", "Mray/s", "Mray/s");
+	for (auto const& [name, mesh] : meshes) {
+		//(as lists, so both keep triangles in the same order)
+		PT::Tri_Mesh full_list(mesh, false, nullptr, Format::Full);
+		PT::Tri_Mesh compact_list(mesh, false, nullptr, Format::Compact);
+		float normal_error = 0.0f, uv_error = 0.0f;
+		for (size_t t = 0; t < full_list.n_triangles(); ++t) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				PT::Tri_Mesh_Vert a = full_list.vertex(full_list.triangles()[t], i);
+				PT::Tri_Mesh_Vert b = compact_list.vertex(compact_list.triangles()[t], i);
+				if (a.normal.norm_squared() > 0.0f) {
+					Vec3 n = a.normal.unit();
+					normal_error = std::max(normal_error, std::atan2(cross(n, b.normal).norm(), dot(n, b.normal)));
+				}
+				uv_error = std::max(uv_error, std::max(std::abs(a.uv.x - b.uv.x), std::abs(a.uv.y - b.uv.y)));
+			}
+		}
+		if (normal_error > Radians(0.01f)) {
+			throw Test::error("Compact normals of '" + name + "' are off by up to " + std::to_string(Degrees(normal_error)) + " degrees.");
+		}
+
+		PT::Tri_Mesh full(mesh, true, nullptr, Format::Full);
+		PT::Tri_Mesh compact(mesh, true, nullptr, Format::Compact);
+
+		//rays from a sphere around the mesh toward points inside its bounds:
+		BBox box = full.bbox();
+		Vec3 center = box.center();
+		float radius = 2.0f * (box.max - box.min).norm();
+		RNG rng(4321);
+		std::vector< Ray > rays;
+		rays.reserve(Rays);
+		for (uint32_t i = 0; i < Rays; ++i) {
+			Vec3 from = center + radius * Vec3(rng.unit() - 0.5f, rng.unit() - 0.5f, rng.unit() - 0.5f).unit();
+			Vec3 to = box.min + Vec3(rng.unit(), rng.unit(), rng.unit()) * (box.max - box.min);
+			rays.emplace_back(from, to - from);
+		}
+		auto rate = [&](PT::Tri_Mesh const& tri_mesh) {
+			uint32_t hits = 0;
+			Timer timer;
+			for (auto const& ray : rays) hits += tri_mesh.hit(ray).hit;
+			float s = timer.s();
+			if (hits == 0) throw Test::error("No rays hit '" + name + "'.");
+			return Rays / (s * 1e6f);
+		};
+		float full_rate = rate(full), compact_rate = rate(compact);
+
+		log("\n\t%-36s %10zu %12.2f %12.2f %9.4f %9.2g %9.2f %9.2f", name.c_str(), full.n_triangles(),
+		    1e-6 * double(full.memory().total()), 1e-6 * double(compact.memory().total()), Degrees(normal_error), uv_error,
+		    full_rate, compact_rate);
+		log("\n\t%-36s %10s %12s %12s   (vertices: %zu x %zu bytes -> %zu x %zu bytes)", "", "", "", "",
+		    full.memory().n_vertices, sizeof(PT::Tri_Mesh_Vert), compact.memory().n_vertices, sizeof(PT::Tri_Mesh_Compact_Vert));
+	}
+
+	//a checkered, smooth-shaded sphere, rendered with full and with compact vertices:
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 320, 240, 16);
+	std::weak_ptr< Camera > camera = camera_instance.lock()->camera;
+
+	HDR_Image checker(64, 64);
+	for (uint32_t y = 0; y < 64; ++y) {
+		for (uint32_t x = 0; x < 64; ++x) checker.at(x, y) = ((x / 8 + y / 8) % 2) ? Spectrum{0.8f, 0.2f, 0.1f} : Spectrum{0.9f};
+	}
+	std::weak_ptr< Texture > checks = scene.get< Texture >(scene.create("Checks", Texture{Textures::Image{Textures::Image::Sampler::bilinear, checker}}));
+	std::weak_ptr< Material > diffuse = Test_Scenes::lambertian(scene, "Diffuse", checks);
+	Halfedge_Mesh sphere_mesh = Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(1.0f, 5));
+	sphere_mesh.set_corner_normals(180.0f);
+	sphere_mesh.set_corner_uvs_project(Vec3{-1.0f, -1.0f, 0.0f}, Vec3{2.0f, 0.0f, 0.0f}, Vec3{0.0f, 2.0f, 0.0f});
+	std::weak_ptr< Halfedge_Mesh > sphere = scene.get< Halfedge_Mesh >(scene.create("Sphere", std::move(sphere_mesh)));
+	Test_Scenes::mesh_instance(scene, "Sphere", sphere, diffuse, Vec3{0.0f, 0.0f, -3.5f});
+	Test_Scenes::sky(scene, Spectrum{0.4f, 0.6f, 1.0f});
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	auto render = [&](Format format, HDR_Image& result) {
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		pathtracer.set_mesh_format(format);
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+			result = std::move(report.second);
+		}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return pathtracer.mesh_memory(scene).at(0).second;
+	};
+	HDR_Image full_image, compact_image;
+	PT::Tri_Mesh::Memory full_memory = render(Format::Full, full_image);
+	PT::Tri_Mesh::Memory compact_memory = render(Format::Compact, compact_image);
+	RNG::fixed_seed = old_seed;
+
+	//(the same seed gives the same samples, so what differs is only what the vertices' quantization changed)
+	constexpr float Tolerance = 0.005f; //mean difference, relative to mean luminance
+	double difference = 0.0, luma = 0.0;
+	for (uint32_t i = 0; i < full_image.w * full_image.h; ++i) {
+		Spectrum d = full_image.at(i) - compact_image.at(i);
+		difference += std::abs(d.r) + std::abs(d.g) + std::abs(d.b);
+		luma += full_image.at(i).r + full_image.at(i).g + full_image.at(i).b;
+	}
+	float relative = luma > 0.0 ? float(difference / luma) : 0.0f;
+	if (!(relative <= Tolerance)) {
+		throw Test::error("Compact render differs from the full render by " + std::to_string(relative) + " (tolerance " + std::to_string(Tolerance) + ").");
+	}
+
+	log("\n\t%ux%u at %u spp, textured sphere of %zu triangles:", camera.lock()->film.width, camera.lock()->film.height,
+	    camera.lock()->film.samples, full_memory.n_triangles);
+	log("\n\t  full:    %.2f MB", 1e-6 * double(full_memory.total()));
+	log("\n\t  compact: %.2f MB, mean difference %.2g (tolerance %.2g)", 1e-6 * double(compact_memory.total()), relative, Tolerance);
+	log("\n");
+});
@@ -0,0 +1,89 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+#include "util/timer.h"
+
+#include <filesystem>
+#include <thread>
+
+// Distributed rendering:
+//  renders a frame with one pathtracer, then again as four partial renders (each of an interleaved share of
+//  the tiles, as --distribute hands them out) that are saved, loaded, and merged. Reports the time of each,
+//  and checks that the merged frame is bit-identical to the single render.
+
+Test test_bench_pt_distribute("bench.pt.distribute", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t Workers = 4;
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 400, 300, 4);
+	std::weak_ptr< Camera > camera = camera_instance.lock()->camera;
+	Test_Scenes::spheres(scene);
+
+	auto render = [&](PT::Pathtracer &pathtracer, HDR_Image &result) {
+		pathtracer.set_report_rate(0.0f);
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+			result = std::move(report.second);
+		}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	};
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	HDR_Image single;
+	Timer single_timer;
+	{
+		PT::Pathtracer pathtracer;
+		render(pathtracer, single);
+	}
+	float single_s = single_timer.s();
+
+	std::vector< std::string > paths;
+	std::vector< float > worker_s;
+	uint32_t tiles = 0;
+	for (uint32_t w = 0; w < Workers; ++w) {
+		paths.emplace_back((std::filesystem::temp_directory_path() / ("s3d-bench-partial" + std::to_string(w) + ".ptck")).string());
+		PT::Pathtracer pathtracer;
+		tiles = pathtracer.tile_count(*camera.lock());
+		std::vector< uint32_t > share;
+		for (uint32_t t = w; t < tiles; t += Workers) share.emplace_back(t);
+		pathtracer.set_tiles(share);
+		HDR_Image partial_image;
+		Timer timer;
+		render(pathtracer, partial_image);
+		pathtracer.partial().save(paths.back());
+		worker_s.emplace_back(timer.s());
+	}
+	RNG::fixed_seed = old_seed;
+
+	Timer merge_timer;
+	std::vector< PT::Checkpoint > partials;
+	for (auto const &path : paths) partials.emplace_back(PT::Checkpoint::load(path));
+	HDR_Image merged = PT::Pathtracer::merge(partials);
+	float merge_s = merge_timer.s();
+	for (auto const &path : paths) std::filesystem::remove(path);
+
+	if (merged.data() != single.data()) throw Test::error("Merged partial renders differ from a single render.");
+
+	bool overlap = false;
+	try {
+		PT::Pathtracer::merge({partials[0], partials[0]});
+	} catch (std::exception const &) {
+		overlap = true;
+	}
+	if (!overlap) throw Test::error("Merging partial renders that share tiles didn't fail.");
+
+	log("\n\t%ux%u at %u spp, %u tiles:", camera.lock()->film.width, camera.lock()->film.height, camera.lock()->film.samples, tiles);
+	log("\n\t  single render:     %.3fs", single_s);
+	for (uint32_t w = 0; w < Workers; ++w) {
+		log("\n\t  partial %u / %u:     %.3fs", w + 1, Workers, worker_s[w]);
+	}
+	log("\n\t  load and merge:    %.3fs", merge_s);
+	log("\n");
+});
@@ -0,0 +1,148 @@
+#include "test.h"
+
+#include "pathtracer/samplers.h"
+#include "util/rand.h"
+#include "util/thread_pool.h"
+#include "util/timer.h"
+
+#include <algorithm>
+#include <thread>
+
+// Environment map importance sampling:
+//  build time, memory per texel, and samples/sec of Samplers::Sphere::Image on a synthetic 4K x 2K
+//  lat/lon map (a dim sky gradient plus a few small, very bright "suns"), against the marginal/conditional
+//  CDF sampler with a std::upper_bound search per row and column that the image sampler used to expect.
+//  Also checks that sample() and pdf() agree: E[luma(dir) / pdf(dir)] over samples should be the
+//  integral of luminance over the sphere, which the sampler computes while building.
+
+namespace {
+
+//the CDF-inversion sampler, for comparison:
+struct CDF_Sampler {
+	uint32_t w = 0, h = 0;
+	std::vector< float > row_cdf; //h entries
+	std::vector< float > cdf;     //w per row
+
+	CDF_Sampler(const HDR_Image& image) {
+		std::tie(w, h) = image.dimension();
+		row_cdf.resize(h);
+		cdf.resize(size_t(w) * h);
+		double rows = 0.0;
+		for (uint32_t y = 0; y < h; ++y) {
+			float sin_theta = std::sin(PI_F * (y + 0.5f) / h);
+			double sum = 0.0;
+			for (uint32_t x = 0; x < w; ++x) {
+				sum += image.at(x, y).luma() * sin_theta;
+				cdf[size_t(y) * w + x] = float(sum);
+			}
+			for (uint32_t x = 0; x < w; ++x) cdf[size_t(y) * w + x] /= float(sum);
+			rows += sum;
+			row_cdf[y] = float(rows);
+		}
+		for (auto& c : row_cdf) c /= float(rows);
+	}
+
+	Vec3 sample(RNG& rng) const {
+		uint32_t y = uint32_t(std::upper_bound(row_cdf.begin(), row_cdf.end(), rng.unit()) - row_cdf.begin());
+		y = std::min(y, h - 1);
+		auto row = cdf.begin() + size_t(y) * w;
+		uint32_t x = uint32_t(std::upper_bound(row, row + w, rng.unit()) - row);
+		x = std::min(x, w - 1);
+		float phi = 2.0f * PI_F * (x + rng.unit()) / w;
+		float theta = PI_F * (y + rng.unit()) / h;
+		float sin_theta = std::sin(theta);
+		return Vec3{sin_theta * std::cos(phi), -std::cos(theta), sin_theta * std::sin(phi)};
+	}
+};
+
+} // namespace
+
+Test test_bench_pt_env_light("bench.pt.env_light", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t W = 4096, H = 2048;
+	constexpr uint32_t Samples = 2000000;
+
+	HDR_Image image(W, H);
+	for (uint32_t y = 0; y < H; ++y) {
+		for (uint32_t x = 0; x < W; ++x) {
+			float sky = 0.2f + 0.8f * float(y) / H;
+			image.at(x, y) = Spectrum{0.5f * sky, 0.7f * sky, sky};
+		}
+	}
+	RNG rng(8642);
+	for (uint32_t sun = 0; sun < 4; ++sun) {
+		uint32_t cx = rng.integer(0, W - 8), cy = rng.integer(H / 8, H / 2);
+		for (uint32_t y = cy; y < cy + 8; ++y) {
+			for (uint32_t x = cx; x < cx + 8; ++x) image.at(x, y) = Spectrum{5000.0f};
+		}
+	}
+
+	Timer cdf_timer;
+	CDF_Sampler cdf(image);
+	float cdf_ms = cdf_timer.ms();
+
+	Timer serial_timer;
+	Samplers::Sphere::Image serial(image);
+	float serial_ms = serial_timer.ms();
+
+	Thread_Pool pool(std::max(1u, std::thread::hardware_concurrency()));
+	Timer parallel_timer;
+	Samplers::Sphere::Image sampler(image, &pool);
+	float parallel_ms = parallel_timer.ms();
+
+	if (serial._pdf != sampler._pdf || serial.total != sampler.total) {
+		throw Test::error("Serial and parallel builds differ.");
+	}
+
+	//sample() and pdf() agree (and samples land where the luminance is):
+	double sum = 0.0;
+	uint32_t zeros = 0;
+	constexpr uint32_t Checks = 200000;
+	for (uint32_t i = 0; i < Checks; ++i) {
+		Vec3 dir = sampler.sample(rng);
+		float pdf = sampler.pdf(dir);
+		if (!(pdf > 0.0f)) {
+			zeros += 1;
+			continue;
+		}
+		//(same lat/lon mapping as Shapes::Sphere::uv)
+		float u = std::atan2(dir.z, dir.x) / (2.0f * PI_F);
+		if (u < 0.0f) u += 1.0f;
+		float v = std::acos(std::clamp(-dir.y, -1.0f, 1.0f)) / PI_F;
+		float luma = image.at(std::min(uint32_t(u * W), W - 1), std::min(uint32_t(v * H), H - 1)).luma();
+		sum += luma / pdf;
+	}
+	if (zeros > Checks / 10000) {
+		throw Test::error("Sampled " + std::to_string(zeros) + " directions with pdf zero.");
+	}
+	double estimate = sum / Checks;
+	if (std::abs(estimate - sampler.total) > 1e-2 * sampler.total) {
+		throw Test::error("E[luma / pdf] = " + std::to_string(estimate) + " but the map integrates to " +
+		                  std::to_string(sampler.total) + ".");
+	}
+
+	auto rate = [&](auto const& s) {
+		RNG bench_rng(1234);
+		Vec3 acc;
+		Timer t;
+		for (uint32_t i = 0; i < Samples; ++i) acc += s.sample(bench_rng);
+		float seconds = t.s();
+		if (!acc.valid()) throw Test::error("Invalid samples.");
+		return Samples / seconds;
+	};
+	float cdf_rate = rate(cdf);
+	float alias_rate = rate(sampler);
+
+	float cdf_bytes = float(sizeof(float) * (cdf.cdf.size() + cdf.row_cdf.size())) / (W * H);
+	float alias_bytes = float(sizeof(float) * sampler._pdf.size() +
+	                          sizeof(Samplers::Sphere::Image::Alias) * (sampler.texels.size() + sampler.rows.size())) /
+	                    (W * H);
+
+	log("\n\t%ux%u map, E[luma/pdf] %.4f vs. integral %.4f", W, H, estimate, sampler.total);
+	log("\n\t%-26s %12s %14s %14s", "", "build ms", "bytes/texel", "samples/s");
+	log("\n\t%-26s %12.1f %14.2f %14.0f", "CDF + upper_bound", cdf_ms, cdf_bytes, cdf_rate);
+	log("\n\t%-26s %12.1f %14.2f %14.0f", "alias table (serial)", serial_ms, alias_bytes, alias_rate);
+	log("\n\t%-26s %12.1f %14s %14s", "alias table (thread pool)", parallel_ms, "", "");
+	log("\n");
+});
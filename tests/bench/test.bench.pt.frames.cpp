@@ -0,0 +1,140 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+#include "scene/animator.h"
+#include "util/timer.h"
+
+#include <thread>
+
+// Multi-frame rendering:
+//  renders a short simulated animation the way headless --animate used to (a new pathtracer per frame, with the
+//  scene stepped on one thread between frames) and the way it does now (one pathtracer for every frame, with the
+//  scene stepped on the pathtracer's pool, and built for the next frame with prepare(), while each frame renders),
+//  and reports the time per frame of each, and how long render() itself takes to start a frame. A texture is
+//  recolored partway through, while a frame that uses it renders. Checks that both give the same frames, and
+//  that prepared builds reuse the meshes that didn't change.
+
+Test test_bench_pt_frames("bench.pt.frames", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t Frames = 8;
+	constexpr uint32_t Meshes = 6;
+
+	Scene scene;
+	Animator animator;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 96, 64, 8);
+
+	std::weak_ptr< Material > material = Test_Scenes::lambertian(scene, "Material", Test_Scenes::constant(scene, "Albedo", Spectrum{0.5f}));
+	for (uint32_t i = 0; i < Meshes; ++i) {
+		std::string name = std::to_string(i);
+		Test_Scenes::mesh_instance(scene, name, Test_Scenes::sphere(scene, "Mesh " + name, 6), material, Vec3{3.0f * i, 0.0f, -10.0f});
+	}
+	constexpr uint32_t Recolor_Frame = Frames / 2;
+	std::weak_ptr< Texture > glow = Test_Scenes::constant(scene, "Glow", Spectrum{3.0f, 2.0f, 1.0f});
+	Test_Scenes::mesh_instance(scene, "Glow", Test_Scenes::sphere(scene, "Glow Sphere", 2), Test_Scenes::emissive(scene, "Glow Material", glow),
+		Vec3{0.0f, 2.0f, -6.0f});
+	auto recolor = [&](uint32_t frame) {
+		glow.lock()->texture = Textures::Constant{frame >= Recolor_Frame ? Spectrum{1.0f, 2.0f, 3.0f} : Spectrum{3.0f, 2.0f, 1.0f}};
+	};
+	//(particles make every step build the collision world)
+	std::weak_ptr< Halfedge_Mesh > particle = Test_Scenes::sphere(scene, "Particle", 1);
+	std::weak_ptr< Particles > particles = scene.get< Particles >(scene.create("Particles", Particles{}));
+	scene.create("Particles Instance", Instance::Particles{
+		scene.get< Transform >(scene.create("Particles Transform", Transform{})), particle, material, particles});
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	auto reset = [&]() {
+		Scene::StepOpts opts;
+		opts.reset = true;
+		opts.simulate = false;
+		opts.animate = false;
+		scene.step(animator, 0.0f, 0.0f, 0.0f, opts);
+	};
+	auto step = [&](uint32_t frame, Thread_Pool *thread_pool) {
+		Scene::StepOpts opts;
+		opts.thread_pool = thread_pool;
+		scene.step(animator, float(frame), float(frame + 1), 1.0f / animator.frame_rate, opts);
+	};
+	auto wait = [](PT::Pathtracer &pathtracer) {
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	};
+
+	//a pathtracer per frame, stepping after each frame is done:
+	std::vector< HDR_Image > separate(Frames);
+	reset();
+	recolor(0);
+	Timer separate_timer;
+	float separate_start = 0.0f; //(time spent in render() calls)
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		bool quit = false;
+		Timer start_timer;
+		pathtracer.render(scene, camera_instance.lock(), [&, frame](PT::Pathtracer::Render_Report &&report) {
+			separate[frame] = std::move(report.second);
+		}, &quit);
+		separate_start += start_timer.s();
+		wait(pathtracer);
+		if (frame + 1 < Frames) {
+			recolor(frame + 1);
+			step(frame, nullptr);
+		}
+	}
+	float separate_s = separate_timer.s();
+
+	//one pathtracer, stepping and building the next frame while each frame renders:
+	std::vector< HDR_Image > pipelined(Frames);
+	reset();
+	recolor(0);
+	Timer pipelined_timer;
+	float pipelined_start = 0.0f;
+	{
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		bool quit = false;
+		for (uint32_t frame = 0; frame < Frames; ++frame) {
+			Timer start_timer;
+			pathtracer.render(scene, camera_instance.lock(), [&, frame](PT::Pathtracer::Render_Report &&report) {
+				pipelined[frame] = std::move(report.second);
+			}, &quit);
+			pipelined_start += start_timer.s();
+			if (frame > 0) {
+				PT::Pathtracer::Completion_Time t = pathtracer.completion_time();
+				if (t.meshes_rebuilt != 0) {
+					RNG::fixed_seed = old_seed;
+					throw Test::error("Prepared build of frame " + std::to_string(frame) + " rebuilt " + std::to_string(t.meshes_rebuilt) + " unchanged meshes.");
+				}
+			}
+			if (frame + 1 < Frames) {
+				//(changes the texture of a copy the frame still rendering may be using)
+				recolor(frame + 1);
+				step(frame, &pathtracer.get_thread_pool());
+				pathtracer.prepare(scene);
+			}
+			wait(pathtracer);
+		}
+	}
+	float pipelined_s = pipelined_timer.s();
+	RNG::fixed_seed = old_seed;
+
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		if (separate[frame].data() != pipelined[frame].data()) {
+			throw Test::error("Frame " + std::to_string(frame) + " differs when pipelined.");
+		}
+	}
+	if (separate[Recolor_Frame - 1].data() == separate[Recolor_Frame].data()) {
+		throw Test::error("Recoloring the glowing sphere didn't change the frame.");
+	}
+
+	log("\n\t%u frames:", Frames);
+	log("\n\t  pathtracer per frame:  %8.2f ms/frame (%8.2f ms in render())", separate_s / Frames * 1e3f,
+	    separate_start / Frames * 1e3f);
+	log("\n\t  persistent, pipelined: %8.2f ms/frame (%8.2f ms in render()) (%.2fx)", pipelined_s / Frames * 1e3f,
+	    pipelined_start / Frames * 1e3f, separate_s / pipelined_s);
+	log("\n");
+});
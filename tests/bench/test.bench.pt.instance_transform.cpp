@@ -0,0 +1,98 @@
+#include "test.h"
+
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/instance.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// Instance transforms:
+//  traces rays against instances of a sphere mesh: translated and uniformly scaled (as particles are), and
+//  rotated and unevenly scaled. Reports the bytes per instance and closest-hit rays/sec for each kind, and
+//  checks every hit's distance, position, and normal against the same hit transformed with full Mat4s.
+
+Test test_bench_pt_instance_transform("bench.pt.instance_transform", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	using Kind = PT::Instance::Transform_Kind;
+
+	PT::Tri_Mesh mesh(Util::closed_sphere_mesh(1.0f, 2), true);
+
+	constexpr uint32_t Instances = 64, Rays = 200000;
+
+	RNG rng(4321);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()) - Vec3(0.5f); };
+
+	std::vector< Mat4 > particles, general;
+	for (uint32_t i = 0; i < Instances; ++i) {
+		Vec3 at = 20.0f * random();
+		particles.emplace_back(Mat4::translate(at) * Mat4::scale(Vec3{0.5f + rng.unit()}));
+		general.emplace_back(Mat4::translate(at) * Mat4::euler(360.0f * random())
+		                     * Mat4::scale(Vec3{0.5f + rng.unit(), 0.5f + rng.unit(), 0.5f + rng.unit()}));
+	}
+
+	std::vector< Ray > rays;
+	rays.reserve(Rays);
+	for (uint32_t i = 0; i < Rays; ++i) {
+		Vec3 from = 40.0f * random();
+		Vec3 to = 20.0f * random();
+		rays.emplace_back(from, to - from);
+	}
+
+	auto run = [&](std::vector< Mat4 > const& transforms, Kind expected, char const* name) {
+		std::vector< PT::Instance > instances;
+		for (auto const& T : transforms) {
+			instances.emplace_back(&mesh, nullptr, T);
+			if (instances.back().transform_kind() != expected) {
+				throw Test::error(std::string("A ") + name + " instance wasn't classified as expected.");
+			}
+		}
+
+		//closest hit of each ray over all the instances:
+		std::vector< PT::Trace > traces(rays.size());
+		Timer timer;
+		for (size_t r = 0; r < rays.size(); ++r) {
+			PT::Hit hit;
+			Ray ray = rays[r];
+			for (auto const& instance : instances) {
+				if (instance.intersect(ray, hit)) ray.dist_bounds.y = hit.t;
+			}
+			if (hit.instance) traces[r] = PT::Instance::finalize(rays[r], hit);
+		}
+		float s = timer.s();
+
+		//the same hits, transformed as Mat4s:
+		uint32_t hits = 0;
+		for (size_t r = 0; r < rays.size(); ++r) {
+			PT::Trace reference;
+			for (auto const& T : transforms) {
+				Mat4 iT = T.inverse();
+				Ray local = rays[r];
+				local.transform(iT);
+				PT::Trace trace = mesh.hit(local);
+				if (!trace.hit) continue;
+				trace.transform(T, iT.T());
+				reference = PT::Trace::min(reference, trace);
+			}
+			PT::Trace const& trace = traces[r];
+			if (trace.hit != reference.hit) throw Test::error(std::string(name) + " instances hit differently than a Mat4 reference.");
+			if (!trace.hit) continue;
+			++hits;
+			float tolerance = 1e-4f * std::max(1.0f, reference.distance);
+			if (std::abs(trace.distance - reference.distance) > tolerance || (trace.position - reference.position).norm() > tolerance
+			    || (trace.normal - reference.normal).norm() > 1e-3f) {
+				throw Test::error(std::string(name) + " instance hit differs from a Mat4 reference (distance "
+				                  + std::to_string(trace.distance) + " vs " + std::to_string(reference.distance) + ").");
+			}
+		}
+		if (hits == 0) throw Test::error(std::string("No rays hit the ") + name + " instances.");
+
+		log("\n\t  %-18s %6.2f Mray/s (%u of %u rays hit)", name, Rays / (s * 1e6f), hits, Rays);
+	};
+
+	log("\n\t%u instances of a %zu-triangle sphere, %zu bytes per instance:", Instances, mesh.n_triangles(), sizeof(PT::Instance));
+	run(particles, Kind::Translate_Scale, "translate + scale");
+	run(general, Kind::General, "general");
+	log("\n");
+});
@@ -0,0 +1,66 @@
+#include "test.h"
+
+#include "geometry/indexed.h"
+#include "pathtracer/aggregate.h"
+#include "scene/animator.h"
+#include "scene/io.h"
+#include "scene/scene.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// Instanced scene:
+//  closest-hit rays/sec through an instance BVH holding a grid of randomly rotated
+//  and scaled copies of the cow and bunny meshes from media/js3d.
+
+Test test_bench_pt_instancing("bench.pt.instancing", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	std::vector< std::unique_ptr< PT::Tri_Mesh > > meshes;
+	for (std::string file : {"media/js3d/cow.js3d", "media/js3d/bunny.js3d"}) {
+		Scene scene;
+		Animator animator;
+		try {
+			load(file, &scene, &animator);
+		} catch (std::exception& e) {
+			throw Test::ignored("Run from the repository root (couldn't load '" + file + "').");
+		}
+		for (auto const& [name, mesh] : scene.meshes) {
+			if (mesh->faces.size() < 100) continue; //(skip the ground planes)
+			meshes.emplace_back(std::make_unique< PT::Tri_Mesh >(Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges), true));
+		}
+	}
+
+	constexpr int32_t Grid = 16; //Grid x Grid instances
+	RNG rng(91011);
+	std::vector< PT::Instance > instances;
+	for (int32_t y = 0; y < Grid; ++y) {
+		for (int32_t x = 0; x < Grid; ++x) {
+			PT::Tri_Mesh const* mesh = meshes[(x + y) % meshes.size()].get();
+			Vec3 extent = mesh->bbox().max - mesh->bbox().min;
+			float scale = (0.6f + 0.4f * rng.unit()) / std::max(extent.x, std::max(extent.y, extent.z));
+			Mat4 T = Mat4::translate(Vec3(float(x), 0.0f, float(y)))
+			       * Mat4::euler(Vec3(0.0f, 360.0f * rng.unit(), 0.0f))
+			       * Mat4::scale(Vec3(scale))
+			       * Mat4::translate(-mesh->bbox().center());
+			instances.emplace_back(mesh, nullptr, T);
+		}
+	}
+	PT::Aggregate aggregate(PT::BVH< PT::Instance >(std::move(instances)));
+
+	//camera-like rays looking down at the grid:
+	constexpr uint32_t Rays = 500000;
+	std::vector< Ray > rays;
+	rays.reserve(Rays);
+	Vec3 eye(Grid * 0.5f, Grid * 0.6f, -Grid * 0.4f);
+	for (uint32_t i = 0; i < Rays; ++i) {
+		Vec3 target(rng.unit() * Grid, 0.0f, rng.unit() * Grid);
+		rays.emplace_back(eye, target - eye);
+	}
+
+	uint32_t hits = 0;
+	Timer timer;
+	for (auto const& ray : rays) hits += aggregate.hit(ray).hit;
+	float s = timer.s();
+
+	log("\n\t%d instances, %u rays (%.1f%% hit): %.2f Mray/s\n", Grid * Grid, Rays, 100.0f * hits / Rays, Rays / (s * 1e6f));
+});
@@ -0,0 +1,105 @@
+#include "test.h"
+
+#include "geometry/util.h"
+#include "pathtracer/light_tree.h"
+#include "pathtracer/list.h"
+#include "pathtracer/shading_material.h"
+#include "scene/material.h"
+#include "scene/texture.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// Light tree:
+//  clouds of small emissive sphere meshes (like glowing particles) plus one large emissive panel,
+//  sampled and evaluated with the light tree and with the uniform List<Instance> the pathtracer used before.
+//  On a small cloud, also checks both estimate the same solid angle of emitters (E[1/pdf] over sampled directions)
+//  to within a few standard errors.
+
+Test test_bench_pt_light_tree("bench.pt.light_tree", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	auto glow = std::make_shared< Texture >(Textures::Constant{Spectrum{4.0f, 3.0f, 2.0f}});
+	Material emissive_material(Materials::Emissive{glow});
+	PT::Shading_Material emissive = PT::Shading_Material::from(emissive_material);
+	PT::Tri_Mesh panel(Util::closed_sphere_mesh(1.0f, 0), true);
+	Mat4 panel_T = Mat4::translate(Vec3(0.0f, 8.0f, 0.0f)) * Mat4::scale(Vec3(3.0f, 0.1f, 3.0f));
+
+	std::vector< Vec3 > points = {Vec3(0.0f), Vec3(6.0f, 0.0f, 0.0f), Vec3(0.0f, -7.0f, 2.0f), Vec3(2.0f, 2.0f, -2.0f)};
+
+	//sample from each point; returns queries/sec and fills in E[1/pdf] (and its standard error) per point:
+	auto run = [&](auto const& lights, uint32_t samples, std::vector< std::pair< double, double > >& solid_angles) {
+		RNG rng(1357);
+		solid_angles.clear();
+		uint32_t zeros = 0;
+		Timer t;
+		for (auto const& from : points) {
+			double sum = 0.0, sum2 = 0.0;
+			for (uint32_t i = 0; i < samples; ++i) {
+				Vec3 dir = lights.sample(rng, from);
+				float pdf = lights.pdf(Ray(from, dir));
+				if (pdf > 0.0f) {
+					sum += 1.0 / pdf;
+					sum2 += 1.0 / (double(pdf) * pdf);
+				} else {
+					zeros += 1;
+				}
+			}
+			double mean = sum / samples;
+			solid_angles.emplace_back(mean, std::sqrt(std::max(sum2 / samples - mean * mean, 0.0) / samples));
+		}
+		float rate = points.size() * samples / t.s();
+		if (zeros > points.size() * samples / 1000) {
+			throw Test::error("Sampled " + std::to_string(zeros) + " directions with pdf zero.");
+		}
+		return rate;
+	};
+
+	auto bench = [&](uint32_t particles, uint32_t subdivisions, uint32_t list_samples, uint32_t tree_samples, bool check) {
+		PT::Tri_Mesh particle(Util::closed_sphere_mesh(0.05f, subdivisions), true);
+		RNG rng(2468);
+		std::vector< Mat4 > transforms;
+		for (uint32_t i = 0; i < particles; ++i) {
+			transforms.emplace_back(Mat4::translate(Vec3(rng.unit(), rng.unit(), rng.unit()) * 10.0f - Vec3(5.0f)));
+		}
+
+		//what the pathtracer did before: uniform choice of instance, then of triangle:
+		std::vector< PT::Instance > instances;
+		for (auto const& T : transforms) instances.emplace_back(&particle, &emissive, T);
+		instances.emplace_back(&panel, &emissive, panel_T);
+		PT::List< PT::Instance > list(std::move(instances));
+
+		Timer build_timer;
+		PT::Light_Tree< PT::Emissive_Triangle > particle_lights(PT::Emissive_Triangle::from_mesh(particle, emissive));
+		PT::Light_Tree< PT::Emissive_Triangle > panel_lights(PT::Emissive_Triangle::from_mesh(panel, emissive));
+		std::vector< PT::Area_Light > area_lights;
+		for (auto const& T : transforms) area_lights.emplace_back(&particle_lights, T);
+		area_lights.emplace_back(&panel_lights, panel_T);
+		PT::Light_Tree< PT::Area_Light > tree(std::move(area_lights));
+		float build_ms = build_timer.ms();
+
+		std::vector< std::pair< double, double > > list_sr, tree_sr;
+		float list_rate = run(list, list_samples, list_sr);
+		float tree_rate = run(tree, tree_samples, tree_sr);
+
+		log("\n\t%u emitting triangles in %u instances (light tree built in %.2f ms):",
+		    uint32_t(particles * particle.n_triangles() + panel.n_triangles()), particles + 1, build_ms);
+		if (check) {
+			log("\n\t  %-22s %18s %18s", "point", "List sr", "Light_Tree sr");
+			for (size_t i = 0; i < points.size(); ++i) {
+				auto [list_mean, list_err] = list_sr[i];
+				auto [tree_mean, tree_err] = tree_sr[i];
+				log("\n\t  (%5.1f, %5.1f, %5.1f)    %9.4f +- %.4f %9.4f +- %.4f", points[i].x, points[i].y, points[i].z,
+				    list_mean, list_err, tree_mean, tree_err);
+				if (std::abs(list_mean - tree_mean) > 4.0 * std::sqrt(list_err * list_err + tree_err * tree_err)) {
+					throw Test::error("Light tree and List disagree on the solid angle of the emitters.");
+				}
+			}
+		}
+		log("\n\t  List<Instance> sample+pdf: %12.0f /s", list_rate);
+		log("\n\t  Light_Tree     sample+pdf: %12.0f /s (%.0fx)", tree_rate, tree_rate / list_rate);
+	};
+
+	bench(100, 0, 20000, 100000, true);
+	bench(2000, 1, 200, 100000, false);
+	log("\n");
+});
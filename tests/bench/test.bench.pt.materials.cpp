@@ -0,0 +1,91 @@
+#include "test.h"
+
+#include "pathtracer/shading_material.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+#include <thread>
+
+// Shading records:
+//  runs the material calls the pathtracer makes at each hit (sidedness, emission, scatter, pdf, evaluate)
+//  over a mix of materials, through Material (a variant visit per call, and a weak_ptr lock for emission) and
+//  through the flattened PT::Shading_Material, on one thread and on every hardware thread.
+//  Checks that both give the same results.
+
+Test test_bench_pt_materials("bench.pt.materials", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t Hits = 1 << 22;
+
+	auto gray = std::make_shared< Texture >(Textures::Constant{Spectrum{0.5f}});
+	auto glow = std::make_shared< Texture >(Textures::Constant{Spectrum{4.0f, 3.0f, 2.0f}});
+	std::vector< Material > materials;
+	materials.emplace_back(Materials::Lambertian{gray});
+	materials.emplace_back(Materials::Mirror{gray});
+	materials.emplace_back(Materials::Glass{gray, gray, 1.5f});
+	materials.emplace_back(Materials::Emissive{glow});
+	materials.emplace_back(Materials::Refract{gray, 1.33f});
+	std::vector< PT::Shading_Material > records;
+	for (auto const& material : materials) records.emplace_back(PT::Shading_Material::from(material));
+
+	//which material each hit lands on:
+	std::vector< uint8_t > hit_material(Hits);
+	{
+		RNG rng(97);
+		for (auto& m : hit_material) m = uint8_t(rng.integer(0, uint32_t(materials.size())));
+	}
+
+	//shade hits [begin,end) the way Pathtracer::trace() does; returns a checksum:
+	auto shade = [&](auto const& bsdfs, uint32_t begin, uint32_t end) {
+		RNG rng(begin);
+		double sum = 0.0;
+		Vec3 out = Vec3(0.3f, 0.8f, 0.1f).unit();
+		for (uint32_t i = begin; i < end; ++i) {
+			auto const& bsdf = bsdfs[hit_material[i]];
+			Vec2 uv(0.5f, 0.5f);
+			if (!bsdf.is_sided()) uv.x = 0.25f;
+			Spectrum emissive = bsdf.emission(uv);
+			sum += emissive.luma();
+			if (bsdf.is_emissive()) continue;
+			Materials::Scatter scatter = bsdf.scatter(rng, out, uv);
+			sum += scatter.attenuation.luma();
+			if (!bsdf.is_specular()) {
+				sum += bsdf.pdf(out, scatter.direction);
+				sum += bsdf.evaluate(out, scatter.direction, uv).luma();
+			}
+		}
+		return sum;
+	};
+
+	//hits shaded per second with 'threads' threads, each taking an equal share of the hits:
+	auto run = [&](auto const& bsdfs, uint32_t threads, double& checksum) {
+		std::vector< double > sums(threads, 0.0);
+		std::vector< std::thread > workers;
+		Timer t;
+		for (uint32_t i = 0; i < threads; ++i) {
+			workers.emplace_back([&, i]() {
+				sums[i] = shade(bsdfs, uint32_t(uint64_t(Hits) * i / threads), uint32_t(uint64_t(Hits) * (i + 1) / threads));
+			});
+		}
+		for (auto& w : workers) w.join();
+		float seconds = t.s();
+		checksum = 0.0;
+		for (double s : sums) checksum += s;
+		return Hits / seconds;
+	};
+
+	std::vector< uint32_t > thread_counts{1};
+	if (std::thread::hardware_concurrency() > 1) thread_counts.emplace_back(std::thread::hardware_concurrency());
+	log("\n\t%-18s %16s %16s", "hits/s", "Material", "Shading_Material");
+	for (uint32_t n : thread_counts) {
+		double material_sum = 0.0, record_sum = 0.0;
+		float material_rate = run(materials, n, material_sum);
+		float record_rate = run(records, n, record_sum);
+		if (material_sum != record_sum) {
+			throw Test::error("Shading records gave a different result (" + std::to_string(record_sum) + ") than materials (" +
+			                  std::to_string(material_sum) + ").");
+		}
+		log("\n\t%2u thread(s)        %16.0f %16.0f   (%.2fx)", n, material_rate, record_rate, record_rate / material_rate);
+	}
+	log("\n");
+});
@@ -0,0 +1,118 @@
+#include "test.h"
+
+#include "pathtracer/ray_log.h"
+#include "util/timer.h"
+
+#include <mutex>
+#include <thread>
+
+// Ray logging:
+//  has several threads log rays as fast as they can, the way Pathtracer::log_ray used to (one mutex-guarded
+//  vector) and the way it does now (a fixed-capacity buffer per thread), while another thread keeps copying
+//  the log. Reports the time of each. Checks that copies never see a half-written ray, that memory stays
+//  bounded, and that each policy keeps the rays it should.
+
+Test test_bench_pt_ray_log("bench.pt.ray_log", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t Threads = 4;
+	constexpr uint32_t Rays = 1000000; //per thread
+	constexpr uint32_t Capacity = 16384; //per thread
+
+	//ray i of a thread is recognizable (and checkably whole) from any of its fields:
+	auto entry = [](uint32_t thread, uint32_t i) {
+		float v = float(i);
+		return PT::Ray_Log{Ray(Vec3{v, float(thread), v}, Vec3{0.0f, 0.0f, 1.0f}), v, Spectrum{v, v, v}};
+	};
+	auto whole = [](PT::Ray_Log const &l) {
+		float v = l.t;
+		return l.ray.point.x == v && l.ray.point.z == v && l.color.r == v && l.color.g == v && l.color.b == v;
+	};
+
+	//run 'log' on every thread, while copying with 'copy' until they finish; returns seconds:
+	uint64_t copies = 0;
+	auto run = [&](auto &&log, auto &&copy) {
+		std::atomic< bool > done = false;
+		copies = 0;
+		std::thread reader([&]() {
+			while (!done) {
+				copy();
+				++copies;
+			}
+		});
+		Timer timer;
+		std::vector< std::thread > threads;
+		for (uint32_t t = 0; t < Threads; ++t) {
+			threads.emplace_back([&, t]() {
+				for (uint32_t i = 0; i < Rays; ++i) log(t, i);
+			});
+		}
+		for (auto &thread : threads) thread.join();
+		float s = timer.s();
+		done = true;
+		reader.join();
+		return s;
+	};
+
+	//the old way: one vector, behind one mutex:
+	std::mutex mut;
+	std::vector< PT::Ray_Log > shared;
+	float shared_s = run([&](uint32_t t, uint32_t i) {
+		std::lock_guard< std::mutex > lock(mut);
+		shared.push_back(entry(t, i));
+	}, [&]() {
+		std::lock_guard< std::mutex > lock(mut);
+		std::vector< PT::Ray_Log > copy = shared;
+	});
+	uint64_t shared_copies = copies;
+	size_t shared_size = shared.size();
+	shared = std::vector< PT::Ray_Log >();
+
+	//per-thread buffers:
+	auto buffered = [&](PT::Ray_Log_Policy policy, std::vector< PT::Ray_Log > &result) {
+		std::vector< std::unique_ptr< PT::Ray_Log_Buffer > > buffers;
+		for (uint32_t t = 0; t < Threads; ++t) buffers.emplace_back(std::make_unique< PT::Ray_Log_Buffer >(Capacity, policy, t));
+		bool torn = false;
+		float s = run([&](uint32_t t, uint32_t i) {
+			buffers[t]->add(entry(t, i));
+		}, [&]() {
+			std::vector< PT::Ray_Log > copy;
+			for (auto const &buffer : buffers) buffer->copy_to(copy);
+			for (auto const &l : copy) torn = torn || !whole(l);
+		});
+		if (torn) throw Test::error("A copy of the ray log held a half-written ray.");
+		result.clear();
+		for (auto const &buffer : buffers) buffer->copy_to(result);
+		return s;
+	};
+
+	std::vector< PT::Ray_Log > reservoir, latest;
+	float reservoir_s = buffered(PT::Ray_Log_Policy::Reservoir, reservoir);
+	uint64_t reservoir_copies = copies;
+	float latest_s = buffered(PT::Ray_Log_Policy::Latest, latest);
+	uint64_t latest_copies = copies;
+
+	if (reservoir.size() != Threads * Capacity || latest.size() != Threads * Capacity) {
+		throw Test::error("Full buffers hold " + std::to_string(reservoir.size()) + " / " + std::to_string(latest.size())
+		                  + " rays, expected " + std::to_string(Threads * Capacity) + ".");
+	}
+	//a uniform sample of [0, Rays) has mean ~Rays/2:
+	double mean = 0.0;
+	for (auto const &l : reservoir) mean += l.t;
+	mean /= double(reservoir.size());
+	if (std::abs(mean / Rays - 0.5) > 0.02) {
+		throw Test::error("Reservoir sample mean is " + std::to_string(mean / Rays) + " of the rays logged, expected ~0.5.");
+	}
+	for (auto const &l : latest) {
+		if (l.t < float(Rays - Capacity)) throw Test::error("Ring buffer kept ray " + std::to_string(l.t) + ", which isn't one of the latest.");
+	}
+
+	log("\n\t%u threads logging %u rays each, while another thread copies the log:", Threads, Rays);
+	log("\n\t  mutex + vector:       %.3fs (%llu copies, %.1f MB held)", shared_s, (unsigned long long)shared_copies,
+	    shared_size * sizeof(PT::Ray_Log) / 1e6);
+	log("\n\t  per-thread reservoir: %.3fs (%llu copies, %.1f MB held)", reservoir_s, (unsigned long long)reservoir_copies,
+	    reservoir.size() * sizeof(PT::Ray_Log) / 1e6);
+	log("\n\t  per-thread ring:      %.3fs (%llu copies, %.1f MB held)", latest_s, (unsigned long long)latest_copies,
+	    latest.size() * sizeof(PT::Ray_Log) / 1e6);
+	log("\n");
+});
@@ -0,0 +1,96 @@
+#include "test.h"
+
+#include "lib/mathlib.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// Sample sequences:
+//  per-draw cost of RNG::unit() from the Mersenne Twister stream and from the counter-based sequences,
+//  and RMS error when each pixel of a 64x64 "film" estimates the integral of a smooth 2D function and of a
+//  discontinuous one from dimensions (2,3) of its samples (i.e., after a camera-like first pair).
+//  Also checks that every pair of Sobol dimensions is stratified: 16 samples land one per cell of a 4x4 grid.
+
+Test test_bench_pt_samplers("bench.pt.samplers", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	using Sequence = RNG::Sequence;
+	constexpr uint32_t Pixels = 64 * 64;
+	constexpr uint32_t Seed = 0x1234;
+
+	//stratification of the scrambled (0,2)-sequence:
+	{
+		RNG rng(1);
+		for (uint32_t pixel = 0; pixel < 256; ++pixel) {
+			for (uint32_t pair = 0; pair < 8; ++pair) {
+				uint32_t cells = 0;
+				for (uint32_t s = 0; s < 16; ++s) {
+					rng.start_sample(Sequence::Sobol, Seed, pixel, s);
+					for (uint32_t d = 0; d < 2 * pair; ++d) rng.unit();
+					float x = rng.unit(), y = rng.unit();
+					cells |= 1u << (uint32_t(x * 4.0f) * 4 + uint32_t(y * 4.0f));
+				}
+				if (cells != 0xffffu) {
+					throw Test::error("Sobol dimensions (" + std::to_string(2 * pair) + "," +
+					                  std::to_string(2 * pair + 1) + ") of pixel " + std::to_string(pixel) +
+					                  " are not stratified.");
+				}
+			}
+		}
+	}
+
+	//per-draw cost (a sample's worth of draws -- 16 dimensions -- at a time, as in a short path):
+	auto draws_per_second = [&](Sequence sequence) {
+		constexpr uint32_t Samples = 1 << 22;
+		RNG rng(Seed);
+		float acc = 0.0f;
+		Timer t;
+		for (uint32_t i = 0; i < Samples; ++i) {
+			if (sequence != Sequence::Stream) rng.start_sample(sequence, Seed, i % Pixels, i / Pixels);
+			for (uint32_t d = 0; d < 16; ++d) acc += rng.unit();
+		}
+		float seconds = t.s();
+		if (!(acc > 0.0f)) throw Test::error("Draws summed to zero.");
+		return Samples * 16.0f / seconds;
+	};
+
+	//RMS (over pixels) error of the per-pixel estimates of f's integral over [0,1)^2:
+	auto rms_error = [&](Sequence sequence, uint32_t spp, auto&& f, double reference) {
+		RNG rng(Seed);
+		double sum2 = 0.0;
+		for (uint32_t pixel = 0; pixel < Pixels; ++pixel) {
+			double estimate = 0.0;
+			for (uint32_t s = 0; s < spp; ++s) {
+				if (sequence != Sequence::Stream) rng.start_sample(sequence, Seed, pixel, s);
+				rng.unit();
+				rng.unit();
+				float x = rng.unit(), y = rng.unit();
+				estimate += f(x, y);
+			}
+			estimate /= spp;
+			sum2 += (estimate - reference) * (estimate - reference);
+		}
+		return std::sqrt(sum2 / Pixels);
+	};
+	auto smooth = [](float x, float y) { return double(std::sin(PI_F * x) * std::sin(PI_F * y)); };
+	const double smooth_reference = 4.0 / (PI_D * PI_D);
+	auto disc = [](float x, float y) { return (x - 0.5f) * (x - 0.5f) + (y - 0.5f) * (y - 0.5f) < 0.16f ? 1.0 : 0.0; };
+	const double disc_reference = PI_D * 0.16;
+
+	log("\n\t%-12s %14s %12s %12s %12s %12s", "sequence", "draws/s", "smooth 16", "smooth 64", "disc 16", "disc 64");
+	double stream_disc = 0.0, sobol_disc = 0.0;
+	for (Sequence sequence : {Sequence::Stream, Sequence::Independent, Sequence::Sobol}) {
+		float rate = draws_per_second(sequence);
+		double s16 = rms_error(sequence, 16, smooth, smooth_reference);
+		double s64 = rms_error(sequence, 64, smooth, smooth_reference);
+		double d16 = rms_error(sequence, 16, disc, disc_reference);
+		double d64 = rms_error(sequence, 64, disc, disc_reference);
+		log("\n\t%-12s %14.0f %12.5f %12.5f %12.5f %12.5f", RNG::sequence_name(sequence), rate, s16, s64, d16, d64);
+		if (sequence == Sequence::Stream) stream_disc = d64;
+		if (sequence == Sequence::Sobol) sobol_disc = d64;
+	}
+	log("\n");
+
+	if (!(sobol_disc < stream_disc)) {
+		throw Test::error("Sobol samples are no better than independent ones on the disc.");
+	}
+});
@@ -0,0 +1,77 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <thread>
+
+// Incremental scene builds:
+//  renders a scene of several large meshes with one pathtracer four times -- from scratch, unchanged,
+//  after hiding one instance, and after recoloring one material's texture -- and reports the build time of
+//  each along with what was reused. Checks that unchanged meshes are never rebuilt and that the instance
+//  BVH is only rebuilt when the set of instances changes.
+
+Test test_bench_pt_scene_build("bench.pt.scene_build", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t Meshes = 8;
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 16, 16, 1);
+
+	std::weak_ptr< Texture > albedo = Test_Scenes::constant(scene, "Albedo", Spectrum{0.5f});
+	std::weak_ptr< Material > material = Test_Scenes::lambertian(scene, "Material", albedo);
+
+	std::vector< std::weak_ptr< Instance::Mesh > > instances;
+	for (uint32_t i = 0; i < Meshes; ++i) {
+		std::string name = std::to_string(i);
+		instances.emplace_back(Test_Scenes::mesh_instance(scene, name, Test_Scenes::sphere(scene, "Mesh " + name, 6), material,
+			Vec3{3.0f * i, 0.0f, -10.0f}));
+	}
+
+	PT::Pathtracer pathtracer;
+	pathtracer.set_report_rate(0.0f);
+	auto render = [&]() {
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [](PT::Pathtracer::Render_Report &&) {}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return pathtracer.completion_time();
+	};
+
+	log("\n\t%-10s %10s %16s %16s %16s %12s", "build", "seconds", "meshes", "textures", "materials", "scene BVH");
+	auto report = [&](const char *what, PT::Pathtracer::Completion_Time const &t) {
+		auto counts = [](uint32_t reused, uint32_t rebuilt) {
+			return std::to_string(reused) + " / " + std::to_string(rebuilt);
+		};
+		log("\n\t%-10s %10.4f %16s %16s %16s %12s", what, t.build, counts(t.meshes_reused, t.meshes_rebuilt).c_str(),
+		    counts(t.textures_reused, t.textures_rebuilt).c_str(), counts(t.materials_reused, t.materials_rebuilt).c_str(),
+		    t.scene_bvh_reused ? "reused" : "rebuilt");
+	};
+
+	PT::Pathtracer::Completion_Time first = render();
+	report("first", first);
+	if (first.meshes_rebuilt != Meshes) throw Test::error("First build did not build every mesh.");
+
+	PT::Pathtracer::Completion_Time same = render();
+	report("unchanged", same);
+	if (same.meshes_rebuilt != 0 || same.materials_rebuilt != 0 || !same.scene_bvh_reused) {
+		throw Test::error("Unchanged scene was (partly) rebuilt.");
+	}
+
+	instances[0].lock()->settings.visible = false;
+	PT::Pathtracer::Completion_Time hidden = render();
+	report("hidden", hidden);
+	if (hidden.meshes_rebuilt != 0 || hidden.scene_bvh_reused) {
+		throw Test::error("Hiding an instance should rebuild only the scene BVH.");
+	}
+
+	albedo.lock()->texture = Textures::Constant{Spectrum{0.25f, 0.5f, 0.75f}};
+	PT::Pathtracer::Completion_Time recolored = render();
+	report("recolored", recolored);
+	if (recolored.textures_rebuilt != 1 || recolored.materials_rebuilt != 1 || recolored.meshes_rebuilt != 0) {
+		throw Test::error("Recoloring a texture should rebuild just it and its material.");
+	}
+	log("\n");
+});
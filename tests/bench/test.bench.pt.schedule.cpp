@@ -0,0 +1,63 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <thread>
+
+// Tile scheduling:
+//  renders a scene whose cost is concentrated in one corner (a finely tessellated sphere), and reports the
+//  render time, how many tiles (and tile pieces) were traced, the slowest tile against the average, and how
+//  busy the render threads were. Renders it again, and checks that the scheduler (which splits and orders
+//  tiles by the costs it measures, and so by timing) gave the same image both times.
+
+Test test_bench_pt_schedule("bench.pt.schedule", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 320, 240, 16);
+	std::weak_ptr< Camera > camera = camera_instance.lock()->camera;
+
+	std::weak_ptr< Material > diffuse = Test_Scenes::lambertian(scene, "Diffuse", Test_Scenes::constant(scene, "Gray", Spectrum{0.6f}));
+	Test_Scenes::mesh_instance(scene, "Fine", Test_Scenes::sphere(scene, "Fine Sphere", 6), diffuse, Vec3{2.2f, 1.6f, -5.0f}, 0.8f);
+	Test_Scenes::mesh_instance(scene, "Coarse", Test_Scenes::sphere(scene, "Coarse Sphere", 1), diffuse, Vec3{-1.0f, -0.5f, -8.0f});
+	Test_Scenes::sky(scene, Spectrum{0.4f, 0.6f, 1.0f});
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	uint32_t threads = 0, tiles = 0;
+	auto render = [&](HDR_Image &result) {
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		//(the default Sobol sequence: tiles are only split with a counter-based sequence, as Stream draws follow on from each other)
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+			result = std::move(report.second);
+		}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		threads = pathtracer.get_thread_pool().size();
+		tiles = pathtracer.tile_count(*camera.lock());
+		return pathtracer.stats();
+	};
+
+	HDR_Image first, second;
+	PT::Pathtracer::Stats a = render(first);
+	PT::Pathtracer::Stats b = render(second);
+	RNG::fixed_seed = old_seed;
+
+	if (first.data() != second.data()) throw Test::error("Renders with the same seed differ.");
+
+	log("\n\t%ux%u at %u spp, %u tiles, %u threads:", camera.lock()->film.width, camera.lock()->film.height,
+	    camera.lock()->film.samples, tiles, threads);
+	if (!PT::RECORD_STATS) log("\n\t  (tile times are only counted with PT::RECORD_STATS)");
+	for (auto const *stats : {&a, &b}) {
+		if (stats->tiles == 0 || stats->render <= 0.0f) continue;
+		log("\n\t  %.3fs, %u tiles and pieces traced, slowest %.1fms (mean %.1fms), threads %.0f%% busy", stats->render,
+		    stats->tiles, 1e3f * stats->slowest_tile, 1e3f * stats->tile_seconds / stats->tiles,
+		    100.0f * stats->tile_seconds / (stats->render * threads));
+	}
+	log("\n");
+});
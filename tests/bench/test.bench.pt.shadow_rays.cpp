@@ -0,0 +1,77 @@
+#include "test.h"
+
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/aggregate.h"
+#include "scene/animator.h"
+#include "scene/io.h"
+#include "scene/scene.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// Shadow rays:
+//  times shadow rays (segments between random points in the scene's bounds) through an
+//  instance BVH of media/js3d/cow.js3d (plus a few spheres), answered by hit() as
+//  sum_delta_lights used to and by occluded(); checks that the answers agree.
+
+Test test_bench_pt_shadow_rays("bench.pt.shadow_rays", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	Scene scene;
+	Animator animator;
+	try {
+		load("media/js3d/cow.js3d", &scene, &animator);
+	} catch (std::exception& e) {
+		throw Test::ignored("Run from the repository root (couldn't load media/js3d/cow.js3d).");
+	}
+
+	std::vector< std::unique_ptr< PT::Tri_Mesh > > meshes;
+	std::vector< PT::Instance > instances;
+	for (auto const& [name, mesh_inst] : scene.instances.meshes) {
+		if (mesh_inst->mesh.expired()) continue;
+		auto mesh = mesh_inst->mesh.lock();
+		meshes.emplace_back(std::make_unique< PT::Tri_Mesh >(Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges), true));
+		Mat4 T = mesh_inst->transform.expired() ? Mat4::I : mesh_inst->transform.lock()->local_to_world();
+		instances.emplace_back(meshes.back().get(), nullptr, T);
+	}
+	Shape sphere(Shapes::Sphere{0.25f});
+	for (int32_t i = -2; i <= 2; ++i) {
+		instances.emplace_back(&sphere, nullptr, Mat4::translate(Vec3(float(i), 0.5f, 0.0f)));
+	}
+	PT::Aggregate aggregate(PT::BVH< PT::Instance >(std::move(instances)));
+
+	constexpr uint32_t Rays = 500000;
+	BBox box = aggregate.bbox();
+	RNG rng(5678);
+	std::vector< Ray > rays;
+	rays.reserve(Rays);
+	for (uint32_t i = 0; i < Rays; ++i) {
+		Vec3 from = box.min + Vec3(rng.unit(), rng.unit(), rng.unit()) * (box.max - box.min);
+		Vec3 to = box.min + Vec3(rng.unit(), rng.unit(), rng.unit()) * (box.max - box.min);
+		rays.emplace_back(from, to - from, Vec2{EPS_F, (to - from).norm() - EPS_F});
+	}
+
+	std::vector< bool > by_hit, by_occluded;
+	by_hit.reserve(Rays);
+	by_occluded.reserve(Rays);
+
+	Timer hit_timer;
+	for (auto const& ray : rays) by_hit.push_back(aggregate.hit(ray).hit);
+	float hit_s = hit_timer.s();
+
+	Timer occluded_timer;
+	for (auto const& ray : rays) by_occluded.push_back(aggregate.occluded(ray));
+	float occluded_s = occluded_timer.s();
+
+	uint32_t blocked = 0;
+	for (uint32_t i = 0; i < Rays; ++i) {
+		if (by_hit[i] != by_occluded[i]) {
+			throw Test::error("hit() and occluded() disagree on shadow ray " + std::to_string(i) + ".");
+		}
+		blocked += by_hit[i];
+	}
+
+	log("\n\t%u shadow rays (%.1f%% blocked):", Rays, 100.0f * blocked / Rays);
+	log("\n\t  hit():      %8.2f Mray/s", Rays / (hit_s * 1e6f));
+	log("\n\t  occluded(): %8.2f Mray/s (%.2fx)\n", Rays / (occluded_s * 1e6f), hit_s / occluded_s);
+});
@@ -0,0 +1,67 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <thread>
+
+// Render statistics:
+//  renders a scene with each integrator and reports what the render statistics counted: rays per second,
+//  BVH nodes and primitives per ray, and time per tile. Checks that every camera ray and tile was counted
+//  (tiles the scheduler split count once per piece), and that the per-pixel costs add up to the traversal
+//  steps counted.
+
+Test test_bench_pt_stats("bench.pt.stats", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+	if (!PT::RECORD_STATS) throw Test::ignored("Render statistics are compiled out (set PT::RECORD_STATS in pathtracer/stats.h).");
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 400, 300, 4);
+	std::weak_ptr< Camera > camera = camera_instance.lock()->camera;
+	Test_Scenes::spheres(scene);
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+
+	auto render = [&](PT::Pathtracer::Integrator integrator, char const *name) {
+		PT::Pathtracer pathtracer;
+		pathtracer.set_report_rate(0.0f);
+		pathtracer.set_integrator(integrator);
+		bool quit = false;
+		pathtracer.render(scene, camera_instance.lock(), [](PT::Pathtracer::Render_Report &&) {}, &quit);
+		while (pathtracer.in_progress()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		PT::Pathtracer::Stats stats = pathtracer.stats();
+		uint32_t tiles = pathtracer.tile_count(*camera.lock());
+
+		auto const &film = camera.lock()->film;
+		uint64_t camera_rays = uint64_t(film.width) * film.height * film.samples;
+		if (stats.counts.camera_rays != camera_rays) {
+			throw Test::error(std::string(name) + " counted " + std::to_string(stats.counts.camera_rays) + " camera rays, expected " + std::to_string(camera_rays) + ".");
+		}
+		if (stats.tiles < tiles) {
+			throw Test::error(std::string(name) + " counted " + std::to_string(stats.tiles) + " tiles, expected at least " + std::to_string(tiles) + ".");
+		}
+		uint64_t cost = 0;
+		for (uint64_t c : stats.pixel_cost) cost += c;
+		if (stats.pixel_cost.size() != size_t(film.width) * film.height || cost != stats.counts.traversal_steps()) {
+			throw Test::error(std::string(name) + " pixel costs don't add up to the traversal steps counted.");
+		}
+
+		uint64_t rays = stats.counts.rays();
+		log("\n\t  %-10s %.3fs, %6.2fM rays/s (%llu camera, %llu shadow, %llu bounce)", name, stats.render,
+		    1e-6 * double(rays) / stats.render, (unsigned long long)stats.counts.camera_rays,
+		    (unsigned long long)stats.counts.shadow_rays, (unsigned long long)stats.counts.bounce_rays);
+		log("\n\t  %-10s %5.1f nodes, %5.1f primitives per ray; %u tiles, %.1fms per tile (slowest %.1fms)", "",
+		    double(stats.counts.nodes_visited) / double(rays), double(stats.counts.primitives_tested) / double(rays),
+		    stats.tiles, 1e3f * stats.tile_seconds / stats.tiles, 1e3f * stats.slowest_tile);
+	};
+
+	log("\n\t%ux%u at %u spp:", camera.lock()->film.width, camera.lock()->film.height, camera.lock()->film.samples);
+	render(PT::Pathtracer::Integrator::Recursive, "recursive");
+	render(PT::Pathtracer::Integrator::Batched_Camera, "batched");
+	log("\n");
+
+	RNG::fixed_seed = old_seed;
+});
@@ -0,0 +1,63 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+#include "util/timer.h"
+
+#include <thread>
+
+// Tile sample buffers:
+//  compares the per-frame sample buffer traffic of full-film buffers (one per tile, as do_trace used to allocate)
+//  with tile-sized buffers, then times a full 4K frame of an empty scene, where per-tile overhead dominates.
+
+Test test_bench_pt_tile_buffers("bench.pt.tile_buffers", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t width = 3840, height = 2160;
+	constexpr uint32_t tile_width = 100, tile_height = 100;
+
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, width, height, 1);
+
+	//buffer traffic per frame (allocation + zero fill + accumulate walk) for both layouts:
+	uint32_t tiles = 0;
+	size_t full_bytes = 0, tile_bytes = 0;
+	float full_ms = 0.0f, tile_ms = 0.0f;
+	for (uint32_t y = 0; y < height; y += tile_height) {
+		for (uint32_t x = 0; x < width; x += tile_width) {
+			uint32_t w = std::min(tile_width, width - x);
+			uint32_t h = std::min(tile_height, height - y);
+			tiles += 1;
+			{
+				Timer t;
+				HDR_Image full(width, height);
+				full.at(x, y) += Spectrum(1.0f);
+				full_ms += t.ms();
+				full_bytes += full.data().size() * sizeof(Spectrum);
+			}
+			{
+				Timer t;
+				HDR_Image tile(w, h);
+				tile.at(0, 0) += Spectrum(1.0f);
+				tile_ms += t.ms();
+				tile_bytes += tile.data().size() * sizeof(Spectrum);
+			}
+		}
+	}
+
+	auto mb = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+	log("\n\t%u tiles of %ux%u on a %ux%u film:", tiles, tile_width, tile_height, width, height);
+	log("\n\t  full-film buffers: %10.1f MB allocated, %8.2f ms", mb(full_bytes), full_ms);
+	log("\n\t  tile buffers:      %10.1f MB allocated, %8.2f ms", mb(tile_bytes), tile_ms);
+
+	//whole frame through the path tracer (which now uses tile buffers):
+	PT::Pathtracer pathtracer;
+	bool quit = false;
+	pathtracer.render(scene, camera_instance.lock(), [](PT::Pathtracer::Render_Report &&) {}, &quit);
+	while (pathtracer.in_progress()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	auto time = pathtracer.completion_time();
+	log("\n\t  frame: built in %.3fs, rendered in %.3fs (%u threads)\n\t",
+	    time.build, time.render, std::thread::hardware_concurrency());
+});
@@ -0,0 +1,70 @@
+#include "test.h"
+
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/tri_mesh.h"
+#include "scene/animator.h"
+#include "scene/io.h"
+#include "scene/scene.h"
+#include "util/rand.h"
+#include "util/timer.h"
+
+// Tri_Mesh storage:
+//  memory per triangle (the BVH's triangle array plus the shared vertex array) and
+//  closest-hit rays/sec through Tri_Mesh::hit on the larger media/js3d meshes and one large synthetic mesh.
+
+Test test_bench_pt_tri_mesh("bench.pt.tri_mesh", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	std::vector< std::pair< std::string, Indexed_Mesh > > meshes;
+	for (std::string file : {"media/js3d/cow.js3d", "media/js3d/bunny.js3d", "media/js3d/A4-human.js3d"}) {
+		Scene scene;
+		Animator animator;
+		try {
+			load(file, &scene, &animator);
+		} catch (std::exception& e) {
+			throw Test::ignored("Run from the repository root (couldn't load '" + file + "').");
+		}
+		for (auto const& [name, mesh] : scene.meshes) {
+			if (mesh->faces.size() < 100) continue; //(skip the ground planes)
+			meshes.emplace_back(file + ":" + name, Indexed_Mesh::from_halfedge_mesh(*mesh, Indexed_Mesh::SplitEdges));
+		}
+		for (auto const& [name, mesh] : scene.skinned_meshes) {
+			meshes.emplace_back(file + ":" + name, mesh->posed_mesh());
+		}
+	}
+	meshes.emplace_back("(subdivided sphere)", Util::closed_sphere_mesh(1.0f, 7));
+
+	constexpr uint32_t Rays = 500000;
+
+	log("\n\t%-40s %10s %14s %14s %10s", "mesh", "triangles", "tri bytes/tri", "all bytes/tri", "Mray/s");
+	for (auto const& [name, mesh] : meshes) {
+		PT::Tri_Mesh tri_mesh(mesh, true);
+		size_t tris = tri_mesh.n_triangles();
+		size_t tri_bytes = sizeof(PT::Triangle) * tris;
+		size_t vert_bytes = sizeof(PT::Tri_Mesh_Vert) * mesh.vertices().size();
+
+		//rays from a sphere around the mesh toward points inside its bounds:
+		BBox box = tri_mesh.bbox();
+		Vec3 center = box.center();
+		float radius = 2.0f * (box.max - box.min).norm();
+		RNG rng(4321);
+		std::vector< Ray > rays;
+		rays.reserve(Rays);
+		for (uint32_t i = 0; i < Rays; ++i) {
+			Vec3 from = center + radius * Vec3(rng.unit() - 0.5f, rng.unit() - 0.5f, rng.unit() - 0.5f).unit();
+			Vec3 to = box.min + Vec3(rng.unit(), rng.unit(), rng.unit()) * (box.max - box.min);
+			rays.emplace_back(from, to - from);
+		}
+
+		uint32_t hits = 0;
+		Timer timer;
+		for (auto const& ray : rays) hits += tri_mesh.hit(ray).hit;
+		float s = timer.s();
+		if (hits == 0) throw Test::error("No rays hit '" + name + "'.");
+
+		log("\n\t%-40s %10zu %14.1f %14.1f %10.2f", name.c_str(), tris, float(tri_bytes) / tris,
+		    float(tri_bytes + vert_bytes) / tris, Rays / (s * 1e6f));
+	}
+	log("\n");
+});
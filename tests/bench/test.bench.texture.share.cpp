@@ -0,0 +1,70 @@
+#include "test.h"
+
+#include "scene/texture.h"
+#include "util/timer.h"
+
+#include <utility>
+
+// Shared texture storage:
+//  copies a large trilinear image texture (as the pathtracer and rasterizer do for every render) and
+//  reports the time per copy. Checks that copies share pixels and mipmap levels with the original,
+//  that writing to the original leaves the copy unchanged, and that update_mipmap() only regenerates
+//  levels once the pixels have changed.
+
+Test test_bench_texture_share("bench.texture.share", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	constexpr uint32_t Size = 2048;
+	constexpr uint32_t Copies = 1000;
+
+	HDR_Image pixels(Size, Size);
+	for (uint32_t y = 0; y < Size; ++y) {
+		for (uint32_t x = 0; x < Size; ++x) {
+			pixels.at(x, y) = Spectrum((x + 0.5f) / Size, (y + 0.5f) / Size, 0.5f);
+		}
+	}
+	Texture texture{Textures::Image{Textures::Image::Sampler::trilinear, pixels}};
+	Textures::Image const &image = std::get< Textures::Image >(texture.texture);
+	if (!image.image.shares_pixels(pixels)) throw Test::error("Texture doesn't share its source's pixels.");
+
+	Timer copy_timer;
+	std::vector< Texture > copies;
+	copies.reserve(Copies);
+	for (uint32_t i = 0; i < Copies; ++i) {
+		copies.emplace_back(texture.copy());
+	}
+	float copy_s = copy_timer.s();
+
+	Textures::Image &copy = std::get< Textures::Image >(copies.back().texture);
+	if (!copy.image.shares_pixels(image.image) || copy.levels.size() != image.levels.size()) {
+		throw Test::error("Copy doesn't share pixels with its original.");
+	}
+	for (uint32_t l = 0; l < copy.levels.size(); ++l) {
+		if (!copy.levels[l].shares_pixels(image.levels[l])) throw Test::error("Copy doesn't share mipmap levels.");
+	}
+
+	//regenerating levels for unchanged pixels is a no-op:
+	Timer same_timer;
+	copy.update_mipmap();
+	float same_s = same_timer.s();
+	if (!copy.levels.empty() && !copy.levels[0].shares_pixels(image.levels[0])) {
+		throw Test::error("update_mipmap() regenerated levels for unchanged pixels.");
+	}
+
+	//writing to the original (after unsharing it) leaves the copy as it was:
+	HDR_Image &original = std::get< Textures::Image >(texture.texture).image;
+	original.make_unique();
+	original.at(0, 0) = Spectrum(1.0f, 0.0f, 1.0f);
+	if (copy.image.shares_pixels(image.image) || std::as_const(copy.image).at(0, 0) == image.image.at(0, 0)) {
+		throw Test::error("Writing to a texture changed its copy.");
+	}
+	Timer changed_timer;
+	std::get< Textures::Image >(texture.texture).update_mipmap();
+	float changed_s = changed_timer.s();
+
+	log("\n\t%ux%u trilinear texture (%zu levels):", Size, Size, image.levels.size());
+	log("\n\t  copy:                      %10.3f us", copy_s / Copies * 1e6f);
+	log("\n\t  update_mipmap (unchanged): %10.3f us", same_s * 1e6f);
+	log("\n\t  update_mipmap (changed):   %10.3f us", changed_s * 1e6f);
+	log("\n");
+});
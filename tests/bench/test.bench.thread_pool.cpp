@@ -0,0 +1,110 @@
+#include "test.h"
+
+#include "util/thread_pool.h"
+#include "util/timer.h"
+
+#include <atomic>
+#include <thread>
+
+// Thread pool cancellation:
+//  times cancelling a group with work still queued (as Pathtracer::cancel does on every re-render)
+//  against clear() followed by a pool restart, which is what cancel used to cost.
+//  Also checks that cancelled tasks are dropped, other groups are untouched, and nested waits don't deadlock.
+
+Test test_bench_thread_pool("bench.thread_pool", []() {
+	if (!Test::run_benchmarks) throw Test::ignored("Benchmark (use --run-benchmarks).");
+
+	uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+	Thread_Pool pool(threads);
+
+	constexpr uint32_t Tasks = 10000;
+	constexpr uint32_t Rounds = 50;
+	auto busy = []() {
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	};
+
+	//cancel with work in flight:
+	float cancel_ms = 0.0f;
+	uint32_t ran = 0;
+	for (uint32_t r = 0; r < Rounds; ++r) {
+		Thread_Pool::Group group;
+		std::atomic< uint32_t > count = 0;
+		std::vector< std::function<void()> > tasks;
+		for (uint32_t i = 0; i < Tasks; ++i) {
+			tasks.emplace_back([&]() { busy(); count += 1; });
+		}
+		pool.enqueue(group, std::move(tasks));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		Timer t;
+		pool.cancel(group);
+		cancel_ms += t.ms();
+		ran += count.load();
+	}
+	if (ran >= Rounds * Tasks) {
+		throw Test::error("Cancelled groups ran all of their tasks.");
+	}
+
+	//the old way: drop everything, join, respawn threads:
+	float restart_ms = 0.0f;
+	for (uint32_t r = 0; r < Rounds; ++r) {
+		Thread_Pool::Group group;
+		std::vector< std::function<void()> > tasks;
+		for (uint32_t i = 0; i < Tasks; ++i) tasks.emplace_back(busy);
+
+		auto restarted = std::make_unique< Thread_Pool >(threads);
+		restarted->enqueue(group, std::move(tasks));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		Timer t;
+		restarted->stop();
+		restarted = std::make_unique< Thread_Pool >(threads);
+		restart_ms += t.ms();
+	}
+
+	//cancelling one group leaves another alone:
+	{
+		Thread_Pool::Group keep, drop;
+		std::atomic< uint32_t > kept = 0;
+		std::vector< std::function<void()> > keep_tasks, drop_tasks;
+		for (uint32_t i = 0; i < 1000; ++i) {
+			keep_tasks.emplace_back([&]() { kept += 1; });
+			drop_tasks.emplace_back(busy);
+		}
+		pool.enqueue(drop, std::move(drop_tasks));
+		pool.enqueue(keep, std::move(keep_tasks));
+		pool.cancel(drop);
+		pool.wait(keep);
+		if (kept.load() != 1000) {
+			throw Test::error("Cancelling a group dropped " + std::to_string(1000 - kept.load()) + " tasks from another group.");
+		}
+	}
+
+	//nested groups (tasks that enqueue and wait on subtasks):
+	{
+		Thread_Pool::Group outer;
+		std::atomic< uint32_t > leaves = 0;
+		std::function< void(uint32_t) > split = [&](uint32_t depth) {
+			if (depth == 0) {
+				leaves += 1;
+				return;
+			}
+			Thread_Pool::Group inner;
+			pool.enqueue(inner, [&, depth]() { split(depth - 1); });
+			pool.enqueue(inner, [&, depth]() { split(depth - 1); });
+			pool.wait(inner);
+		};
+		Timer t;
+		pool.enqueue(outer, [&]() { split(12); });
+		pool.wait(outer);
+		float nested_ms = t.ms();
+		if (leaves.load() != (1u << 12)) {
+			throw Test::error("Nested groups ran " + std::to_string(leaves.load()) + " leaves, expected 4096.");
+		}
+		log("\n\t%u-level nested fork/join: %.2f ms", 12, nested_ms);
+	}
+
+	log("\n\t%u threads, %u rounds of %u queued tasks:", threads, Rounds, Tasks);
+	log("\n\t  cancel(group):       %8.3f ms per round", cancel_ms / Rounds);
+	log("\n\t  stop() + restart:    %8.3f ms per round\n", restart_ms / Rounds);
+});
@@ -0,0 +1,119 @@
+#include "test.h"
+#include "pathtracer/bvh.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+#include "util/thread_pool.h"
+
+#include <cstring>
+
+// The binned-SAH builder gives the same tree however its tasks are scheduled, and finds the same closest
+// hits as testing every primitive in turn (which is what a BVH without nodes did).
+
+static std::vector<PT::Triangle> random_triangles(uint32_t count, uint32_t seed) {
+	RNG rng(seed);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()); };
+	std::vector<PT::Triangle> triangles;
+	for (uint32_t i = 0; i < count; ++i) {
+		Vec3 at = 10.0f * random();
+		triangles.emplace_back(at + 0.5f * random(), at + 0.5f * random(), at + 0.5f * random(), i, i, i);
+	}
+	return triangles;
+}
+
+static std::vector<Ray> random_rays(uint32_t count, uint32_t seed) {
+	RNG rng(seed);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()); };
+	std::vector<Ray> rays;
+	for (uint32_t i = 0; i < count; ++i) {
+		Vec3 from = Vec3(5.0f) + 20.0f * (random() - Vec3(0.5f));
+		rays.emplace_back(from, 10.0f * random() - from);
+	}
+	return rays;
+}
+
+//are a and b the same tree, over the same primitives in the same order?
+static std::optional<std::string> same_tree(PT::BVH<PT::Triangle> const& a, PT::BVH<PT::Triangle> const& b) {
+	if (a.nodes.size() != b.nodes.size()) return "different node counts";
+	for (size_t i = 0; i < a.nodes.size(); ++i) {
+		auto const &x = a.nodes[i], &y = b.nodes[i];
+		if (x.bbox.min != y.bbox.min || x.bbox.max != y.bbox.max || x.start != y.start || x.size != y.size || x.l != y.l
+		    || x.r != y.r) {
+			return "node " + std::to_string(i) + " differs";
+		}
+	}
+	if (!(a.primitives == b.primitives)) return "primitives in a different order";
+	if (a.wide_nodes.size() != b.wide_nodes.size()
+	    || std::memcmp(a.wide_nodes.data(), b.wide_nodes.data(), a.wide_nodes.size() * sizeof(PT::BVH_Wide_Node)) != 0) {
+		return "different wide nodes";
+	}
+	return std::nullopt;
+}
+
+Test test_pt_bvh_build_deterministic("pt.bvh.build.deterministic", []() {
+	PT::BVH_Build_Opts opts;
+	opts.max_leaf_size = 4;
+	opts.parallel_threshold = 64; //(so even this small a build splits into many tasks)
+	opts.wide = true; //(so the collapsed nodes are compared too)
+
+	PT::BVH<PT::Triangle> serial(random_triangles(5000, 1), opts);
+	for (uint32_t threads : {1u, 2u, 4u}) {
+		Thread_Pool pool(threads);
+		opts.thread_pool = &pool;
+		for (uint32_t run = 0; run < 3; ++run) {
+			PT::BVH<PT::Triangle> parallel(random_triangles(5000, 1), opts);
+			if (auto err = same_tree(serial, parallel)) {
+				throw Test::error("Parallel build on " + std::to_string(threads) + " threads differs from the serial build: " + *err + ".");
+			}
+		}
+	}
+});
+
+Test test_pt_bvh_build_matches_list("pt.bvh.build.matches_list", []() {
+	std::vector<PT::Triangle> triangles = random_triangles(2000, 2);
+	std::vector<Ray> rays = random_rays(2000, 3);
+
+	for (size_t max_leaf_size : {size_t(1), size_t(4), size_t(16)}) {
+		PT::BVH<PT::Triangle> bvh(std::vector<PT::Triangle>(triangles), max_leaf_size);
+		for (auto const& ray : rays) {
+			PT::Trace expected;
+			for (auto const& triangle : triangles) expected = PT::Trace::min(expected, triangle.hit(ray));
+			PT::Trace trace = bvh.hit(ray);
+			if (trace.hit != expected.hit || (trace.hit && trace.distance != expected.distance)) {
+				throw Test::error("BVH (max leaf size " + std::to_string(max_leaf_size) + ") hit differs from testing every triangle.");
+			}
+		}
+	}
+});
+
+Test test_pt_bvh_build_degenerate("pt.bvh.build.degenerate", []() {
+	//centroids all equal, and centroids (and sizes) spread over most of float's exponent range:
+	std::vector<PT::Triangle> same, spaced;
+	for (uint32_t i = 0; i < 20000; ++i) {
+		same.emplace_back(Vec3{0.0f}, Vec3{1.0f, 0.0f, 0.0f}, Vec3{0.0f, 1.0f, 0.0f}, i, i, i);
+	}
+	for (uint32_t i = 0; i < 63; ++i) {
+		float x = std::ldexp(1.0f, 4 * int32_t(i) - 126);
+		for (uint32_t copy = 0; copy < 4; ++copy) {
+			spaced.emplace_back(Vec3{x, 0.0f, 0.0f}, Vec3{x, x, 0.0f}, Vec3{x, 0.0f, x}, i, i, i);
+		}
+	}
+	for (auto* triangles : {&same, &spaced}) {
+		size_t count = triangles->size();
+		PT::BVH<PT::Triangle> bvh(std::move(*triangles), 1);
+		if (bvh.nodes.size() != 2 * count - 1) throw Test::error("Degenerate build has the wrong number of nodes.");
+
+		//depth of the deepest leaf:
+		uint32_t deepest = 0;
+		std::vector<std::pair<size_t, uint32_t>> stack{{bvh.root_idx, 0}};
+		while (!stack.empty()) {
+			auto [idx, depth] = stack.back();
+			stack.pop_back();
+			deepest = std::max(deepest, depth);
+			auto const& node = bvh.nodes[idx];
+			if (node.l == node.r) continue;
+			stack.emplace_back(node.l, depth + 1);
+			stack.emplace_back(node.r, depth + 1);
+		}
+		if (deepest > 96) throw Test::error("Degenerate build is " + std::to_string(deepest) + " nodes deep.");
+	}
+});
@@ -0,0 +1,61 @@
+#include "test.h"
+#include "pathtracer/bvh.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+
+// 4-wide traversal finds the same closest hits, and answers occlusion queries the same, as binary traversal
+// of the tree it was collapsed from.
+
+Test test_pt_bvh_wide_matches_binary("pt.bvh.wide.matches_binary", []() {
+	RNG rng(5);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()); };
+
+	std::vector<PT::Triangle> triangles;
+	for (uint32_t i = 0; i < 3000; ++i) {
+		Vec3 at = 10.0f * random();
+		triangles.emplace_back(at + 0.5f * random(), at + 0.5f * random(), at + 0.5f * random(), i, i, i);
+	}
+
+	std::vector<Ray> rays;
+	for (uint32_t i = 0; i < 3000; ++i) {
+		Vec3 from = Vec3(5.0f) + 20.0f * (random() - Vec3(0.5f));
+		Ray ray(from, 10.0f * random() - from);
+		//(some rays end early, so occlusion queries can come out either way)
+		if (i % 2) ray.dist_bounds.y = 10.0f * rng.unit();
+		rays.emplace_back(ray);
+	}
+	//axis-aligned rays (zero direction components) through the middle of the scene:
+	for (uint32_t i = 0; i < 300; ++i) {
+		Vec3 at = 10.0f * random();
+		Vec3 dir;
+		dir[i % 3] = (i / 3) % 2 ? 1.0f : -1.0f;
+		rays.emplace_back(at - 20.0f * dir, dir);
+	}
+
+	for (size_t max_leaf_size : {size_t(1), size_t(4), size_t(8)}) {
+		PT::BVH_Build_Opts opts;
+		opts.max_leaf_size = max_leaf_size;
+		opts.wide = false;
+		PT::BVH<PT::Triangle> binary(std::vector<PT::Triangle>(triangles), opts);
+		opts.wide = true;
+		PT::BVH<PT::Triangle> wide(std::vector<PT::Triangle>(triangles), opts);
+		if (!binary.wide_nodes.empty() || wide.wide_nodes.empty()) {
+			throw Test::error("BVH_Build_Opts::wide didn't choose the traversal.");
+		}
+
+		uint32_t hits = 0;
+		for (auto const& ray : rays) {
+			PT::Hit a, b;
+			bool hit_a = binary.intersect(ray, a), hit_b = wide.intersect(ray, b);
+			if (hit_a != hit_b || (hit_a && (a.t != b.t || a.prim != b.prim || a.bary != b.bary))) {
+				throw Test::error("Wide traversal (max leaf size " + std::to_string(max_leaf_size) + ") hit differs from binary traversal.");
+			}
+			bool occluded_a = binary.occluded(ray), occluded_b = wide.occluded(ray);
+			if (occluded_a != occluded_b || occluded_a != hit_a) {
+				throw Test::error("Wide traversal (max leaf size " + std::to_string(max_leaf_size) + ") occlusion differs from binary traversal.");
+			}
+			hits += hit_a;
+		}
+		if (hits == 0 || hits == rays.size()) throw Test::error("Test rays should hit some, but not all, triangles.");
+	}
+});
@@ -0,0 +1,177 @@
+#include "test.h"
+#include "geometry/halfedge.h"
+#include "geometry/indexed.h"
+#include "geometry/util.h"
+#include "pathtracer/bvh_cache.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+#include "util/thread_pool.h"
+
+#include <fstream>
+#include <functional>
+#include <optional>
+
+// The BVH cache loads an entry only for exactly the mesh and build options it was stored for, and a mesh built
+// from a loaded entry is the same as one built from scratch; entries that don't check out are rebuilt.
+
+//(split into corners, as the pathtracer converts halfedge meshes)
+static Indexed_Mesh sphere(float radius, uint32_t subdivisions) {
+	return Indexed_Mesh::from_halfedge_mesh(Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(radius, subdivisions)),
+	                                        Indexed_Mesh::SplitEdges);
+}
+
+//does 'b' have the same triangles as 'a', in the same order, and hit rays the same?
+static std::optional< std::string > same_mesh(PT::Tri_Mesh const& a, PT::Tri_Mesh const& b) {
+	if (a.n_triangles() != b.n_triangles()) return "different triangle counts";
+	for (size_t t = 0; t < a.n_triangles(); ++t) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (a.triangles()[t].position(i) != b.triangles()[t].position(i)) return "triangle " + std::to_string(t) + " differs";
+		}
+	}
+	RNG rng(11);
+	for (uint32_t i = 0; i < 2000; ++i) {
+		Vec3 from = 3.0f * Vec3(rng.unit() - 0.5f, rng.unit() - 0.5f, rng.unit() - 0.5f).unit();
+		Vec3 to = Vec3(rng.unit(), rng.unit(), rng.unit()) - Vec3(0.5f);
+		Ray ray(from, to - from);
+		PT::Trace x = a.hit(ray), y = b.hit(ray);
+		if (x.hit != y.hit || x.distance != y.distance || x.normal != y.normal || x.uv != y.uv) {
+			return "ray " + std::to_string(i) + " hits differently";
+		}
+	}
+	return std::nullopt;
+}
+
+//an empty directory 'name' in the temporary directory:
+static std::filesystem::path empty_directory(std::string const& name) {
+	std::filesystem::path dir = std::filesystem::temp_directory_path() / name;
+	std::filesystem::remove_all(dir);
+	return dir;
+}
+
+//use an empty cache in a temporary directory as the shared cache, for as long as it is in scope:
+struct Temporary_Cache {
+	std::filesystem::path dir;
+	PT::BVH_Cache cache;
+	Temporary_Cache(std::string const& name) : dir(empty_directory(name)), cache(dir) {
+		PT::BVH_Cache::shared = &cache;
+	}
+	~Temporary_Cache() {
+		PT::BVH_Cache::shared = nullptr;
+		std::filesystem::remove_all(dir);
+	}
+};
+
+Test test_pt_bvh_cache_hits("pt.bvh_cache.hits", []() {
+	using Format = PT::Tri_Mesh::Vertex_Format;
+
+	//(each mesh built without a cache first, to compare with)
+	Indexed_Mesh mesh = sphere(1.0f, 4);
+	PT::Tri_Mesh uncached(mesh, true), uncached_compact(mesh, true, nullptr, Format::Compact);
+	Indexed_Mesh moved = mesh.copy();
+	moved.vertices()[0].pos.x += 1e-3f;
+	PT::Tri_Mesh uncached_moved(moved, true);
+	Indexed_Mesh recolored = mesh.copy();
+	recolored.vertices()[0].uv.x += 0.5f;
+	PT::Tri_Mesh uncached_recolored(recolored, true);
+	PT::Tri_Mesh uncached_wide(mesh, true, nullptr, Format::Full, true);
+
+	Temporary_Cache temporary("s3d-test-bvh-cache-hits");
+	PT::BVH_Cache &cache = temporary.cache;
+	//build 'm', expecting it to be a hit or a miss, and to match 'expected':
+	auto build = [&](std::string const& what, Indexed_Mesh const& m, Format format, bool hit, PT::Tri_Mesh const& expected,
+	                 Thread_Pool *thread_pool = nullptr, bool wide = false) {
+		PT::BVH_Cache::Counts before = cache.counts();
+		PT::Tri_Mesh built(m, true, thread_pool, format, wide);
+		PT::BVH_Cache::Counts after = cache.counts();
+		uint32_t loaded = after.loaded - before.loaded, stored = after.stored - before.stored;
+		if (loaded != (hit ? 1u : 0u) || stored != (hit ? 0u : 1u)) {
+			throw Test::error(what + " should have " + (hit ? "loaded" : "stored") + " one entry; it loaded " + std::to_string(loaded)
+			                  + " and stored " + std::to_string(stored) + ".");
+		}
+		if (auto err = same_mesh(expected, built)) throw Test::error(what + " differs from building without a cache: " + *err + ".");
+	};
+
+	build("First build", mesh, Format::Full, false, uncached);
+	build("Second build", mesh, Format::Full, true, uncached);
+	//(the key is the mesh's data, not the mesh)
+	build("Build of a copy", mesh.copy(), Format::Full, true, uncached);
+	build("First compact build", mesh, Format::Compact, false, uncached_compact);
+	build("Second compact build", mesh, Format::Compact, true, uncached_compact);
+
+	//changing the mesh at all makes a new entry:
+	build("Build of a changed mesh", moved, Format::Full, false, uncached_moved);
+	build("Build with a changed uv", recolored, Format::Full, false, uncached_recolored);
+	build("Second build of the original mesh", mesh, Format::Full, true, uncached);
+
+	//...as does changing options that change the tree:
+	build("Build with a 4-wide BVH", mesh, Format::Full, false, uncached_wide, nullptr, true);
+	build("Second build with a 4-wide BVH", mesh, Format::Full, true, uncached_wide, nullptr, true);
+
+	PT::BVH_Build_Opts opts;
+	opts.max_leaf_size = 4;
+	uint64_t key = PT::BVH_Cache::key(mesh, Format::Full, opts);
+	for (auto change : std::vector< void (*)(PT::BVH_Build_Opts&) >{
+		[](PT::BVH_Build_Opts& o) { o.max_leaf_size = 8; },
+		[](PT::BVH_Build_Opts& o) { o.buckets = 32; },
+	}) {
+		PT::BVH_Build_Opts changed = opts;
+		change(changed);
+		if (PT::BVH_Cache::key(mesh, Format::Full, changed) == key) throw Test::error("Changing a build option didn't change the key.");
+	}
+	//(but building on a thread pool doesn't change the tree, so doesn't miss)
+	Thread_Pool pool(2);
+	PT::BVH_Build_Opts pooled = opts;
+	pooled.thread_pool = &pool;
+	pooled.parallel_threshold = 16;
+	if (PT::BVH_Cache::key(mesh, Format::Full, pooled) != key) throw Test::error("Building on a thread pool changed the key.");
+	build("Build on a thread pool", mesh, Format::Full, true, uncached, &pool);
+});
+
+Test test_pt_bvh_cache_rejects("pt.bvh_cache.rejects", []() {
+	Indexed_Mesh mesh = sphere(1.0f, 4);
+	PT::Tri_Mesh uncached(mesh, true);
+
+	Temporary_Cache temporary("s3d-test-bvh-cache-rejects");
+	PT::BVH_Cache &cache = temporary.cache;
+	{ PT::Tri_Mesh stored(mesh, true); }
+
+	std::filesystem::path entry;
+	for (auto const& file : std::filesystem::directory_iterator(temporary.dir)) entry = file.path();
+	if (entry.empty()) throw Test::error("No cache entry was written.");
+	uint64_t bytes = std::filesystem::file_size(entry);
+
+	//damage the entry: a flipped byte (that only its checksum can tell), a missing end, and an empty file are
+	// rejected, and the mesh is rebuilt and stored again:
+	struct Damage {
+		std::string what;
+		std::function< void() > apply;
+	};
+	for (auto const& damage : std::vector< Damage >{
+		{"a flipped byte", [&]() {
+			std::fstream file(entry, std::ios::in | std::ios::out | std::ios::binary);
+			file.seekg(std::streamoff(bytes / 2));
+			char byte = char(file.get());
+			file.seekp(std::streamoff(bytes / 2));
+			file.put(char(byte ^ 0x10));
+		}},
+		{"a missing end", [&]() { std::filesystem::resize_file(entry, bytes - 8); }},
+		{"nothing in it", [&]() { std::filesystem::resize_file(entry, 0); }},
+	}) {
+		damage.apply();
+		PT::BVH_Cache::Counts before = cache.counts();
+		PT::Tri_Mesh rebuilt(mesh, true);
+		PT::BVH_Cache::Counts after = cache.counts();
+		if (after.rejected != before.rejected + 1 || after.loaded != before.loaded
+		    || after.stored != before.stored + 1) {
+			throw Test::error("An entry with " + damage.what + " should have been rejected and rebuilt.");
+		}
+		if (auto err = same_mesh(uncached, rebuilt)) throw Test::error("Mesh rebuilt after " + damage.what + " differs: " + *err + ".");
+		if (std::filesystem::file_size(entry) != bytes) throw Test::error("The rebuilt entry wasn't stored again.");
+	}
+
+	//(and the entry stored again loads)
+	PT::BVH_Cache::Counts before = cache.counts();
+	PT::Tri_Mesh loaded(mesh, true);
+	if (cache.counts().loaded != before.loaded + 1) throw Test::error("The rebuilt entry didn't load.");
+	if (auto err = same_mesh(uncached, loaded)) throw Test::error("Mesh loaded from the rebuilt entry differs: " + *err + ".");
+});
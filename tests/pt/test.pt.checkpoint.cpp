@@ -0,0 +1,144 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <filesystem>
+
+// A render resumed from a checkpoint gives the same image as one that was never interrupted, and only
+// traces the tiles the checkpoint doesn't have.
+
+Test test_pt_checkpoint_resume("pt.checkpoint.resume", []() {
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 80, 64, 4);
+	Test_Scenes::spheres(scene);
+
+	std::string path = (std::filesystem::temp_directory_path() / "s3d-test-checkpoint.ptck").string();
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+	auto restore = [&]() {
+		RNG::fixed_seed = old_seed;
+		std::filesystem::remove(path);
+	};
+
+	try {
+		HDR_Image uninterrupted;
+		uint32_t tiles = 0;
+		{
+			PT::Pathtracer pathtracer;
+			tiles = pathtracer.tile_count(*camera_instance.lock()->camera.lock());
+			uninterrupted = Test_Scenes::render(pathtracer, scene, camera_instance);
+		}
+		if (tiles < 4) throw Test::error("Expected the film to be split into several tiles, got " + std::to_string(tiles) + ".");
+
+		//checkpoints with no tiles, some (not in order), and all of them:
+		std::vector< std::vector< uint32_t > > done_tiles{{}, {}, {}};
+		for (uint32_t t = 0; t < tiles; ++t) {
+			if (t % 3 == 1 || t == tiles - 1) done_tiles[1].emplace_back(t);
+			done_tiles[2].emplace_back(t);
+		}
+		for (auto const &done : done_tiles) {
+			std::string what = std::to_string(done.size()) + " of " + std::to_string(tiles) + " tiles";
+			{
+				//(a render of just those tiles saves the same checkpoint as one interrupted once they were done)
+				PT::Pathtracer pathtracer;
+				pathtracer.set_tiles(done.empty() ? std::vector< uint32_t >{0} : done);
+				Test_Scenes::render(pathtracer, scene, camera_instance);
+				PT::Checkpoint checkpoint = pathtracer.partial();
+				if (done.empty()) checkpoint.reset(checkpoint.width, checkpoint.height, tiles);
+				checkpoint.save(path);
+			}
+
+			PT::Checkpoint loaded = PT::Checkpoint::load(path);
+			uint32_t loaded_done = 0;
+			for (uint8_t d : loaded.tiles_done) loaded_done += d;
+			if (loaded_done != done.size()) {
+				throw Test::error("Checkpoint of " + what + " loaded with " + std::to_string(loaded_done) + " tiles done.");
+			}
+
+			PT::Pathtracer pathtracer;
+			pathtracer.resume_from(path);
+			HDR_Image resumed = Test_Scenes::render(pathtracer, scene, camera_instance);
+			if (resumed.data() != uninterrupted.data()) {
+				throw Test::error("Render resumed from " + what + " differs from the uninterrupted render.");
+			}
+			PT::Pathtracer::Sample_Counts counts = pathtracer.sample_counts();
+			bool traced_all = counts.traced == counts.budget;
+			if (traced_all != done.empty() || (done.size() == tiles && counts.traced != 0)) {
+				throw Test::error("Render resumed from " + what + " traced " + std::to_string(counts.traced) + " of "
+				                  + std::to_string(counts.budget) + " samples.");
+			}
+		}
+
+		//a checkpoint made with larger tiles (as a machine with fewer threads makes) resumes with its own tiles:
+		// (film.samples is less than a tile's samples, so there is a tile per area of the film)
+		uint32_t larger_tiles = 0;
+		{
+			PT::Pathtracer pathtracer;
+			pathtracer.set_tiles({0});
+			Test_Scenes::render(pathtracer, scene, camera_instance);
+			PT::Checkpoint checkpoint = pathtracer.partial();
+			checkpoint.tile_size *= 2;
+			uint32_t across = (checkpoint.width + checkpoint.tile_size - 1) / checkpoint.tile_size;
+			uint32_t down = (checkpoint.height + checkpoint.tile_size - 1) / checkpoint.tile_size;
+			larger_tiles = across * down;
+			checkpoint.reset(checkpoint.width, checkpoint.height, larger_tiles);
+			checkpoint.save(path);
+		}
+		{
+			PT::Pathtracer pathtracer;
+			pathtracer.resume_from(path);
+			HDR_Image resumed = Test_Scenes::render(pathtracer, scene, camera_instance);
+			if (pathtracer.partial().tiles_done.size() != larger_tiles) {
+				throw Test::error("Render resumed from a checkpoint with larger tiles didn't keep its tiles.");
+			}
+			if (resumed.data() != uninterrupted.data()) {
+				throw Test::error("Render resumed from a checkpoint with larger tiles differs from the uninterrupted render.");
+			}
+		}
+	} catch (...) {
+		restore();
+		throw;
+	}
+	restore();
+});
+
+Test test_pt_checkpoint_mismatch("pt.checkpoint.mismatch", []() {
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 32, 32, 2);
+	Test_Scenes::spheres(scene);
+
+	std::string path = (std::filesystem::temp_directory_path() / "s3d-test-checkpoint-mismatch.ptck").string();
+	auto throws = [&](std::string const &what, auto &&f) {
+		try {
+			f();
+		} catch (std::exception const &) {
+			return;
+		}
+		std::filesystem::remove(path);
+		throw Test::error(what + " didn't fail.");
+	};
+
+	{
+		PT::Pathtracer pathtracer;
+		Test_Scenes::render(pathtracer, scene, camera_instance);
+		pathtracer.partial().save(path);
+	}
+
+	//resuming with other film settings:
+	camera_instance.lock()->camera.lock()->film.samples = 4;
+	throws("Resuming with a different sample count", [&]() {
+		PT::Pathtracer pathtracer;
+		pathtracer.resume_from(path);
+		Test_Scenes::render(pathtracer, scene, camera_instance);
+	});
+
+	//loading a truncated file:
+	std::uintmax_t size = std::filesystem::file_size(path);
+	std::filesystem::resize_file(path, size / 2);
+	throws("Loading a truncated checkpoint", [&]() {
+		PT::Checkpoint::load(path);
+	});
+	std::filesystem::remove(path);
+});
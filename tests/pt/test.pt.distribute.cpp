@@ -0,0 +1,109 @@
+#include "test.h"
+
+#include "../scenes.h"
+#include "pathtracer/pathtracer.h"
+
+#include <algorithm>
+
+// Partial renders of disjoint sets of a frame's tiles merge into exactly the image of one render of every
+// tile, however the tiles are shared out; partials of different renders, or that share tiles, don't merge.
+
+//render just 'tiles' of the frame, returning the partial sums:
+static PT::Checkpoint partial(Scene &scene, std::weak_ptr< Instance::Camera > camera_instance, std::vector< uint32_t > const &tiles) {
+	PT::Pathtracer pathtracer;
+	pathtracer.set_tiles(tiles);
+	Test_Scenes::render(pathtracer, scene, camera_instance);
+	return pathtracer.partial();
+}
+
+Test test_pt_distribute_merge("pt.distribute.merge", []() {
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 80, 64, 4);
+	Test_Scenes::spheres(scene);
+
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+	try {
+		HDR_Image single;
+		uint32_t tiles = 0;
+		{
+			PT::Pathtracer pathtracer;
+			tiles = pathtracer.tile_count(*camera_instance.lock()->camera.lock());
+			single = Test_Scenes::render(pathtracer, scene, camera_instance);
+		}
+
+		for (uint32_t workers : {1u, 2u, 3u}) {
+			//tiles shared out interleaved (as --distribute does) and in contiguous runs:
+			for (bool interleaved : {true, false}) {
+				std::vector< PT::Checkpoint > partials;
+				for (uint32_t w = 0; w < workers; ++w) {
+					std::vector< uint32_t > share;
+					for (uint32_t t = 0; t < tiles; ++t) {
+						if ((interleaved ? t % workers : t * workers / tiles) == w) share.emplace_back(t);
+					}
+					partials.emplace_back(partial(scene, camera_instance, share));
+				}
+				//(merged in reverse, so the sums aren't added in the order tiles were traced)
+				std::reverse(partials.begin(), partials.end());
+				HDR_Image merged = PT::Pathtracer::merge(partials);
+				if (merged.data() != single.data()) {
+					throw Test::error("Merging " + std::to_string(workers) + (interleaved ? " interleaved" : " contiguous")
+					                  + " partial renders differs from a single render.");
+				}
+			}
+		}
+
+		//tiles no partial has are left black, and the rest are still exact:
+		HDR_Image lone = PT::Pathtracer::merge({partial(scene, camera_instance, {0})});
+		uint32_t black = 0;
+		for (uint32_t i = 0; i < uint32_t(lone.data().size()); ++i) {
+			if (lone.data()[i] == Spectrum{}) black += 1;
+			else if (lone.data()[i] != single.data()[i]) throw Test::error("Pixels of a lone partial render differ from a single render.");
+		}
+		if (black == 0 || black == lone.data().size()) throw Test::error("Merging one tile didn't leave only the other tiles black.");
+	} catch (...) {
+		RNG::fixed_seed = old_seed;
+		throw;
+	}
+	RNG::fixed_seed = old_seed;
+});
+
+Test test_pt_distribute_mismatch("pt.distribute.mismatch", []() {
+	Scene scene;
+	std::weak_ptr< Instance::Camera > camera_instance = Test_Scenes::camera(scene, 32, 32, 2);
+	Test_Scenes::spheres(scene);
+
+	auto throws = [&](std::string const &what, std::vector< PT::Checkpoint > const &partials) {
+		try {
+			PT::Pathtracer::merge(partials);
+		} catch (std::exception const &) {
+			return;
+		}
+		throw Test::error("Merging " + what + " didn't fail.");
+	};
+
+	//(with the same seed, so only the differences under test keep partials from merging)
+	uint32_t old_seed = RNG::fixed_seed;
+	RNG::fixed_seed = 0x5EED;
+	try {
+		PT::Checkpoint first = partial(scene, camera_instance, {0}), second = partial(scene, camera_instance, {1});
+		PT::Pathtracer::merge({first, second});
+		throws("partial renders that share tiles", {first, second, first});
+
+		std::shared_ptr< Camera > camera = camera_instance.lock()->camera.lock();
+		camera->film.samples = 4;
+		throws("partial renders with different sample counts", {first, partial(scene, camera_instance, {1})});
+		camera->film.samples = 2;
+
+		camera->film.max_ray_depth += 1;
+		throws("partial renders with different ray depths", {first, partial(scene, camera_instance, {1})});
+		camera->film.max_ray_depth -= 1;
+
+		RNG::fixed_seed = 0x5EED + 1;
+		throws("partial renders with different seeds", {first, partial(scene, camera_instance, {1})});
+	} catch (...) {
+		RNG::fixed_seed = old_seed;
+		throw;
+	}
+	RNG::fixed_seed = old_seed;
+});
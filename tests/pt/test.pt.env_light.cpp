@@ -0,0 +1,104 @@
+#include "test.h"
+
+#include "pathtracer/samplers.h"
+#include "util/rand.h"
+#include "util/thread_pool.h"
+
+// Environment map importance sampling: the alias tables pick each texel with the probability the sampler
+// keeps for it (luminance times solid angle, normalized), the sampler's total is the integral of luminance
+// over the sphere, and sample() and pdf() agree (E[luma / pdf] over samples is the map's integral).
+
+//a dim sky gradient with a few small, very bright "suns":
+static HDR_Image sky(uint32_t w, uint32_t h) {
+	HDR_Image image(w, h);
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			float gradient = 0.2f + 0.8f * float(y) / h;
+			image.at(x, y) = Spectrum{0.5f * gradient, 0.7f * gradient, gradient};
+		}
+	}
+	RNG rng(10);
+	for (uint32_t sun = 0; sun < 3; ++sun) {
+		uint32_t cx = rng.integer(0, w - 2), cy = rng.integer(h / 8, h / 2);
+		for (uint32_t y = cy; y < cy + 2; ++y) {
+			for (uint32_t x = cx; x < cx + 2; ++x) image.at(x, y) = Spectrum{500.0f};
+		}
+	}
+	//(and a black texel, which must never be picked)
+	image.at(w / 2, h - 1) = Spectrum{};
+	return image;
+}
+
+//probability of an alias table of n slots picking each slot:
+static std::vector< double > picks(Samplers::Sphere::Image::Alias const *table, uint32_t n) {
+	std::vector< double > ret(n, 0.0);
+	for (uint32_t i = 0; i < n; ++i) {
+		ret[i] += double(table[i].keep) / n;
+		if (table[i].keep < 1.0f) ret[table[i].alias] += (1.0 - double(table[i].keep)) / n;
+	}
+	return ret;
+}
+
+Test test_pt_env_light_alias("pt.env_light.alias", []() {
+	constexpr uint32_t W = 64, H = 32;
+	HDR_Image image = sky(W, H);
+
+	Samplers::Sphere::Image sampler(image);
+	Thread_Pool pool(3);
+	Samplers::Sphere::Image parallel(image, &pool);
+	if (parallel._pdf != sampler._pdf || parallel.total != sampler.total) throw Test::error("Serial and parallel builds differ.");
+
+	//the map's integral (as the sampler takes it, with each texel's solid angle from the sine at its center; and
+	// exactly), and each texel's share of it:
+	double integral = 0.0, exact = 0.0;
+	std::vector< double > expected(size_t(W) * H);
+	for (uint32_t y = 0; y < H; ++y) {
+		double sin_theta = std::sin(PI_D * (y + 0.5) / H);
+		double band = std::cos(PI_D * y / H) - std::cos(PI_D * (y + 1) / H);
+		for (uint32_t x = 0; x < W; ++x) {
+			expected[size_t(y) * W + x] = double(image.at(x, y).luma()) * sin_theta;
+			integral += expected[size_t(y) * W + x];
+			exact += double(image.at(x, y).luma()) * band * 2.0 * PI_D / W;
+		}
+	}
+	for (double &e : expected) e /= integral;
+	integral *= 2.0 * PI_D * PI_D / (double(W) * H);
+	if (std::abs(sampler.total - integral) > 1e-5 * integral) {
+		throw Test::error("The sampler's total is " + std::to_string(sampler.total) + ", but the map integrates to " + std::to_string(integral) + ".");
+	}
+
+	std::vector< double > rows = picks(sampler.rows.data(), H);
+	for (uint32_t y = 0; y < H; ++y) {
+		std::vector< double > texels = picks(&sampler.texels[size_t(y) * W], W);
+		for (uint32_t x = 0; x < W; ++x) {
+			size_t i = size_t(y) * W + x;
+			double picked = rows[y] * texels[x];
+			if (std::abs(picked - expected[i]) > 1e-5 * expected[i] + 1e-9 || std::abs(sampler._pdf[i] - expected[i]) > 1e-5 * expected[i] + 1e-9) {
+				throw Test::error("Texel (" + std::to_string(x) + ", " + std::to_string(y) + ") is picked with probability " + std::to_string(picked)
+				                  + " (and has pdf " + std::to_string(sampler._pdf[i]) + "), but has " + std::to_string(expected[i]) + " of the map's luminance.");
+			}
+		}
+	}
+
+	//sample() and pdf() agree: (pdf() is exact within each texel, so this is the exact integral)
+	RNG rng(11);
+	constexpr uint32_t Samples = 100000;
+	double sum = 0.0, sum2 = 0.0;
+	for (uint32_t i = 0; i < Samples; ++i) {
+		Vec3 dir = sampler.sample(rng);
+		float pdf = sampler.pdf(dir);
+		//(same lat/lon mapping as Shapes::Sphere::uv)
+		float u = std::atan2(dir.z, dir.x) / (2.0f * PI_F);
+		if (u < 0.0f) u += 1.0f;
+		float v = std::acos(std::clamp(-dir.y, -1.0f, 1.0f)) / PI_F;
+		float luma = image.at(std::min(uint32_t(u * W), W - 1), std::min(uint32_t(v * H), H - 1)).luma();
+		if (!(pdf > 0.0f) || luma == 0.0f) throw Test::error("Sampled " + to_string(dir) + ", which has pdf " + std::to_string(pdf) + ".");
+		sum += luma / pdf;
+		sum2 += double(luma / pdf) * (luma / pdf);
+	}
+	double mean = sum / Samples, error = std::sqrt(std::max(sum2 / Samples - mean * mean, 0.0) / Samples);
+	if (std::abs(mean - exact) > 4.0 * error + 1e-5 * exact) {
+		throw Test::error("E[luma / pdf] = " + std::to_string(mean) + " +- " + std::to_string(error) + ", but the map integrates to "
+		                  + std::to_string(exact) + ".");
+	}
+});
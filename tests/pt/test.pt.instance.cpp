@@ -0,0 +1,121 @@
+#include "test.h"
+#include "geometry/util.h"
+#include "pathtracer/instance.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+
+// Instances store their transforms as Affines, and skip the general matrix math for identity and
+// translate + uniform scale transforms; every kind gives the same hits as moving the ray (and the hit) with
+// full Mat4s, which is how instances were traced before.
+
+using Kind = PT::Instance::Transform_Kind;
+
+//largest difference between a and b, relative to the larger of 1 and their size:
+static float difference(Vec3 a, Vec3 b) {
+	return (a - b).norm() / std::max(1.0f, std::max(a.norm(), b.norm()));
+}
+
+static std::vector< std::pair< Mat4, Kind > > transforms(RNG &rng) {
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()) - Vec3(0.5f); };
+	std::vector< std::pair< Mat4, Kind > > ret{
+		{Mat4::I, Kind::Identity},
+		{Mat4::translate(Vec3{1.0f, -2.0f, 3.0f}), Kind::Translate_Scale},
+		{Mat4::scale(Vec3{0.25f}), Kind::Translate_Scale},
+		//(mirrored, unevenly scaled, and rotated, none of which the fast path handles)
+		{Mat4::scale(Vec3{-1.0f}), Kind::General},
+		{Mat4::scale(Vec3{1.0f, 1.0f, 2.0f}), Kind::General},
+		{Mat4::euler(Vec3{0.0f, 90.0f, 0.0f}), Kind::General},
+	};
+	for (uint32_t i = 0; i < 20; ++i) {
+		Vec3 at = 20.0f * random();
+		ret.emplace_back(Mat4::translate(at) * Mat4::scale(Vec3{0.1f + 4.0f * rng.unit()}), Kind::Translate_Scale);
+		ret.emplace_back(Mat4::translate(at) * Mat4::euler(360.0f * random())
+		                 * Mat4::scale(Vec3{0.1f + 4.0f * rng.unit(), 0.1f + 4.0f * rng.unit(), 0.1f + 4.0f * rng.unit()}),
+		                 Kind::General);
+	}
+	return ret;
+}
+
+Test test_pt_instance_affine("pt.instance.affine", []() {
+	RNG rng(21);
+	for (auto const& [T, kind] : transforms(rng)) {
+		PT::Affine A(T), iA = A.inverse();
+		Mat4 iT = T.inverse();
+		if (A.to_mat4() != T) throw Test::error("Affine doesn't convert back to the Mat4 it was made from.");
+		for (uint32_t i = 0; i < 100; ++i) {
+			Vec3 p = 50.0f * (Vec3(rng.unit(), rng.unit(), rng.unit()) - Vec3(0.5f));
+			if (difference(A * p, T * p) > 1e-6f || difference(A.rotate(p), T.rotate(p)) > 1e-6f
+			    || difference(iA * p, iT * p) > 1e-5f || difference(iA.rotate_transposed(p), iT.T().rotate(p)) > 1e-5f) {
+				throw Test::error("Affine transforms " + to_string(p) + " differently than its Mat4.");
+			}
+		}
+	}
+});
+
+Test test_pt_instance_fast_path("pt.instance.fast_path", []() {
+	PT::Tri_Mesh mesh(Util::closed_sphere_mesh(1.0f, 2), true);
+
+	RNG rng(22);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()) - Vec3(0.5f); };
+	for (auto const& transform : transforms(rng)) {
+		Mat4 const& T = transform.first;
+		PT::Instance instance(&mesh, nullptr, T);
+		std::string name = to_string(T.cols[0].xyz()) + ", " + to_string(T.cols[1].xyz()) + ", " + to_string(T.cols[2].xyz()) + ", "
+		                 + to_string(T.cols[3].xyz());
+		if (instance.transform_kind() != transform.second) {
+			throw Test::error("Instance transformed by " + name + " wasn't classified as expected.");
+		}
+
+		//the general path, with Mat4s:
+		Mat4 iT = T.inverse();
+		auto reference = [&](Ray ray) {
+			ray.transform(iT);
+			PT::Trace trace = mesh.hit(ray);
+			if (trace.hit) trace.transform(T, iT.T());
+			return trace;
+		};
+
+		BBox box = mesh.bbox();
+		box.transform(T);
+		BBox bbox = instance.bbox();
+		if (difference(bbox.min, box.min) > 1e-5f || difference(bbox.max, box.max) > 1e-5f) {
+			throw Test::error("Instance transformed by " + name + " has different bounds than its Mat4's.");
+		}
+
+		//(the general path rounds differently than Mat4s do, e.g. inverting through cross products, which for
+		// unevenly scaled transforms can lose a few more bits; the fast path's few operations shouldn't)
+		float tolerance = transform.second == Kind::General ? 1e-4f : 1e-5f;
+
+		//rays toward the instance, half of them stopping short (for occlusion queries either way):
+		Vec3 center = T * Vec3{};
+		uint32_t hits = 0;
+		for (uint32_t i = 0; i < 500; ++i) {
+			Vec3 from = center + 40.0f * random();
+			Ray ray(from, center + 2.0f * random() - from);
+			if (i % 2) ray.dist_bounds.y = (center - from).norm() * 2.0f * rng.unit();
+
+			PT::Trace expected = reference(ray);
+			PT::Trace trace = instance.hit(ray);
+			bool occluded = instance.occluded(ray);
+			if (trace.hit != expected.hit || occluded != expected.hit) {
+				//(a hit right at the end of the ray can come out either way)
+				Ray unbounded = ray;
+				unbounded.dist_bounds.y = std::numeric_limits< float >::infinity();
+				PT::Trace end = reference(unbounded);
+				if (end.hit && std::abs(end.distance - ray.dist_bounds.y) < 1e-4f * std::max(1.0f, end.distance)) continue;
+				throw Test::error("Ray " + std::to_string(i) + " " + (expected.hit ? "hits" : "misses") + " the instance transformed by "
+				                  + name + " with Mat4s, but not with its " + (trace.hit == expected.hit ? "occlusion query." : "Affines."));
+			}
+			if (!trace.hit) continue;
+			++hits;
+			if (std::abs(trace.distance - expected.distance) > tolerance * std::max(1.0f, expected.distance)
+			    || difference(trace.position, expected.position) > tolerance || difference(trace.origin, expected.origin) > tolerance
+			    || difference(trace.normal, expected.normal) > 10.0f * tolerance) {
+				throw Test::error("Ray " + std::to_string(i) + " hits the instance transformed by " + name + " at " + to_string(trace.position)
+				                  + " (distance " + std::to_string(trace.distance) + "), but at " + to_string(expected.position)
+				                  + " (distance " + std::to_string(expected.distance) + ") with Mat4s.");
+			}
+		}
+		if (hits == 0) throw Test::error("No rays hit the instance transformed by " + name + ".");
+	}
+});
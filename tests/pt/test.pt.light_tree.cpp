@@ -0,0 +1,79 @@
+#include "test.h"
+#include "geometry/util.h"
+#include "pathtracer/light_tree.h"
+#include "pathtracer/shading_material.h"
+#include "scene/material.h"
+#include "scene/texture.h"
+#include "util/rand.h"
+
+// Light trees sample emitters with the density pdf() reports: directions they sample have nonzero pdf, and
+// E[1/pdf] over sampled directions is the solid angle the emitters cover (as found by hitting them with rays
+// in uniformly random directions).
+
+//mean and standard error of f() over 'samples' draws:
+template< typename F > static std::pair< double, double > estimate(uint32_t samples, F const& f) {
+	double sum = 0.0, sum2 = 0.0;
+	for (uint32_t i = 0; i < samples; ++i) {
+		double x = f();
+		sum += x;
+		sum2 += x * x;
+	}
+	double mean = sum / samples;
+	return {mean, std::sqrt(std::max(sum2 / samples - mean * mean, 0.0) / samples)};
+}
+
+Test test_pt_light_tree_pdf("pt.light_tree.pdf", []() {
+	auto glow = std::make_shared< Texture >(Textures::Constant{Spectrum{4.0f, 3.0f, 2.0f}});
+	Material emissive_material(Materials::Emissive{glow});
+	PT::Shading_Material emissive = PT::Shading_Material::from(emissive_material);
+
+	//a cloud of small emissive spheres, and one large flattened one:
+	PT::Tri_Mesh particle(Util::closed_sphere_mesh(0.25f, 0), true);
+	PT::Tri_Mesh panel(Util::closed_sphere_mesh(1.0f, 0), true);
+	RNG rng(9);
+	std::vector< std::pair< PT::Tri_Mesh const *, Mat4 > > placed;
+	for (uint32_t i = 0; i < 20; ++i) {
+		placed.emplace_back(&particle, Mat4::translate(Vec3(rng.unit(), rng.unit(), rng.unit()) * 10.0f - Vec3(5.0f)));
+	}
+	placed.emplace_back(&panel, Mat4::translate(Vec3(0.0f, 8.0f, 0.0f)) * Mat4::scale(Vec3(3.0f, 0.1f, 3.0f)));
+
+	std::vector< PT::Instance > instances;
+	for (auto const& [mesh, T] : placed) instances.emplace_back(mesh, &emissive, T);
+	PT::List< PT::Instance > list(std::move(instances));
+
+	PT::Light_Tree< PT::Emissive_Triangle > particle_lights(PT::Emissive_Triangle::from_mesh(particle, emissive));
+	PT::Light_Tree< PT::Emissive_Triangle > panel_lights(PT::Emissive_Triangle::from_mesh(panel, emissive));
+	std::vector< PT::Area_Light > area_lights;
+	for (auto const& [mesh, T] : placed) area_lights.emplace_back(mesh == &panel ? &panel_lights : &particle_lights, T);
+	PT::Light_Tree< PT::Area_Light > tree(std::move(area_lights));
+
+	//(points outside every emitter, inside the cloud and beyond it)
+	for (Vec3 from : {Vec3(0.0f, 0.5f, 0.0f), Vec3(9.0f, 0.0f, 0.0f), Vec3(0.0f, -9.0f, 2.0f), Vec3(2.0f, 5.0f, -2.0f)}) {
+		std::string where = "from " + to_string(from);
+
+		uint32_t zeros = 0;
+		auto tree_sr = estimate(20000, [&]() {
+			float pdf = tree.pdf(Ray(from, tree.sample(rng, from)));
+			if (pdf > 0.0f) return 1.0 / pdf;
+			zeros += 1;
+			return 0.0;
+		});
+		if (zeros > 20) throw Test::error("The light tree sampled " + std::to_string(zeros) + " directions with pdf zero " + where + ".");
+
+		//(uniformly over the sphere, the fraction of directions that hit an emitter; the rest should have pdf zero)
+		uint32_t strays = 0;
+		auto hit_sr = estimate(100000, [&]() {
+			float z = 2.0f * rng.unit() - 1.0f, phi = 2.0f * PI_F * rng.unit();
+			float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+			Ray ray(from, Vec3(r * std::cos(phi), r * std::sin(phi), z));
+			if (list.hit(ray).hit) return 4.0 * PI_D;
+			if (tree.pdf(ray) > 0.0f) strays += 1;
+			return 0.0;
+		});
+		if (strays > 20) throw Test::error("The light tree has pdf in " + std::to_string(strays) + " directions with no emitter " + where + ".");
+		if (std::abs(tree_sr.first - hit_sr.first) > 4.0 * std::sqrt(tree_sr.second * tree_sr.second + hit_sr.second * hit_sr.second)) {
+			throw Test::error("The light tree covers " + std::to_string(tree_sr.first) + " +- " + std::to_string(tree_sr.second)
+			                  + " sr " + where + ", but the emitters " + std::to_string(hit_sr.first) + " +- " + std::to_string(hit_sr.second) + ".");
+		}
+	}
+});
@@ -0,0 +1,115 @@
+#include "test.h"
+
+#include "pathtracer/ray_log.h"
+
+#include <algorithm>
+#include <thread>
+
+// Ray log buffers: a buffer holds every ray until it is full, then a uniform sample of the rays logged
+// (Reservoir) or the latest ones (Latest); and copies made while other threads log never hold a half-written ray.
+
+//ray i of a thread is recognizable (and checkably whole) from any of its fields:
+static PT::Ray_Log entry(uint32_t thread, uint32_t i) {
+	float v = float(i);
+	return PT::Ray_Log{Ray(Vec3{v, float(thread), v}, Vec3{0.0f, 0.0f, 1.0f}), v, Spectrum{v, v, v}};
+}
+static bool whole(PT::Ray_Log const &l) {
+	float v = l.t;
+	return l.ray.point.x == v && l.ray.point.z == v && l.color.r == v && l.color.g == v && l.color.b == v;
+}
+
+//the (sorted) indices of the rays a buffer holds:
+static std::vector< uint32_t > held(PT::Ray_Log_Buffer const &buffer) {
+	std::vector< PT::Ray_Log > copy;
+	buffer.copy_to(copy);
+	std::vector< uint32_t > ret;
+	for (auto const &l : copy) {
+		if (!whole(l)) throw Test::error("A ray log buffer holds a half-written ray.");
+		ret.emplace_back(uint32_t(l.t));
+	}
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
+
+Test test_pt_ray_log_policies("pt.ray_log.policies", []() {
+	constexpr uint32_t Capacity = 256;
+	constexpr uint32_t Rays = 100000;
+
+	for (PT::Ray_Log_Policy policy : {PT::Ray_Log_Policy::Reservoir, PT::Ray_Log_Policy::Latest}) {
+		std::string what = policy == PT::Ray_Log_Policy::Reservoir ? "reservoir" : "ring";
+		PT::Ray_Log_Buffer buffer(Capacity, policy, 21);
+
+		//until it is full, a buffer holds every ray logged:
+		for (uint32_t i = 0; i < Capacity / 2; ++i) buffer.add(entry(0, i));
+		std::vector< uint32_t > half = held(buffer);
+		for (uint32_t i = 0; i < Capacity / 2; ++i) {
+			if (half.size() != Capacity / 2 || half[i] != i) throw Test::error("A half-full " + what + " buffer lost rays.");
+		}
+
+		for (uint32_t i = Capacity / 2; i < Rays; ++i) buffer.add(entry(0, i));
+		if (buffer.logged() != Rays) throw Test::error("A " + what + " buffer counted " + std::to_string(buffer.logged()) + " rays logged.");
+		std::vector< uint32_t > full = held(buffer);
+		if (full.size() != Capacity || std::adjacent_find(full.begin(), full.end()) != full.end()) {
+			throw Test::error("A full " + what + " buffer holds " + std::to_string(full.size()) + " rays (or some twice).");
+		}
+
+		if (policy == PT::Ray_Log_Policy::Latest) {
+			if (full.front() != Rays - Capacity) throw Test::error("The ring buffer kept ray " + std::to_string(full.front()) + ", which isn't one of the latest.");
+		} else {
+			//a uniform sample of [0, Rays) has mean ~Rays/2, and about a quarter of it in each quarter:
+			double mean = 0.0;
+			uint32_t quarters[4] = {0, 0, 0, 0};
+			for (uint32_t i : full) {
+				mean += double(i) / Rays;
+				quarters[std::min(4u * i / Rays, 3u)] += 1;
+			}
+			mean /= Capacity;
+			//(standard deviation of the mean is ~0.018, and of each quarter's count ~7)
+			if (std::abs(mean - 0.5) > 0.07) throw Test::error("Reservoir sample mean is " + std::to_string(mean) + " of the rays logged, expected ~0.5.");
+			for (uint32_t count : quarters) {
+				if (count < Capacity / 4 - 28 || count > Capacity / 4 + 28) throw Test::error("Reservoir sample isn't spread over the rays logged.");
+			}
+		}
+
+		buffer.clear();
+		if (!held(buffer).empty() || buffer.logged() != 0) throw Test::error("A cleared " + what + " buffer still holds rays.");
+	}
+});
+
+Test test_pt_ray_log_concurrent("pt.ray_log.concurrent", []() {
+	constexpr uint32_t Threads = 2;
+	constexpr uint32_t Rays = 200000; //per thread
+	constexpr uint32_t Capacity = 512;
+
+	for (PT::Ray_Log_Policy policy : {PT::Ray_Log_Policy::Reservoir, PT::Ray_Log_Policy::Latest}) {
+		std::vector< std::unique_ptr< PT::Ray_Log_Buffer > > buffers;
+		for (uint32_t t = 0; t < Threads; ++t) buffers.emplace_back(std::make_unique< PT::Ray_Log_Buffer >(Capacity, policy, t));
+
+		//copy the log (checking every ray in it) until the writers finish:
+		std::atomic< bool > done = false;
+		bool torn = false;
+		uint32_t copies = 0;
+		std::thread reader([&]() {
+			while (!done || copies == 0) {
+				std::vector< PT::Ray_Log > copy;
+				for (auto const &buffer : buffers) buffer->copy_to(copy);
+				for (auto const &l : copy) torn = torn || !whole(l);
+				copies += 1;
+			}
+		});
+		std::vector< std::thread > writers;
+		for (uint32_t t = 0; t < Threads; ++t) {
+			writers.emplace_back([&, t]() {
+				for (uint32_t i = 0; i < Rays; ++i) buffers[t]->add(entry(t, i));
+			});
+		}
+		for (auto &writer : writers) writer.join();
+		done = true;
+		reader.join();
+
+		if (torn) throw Test::error("A copy of the ray log held a half-written ray.");
+		for (auto const &buffer : buffers) {
+			if (held(*buffer).size() != Capacity) throw Test::error("A full buffer doesn't hold as many rays as it can.");
+		}
+	}
+});
@@ -0,0 +1,69 @@
+#include "test.h"
+#include "geometry/util.h"
+#include "pathtracer/aggregate.h"
+#include "util/rand.h"
+
+// Shadow rays: occluded() says a segment is blocked exactly when hit() finds something along it, for mesh
+// and shape instances in lists and in binary and 4-wide BVHs (over meshes with and without BVHs of their own).
+
+Test test_pt_shadow_rays_occluded("pt.shadow_rays.occluded", []() {
+	RNG rng(6);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()); };
+
+	Indexed_Mesh sphere_mesh = Util::closed_sphere_mesh(1.0f, 2);
+	std::vector< std::pair< std::string, PT::Tri_Mesh > > meshes;
+	meshes.emplace_back("mesh BVH", PT::Tri_Mesh(sphere_mesh, true));
+	meshes.emplace_back("wide mesh BVH", PT::Tri_Mesh(sphere_mesh, true, nullptr, PT::Tri_Mesh::Vertex_Format::Full, true));
+	meshes.emplace_back("compact mesh BVH", PT::Tri_Mesh(sphere_mesh, true, nullptr, PT::Tri_Mesh::Vertex_Format::Compact));
+	meshes.emplace_back("mesh list", PT::Tri_Mesh(sphere_mesh, false));
+	Shape sphere(Shapes::Sphere{0.5f});
+
+	//a few dozen instances scattered through a 10x10x10 box, so segments cross some and miss others:
+	std::vector< Mat4 > transforms;
+	for (uint32_t i = 0; i < 40; ++i) {
+		transforms.emplace_back(Mat4::translate(10.0f * random()) * Mat4::scale(Vec3{0.2f + 0.8f * rng.unit()}));
+	}
+	std::vector< Ray > rays;
+	for (uint32_t i = 0; i < 4000; ++i) {
+		Vec3 from = 12.0f * random() - Vec3{1.0f}, to = 12.0f * random() - Vec3{1.0f};
+		rays.emplace_back(from, to - from, Vec2{EPS_F, (to - from).norm() - EPS_F});
+	}
+
+	for (auto const& named_mesh : meshes) {
+		std::string const& name = named_mesh.first;
+		PT::Tri_Mesh const& mesh = named_mesh.second;
+		auto instances = [&]() {
+			std::vector< PT::Instance > ret;
+			for (uint32_t i = 0; i < uint32_t(transforms.size()); ++i) {
+				if (i % 4 == 3) ret.emplace_back(&sphere, nullptr, transforms[i]);
+				else ret.emplace_back(&mesh, nullptr, transforms[i]);
+			}
+			return ret;
+		};
+		PT::BVH_Build_Opts opts;
+		std::vector< std::pair< std::string, PT::Aggregate > > aggregates;
+		aggregates.emplace_back("list", PT::Aggregate(PT::List< PT::Instance >(instances())));
+		aggregates.emplace_back("BVH", PT::Aggregate(PT::BVH< PT::Instance >(instances(), opts)));
+		opts.wide = true;
+		aggregates.emplace_back("wide BVH", PT::Aggregate(PT::BVH< PT::Instance >(instances(), opts)));
+
+		for (auto const& [aggregate_name, aggregate] : aggregates) {
+			std::string what = "a " + aggregate_name + " of instances (" + name + ")";
+			uint32_t blocked = 0;
+			for (uint32_t i = 0; i < uint32_t(rays.size()); ++i) {
+				bool hit = aggregate.hit(rays[i]).hit;
+				if (aggregate.occluded(rays[i]) != hit) {
+					//(a hit right at either end of the segment can come out either way)
+					Ray unbounded = rays[i];
+					unbounded.dist_bounds = Vec2{0.0f, std::numeric_limits< float >::infinity()};
+					PT::Trace end = aggregate.hit(unbounded);
+					if (end.hit && (end.distance < 2.0f * EPS_F || std::abs(end.distance - rays[i].dist_bounds.y) < 1e-4f)) continue;
+					throw Test::error("Shadow ray " + std::to_string(i) + " through " + what + " is " + (hit ? "" : "not ")
+					                  + "blocked according to hit(), but occluded() disagrees.");
+				}
+				blocked += hit;
+			}
+			if (blocked == 0 || blocked == rays.size()) throw Test::error("Shadow rays through " + what + " should be blocked only sometimes.");
+		}
+	}
+});
@@ -0,0 +1,103 @@
+#include "test.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+
+// Compact mesh vertices decode to within fixed bounds of the attributes they were made from: normals (16-bit
+// octahedral) to within a small angle, and uvs to within half a quantization step of the mesh's uv range.
+
+//angle (radians) between unit vectors a and b:
+static float angle(Vec3 a, Vec3 b) {
+	return std::atan2(cross(a, b).norm(), dot(a, b));
+}
+
+//16-bit octahedral encoding: the largest error (near the centers of the octahedron's faces, where the map
+// stretches most) is just under 0.004 degrees
+static constexpr float Normal_Bound = 0.005f * PI_F / 180.0f;
+
+Test test_pt_tri_mesh_compact_normals("pt.tri_mesh.compact.normals", []() {
+	RNG rng(7);
+	std::vector< Vec3 > normals;
+	//the axes, the octahedron's edges and faces' centers (where the fold and sign flips happen):
+	for (int x = -1; x <= 1; ++x) {
+		for (int y = -1; y <= 1; ++y) {
+			for (int z = -1; z <= 1; ++z) {
+				if (x || y || z) normals.emplace_back(Vec3{float(x), float(y), float(z)}.unit());
+			}
+		}
+	}
+	normals.emplace_back(Vec3{-0.0f, -0.0f, -1.0f});
+	//uniformly over the sphere, and just either side of the equator the lower half is folded across:
+	for (uint32_t i = 0; i < 200000; ++i) {
+		float z = 2.0f * rng.unit() - 1.0f, phi = 2.0f * PI_F * rng.unit();
+		if (i % 4 == 0) z = (rng.unit() - 0.5f) * 1e-4f;
+		float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		normals.emplace_back(Vec3{r * std::cos(phi), r * std::sin(phi), z});
+	}
+
+	for (Vec3 n : normals) {
+		Vec3 decoded = PT::Tri_Mesh_Compact_Vert::decode_normal(PT::Tri_Mesh_Compact_Vert::encode_normal(n));
+		if (std::abs(decoded.norm() - 1.0f) > 1e-6f) {
+			throw Test::error("Normal " + to_string(n) + " decoded to " + to_string(decoded) + ", which isn't unit length.");
+		}
+		float error = angle(n, decoded);
+		if (!(error <= Normal_Bound)) {
+			throw Test::error("Normal " + to_string(n) + " decoded to " + to_string(decoded) + ", " + std::to_string(error * 180.0f / PI_F)
+			                  + " degrees off.");
+		}
+	}
+});
+
+Test test_pt_tri_mesh_compact_vertices("pt.tri_mesh.compact.vertices", []() {
+	RNG rng(8);
+	auto random = [&]() { return Vec3(rng.unit(), rng.unit(), rng.unit()); };
+
+	//uv ranges: ordinary, offset and scaled, and flat in v (every uv's v the same):
+	for (auto [uv_min, uv_size] : {std::pair{Vec2{0.0f, 0.0f}, Vec2{1.0f, 1.0f}}, std::pair{Vec2{-3.0f, 10.0f}, Vec2{8.0f, 0.25f}},
+	                               std::pair{Vec2{0.5f, 0.5f}, Vec2{2.0f, 0.0f}}}) {
+		std::vector< Indexed_Mesh::Vert > verts;
+		std::vector< Indexed_Mesh::Index > indices;
+		for (uint32_t i = 0; i < 3000; ++i) {
+			Vec3 at = 10.0f * random();
+			Vec3 normal = 2.0f * random() - Vec3{1.0f};
+			//(some not unit length, as meshes' normals can be)
+			if (i % 3) normal = normal.unit();
+			for (uint32_t c = 0; c < 3; ++c) {
+				indices.emplace_back(uint32_t(verts.size()));
+				verts.emplace_back(Indexed_Mesh::Vert{at + 0.5f * random(), normal, uv_min + uv_size * Vec2{rng.unit(), rng.unit()},
+				                                      uint32_t(verts.size())});
+			}
+		}
+		//(the corners of the uv range, so it is exactly [uv_min, uv_min + uv_size])
+		verts[0].uv = uv_min;
+		verts[1].uv = uv_min + uv_size;
+		Indexed_Mesh mesh{std::vector< Indexed_Mesh::Vert >(verts), std::vector< Indexed_Mesh::Index >(indices)};
+
+		//(as a list, so it keeps the triangles in mesh order)
+		PT::Tri_Mesh compact(mesh, false, nullptr, PT::Tri_Mesh::Vertex_Format::Compact);
+		if (compact.vertex_format() != PT::Tri_Mesh::Vertex_Format::Compact || compact.n_triangles() != indices.size() / 3) {
+			throw Test::error("Compact mesh wasn't built with compact vertices.");
+		}
+
+		Vec2 uv_bound = 0.5f * uv_size / 65535.0f + Vec2{1e-6f * (std::abs(uv_min.x) + uv_size.x), 1e-6f * (std::abs(uv_min.y) + uv_size.y)};
+		for (size_t t = 0; t < compact.n_triangles(); ++t) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				Indexed_Mesh::Vert const &expected = verts[indices[3 * t + i]];
+				PT::Tri_Mesh_Vert decoded = compact.vertex(compact.triangles()[t], i);
+				std::string where = "Triangle " + std::to_string(t) + " corner " + std::to_string(i);
+
+				//(compact triangles keep positions only as p0, e1, e2)
+				if ((decoded.position - expected.pos).norm() > 1e-5f) {
+					throw Test::error(where + " position is " + to_string(decoded.position) + ", expected " + to_string(expected.pos) + ".");
+				}
+				float error = angle(expected.norm.unit(), decoded.normal);
+				if (!(error <= Normal_Bound)) {
+					throw Test::error(where + " normal is " + std::to_string(error * 180.0f / PI_F) + " degrees off.");
+				}
+				if (!(std::abs(decoded.uv.x - expected.uv.x) <= uv_bound.x && std::abs(decoded.uv.y - expected.uv.y) <= uv_bound.y)) {
+					throw Test::error(where + " uv is " + to_string(decoded.uv) + ", expected " + to_string(expected.uv) + " (to within "
+					                  + to_string(uv_bound) + ").");
+				}
+			}
+		}
+	}
+});
@@ -0,0 +1,85 @@
+#pragma once
+
+// Small scenes shared by the path tracer tests and benchmarks.
+
+#include "geometry/util.h"
+#include "pathtracer/pathtracer.h"
+#include "scene/scene.h"
+
+#include <string>
+#include <thread>
+
+namespace Test_Scenes {
+
+//a camera at the origin looking down -z, rendering width x height pixels at 'samples' spp; returns its instance:
+inline std::weak_ptr< Instance::Camera > camera(Scene &scene, uint32_t width, uint32_t height, uint32_t samples) {
+	std::weak_ptr< Camera > camera = scene.get< Camera >(scene.create("Camera", Camera{}));
+	camera.lock()->film.width = width;
+	camera.lock()->film.height = height;
+	camera.lock()->film.samples = samples;
+	camera.lock()->aspect_ratio = width / float(height);
+	return scene.get< Instance::Camera >(scene.create(
+		"Camera Instance", Instance::Camera{scene.get< Transform >(scene.create("Camera Transform", Transform{})), camera}));
+}
+
+inline std::weak_ptr< Texture > constant(Scene &scene, std::string const &name, Spectrum color) {
+	return scene.get< Texture >(scene.create(name, Texture{Textures::Constant{color}}));
+}
+
+inline std::weak_ptr< Material > lambertian(Scene &scene, std::string const &name, std::weak_ptr< Texture > albedo) {
+	return scene.get< Material >(scene.create(name, Material{Materials::Lambertian{albedo}}));
+}
+
+inline std::weak_ptr< Material > emissive(Scene &scene, std::string const &name, std::weak_ptr< Texture > emissive) {
+	return scene.get< Material >(scene.create(name, Material{Materials::Emissive{emissive}}));
+}
+
+inline std::weak_ptr< Halfedge_Mesh > sphere(Scene &scene, std::string const &name, uint32_t subdivisions) {
+	return scene.get< Halfedge_Mesh >(scene.create(name, Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(1.0f, subdivisions))));
+}
+
+//an instance of 'mesh', moved to 'at' and scaled by 'scale' (with a transform named "Transform <name>"):
+inline std::weak_ptr< Instance::Mesh > mesh_instance(Scene &scene, std::string const &name, std::weak_ptr< Halfedge_Mesh > mesh,
+                                                     std::weak_ptr< Material > material, Vec3 at, float scale = 1.0f) {
+	std::weak_ptr< Transform > transform = scene.get< Transform >(scene.create("Transform " + name,
+		Transform{at, Vec3{}, Vec3{scale}}));
+	return scene.get< Instance::Mesh >(scene.create("Instance " + name, Instance::Mesh{transform, mesh, material}));
+}
+
+//a constant-colored hemisphere light over the scene:
+inline void sky(Scene &scene, Spectrum color) {
+	Environment_Lights::Hemisphere hemisphere;
+	hemisphere.radiance = constant(scene, "Sky", color);
+	scene.create("Sky Light", Environment_Light{hemisphere});
+}
+
+//a grid of 5 x 'rows' spheres in front of the camera (alternately diffuse gray and orange-emissive) under a blue sky:
+inline void spheres(Scene &scene, uint32_t rows = 1) {
+	std::weak_ptr< Material > diffuse = lambertian(scene, "Diffuse", constant(scene, "Gray", Spectrum{0.6f}));
+	std::weak_ptr< Material > glow = emissive(scene, "Emissive", constant(scene, "Glow", Spectrum{3.0f, 2.0f, 1.0f}));
+	std::weak_ptr< Halfedge_Mesh > mesh = sphere(scene, "Sphere", 3);
+	for (uint32_t i = 0; i < 5; ++i) {
+		for (uint32_t j = 0; j < rows; ++j) {
+			std::string name = rows == 1 ? std::to_string(i) : std::to_string(i) + "," + std::to_string(j);
+			Vec3 at{2.5f * (float(i) - 2.0f), 2.5f * (float(j) - 0.5f * (rows - 1)), -8.0f};
+			mesh_instance(scene, name, mesh, (i + j) % 2 ? diffuse : glow, at);
+		}
+	}
+	sky(scene, Spectrum{0.4f, 0.6f, 1.0f});
+}
+
+//render with 'pathtracer' (as set up by the caller) until it is done; returns the final image:
+inline HDR_Image render(PT::Pathtracer &pathtracer, Scene &scene, std::weak_ptr< Instance::Camera > camera_instance) {
+	HDR_Image result;
+	pathtracer.set_report_rate(0.0f);
+	bool quit = false;
+	pathtracer.render(scene, camera_instance.lock(), [&](PT::Pathtracer::Render_Report &&report) {
+		result = std::move(report.second);
+	}, &quit);
+	while (pathtracer.in_progress()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return result;
+}
+
+} // namespace Test_Scenes
@@ -0,0 +1,69 @@
+#include "test.h"
+#include "scene/texture.h"
+
+#include <utility>
+
+// Copy-on-write images: copies share pixels until make_unique() gives one its own, writing to an unshared
+// image leaves its copies as they were, and textures only regenerate mipmap levels once their pixels change.
+
+static HDR_Image gradient(uint32_t w, uint32_t h) {
+	HDR_Image image(w, h);
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) image.at(x, y) = Spectrum((x + 0.5f) / w, (y + 0.5f) / h, 0.5f);
+	}
+	return image;
+}
+
+Test test_util_hdr_image_unshare("util.hdr_image.unshare", []() {
+	HDR_Image image = gradient(16, 8);
+	HDR_Image copy = image.copy();
+	if (!copy.shares_pixels(image)) throw Test::error("Copy doesn't share its original's pixels.");
+
+	//unsharing keeps the pixels, and writing then leaves the copy as it was:
+	image.make_unique();
+	if (copy.shares_pixels(image)) throw Test::error("make_unique() didn't unshare the pixels.");
+	if (image.data() != copy.data()) throw Test::error("make_unique() changed the pixels.");
+	image.at(3, 2) = Spectrum(1.0f, 0.0f, 1.0f);
+	image.writable_data()[0] = Spectrum(0.0f, 1.0f, 0.0f);
+	if (std::as_const(copy).at(3, 2) == std::as_const(image).at(3, 2) || copy.data()[0] == image.data()[0]) {
+		throw Test::error("Writing to an image changed its copy.");
+	}
+	if (copy.data() != gradient(16, 8).data()) throw Test::error("Writing to an image changed its copy.");
+
+	//unsharing an image with its own pixels keeps them where they are:
+	Spectrum const *before = image.data().data();
+	image.make_unique();
+	if (image.data().data() != before) throw Test::error("make_unique() copied pixels that weren't shared.");
+	//...as does the copy, once it is the last one holding the old pixels:
+	before = copy.data().data();
+	copy.make_unique();
+	if (copy.data().data() != before) throw Test::error("make_unique() copied pixels the image no longer shared.");
+});
+
+Test test_util_hdr_image_texture_levels("util.hdr_image.texture_levels", []() {
+	Texture texture{Textures::Image{Textures::Image::Sampler::trilinear, gradient(64, 32)}};
+	Textures::Image &image = std::get< Textures::Image >(texture.texture);
+	if (image.levels.empty()) throw Test::error("Trilinear texture has no mipmap levels.");
+
+	Texture copied = texture.copy();
+	Textures::Image &copy = std::get< Textures::Image >(copied.texture);
+	if (!copy.image.shares_pixels(image.image) || copy.levels.size() != image.levels.size()) {
+		throw Test::error("Texture copy doesn't share its original's pixels.");
+	}
+	for (uint32_t l = 0; l < copy.levels.size(); ++l) {
+		if (!copy.levels[l].shares_pixels(image.levels[l])) throw Test::error("Texture copy doesn't share mipmap levels.");
+	}
+
+	//unchanged pixels keep their levels:
+	copy.update_mipmap();
+	if (!copy.levels[0].shares_pixels(image.levels[0])) throw Test::error("update_mipmap() regenerated levels for unchanged pixels.");
+
+	//...and changed pixels get new ones (leaving the copy's alone):
+	HDR_Image level0 = image.levels[0].copy();
+	image.image.make_unique();
+	for (Spectrum &pixel : image.image.writable_data()) pixel = Spectrum(1.0f);
+	image.update_mipmap();
+	//(only checks the levels are new, since the downsampling they're filled by is A1 student code)
+	if (image.levels[0].shares_pixels(level0)) throw Test::error("update_mipmap() didn't regenerate levels for changed pixels.");
+	if (!copy.levels[0].shares_pixels(level0)) throw Test::error("Updating a texture's levels changed its copy's.");
+});
@@ -0,0 +1,116 @@
+#include "test.h"
+#include "util/rand.h"
+
+#include <vector>
+
+// Counter-based sample sequences: a draw depends only on (seed, pixel, sample, dimension), so samples can be
+// drawn in any order (or paused and resumed) and give the same numbers, on every run and every platform.
+
+using Sequence = RNG::Sequence;
+
+//the first draws of sample 3 of pixel 7 with seed 0x5EED, which shouldn't change from version to version:
+// (changing them changes every image rendered with a fixed seed)
+Test test_util_rand_sequence_values("util.rand.sequence.values", []() {
+	struct Expected {
+		Sequence sequence;
+		float draws[4];
+	};
+	for (Expected const& expected : {
+		Expected{Sequence::Independent, {0.267827094f, 0.939427078f, 0.697239161f, 0.857059658f}},
+		Expected{Sequence::Sobol, {0.795079172f, 0.823273122f, 0.339683414f, 0.543264329f}},
+	}) {
+		RNG rng(1);
+		rng.start_sample(expected.sequence, 0x5EED, 7, 3);
+		for (uint32_t d = 0; d < 4; ++d) {
+			float draw = rng.unit();
+			if (draw != expected.draws[d]) {
+				throw Test::error(std::string(RNG::sequence_name(expected.sequence)) + " draw " + std::to_string(d) + " is "
+				                  + std::to_string(draw) + ", expected " + std::to_string(expected.draws[d]) + ".");
+			}
+		}
+	}
+
+	//(the Mersenne Twister stream, too, which --sampler stream still draws from)
+	RNG rng(0x5EED);
+	for (float expected : {0.290942013f, 0.694827557f, 0.731897235f, 0.534605145f}) {
+		if (rng.unit() != expected) throw Test::error("Stream draws differ from the expected values.");
+	}
+});
+
+Test test_util_rand_sequence_order("util.rand.sequence.order", []() {
+	constexpr uint32_t Pixels = 16, Samples = 32, Draws = 12;
+	auto index = [&](uint32_t pixel, uint32_t sample, uint32_t draw) {
+		return (pixel * Samples + sample) * Draws + draw;
+	};
+
+	for (Sequence sequence : {Sequence::Independent, Sequence::Sobol}) {
+		std::string name = RNG::sequence_name(sequence);
+
+		//every sample in order, from one RNG:
+		std::vector<int32_t> in_order(Pixels * Samples * Draws);
+		RNG rng(1);
+		for (uint32_t pixel = 0; pixel < Pixels; ++pixel) {
+			for (uint32_t sample = 0; sample < Samples; ++sample) {
+				rng.start_sample(sequence, 42, pixel, sample);
+				for (uint32_t d = 0; d < Draws; ++d) in_order[index(pixel, sample, d)] = rng.integer(0, 1 << 30);
+			}
+		}
+		rng.end_sample();
+
+		//in reverse, from RNGs with other seeds, interleaving two samples a draw at a time (as the
+		// batched-camera integrator does with its paths):
+		RNG a(2), b(3);
+		for (uint32_t pixel = Pixels; pixel-- > 0;) {
+			for (uint32_t sample = Samples; sample > 0; sample -= 2) {
+				a.start_sample(sequence, 42, pixel, sample - 1);
+				b.start_sample(sequence, 42, pixel, sample - 2);
+				RNG::Sample_State sa = a.save_sample(), sb = b.save_sample();
+				for (uint32_t d = 0; d < Draws; ++d) {
+					a.resume_sample(sb);
+					int32_t from_b = a.integer(0, 1 << 30);
+					sb = a.save_sample();
+					a.resume_sample(sa);
+					int32_t from_a = a.integer(0, 1 << 30);
+					sa = a.save_sample();
+					if (from_a != in_order[index(pixel, sample - 1, d)] || from_b != in_order[index(pixel, sample - 2, d)]) {
+						throw Test::error(name + " draws depend on the order samples are drawn in.");
+					}
+				}
+			}
+		}
+
+		//...but do depend on the seed:
+		rng.start_sample(sequence, 43, 0, 0);
+		bool same = true;
+		for (uint32_t d = 0; d < Draws; ++d) same = same && rng.integer(0, 1 << 30) == in_order[index(0, 0, d)];
+		if (same) throw Test::error(name + " draws don't depend on the seed.");
+	}
+});
+
+Test test_util_rand_sobol_stratified("util.rand.sobol.stratified", []() {
+	//each pair of dimensions is a (0,2)-sequence: any 2^k consecutive samples (from 0) put exactly one point in
+	// every elementary interval of area 2^-k, e.g. one in each cell of a 4x4 grid for 16 samples:
+	constexpr uint32_t Samples = 16, Pairs = 4;
+	for (uint32_t pixel = 0; pixel < 8; ++pixel) {
+		for (uint32_t pair = 0; pair < Pairs; ++pair) {
+			for (uint32_t cols : {1u, 2u, 4u, 8u, 16u}) {
+				uint32_t rows = Samples / cols;
+				std::vector<uint32_t> cells(Samples, 0);
+				for (uint32_t s = 0; s < Samples; ++s) {
+					RNG rng(1);
+					rng.start_sample(Sequence::Sobol, 7, pixel, s);
+					for (uint32_t skip = 0; skip < 2 * pair; ++skip) rng.unit();
+					float x = rng.unit(), y = rng.unit();
+					cells[uint32_t(y * rows) * cols + uint32_t(x * cols)] += 1;
+				}
+				for (uint32_t count : cells) {
+					if (count != 1) {
+						throw Test::error("Sobol samples aren't stratified in " + std::to_string(cols) + "x" + std::to_string(rows)
+						                  + " cells (pixel " + std::to_string(pixel) + ", dimensions " + std::to_string(2 * pair)
+						                  + " and " + std::to_string(2 * pair + 1) + ").");
+					}
+				}
+			}
+		}
+	}
+});
@@ -0,0 +1,55 @@
+#include "test.h"
+#include "util/thread_pool.h"
+
+#include <atomic>
+
+// Many short-lived groups on the stack, waited on (or cancelled) and destroyed right away, from outside the
+// pool and from its workers -- the group must not be touched by a finishing task after wait() returns.
+
+Test test_util_thread_pool_short_groups("util.thread_pool.short_groups", []() {
+	Thread_Pool pool(4);
+
+	constexpr uint32_t Groups = 2000;
+
+	//from outside the pool:
+	for (uint32_t g = 0; g < Groups; ++g) {
+		std::atomic< uint32_t > ran = 0;
+		Thread_Pool::Group group;
+		uint32_t tasks = 1 + g % 4;
+		for (uint32_t t = 0; t < tasks; ++t) {
+			pool.enqueue(group, [&ran]() { ran.fetch_add(1); });
+		}
+		pool.wait(group);
+		if (ran.load() != tasks) {
+			throw Test::error("wait() returned before all of a group's tasks ran.");
+		}
+	}
+
+	//from the workers (which help run tasks while waiting):
+	std::atomic< uint32_t > ran = 0;
+	Thread_Pool::Group outer;
+	for (uint32_t g = 0; g < Groups; ++g) {
+		pool.enqueue(outer, [&pool, &ran, g]() {
+			Thread_Pool::Group inner;
+			for (uint32_t t = 0; t < 1 + g % 3; ++t) {
+				pool.enqueue(inner, [&ran]() { ran.fetch_add(1); });
+			}
+			pool.wait(inner);
+		});
+	}
+	pool.wait(outer);
+	uint32_t expected = 0;
+	for (uint32_t g = 0; g < Groups; ++g) expected += 1 + g % 3;
+	if (ran.load() != expected) {
+		throw Test::error("Nested groups ran " + std::to_string(ran.load()) + " tasks, expected " + std::to_string(expected) + ".");
+	}
+
+	//cancelled while their tasks run:
+	for (uint32_t g = 0; g < Groups; ++g) {
+		Thread_Pool::Group group;
+		for (uint32_t t = 0; t < 8; ++t) {
+			pool.enqueue(group, []() {});
+		}
+		pool.cancel(group);
+	}
+});